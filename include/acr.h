@@ -24,6 +24,7 @@ extern "C" {
 #include <string>
 #include <list>
 #include <vector>
+#include <memory>
 
 #include "sas.h"
 #include "ralf_processor.h"
@@ -365,16 +366,69 @@ private:
     Originator originator;
   };
 
-  void encode_sdp_description(rapidjson::Writer<rapidjson::StringBuffer>* writer,
-                              const MediaDescription& media);
+  /// The fields that make up the Rf message.
+  struct RfFields
+  {
+    RfFields();
+
+    Initiator initiator;
+    std::list<std::string> ccfs;
+    std::list<std::string> ecfs;
+    RecordType record_type;
+    std::string username;
+    int interim_interval;
+    std::list<SubscriptionId> subscription_ids;
+    std::string method;
+    std::string event;
+    int expires;
+    int num_contacts;
+    NodeRole node_role;
+    Node node_functionality;
+    std::string user_session_id;
+    std::list<std::string> calling_party_addresses;
+    std::string called_party_address;
+    std::string requested_party_address;
+    std::list<std::string> called_asserted_ids;
+    std::list<std::string> associated_uris;
+    pj_time_val req_timestamp;
+    pj_time_val rsp_timestamp;
+    std::list<ASInformation> as_information;
+    std::string orig_ioi;
+    std::string term_ioi;
+    std::list<std::string> transit_iois;
+    std::string icid;
+    std::list<EarlyMediaDescription> early_media;
+    MediaDescription media;
+    std::string served_party_ip_address;
+    ServerCapabilities server_caps;
+    std::list<MessageBody> msg_bodies;
+    int status_code;
+    std::list<std::string> reasons;
+    std::list<std::string> access_network_info;
+    std::string from_address;
+    std::string visited_network_id;
+    std::string route_hdr_received;
+    std::string route_hdr_transmitted;
+    std::string instance_id;
+  };
+
+  /// Encodes the Rf message from the given fields.
+  static std::string encode_message(const RfFields& rf, pj_time_val timestamp);
+
+  /// Makes sure _rf isn't shared with a request that is waiting to be
+  /// encoded, so it can be changed.  Must be called before changing _rf.
+  void unshare_fields();
+
+  static void encode_sdp_description(rapidjson::Writer<rapidjson::StringBuffer>* writer,
+                                     const MediaDescription& media);
 
-  void encode_media_components(rapidjson::Writer<rapidjson::StringBuffer>* writer,
-                               const std::vector<std::string>& sdp,
-                               SDPType sdp_type,
-                               Initiator initiator_flag,
-                               const std::string& initiator_party);
+  static void encode_media_components(rapidjson::Writer<rapidjson::StringBuffer>* writer,
+                                      const std::vector<std::string>& sdp,
+                                      SDPType sdp_type,
+                                      Initiator initiator_flag,
+                                      const std::string& initiator_party);
 
-  void split_sdp(const std::string& sdp, std::vector<std::string>& lines);
+  static void split_sdp(const std::string& sdp, std::vector<std::string>& lines);
 
   void store_charging_addresses(pjsip_msg* msg);
 
@@ -408,85 +462,14 @@ private:
   RalfProcessor* _ralf;
   SAS::TrailId _trail;
 
-  Initiator _initiator;
-
   bool _first_req;
   bool _first_rsp;
 
-  std::list<std::string> _ccfs;
-  std::list<std::string> _ecfs;
-
-  RecordType _record_type;
-
-  std::string _username;
-
-  int _interim_interval;
-
-  std::list<SubscriptionId> _subscription_ids;
-
-  std::string _method;
-
-  std::string _event;
-
-  int _expires;
-
-  int _num_contacts;
-
-  NodeRole _node_role;
-
-  Node _node_functionality;
-
-  std::string _user_session_id;
-
-  std::list<std::string> _calling_party_addresses;
-
-  std::string _called_party_address;
-
-  std::string _requested_party_address;
-
-  std::list<std::string> _called_asserted_ids;
-
-  std::list<std::string> _associated_uris;
-
-  pj_time_val _req_timestamp;
-
-  pj_time_val _rsp_timestamp;
-
-  std::list<ASInformation> _as_information;
-
-  std::string _orig_ioi;
-
-  std::string _term_ioi;
-
-  std::list<std::string> _transit_iois;
-
-  std::string _icid;
-
-  std::list<EarlyMediaDescription> _early_media;
-
-  MediaDescription _media;
-
-  std::string _served_party_ip_address;
-
-  ServerCapabilities _server_caps;
-
-  std::list<MessageBody> _msg_bodies;
-
-  int _status_code;
-
-  std::list<std::string> _reasons;
-
-  std::list<std::string> _access_network_info;
-
-  std::string _from_address;
-
-  std::string _visited_network_id;
-
-  std::string _route_hdr_received;
-
-  std::string _route_hdr_transmitted;
-
-  std::string _instance_id;
+  // The fields that make up the Rf message.  When the ACR is sent, the
+  // request to Ralf shares these and encodes them on a Ralf thread.  If the
+  // ACR is then changed while they are still shared, it takes its own copy
+  // first (see unshare_fields).
+  std::shared_ptr<RfFields> _rf;
 };
 
 
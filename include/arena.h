@@ -0,0 +1,146 @@
+/**
+ * @file arena.h  Memory arena for short-lived bookkeeping containers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef ARENA_H__
+#define ARENA_H__
+
+#include <stddef.h>
+#include <new>
+#include <utility>
+
+/// A memory arena for the containers belonging to a single object, such as
+/// the maps used by a proxy transaction to track its forks.
+///
+/// Small allocations are carved out of a buffer embedded in the arena, and
+/// then out of larger blocks obtained from the heap as needed.  Freed chunks
+/// are kept on per-size free lists for reuse, and all the memory is returned
+/// to the heap in one go when the arena is destroyed.  Allocations above
+/// MAX_SMALL_SIZE go straight to the heap.
+///
+/// The arena is not thread-safe - the caller must serialize access to it, as
+/// it already must for the containers that use it.
+class Arena
+{
+public:
+  Arena();
+  ~Arena();
+
+  void* allocate(size_t size);
+  void deallocate(void* ptr, size_t size);
+
+  /// Number of blocks obtained from the heap (excluding large allocations).
+  /// Used for testing.
+  int heap_blocks() const { return _heap_blocks; }
+
+  static const size_t ALIGNMENT = 16;
+  static const size_t MAX_SMALL_SIZE = 512;
+  static const size_t INITIAL_SIZE = 1024;
+  static const size_t BLOCK_SIZE = 4096;
+
+private:
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  struct FreeChunk
+  {
+    FreeChunk* next;
+  };
+
+  struct Block
+  {
+    Block* next;
+  };
+
+  static size_t size_class(size_t size)
+  {
+    return (size == 0) ? 1 : (size + ALIGNMENT - 1) / ALIGNMENT;
+  }
+
+  FreeChunk* _free[MAX_SMALL_SIZE / ALIGNMENT + 1];
+  char* _next;
+  char* _end;
+  Block* _blocks;
+  int _heap_blocks;
+
+  alignas(ALIGNMENT) char _initial[INITIAL_SIZE];
+};
+
+/// STL allocator allocating from an Arena.  All copies of an allocator
+/// (including rebound copies) share the same arena, which must outlive any
+/// container using it.
+template <typename T>
+class ArenaAllocator
+{
+public:
+  typedef T value_type;
+  typedef T* pointer;
+  typedef const T* const_pointer;
+  typedef T& reference;
+  typedef const T& const_reference;
+  typedef size_t size_type;
+  typedef ptrdiff_t difference_type;
+
+  template <typename U>
+  struct rebind
+  {
+    typedef ArenaAllocator<U> other;
+  };
+
+  explicit ArenaAllocator(Arena* arena) : _arena(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+  T* allocate(size_t n, const void* hint = NULL)
+  {
+    return static_cast<T*>(_arena->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n)
+  {
+    _arena->deallocate(ptr, n * sizeof(T));
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args)
+  {
+    ::new((void*)ptr) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* ptr)
+  {
+    ptr->~U();
+  }
+
+  T* address(T& x) const { return &x; }
+  const T* address(const T& x) const { return &x; }
+  size_t max_size() const { return size_t(-1) / sizeof(T); }
+
+  Arena* arena() const { return _arena; }
+
+private:
+  Arena* _arena;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+  return a.arena() != b.arena();
+}
+
+#endif
@@ -225,6 +225,22 @@ protected:
                         std::string resync,
                         pjsip_msg* req,
                         pjsip_msg* rsp);
+  void create_challenge_async(pjsip_digest_credential* credentials,
+                              pj_bool_t stale,
+                              std::string resync,
+                              pjsip_msg* req,
+                              pjsip_msg* rsp,
+                              ACR* acr);
+  void challenge_with_av(AuthenticationVector* av,
+                         bool av_source_unavailable,
+                         const std::string& impi,
+                         const std::string& impu_for_hss,
+                         ImpiStore::Impi* impi_obj,
+                         pj_bool_t stale,
+                         pjsip_msg* req,
+                         pjsip_msg* rsp);
+  bool av_required_from_hss(pjsip_msg* req);
+  void send_auth_response(pjsip_msg* req, pjsip_msg* rsp, ACR* acr);
   int calculate_challenge_expiration_time(pjsip_msg* req);
   AuthenticationVector* verify_auth_vector(rapidjson::Document* av,
                                            const std::string& impi);
@@ -23,6 +23,7 @@
 #include <functional>
 #include "updater.h"
 #include "sas.h"
+#include "prefix_trie.h"
 
 class BgcfService
 {
@@ -40,7 +41,7 @@ public:
 
 private:
   std::map<std::string, std::vector<std::string>> _domain_routes;
-  std::map<std::string, std::vector<std::string>> _number_routes;
+  PrefixTrie<std::vector<std::string>> _number_routes;
   std::string _configuration;
   Updater<void, BgcfService>* _updater;
 
@@ -27,6 +27,7 @@
 #include "impistore.h"
 #include "analyticslogger.h"
 #include "fifcservice.h"
+#include "simservs_cache.h"
 
 // Struct containing the possible values for non-REGISTER authentication. These
 // are a set of flags that indicate different conditions that may cause a
@@ -81,6 +82,9 @@ struct options
   std::vector<std::string>             impi_stores;
   std::string                          ralf_server;
   int                                  ralf_threads;
+  int                                  ralf_batch_size;
+  int                                  ralf_batch_linger_ms;
+  int                                  ralf_spool_size;
   std::vector<std::string>             dns_servers;
   std::vector<std::string>             enum_servers;
   std::string                          enum_suffix;
@@ -93,9 +97,11 @@ struct options
   std::string                          http_address;
   int                                  http_port;
   int                                  http_threads;
+  int                                  pjsip_threads;
   std::string                          billing_cdf;
   bool                                 emerg_reg_accepted;
   int                                  worker_threads;
+  int                                  worker_queue_shards;
   bool                                 log_to_file;
   std::string                          log_directory;
   int                                  log_level;
@@ -139,16 +145,25 @@ struct options
   std::string                          dummy_app_server;
   bool                                 http_acr_logging;
   int                                  homestead_timeout;
+  int                                  homestead_async_threads;
   int                                  request_on_queue_timeout;
   std::set<std::string>                blacklisted_scscfs;
   bool                                 enable_orig_sip_to_tel_coerce;
   bool                                 ram_record_everything;
+  int                                  msg_trace_sample_rate;
+  int                                  subscriber_profile_cache_size;
+  int                                  subscriber_profile_cache_ttl;
+  int                                  subscriber_profile_reg_refresh;
+  int                                  enum_cache_size;
+  int                                  simservs_cache_size;
+  int                                  simservs_cache_ttl;
 };
 
 // Objects that must be shared with dynamically linked sproutlets must be
 // globally scoped.
 extern LoadMonitor* load_monitor;
 extern HSSConnection* hss_connection;
+extern SimservsCache* simservs_cache;
 extern Store* local_data_store;
 extern std::vector<Store*> remote_data_stores;
 extern Store* local_impi_data_store;
@@ -16,6 +16,9 @@
 #define DNSRESOLVER_H__
 
 #include <string>
+#include <deque>
+#include <functional>
+#include <pthread.h>
 #include <netinet/in.h>
 #include <ares.h>
 #include "sas.h"
@@ -30,17 +33,51 @@
 class DNSResolver
 {
 public:
-  DNSResolver(const std::vector<struct IP46Address>& servers);
+  DNSResolver(const std::vector<struct IP46Address>& servers,
+              int port = DEFAULT_PORT);
   virtual ~DNSResolver();
   // Helper function wrapping the destructor for use as thread-local callbacks.
   static void destroy(DNSResolver* resolver);
   // Perform a NAPTR query for the specified domain, returning the results in
   // the naptr_reply structure, and logging to the trail.  The caller must
-  // call free_naptr_reply when it has finished with naptr_reply.
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  // call free_naptr_reply when it has finished with naptr_reply.  ttl is set
+  // to how long the result (positive or negative) may be cached for, in
+  // seconds, or 0 if it must not be cached.
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   // Free a naptr_reply structure.
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 
+  // The port DNS servers listen on, unless told otherwise.
+  static const int DEFAULT_PORT = 53;
+
+  // Initialize an ares channel for querying the specified servers.  The
+  // ares_addrs array must have room for 3 entries.
+  static void init_channel(ares_channel& channel,
+                           struct ares_addr_port_node* ares_addrs,
+                           const std::vector<struct IP46Address>& servers,
+                           int port);
+
+  // Log a NAPTR query to the trail.
+  static void log_naptr_query(const std::string& domain, SAS::TrailId trail);
+
+  // Log and parse the result of a NAPTR query.  Returns the status of the
+  // query, and on success fills in naptr_reply.  ttl is set as for
+  // perform_naptr_query.
+  static int parse_naptr_response(const std::string& domain,
+                                  SAS::TrailId trail,
+                                  int status,
+                                  unsigned char* abuf,
+                                  int alen,
+                                  struct ares_naptr_reply*& naptr_reply,
+                                  int& ttl);
+
+  // Work out how long a DNS response may be cached for, in seconds.  For a
+  // response with answers, this is the lowest TTL of the answers.  For a
+  // negative response, it is the negative caching TTL from the SOA record in
+  // the authority section (RFC 2308).  Returns 0 if the response is
+  // malformed or has no suitable records.
+  static int response_ttl(const unsigned char* abuf, int alen);
+
 private:
   // Send a query for the specified domain.
   void send_naptr_query(const std::string& domain, SAS::TrailId trail);
@@ -74,9 +111,84 @@ private:
   // The reply data structure.  Only valid between ares_callback and
   // perform_naptr_query returning, and only if _status is ARES_SUCCESS.
   struct ares_naptr_reply* _naptr_reply;
+  // How long the reply may be cached for.  Only valid between ares_callback
+  // and perform_naptr_query returning.
+  int _ttl;
   // Pointer to a linked list of servers
-  struct ares_addr_node _ares_addrs[3];
+  struct ares_addr_port_node _ares_addrs[3];
+
+};
+
+/// @class AsyncDNSResolver
+///
+/// DNS resolver using the ares library without blocking the calling thread.
+/// A single AsyncDNSResolver (and so a single ares channel) is shared by all
+/// threads.  Queries are passed to a dedicated I/O thread, which sends them
+/// and services the ares sockets, and the results are passed to a callback
+/// on that thread.  The callback must therefore do no more than hand the
+/// results on to wherever they are needed.
+class AsyncDNSResolver
+{
+public:
+  // Callback for the result of a NAPTR query.  This is passed the ares status,
+  // if the status is ARES_SUCCESS the reply, which the callback must free
+  // using free_naptr_reply, and how long the result may be cached for (as
+  // for DNSResolver::perform_naptr_query).
+  typedef std::function<void(int, struct ares_naptr_reply*, int)> NaptrCallback;
+
+  AsyncDNSResolver(const std::vector<struct IP46Address>& servers,
+                   int port = DNSResolver::DEFAULT_PORT);
+  virtual ~AsyncDNSResolver();
+
+  // Send a NAPTR query for the specified domain, logging to the trail.  This
+  // returns immediately, and the callback is called on the I/O thread when
+  // the query completes or fails (including when the resolver is destroyed
+  // with the query outstanding).  This may be called on any thread, including
+  // from a callback.
+  virtual void send_naptr_query(const std::string& domain,
+                                SAS::TrailId trail,
+                                NaptrCallback callback);
+  // Free a naptr_reply structure.
+  virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
+
+private:
+  // A query that has been passed to the resolver.
+  struct Query
+  {
+    std::string domain;
+    SAS::TrailId trail;
+    NaptrCallback callback;
+  };
+
+  // Entry point and main loop for the I/O thread.
+  static void* io_thread_fn(void* resolver);
+  void io_thread();
+  // Send any queries waiting to be sent.  Only called on the I/O thread.
+  void send_queued_queries();
+  // Wake the I/O thread so it notices new queries or termination.
+  void wake_io_thread();
+  // ares callback function.
+  static void ares_callback(void* arg,
+                            int status,
+                            int timeouts,
+                            unsigned char* abuf,
+                            int alen);
+
+  // The ares data structure that controls actually making the queries.  This
+  // is only touched by the I/O thread (and by the constructor and destructor
+  // while the I/O thread isn't running).
+  ares_channel _channel;
+  // Pointer to a linked list of servers
+  struct ares_addr_port_node _ares_addrs[3];
+
+  // Queries waiting for the I/O thread to send them, protected by _lock.
+  pthread_mutex_t _lock;
+  std::deque<Query*> _queued_queries;
+  bool _terminated;
 
+  // Pipe used to wake the I/O thread.
+  int _wake_pipe[2];
+  pthread_t _io_thread;
 };
 
 /// @class DNSResolverFactory
@@ -90,6 +202,8 @@ public:
   virtual ~DNSResolverFactory() {}
   // Create a new resolver.
   virtual DNSResolver* new_resolver(const std::vector<struct IP46Address>& servers) const;
+  // Create a new asynchronous resolver.
+  virtual AsyncDNSResolver* new_async_resolver(const std::vector<struct IP46Address>& servers) const;
 
 };
 
@@ -17,6 +17,9 @@
 
 #include <list>
 #include <string>
+#include <functional>
+#include <memory>
+#include <pthread.h>
 #include <boost/regex.hpp>
 #include <boost/thread.hpp>
 #include <netinet/in.h>
@@ -26,6 +29,9 @@
 #include "dnsresolver.h"
 #include "communicationmonitor.h"
 #include "updater.h"
+#include "prefix_trie.h"
+#include "snmp_counter_table.h"
+#include "ttl_cache.h"
 
 /// @class EnumService
 ///
@@ -41,6 +47,25 @@ public:
   /// Translate a PSTN number to a SIP URI.
   virtual std::string lookup_uri_from_user(const std::string& user, SAS::TrailId trail) const = 0;
 
+  /// Callback for the result of an asynchronous lookup.  This is passed the
+  /// translated URI, or an empty string if the lookup failed.
+  typedef std::function<void(const std::string&)> LookupCallback;
+
+  /// Whether lookup_uri_from_user_async can complete after it has returned.
+  /// If not, there is no benefit in using it over lookup_uri_from_user.
+  virtual bool is_async() const { return false; }
+
+  /// Translate a PSTN number to a SIP URI without blocking the calling
+  /// thread.  The callback may be called on any thread, either before or
+  /// after this returns.  By default, this just does the lookup
+  /// synchronously.
+  virtual void lookup_uri_from_user_async(const std::string& user,
+                                          SAS::TrailId trail,
+                                          LookupCallback callback) const
+  {
+    callback(lookup_uri_from_user(user, trail));
+  }
+
   // Parse a string of the form !<regex>!<replace>! into a regular expression
   // and a replacement string.
   static bool parse_regex_replace(const std::string& regex_replace, boost::regex& regex, std::string& replace);
@@ -96,7 +121,7 @@ private:
   };
 
   std::vector<NumberPrefix> _number_prefixes;
-  std::map<std::string, NumberPrefix> _prefix_regex_map;
+  PrefixTrie<NumberPrefix> _prefix_trie;
   std::string _configuration;
   Updater<void, JSONEnumService>* _updater;
 
@@ -110,6 +135,10 @@ private:
 /// @class DNSEnumService
 ///
 /// Provides an ENUM service based on DNS queries from an ENUM server.
+///
+/// If a cache size is given, the rules from each NAPTR response (and the
+/// fact that a domain doesn't exist) are cached for the TTL in the response,
+/// so lookups for popular numbers don't need to query the ENUM server at all.
 class DNSEnumService : public EnumService
 {
 public:
@@ -117,11 +146,20 @@ public:
                  const std::string& dns_suffix = ".e164.arpa",
                  const DNSResolverFactory* resolver_factory =
                                                        new DNSResolverFactory(),
-                 CommunicationMonitor* comm_monitor = NULL);
+                 CommunicationMonitor* comm_monitor = NULL,
+                 size_t cache_size = 0,
+                 SNMP::CounterTable* cache_hit_tbl = NULL,
+                 SNMP::CounterTable* cache_miss_tbl = NULL,
+                 SNMP::CounterTable* cache_eviction_tbl = NULL);
   ~DNSEnumService();
 
   std::string lookup_uri_from_user(const std::string& user, SAS::TrailId trail) const;
 
+  bool is_async() const { return (_async_resolver != NULL); }
+  void lookup_uri_from_user_async(const std::string& user,
+                                  SAS::TrailId trail,
+                                  LookupCallback callback) const;
+
   // Characters to strip from a key before turning it into a domain.  This is
   // all non-digit characters.
   static const boost::regex CHARS_TO_STRIP_FROM_DOMAIN;
@@ -160,9 +198,93 @@ private:
 
   };
 
+  // The rules from a NAPTR response, in order.  These are shared between the
+  // cache and any lookups using them.
+  typedef std::shared_ptr<const std::vector<Rule>> RuleSet;
+
+  /// @class RuleCache
+  ///
+  /// Cache of the rules from NAPTR responses, keyed by ENUM domain.  A NULL
+  /// rule set records that the domain doesn't exist.  Entries expire after
+  /// the TTL from the DNS response, and the least recently used entries are
+  /// evicted once the cache is full.
+  class RuleCache
+  {
+  public:
+    RuleCache(size_t max_size,
+              SNMP::CounterTable* hit_tbl,
+              SNMP::CounterTable* miss_tbl,
+              SNMP::CounterTable* eviction_tbl);
+
+    // Looks up the rules for a domain.  Returns true if a valid entry was
+    // found, in which case rules is filled in from it.
+    bool get(const std::string& domain, RuleSet& rules);
+    // Stores the rules for a domain, to expire after the given time.
+    void put(const std::string& domain, const RuleSet& rules, int ttl_s);
+    // The number of entries in the cache (including expired entries that
+    // have not yet been removed).  Used for testing.
+    size_t size();
+
+  private:
+    SNMP::CounterTable* _hit_tbl;
+    SNMP::CounterTable* _miss_tbl;
+
+    TtlCache<RuleSet> _cache;
+  };
+
   // Maximum number of DNS queries per request.
   static const int MAX_DNS_QUERIES = 5;
 
+  // The longest time for which we cache the fact that a domain doesn't exist,
+  // so that newly provisioned numbers are picked up reasonably quickly.
+  static const int MAX_NEGATIVE_CACHE_TTL_S = 300;
+
+  /// The state of a single lookup, which may take several DNS queries.
+  struct Lookup
+  {
+    Lookup(const std::string& user, SAS::TrailId trail);
+
+    // Whether another query is needed.
+    bool in_progress() const
+    {
+      return ((!complete) && (!failed) && (dns_queries < MAX_DNS_QUERIES));
+    }
+
+    std::string user;
+    SAS::TrailId trail;
+    // The Application Unique String, which is the input to every rule.
+    std::string aus;
+    // The key for the next query or, once complete, the translated URI.
+    std::string string;
+    // The number of rule sets applied so far, whether from DNS or the cache.
+    int dns_queries;
+    bool complete;
+    bool failed;
+    bool server_contacted;
+    bool server_failed;
+    // The callback for an asynchronous lookup.
+    LookupCallback callback;
+  };
+
+  // Updates a lookup with the cached rules for the domain, if there are any.
+  // Returns whether there were.
+  bool apply_cached_rules(Lookup& lookup, const std::string& domain) const;
+  // Updates a lookup with the result of a DNS query for the domain, and
+  // caches the result if possible.
+  void process_naptr_reply(Lookup& lookup,
+                           const std::string& domain,
+                           int status,
+                           const struct ares_naptr_reply* naptr_reply,
+                           int ttl) const;
+  // Updates a lookup with the result of querying for the current key.  rules
+  // is only used if status is ARES_SUCCESS.
+  void apply_rules(Lookup& lookup, int status, const RuleSet& rules) const;
+  // Logs the end of a lookup and returns the result.
+  std::string finish_lookup(const Lookup& lookup) const;
+  // Carries on with an asynchronous lookup, sending the next query if
+  // needed, or calling the callback if the lookup has finished.
+  void continue_async_lookup(Lookup* lookup) const;
+
   // Converts a key to an ENUM domain name.
   std::string key_to_domain(const std::string& key) const;
   // Gets a resolver (from thread-local data).
@@ -179,6 +301,10 @@ private:
   pthread_key_t _thread_local;
   // DNSResolverFactory, used for constructing DNSResolvers when required.
   const DNSResolverFactory* _resolver_factory;
+  // Resolver shared by all asynchronous lookups.
+  AsyncDNSResolver* _async_resolver;
+  // Cache of rules from previous queries, or NULL if caching is disabled.
+  RuleCache* _rule_cache;
 
   // Helper used to track enum communication state, and issue/clear alarms
   // based upon recent activity.
@@ -33,12 +33,16 @@ public:
   /// Updates the fallback iFCs.
   void update_fifcs();
 
-  /// Get the fallback iFCs
+  /// Get the fallback iFCs.  The iFCs share the parsed fallback iFC
+  // configuration, so don't use ifc_doc.
   std::vector<Ifc> get_fallback_ifcs(rapidxml::xml_document<>* ifc_doc) const;
 
 private:
   Alarm* _alarm;
-  std::vector<std::string> _fallback_ifcs;
+  // The fallback iFCs in priority order.  Each iFC shares ownership of the
+  // parsed configuration document, so iFCs handed out remain valid when the
+  // fallback iFCs are reloaded.
+  std::vector<Ifc> _fallback_ifcs;
   std::string _configuration;
   Updater<void, FIFCService>* _updater;
 
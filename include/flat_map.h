@@ -0,0 +1,171 @@
+/**
+ * @file flat_map.h  Map and set containers backed by a sorted vector.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef FLAT_MAP_H__
+#define FLAT_MAP_H__
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/// A map held as a vector of key/value pairs sorted by key.  This supports
+/// the commonly used subset of the std::map interface, and is much cheaper
+/// than a std::map when there are only ever a handful of entries, as lookups
+/// are a short scan of contiguous memory and there is no allocation per
+/// entry.
+///
+/// Unlike std::map, inserting or erasing an entry invalidates iterators and
+/// references to the other entries.
+template <typename K, typename V>
+class FlatMap
+{
+public:
+  typedef K key_type;
+  typedef V mapped_type;
+  typedef std::pair<K, V> value_type;
+  typedef typename std::vector<value_type>::iterator iterator;
+  typedef typename std::vector<value_type>::const_iterator const_iterator;
+
+  iterator begin() { return _entries.begin(); }
+  iterator end() { return _entries.end(); }
+  const_iterator begin() const { return _entries.begin(); }
+  const_iterator end() const { return _entries.end(); }
+
+  bool empty() const { return _entries.empty(); }
+  size_t size() const { return _entries.size(); }
+  void clear() { _entries.clear(); }
+
+  iterator find(const K& key)
+  {
+    iterator it = lower_bound(key);
+    return ((it != _entries.end()) && (it->first == key)) ? it : _entries.end();
+  }
+
+  const_iterator find(const K& key) const
+  {
+    const_iterator it = lower_bound(key);
+    return ((it != _entries.end()) && (it->first == key)) ? it : _entries.end();
+  }
+
+  V& operator[](const K& key)
+  {
+    iterator it = lower_bound(key);
+    if ((it == _entries.end()) || (it->first != key))
+    {
+      it = _entries.insert(it, value_type(key, V()));
+    }
+    return it->second;
+  }
+
+  std::pair<iterator, bool> insert(const value_type& value)
+  {
+    iterator it = lower_bound(value.first);
+    if ((it != _entries.end()) && (it->first == value.first))
+    {
+      return std::make_pair(it, false);
+    }
+    return std::make_pair(_entries.insert(it, value), true);
+  }
+
+  iterator erase(iterator it)
+  {
+    return _entries.erase(it);
+  }
+
+  size_t erase(const K& key)
+  {
+    iterator it = find(key);
+    if (it == _entries.end())
+    {
+      return 0;
+    }
+    _entries.erase(it);
+    return 1;
+  }
+
+private:
+  struct KeyLess
+  {
+    bool operator()(const value_type& entry, const K& key) const
+    {
+      return entry.first < key;
+    }
+  };
+
+  iterator lower_bound(const K& key)
+  {
+    return std::lower_bound(_entries.begin(), _entries.end(), key, KeyLess());
+  }
+
+  const_iterator lower_bound(const K& key) const
+  {
+    return std::lower_bound(_entries.begin(), _entries.end(), key, KeyLess());
+  }
+
+  std::vector<value_type> _entries;
+};
+
+/// A set held as a sorted vector, with the same trade-offs as FlatMap.
+template <typename K>
+class FlatSet
+{
+public:
+  typedef K key_type;
+  typedef K value_type;
+  typedef typename std::vector<K>::const_iterator iterator;
+  typedef typename std::vector<K>::const_iterator const_iterator;
+
+  const_iterator begin() const { return _entries.begin(); }
+  const_iterator end() const { return _entries.end(); }
+
+  bool empty() const { return _entries.empty(); }
+  size_t size() const { return _entries.size(); }
+  void clear() { _entries.clear(); }
+
+  const_iterator find(const K& key) const
+  {
+    const_iterator it = std::lower_bound(_entries.begin(), _entries.end(), key);
+    return ((it != _entries.end()) && (*it == key)) ? it : _entries.end();
+  }
+
+  size_t count(const K& key) const
+  {
+    return (find(key) != _entries.end()) ? 1 : 0;
+  }
+
+  std::pair<const_iterator, bool> insert(const K& key)
+  {
+    typename std::vector<K>::iterator it =
+                      std::lower_bound(_entries.begin(), _entries.end(), key);
+    if ((it != _entries.end()) && (*it == key))
+    {
+      return std::make_pair(const_iterator(it), false);
+    }
+    return std::make_pair(const_iterator(_entries.insert(it, key)), true);
+  }
+
+  size_t erase(const K& key)
+  {
+    typename std::vector<K>::iterator it =
+                      std::lower_bound(_entries.begin(), _entries.end(), key);
+    if ((it == _entries.end()) || (*it != key))
+    {
+      return 0;
+    }
+    _entries.erase(it);
+    return 1;
+  }
+
+private:
+  std::vector<K> _entries;
+};
+
+#endif
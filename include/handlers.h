@@ -18,6 +18,7 @@
 #include "subscriber_manager.h"
 #include "sipresolver.h"
 #include "impistore.h"
+#include "simservs_cache.h"
 
 /// Base AuthTimeoutTask class for tasks that implement authentication timeout
 /// callbacks from specific timer services.
@@ -211,6 +212,31 @@ private:
   const Config* _cfg;
 };
 
+/// Task for invalidating the MMTEL AS's cached simservs for an IMPU, used when
+/// the subscriber's simservs document is changed on the XDMS.
+class InvalidateSimservsTask : public HttpStackUtils::Task
+{
+public:
+  struct Config
+  {
+    Config(SimservsCache* cache) :
+      _cache(cache)
+    {}
+
+    SimservsCache* _cache;
+  };
+
+  InvalidateSimservsTask(HttpStack::Request& req, const Config* cfg, SAS::TrailId trail) :
+    HttpStackUtils::Task(req, trail), _cfg(cfg)
+  {};
+  virtual ~InvalidateSimservsTask() {}
+
+  void run();
+
+private:
+  const Config* _cfg;
+};
+
 /// Task for receiving user data sent by Homestead when it receives a PPR.
 /// It will send NOTIFYs if the associated URIs have changed (by calling
 /// into the SM).
@@ -264,4 +290,25 @@ protected:
   std::string _default_public_id;
   AssociatedURIs _associated_uris;
 };
+
+/// Task to dump the sampled SIP message traces held by this node.
+class GetMessageTracesTask : public HttpStackUtils::Task
+{
+public:
+  struct Config
+  {
+    Config() {}
+  };
+
+  GetMessageTracesTask(HttpStack::Request& req,
+                       const Config* cfg,
+                       SAS::TrailId trail) :
+    HttpStackUtils::Task(req, trail), _cfg(cfg)
+  {};
+
+  void run();
+
+protected:
+  const Config* _cfg;
+};
 #endif
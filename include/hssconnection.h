@@ -13,6 +13,8 @@
 #define HSSCONNECTION_H__
 
 #include <curl/curl.h>
+#include <atomic>
+#include <functional>
 #include "rapidjson/document.h"
 
 #include "httpconnection.h"
@@ -23,6 +25,12 @@
 #include "load_monitor.h"
 #include "associated_uris.h"
 #include "sifcservice.h"
+#include "threadpool.h"
+#include "exception_handler.h"
+#include "snmp_counter_table.h"
+#include "request_coalescer.h"
+
+class SubscriberProfileCache;
 
 /// @class HSSConnection
 ///
@@ -62,6 +70,11 @@ public:
     std::deque<std::string> _ccfs;
     std::deque<std::string> _ecfs;
 
+    // Set if this is the response to a registration request that was served
+    // from the local cache on the assumption that the registration is a
+    // refresh, rather than being sent to Homestead.
+    bool _reg_from_cache;
+
     irs_info() :
       _regstate(""),
       _prev_regstate(""),
@@ -69,11 +82,29 @@ public:
       _associated_uris({}),
       _aliases(),
       _ccfs(),
-      _ecfs()
+      _ecfs(),
+      _reg_from_cache(false)
     {
     }
   };
 
+  /// Callback for an asynchronous request that returns a JSON document.  The
+  /// callback takes ownership of the document, which is NULL if the request
+  /// failed.
+  typedef std::function<void(HTTPCode, rapidjson::Document*)> JsonCallback;
+
+  /// Constructor.
+  ///
+  /// @param async_threads     - The number of threads to make asynchronous
+  ///                            requests on.  If this is 0, asynchronous
+  ///                            requests are made on the calling thread.
+  ///                            Otherwise, requests are rejected with a 503
+  ///                            once MAX_QUEUED_ASYNC_REQUESTS_PER_THREAD
+  ///                            requests per thread are waiting.
+  /// @param exception_handler - Exception handler for those threads.
+  /// @param coalesced_tbl     - Counts requests for registration or location
+  ///                            data that were satisfied by an identical
+  ///                            request that was already in flight.
   HSSConnection(const std::string& server,
                 HttpResolver* resolver,
                 LoadMonitor* load_monitor,
@@ -85,7 +116,11 @@ public:
                 SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                 CommunicationMonitor* comm_monitor,
                 SIFCService* sifc_service,
-                long homestead_timeout_ms);
+                long homestead_timeout_ms,
+                SubscriberProfileCache* profile_cache = NULL,
+                int async_threads = 0,
+                ExceptionHandler* exception_handler = NULL,
+                SNMP::CounterTable* coalesced_tbl = NULL);
   virtual ~HSSConnection();
 
   HTTPCode get_auth_vector(const std::string& private_user_id,
@@ -115,6 +150,38 @@ public:
   virtual HTTPCode get_registration_data(const std::string& public_id,
                                          irs_info& irs_info,
                                          SAS::TrailId trail);
+
+  /// Returns whether the asynchronous method below makes its requests on a
+  /// separate pool of threads.  If not, they make the request on the calling
+  /// thread and run the callback before returning, so callers should only
+  /// suspend processing to wait for a request if this returns true.
+  virtual bool is_async() const;
+
+  /// Asynchronous version of get_auth_vector, which doesn't block the
+  /// calling thread if is_async() returns true.  The request itself is still
+  /// a blocking HTTP request, made on one of the async_threads rather than on
+  /// a worker thread.  This is the only asynchronous request: the
+  /// registration and location queries made by the S-CSCF and I-CSCF block
+  /// the worker thread that makes them.  The callback is run exactly
+  /// once, on the thread that made the request, so it must not block and will
+  /// usually queue further processing to a worker thread (for example, with
+  /// the ResumeFn returned by SproutletTsxHelper::suspend()).  If too many
+  /// requests are already waiting, the callback is run straight away with
+  /// HTTP_SERVER_UNAVAILABLE.
+  void get_auth_vector_async(const std::string& private_user_id,
+                             const std::string& public_user_id,
+                             const std::string& auth_type,
+                             const std::string& resync_auth,
+                             const std::string& server_name,
+                             SAS::TrailId trail,
+                             JsonCallback callback);
+
+  /// Discards any locally cached registration data for the IMPU and the rest
+  /// of its implicit registration set.  This must be called whenever the data
+  /// is changed by something other than a registration state update through
+  /// this connection, for example by a Push-Profile request.
+  virtual void invalidate_cached_registration_data(const std::string& public_id);
+
   rapidxml::xml_document<>* parse_xml(std::string raw, const std::string& url);
 
   static const std::string REG;
@@ -125,7 +192,68 @@ public:
   static const std::string AUTH_TIMEOUT;
   static const std::string AUTH_FAIL;
 
+  /// The number of asynchronous requests per thread that can be waiting for
+  /// a thread before further requests are rejected.
+  static const int MAX_QUEUED_ASYNC_REQUESTS_PER_THREAD = 20;
+
+protected:
+  /// An asynchronous request.
+  struct AsyncRequest
+  {
+    // Makes the request, saving off the result.
+    std::function<void()> send;
+
+    // Passes the result to the caller's callback.
+    std::function<void()> respond;
+
+    // Tells the caller's callback that the request was rejected because too
+    // many requests were queued.
+    std::function<void()> reject;
+
+    // Whether respond has been called.
+    bool responded;
+  };
+
+  /// Queues an asynchronous request to the pool, or processes it immediately
+  /// if there is no pool.  If the pool's queue is full, the request is
+  /// rejected.  Takes ownership of the request.
+  virtual void send_async(AsyncRequest* request);
+
+  /// Processes an asynchronous request and deletes it.
+  static void process_async_request(AsyncRequest* request);
+
 private:
+  /// Called if processing an asynchronous request hits an exception.  The
+  /// caller is still told that the request completed (with whatever result
+  /// was saved off, which defaults to a failure), unless the exception was in
+  /// its own callback.
+  static void exception_callback(AsyncRequest* request);
+
+  /// @class AsyncPool
+  /// The pool of threads that asynchronous requests are made on.
+  class AsyncPool : public ThreadPool<AsyncRequest*>
+  {
+  public:
+    AsyncPool(unsigned int num_threads,
+              int max_queued,
+              ExceptionHandler* exception_handler);
+    virtual ~AsyncPool() {}
+
+    /// Queues a request, unless max_queued requests are already waiting.
+    ///
+    /// @return true if the request was queued.
+    bool try_add_work(AsyncRequest* request);
+
+  private:
+    virtual void process_work(AsyncRequest*& request);
+
+    const int _max_queued;
+
+    // The number of requests that have been queued and not yet picked up
+    // by a thread.
+    std::atomic<int> _queued;
+  };
+
   virtual long get_json_object(const std::string& path,
                                rapidjson::Document*& object,
                                SAS::TrailId trail);
@@ -152,6 +280,21 @@ private:
   SNMP::EventAccumulatorTable* _uar_latency_tbl;
   SNMP::EventAccumulatorTable* _lir_latency_tbl;
   SIFCService* _sifc_service;
+
+  // Cache of the parsed registration data for subscribers.  NULL if caching is
+  // disabled.
+  SubscriberProfileCache* _profile_cache;
+
+  // Identical concurrent requests for registration data (keyed on public ID)
+  // and location data (keyed on path) share a single request to Homestead.
+  // Each caller gets its own copy of the location data, so it is shared as a
+  // const document.
+  RequestCoalescer<irs_info> _reg_data_requests;
+  RequestCoalescer<std::shared_ptr<const rapidjson::Document>> _location_requests;
+
+  // Pool of threads for asynchronous requests.  NULL if asynchronous requests
+  // are made on the calling thread.
+  AsyncPool* _async_pool;
 };
 
 #endif
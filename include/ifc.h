@@ -68,20 +68,33 @@ struct AsInvocation
   bool include_register_response;
 };
 
+class CompiledIfc;
+class IfcCompilation;
+
 /// A single Initial Filter Criterion (iFC).
+//
+// The first time an iFC is matched, its XML is walked.  If it (or a copy of
+// it) is matched again, it is compiled into a form that can be matched
+// against requests without walking the XML (see CompiledIfc).  Most iFCs are
+// parsed from a Homestead response and matched once, so this only spends
+// time compiling iFCs that are cached or shared.  iFCs that can't be
+// compiled are always matched by walking the XML.
 class Ifc
 {
 public:
-  Ifc(rapidxml::xml_node<>* ifc) :
-    _ifc(ifc)
-  {
-  }
+  Ifc(rapidxml::xml_node<>* ifc);
 
   /// This constructor creates an Ifc and makes sure that all of its
   // associated memory is owned by the passed in XML document.
   Ifc(std::string ifc_str,
       rapidxml::xml_document<>* ifc_doc);
 
+  /// This constructor creates an Ifc that shares ownership of the XML
+  // document containing it, so the Ifc (and any copy of it) remains valid
+  // after everyone else has released the document.
+  Ifc(rapidxml::xml_node<>* ifc,
+      std::shared_ptr<rapidxml::xml_document<>> ifc_doc);
+
   bool filter_matches(const SessionCase& session_case,
                       const bool is_registered,
                       const bool is_initial_registration,
@@ -90,6 +103,18 @@ public:
 
   AsInvocation as_invocation() const;
 
+  /// Matches the iFC by walking its XML.  filter_matches uses this for iFCs
+  // that couldn't be compiled, so that any errors in them are still reported
+  // on each request.  Also used in UT to check the compiled form.
+  bool dom_filter_matches(const SessionCase& session_case,
+                          const bool is_registered,
+                          const bool is_initial_registration,
+                          pjsip_msg* msg,
+                          SAS::TrailId trail) const;
+
+  /// Whether the iFC has been compiled.  Used for testing.
+  bool is_compiled() const;
+
 private:
 
 class ifc_error : public std::exception {};
@@ -117,4 +142,11 @@ class ifc_error : public std::exception {};
 
   rapidxml::xml_node<>* _ifc;
   std::string _server_name;
+
+  // Counts matches of the iFC and holds its compiled form once it has been
+  // compiled.  This is shared between copies of the Ifc.
+  std::shared_ptr<IfcCompilation> _compilation;
+
+  // The document containing the iFC, if the Ifc shares ownership of it.
+  std::shared_ptr<rapidxml::xml_document<>> _ifc_doc;
 };
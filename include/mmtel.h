@@ -28,6 +28,7 @@ extern "C" {
 #include "appserver.h"
 #include "xdmconnection.h"
 #include "simservs.h"
+#include "simservs_cache.h"
 #include "aschain.h"
 #include "counter.h"
 
@@ -41,9 +42,11 @@ class Mmtel : public AppServer
 {
 public:
   Mmtel(const std::string& service_name,
-        XDMConnection* xdm_client) :
+        XDMConnection* xdm_client,
+        SimservsCache* simservs_cache = NULL) :
     AppServer(service_name),
-    _xdmc(xdm_client) {};
+    _xdmc(xdm_client),
+    _simservs_cache(simservs_cache) {};
 
   AppServerTsx* get_app_tsx(SproutletHelper* helper,
                             pjsip_msg* req,
@@ -53,6 +56,7 @@ public:
 
 private:
   XDMConnection* _xdmc;
+  SimservsCache* _simservs_cache;
 
   simservs *get_user_services(std::string public_id, SAS::TrailId trail);
 };
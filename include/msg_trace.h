@@ -0,0 +1,69 @@
+/**
+ * @file msg_trace.h  Sampled SIP message traces held in per-thread buffers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef MSG_TRACE_H__
+#define MSG_TRACE_H__
+
+extern "C" {
+#include <pjsip.h>
+}
+
+#include <string>
+
+/// Message tracing keeps full copies of a sample of the SIP messages that a
+/// node handles, so that message-level diagnostics are available without
+/// running at VERBOSE log level.
+///
+/// Each thread records into its own ring buffer, so recording a trace never
+/// takes a lock or contends with other threads.  The buffers are only read
+/// when they are dumped.
+namespace MsgTrace
+{
+  /// Number of traces kept on each thread before the oldest is overwritten.
+  const int SLOTS_PER_THREAD = 16;
+
+  /// Maximum number of bytes kept for each traced message.
+  const int MAX_MSG_LEN = 4096;
+
+  /// Maximum length of the description kept with each traced message.
+  const int MAX_DESCRIPTION_LEN = 256;
+
+  /// Sets how often messages are traced.  One message in every sample_rate
+  /// handled by each thread is traced.  A sample rate of zero (the default)
+  /// disables tracing.  The sample rate must not be negative.
+  void set_sample_rate(int sample_rate);
+
+  /// Returns whether the message about to be handled on this thread should be
+  /// traced.  This is cheap, so can be called on every message, but must be
+  /// called exactly once per message to keep the sampling rate accurate.
+  bool sample();
+
+  /// Records a message into this thread's trace buffer.  Messages longer
+  /// than MAX_MSG_LEN are truncated.
+  void record(const std::string& description, const char* buf, int len);
+
+  /// Prints a message directly into this thread's trace buffer.
+  void record(const std::string& description, pjsip_msg* msg);
+
+  /// Returns the recorded traces from all threads, oldest first.
+  std::string dump();
+
+  /// Writes the recorded traces to a file in the specified directory, if
+  /// tracing is enabled.  This doesn't allocate memory or take locks, so is
+  /// safe to call from a signal handler.
+  void dump(const char* directory);
+
+  /// Discards all the recorded traces.  This must not be called while other
+  /// threads may be recording traces.
+  void clear();
+}
+
+#endif
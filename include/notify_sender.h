@@ -23,6 +23,7 @@ extern "C" {
 #include <string>
 #include <list>
 #include <map>
+#include <vector>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -101,6 +102,7 @@ private:
                                   int cseq,
                                   const ClassifiedBindings& classified_bindings,
                                   const RegistrationState& reg_state,
+                                  const std::vector<std::string>& reg_state_xml,
                                   int now,
                                   SAS::TrailId trail);
 
@@ -111,6 +113,7 @@ private:
                             int cseq,
                             const ClassifiedBindings& classified_bindings,
                             const RegistrationState& reg_state,
+                            const std::vector<std::string>& reg_state_xml,
                             const SubscriptionState& subscription_state,
                             int expiry,
                             SAS::TrailId trail);
@@ -127,20 +130,34 @@ private:
                                   Subscription* subscription,
                                   const ClassifiedBindings& classified_bindings,
                                   const RegistrationState& reg_state,
+                                  const std::vector<std::string>& reg_state_xml,
                                   SAS::TrailId trail);
 
+  /// Prints the reg-info document for an AoR, for sharing between the
+  /// NOTIFYs to all of its subscriptions.  The only part of the document
+  /// that differs between subscriptions is the id of each registration
+  /// element, so the document is split into the text either side of these
+  /// ids.
+  ///
+  /// @return false if the document couldn't be printed, in which case each
+  ///         NOTIFY builds its own document.
+  bool notify_print_reg_state_xml(const std::string& aor,
+                                  const AssociatedURIs& associated_uris,
+                                  const ClassifiedBindings& classified_bindings,
+                                  const RegistrationState& reg_state,
+                                  std::vector<std::string>& reg_state_xml);
+
   pj_xml_node* notify_create_reg_state_xml(
                                   pj_pool_t *pool,
                                   const std::string& aor,
                                   const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
+                                  const pj_str_t* reg_id,
                                   const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
-                                  SAS::TrailId trail);
+                                  const RegistrationState& reg_state);
 
   pj_xml_node* create_reg_node(pj_pool_t* pool,
                                pj_str_t* aor,
-                               pj_str_t* id,
+                               const pj_str_t* id,
                                pj_str_t* state);
 
 
@@ -338,6 +338,17 @@ void translate_request_uri(pjsip_msg* req,
                            bool should_override_npdi,
                            SAS::TrailId trail);
 
+/// Works out whether translate_request_uri would do an ENUM lookup on the
+/// Request-URI and, if so, for which user.  This allows callers to do the
+/// lookup asynchronously, then pass the result to apply_enum_translation.
+bool enum_lookup_required(pjsip_msg* req, std::string& user);
+
+void apply_enum_translation(pjsip_msg* req,
+                            pj_pool_t* pool,
+                            const std::string& new_uri_str,
+                            bool should_override_npdi,
+                            SAS::TrailId trail);
+
 void update_request_uri_np_data(pjsip_msg* req,
                                 pj_pool_t* pool,
                                 EnumService* enum_service,
@@ -468,6 +479,47 @@ int expiry_for_binding(pjsip_contact_hdr* contact,
                        pjsip_expires_hdr* expires,
                        int max_expires);
 
+/// Hash and equality functors allowing a pj_str_t to be used directly as the
+/// key of an unordered container, without copying it into a std::string.  The
+/// container does not own the string, so the characters must outlive it.
+struct PjStrHash
+{
+  size_t operator()(const pj_str_t& s) const
+  {
+    return pj_hash_calc(0, s.ptr, s.slen);
+  }
+};
+
+struct PjStrEqual
+{
+  bool operator()(const pj_str_t& a, const pj_str_t& b) const
+  {
+    return (a.slen == b.slen) && (pj_strcmp(&a, &b) == 0);
+  }
+};
+
+/// Case-insensitive versions of the above, for keying on host names.
+struct PjStrCaseHash
+{
+  size_t operator()(const pj_str_t& s) const
+  {
+    size_t hash = 0;
+    for (pj_ssize_t ii = 0; ii < s.slen; ++ii)
+    {
+      hash = (hash * 33) + pj_tolower(s.ptr[ii]);
+    }
+    return hash;
+  }
+};
+
+struct PjStrCaseEqual
+{
+  bool operator()(const pj_str_t& a, const pj_str_t& b) const
+  {
+    return (a.slen == b.slen) && (pj_stricmp(&a, &b) == 0);
+  }
+};
+
 } // namespace PJUtils
 
 #endif
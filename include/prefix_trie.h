@@ -0,0 +1,170 @@
+/**
+ * @file prefix_trie.h  Longest-prefix-match index for number prefixes.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef PREFIX_TRIE_H__
+#define PREFIX_TRIE_H__
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// A trie of string prefixes (typically telephone number prefixes), each with
+/// an associated value, supporting longest-prefix-match lookups in time
+/// proportional to the length of the number rather than the number of
+/// prefixes.
+///
+/// The trie is intended to be built once when configuration is loaded and
+/// then only read, so it has no support for removing prefixes.  The nodes are
+/// held in a single vector, with the children of each node chained through
+/// sibling indexes, so there is no allocation per node.
+template <typename V>
+class PrefixTrie
+{
+public:
+  typedef std::pair<std::string, V> value_type;
+
+  PrefixTrie() : _nodes(1) {}
+
+  bool empty() const { return _values.empty(); }
+  size_t size() const { return _values.size(); }
+
+  void swap(PrefixTrie& other)
+  {
+    _nodes.swap(other._nodes);
+    _values.swap(other._values);
+  }
+
+  /// Adds a prefix.  If the prefix is already present, the trie is unchanged,
+  /// as for std::map::insert.
+  ///
+  /// @return true if the prefix was added.
+  bool insert(const std::string& prefix, const V& value)
+  {
+    // Find or create the node for the prefix.
+    std::vector<uint32_t> path(1, 0);
+    for (std::string::const_iterator c = prefix.begin(); c != prefix.end(); ++c)
+    {
+      uint32_t child = find_child(path.back(), *c);
+      if (child == NONE)
+      {
+        child = _nodes.size();
+        _nodes.push_back(Node(*c));
+        _nodes[child].next_sibling = _nodes[path.back()].first_child;
+        _nodes[path.back()].first_child = child;
+      }
+      path.push_back(child);
+    }
+
+    if (_nodes[path.back()].value != NONE)
+    {
+      return false;
+    }
+
+    uint32_t index = _values.size();
+    _values.push_back(value_type(prefix, value));
+    _nodes[path.back()].value = index;
+
+    // Keep track of the greatest prefix below each node on the path.
+    for (std::vector<uint32_t>::const_iterator node = path.begin();
+         node != path.end();
+         ++node)
+    {
+      uint32_t& greatest = _nodes[*node].greatest;
+      if ((greatest == NONE) || (_values[greatest].first < prefix))
+      {
+        greatest = index;
+      }
+    }
+
+    return true;
+  }
+
+  /// Finds the longest prefix of a number.
+  ///
+  /// If match_extensions is set and the number is itself a prefix of one or
+  /// more of the prefixes in the trie, the lexicographically greatest of those
+  /// is returned instead.  This is what the reverse scan of a sorted map of
+  /// prefixes that this replaces did for numbers shorter than the prefix
+  /// being compared.
+  ///
+  /// @return The matching prefix and its value, or NULL if there is no match.
+  const value_type* longest_match(const std::string& number,
+                                  bool match_extensions = false) const
+  {
+    uint32_t node = 0;
+    uint32_t best = _nodes[0].value;
+
+    for (std::string::const_iterator c = number.begin(); c != number.end(); ++c)
+    {
+      node = find_child(node, *c);
+      if (node == NONE)
+      {
+        return (best != NONE) ? &_values[best] : NULL;
+      }
+
+      if (_nodes[node].value != NONE)
+      {
+        best = _nodes[node].value;
+      }
+    }
+
+    // We've used up the whole number.
+    if (match_extensions)
+    {
+      best = _nodes[node].greatest;
+    }
+
+    return (best != NONE) ? &_values[best] : NULL;
+  }
+
+private:
+  static const uint32_t NONE = (uint32_t)-1;
+
+  struct Node
+  {
+    Node(char c = '\0') :
+      c(c),
+      value(NONE),
+      greatest(NONE),
+      first_child(NONE),
+      next_sibling(NONE)
+    {
+    }
+
+    char c;
+
+    // Index into _values of the prefix ending at this node, if any.
+    uint32_t value;
+
+    // Index into _values of the lexicographically greatest prefix ending at
+    // or below this node.
+    uint32_t greatest;
+
+    uint32_t first_child;
+    uint32_t next_sibling;
+  };
+
+  uint32_t find_child(uint32_t node, char c) const
+  {
+    uint32_t child = _nodes[node].first_child;
+    while ((child != NONE) && (_nodes[child].c != c))
+    {
+      child = _nodes[child].next_sibling;
+    }
+    return child;
+  }
+
+  std::vector<Node> _nodes;
+  std::vector<value_type> _values;
+};
+
+#endif
@@ -12,18 +12,45 @@
 #ifndef RALF_PROCESSOR_H_
 #define RALF_PROCESSOR_H_
 
+#include <pthread.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <functional>
+
 #include "threadpool.h"
 #include "sas.h"
 #include "httpconnection.h"
 #include "exception_handler.h"
+#include "snmp_counter_table.h"
 
 class RalfProcessor
 {
 public:
   /// Constructor
+  ///
+  /// @param ralf_connection   - The connection to Ralf.
+  /// @param exception_handler - Exception handler for the Ralf threads.
+  /// @param ralf_threads      - The number of threads to send requests on.
+  /// @param max_batch_size    - The maximum number of requests that a Ralf
+  ///                            thread picks up and sends in one go.
+  /// @param batch_linger_ms   - How long to wait for a batch to fill up
+  ///                            before sending it anyway.  Only used if
+  ///                            max_batch_size is greater than 1.
+  /// @param spool_size        - The maximum number of requests waiting to be
+  ///                            sent.  Once there are this many, further
+  ///                            requests are dropped rather than blocking the
+  ///                            caller.  If 0, the caller blocks while 100
+  ///                            batches are waiting for a thread.
+  /// @param dropped_tbl       - Counts requests that are dropped because the
+  ///                            spool is full.  May be NULL.
   RalfProcessor(HttpConnection* ralf_connection,
                 ExceptionHandler* exception_handler,
-                const int ralf_threads);
+                const int ralf_threads,
+                const int max_batch_size = 1,
+                const int batch_linger_ms = 0,
+                const int spool_size = 0,
+                SNMP::CounterTable* dropped_tbl = NULL);
 
   /// Destructor
   virtual ~RalfProcessor();
@@ -33,6 +60,27 @@ public:
     std::string path;
     std::string message;
     SAS::TrailId trail;
+
+    /// If set, builds the message.  This lets the caller defer encoding the
+    /// message to the Ralf thread that sends it.
+    std::function<std::string()> encoder;
+
+    /// Builds the message using the encoder, if it hasn't been built already.
+    void encode()
+    {
+      if (encoder)
+      {
+        message = encoder();
+        encoder = nullptr;
+      }
+    }
+  };
+
+  /// A batch of Ralf requests that is sent by a single Ralf thread.
+  struct RalfBatch
+  {
+    RalfProcessor* processor;
+    std::vector<RalfRequest*> requests;
   };
 
   /// This function adds a ralf request to the pool. Actually sending
@@ -41,33 +89,37 @@ public:
   /// @param rr         The RalfRequest to add to the queue
   virtual void send_request_to_ralf(RalfRequest* rr);
 
-  static void exception_callback(RalfProcessor::RalfRequest* work)
+  static void exception_callback(RalfProcessor::RalfBatch* batch)
   {
     // No recovery behaviour as this is asynchronous, so we can't sensibly
-    // respond
+    // respond.  Just free up the space the batch was taking in the spool.
+    batch->processor->batch_complete(batch);
   }
 
 private:
   /// @class Pool
   /// The thread pool used by the ralf processor
-  class Pool : public ThreadPool<RalfProcessor::RalfRequest*>
+  class Pool : public ThreadPool<RalfProcessor::RalfBatch*>
   {
   public:
     /// Constructor.
     /// @param ralf_connection    A pointer to the underlying ralf connection.
     /// @param num_threads        Number of ralf threads to start
     /// @param exception_handler  Exception handler
+    /// @param max_queue          Maximum number of batches to queue, or 0 for
+    ///                           no limit
     Pool(HttpConnection* ralf_connection,
          ExceptionHandler* exception_handler,
-         void (*callback)(RalfProcessor::RalfRequest*),
-         unsigned int num_threads);
+         void (*callback)(RalfProcessor::RalfBatch*),
+         unsigned int num_threads,
+         unsigned int max_queue);
 
     /// Destructor
     virtual ~Pool();
 
   private:
     /// Called by worker threads when they pull work off the queue.
-    virtual void process_work(RalfProcessor::RalfRequest*&);
+    virtual void process_work(RalfProcessor::RalfBatch*&);
 
     /// Underlying Ralf connection
     HttpConnection* _ralf_connection;
@@ -75,8 +127,40 @@ private:
 
   friend class Pool;
 
+  /// Frees up the space that a batch was taking in the spool, and deletes the
+  /// batch along with any requests left in it.
+  void batch_complete(RalfBatch* batch);
+
+  /// Sends batches that haven't filled up within the linger time.
+  static void* flush_thread_fn(void* processor);
+  void flush_batches();
+
   ///  Thread pool
   Pool* _thread_pool;
+
+  size_t _max_batch_size;
+  long _batch_linger_ms;
+  size_t _spool_size;
+  SNMP::CounterTable* _dropped_tbl;
+
+  /// Protects the fields below.
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+
+  /// The batch that is being filled up, if any, and when it must be sent (on
+  /// the monotonic clock).
+  RalfBatch* _pending_batch;
+  struct timespec _pending_batch_deadline;
+
+  /// The number of requests that haven't been sent yet.
+  size_t _spooled;
+
+  /// Whether requests are being dropped because the spool is full.
+  bool _dropping;
+
+  bool _terminated;
+  bool _flush_thread_started;
+  pthread_t _flush_thread;
 };
 
 #endif
@@ -145,14 +145,61 @@ private:
                                  bool& matched_dummy_as,
                                  SAS::TrailId trail);
 
-  /// Sends a 3rd party register to an application server
+  /// The parts of a 3rd party register that are the same for every
+  /// application server.  These are worked out once per registration, and
+  /// then used to build the register for each application server.
+  struct ThirdPartyRegisterTemplate
+  {
+    /// Whether the registers contain information from the received register
+    /// and its response.  If not, the fields below are unused.
+    bool include_register_info;
+
+    /// Headers to copy from the received register and its response, in the
+    /// order to add them.
+    std::vector<pjsip_hdr*> headers;
+
+    /// The printed received register and response, for application servers
+    /// that want them in the body.  Only filled in if there is an application
+    /// server that wants them.
+    std::string register_request;
+    std::string register_response;
+  };
+
+  /// Builds the template for the 3rd party registers to a set of application
+  /// servers
   ///
   /// @param[in]  received_register_message
-  ///                           The received register message. This may be
-  ///                           included in the body of 3rd party registers
+  ///                           The received register message, or NULL if this
+  ///                           is a network-initiated deregistration
   /// @param[in]  ok_response_msg
-  ///                           The response to the REGISTER message. This may
-  ///                           be included in the body of 3rd party registers
+  ///                           The response to the REGISTER message, or NULL
+  /// @param[in]  application_servers
+  ///                           The application servers to send registers to
+  /// @param[out] reg_template  The template
+  void build_register_template(pjsip_msg* received_register_msg,
+                               pjsip_msg* ok_response_msg,
+                               const std::vector<AsInvocation>& application_servers,
+                               ThirdPartyRegisterTemplate& reg_template);
+
+  /// Builds a 3rd party register to an application server from the template
+  ///
+  /// @param[in]  reg_template  The template for the registers
+  /// @param[in]  served_user   The IMPU we are sending 3rd party registers for
+  /// @param[in]  as            The application server we are sending a 3rd
+  ///                           party register to
+  /// @param[in]  expires       The expiry of the received register
+  /// @param[in]  trail         The SAS trail ID
+  ///
+  /// @return                   The register, or NULL if it couldn't be built
+  pjsip_tx_data* build_register_to_as(const ThirdPartyRegisterTemplate& reg_template,
+                                      const std::string& served_user,
+                                      const AsInvocation& as,
+                                      int expires,
+                                      SAS::TrailId trail);
+
+  /// Sends a 3rd party register to an application server
+  ///
+  /// @param[in]  tdata         The register to send
   /// @param[in]  served_user   The IMPU we are sending 3rd party registers for
   /// @param[in]  as            The application server we are sending a 3rd
   ///                           party register to
@@ -161,15 +208,13 @@ private:
   ///                           Whether or not the received register is an
   ///                           initial registration
   /// @param[in]  trail         The SAS trail ID
-  void send_register_to_as(pjsip_msg* received_register_msg,
-                           pjsip_msg* ok_response_msg,
+  void send_register_to_as(pjsip_tx_data* tdata,
                            const std::string& served_user,
                            const AsInvocation& as,
                            int expires,
                            bool is_initial_registration,
                            SAS::TrailId trail);
 
-
   /// Builds a PJSIP callback for when the 3rd party register completes
   ///
   /// @param[in]  token         Token containing the stored ThirdPartyRegData
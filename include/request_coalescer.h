@@ -0,0 +1,266 @@
+/**
+ * @file request_coalescer.h  Shares the results of identical concurrent
+ * requests.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef REQUEST_COALESCER_H__
+#define REQUEST_COALESCER_H__
+
+#include <pthread.h>
+#include <time.h>
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+
+#include "log.h"
+#include "utils.h"
+#include "sas.h"
+#include "sproutsasevent.h"
+#include "httpconnection.h"
+#include "snmp_counter_table.h"
+
+/// Makes sure that only one of a set of identical requests is in flight at a
+/// time.  A thread that makes a request while an identical one (with the same
+/// key) is in flight waits for that request to complete and is given a copy of
+/// its result, rather than making the request itself.
+///
+/// Waiting for an in-flight request counts as IO for the waiting thread, and
+/// the waiter's SAS trail is associated with the trail of the request it waits
+/// for.
+///
+/// A thread only waits for an in-flight request for a limited time, in case
+/// the thread making it has died.  After this, the request is treated as
+/// abandoned and the next thread to make it sends it again.
+///
+/// The Result type must be copyable, and a copy must be safe to use on a
+/// different thread to the original.
+template <class Result>
+class RequestCoalescer
+{
+public:
+  /// Sends a request, filling in the result.
+  typedef std::function<HTTPCode(Result&)> Request;
+
+  /// Constructor.
+  ///
+  /// @param max_wait_ms   - How long a request can be in flight before it is
+  ///                        treated as abandoned.
+  /// @param coalesced_tbl - Counts requests that were satisfied by another
+  ///                        thread's request.  May be NULL.
+  RequestCoalescer(long max_wait_ms,
+                   SNMP::CounterTable* coalesced_tbl = NULL) :
+    _max_wait_ms(max_wait_ms),
+    _coalesced_tbl(coalesced_tbl)
+  {
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, &cond_attr);
+
+    pthread_condattr_destroy(&cond_attr);
+  }
+
+  ~RequestCoalescer()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Sends a request, unless an identical request is already in flight, in
+  /// which case waits for that request and copies its result.
+  ///
+  /// @param key     - Identifies the request.  Requests with the same key
+  ///                  must have the same result.
+  /// @param result  - Filled in with the result of the request.
+  /// @param request - Sends the request.  This is only called if there is no
+  ///                  identical request in flight.
+  /// @param trail   - The SAS trail the request is made on.
+  /// @return        - The HTTP code of the request.
+  HTTPCode send(const std::string& key,
+                Result& result,
+                const Request& request,
+                SAS::TrailId trail)
+  {
+    pthread_mutex_lock(&_lock);
+
+    std::shared_ptr<InFlightRequest> in_flight;
+
+    while (true)
+    {
+      typename std::unordered_map<std::string,
+                                  std::shared_ptr<InFlightRequest>>::iterator it =
+                                                           _in_flight.find(key);
+      if ((it == _in_flight.end()) ||
+          (timespec_ms_until(it->second->deadline) <= 0))
+      {
+        // There is no request in flight, or there is but it has been
+        // abandoned, so send the request.
+        break;
+      }
+
+      in_flight = it->second;
+      in_flight->waiters++;
+
+      // Link this trail to the one the request is being made on, so that the
+      // request and its response can be found from either.
+      SAS::Event event(trail, SASEvent::HTTP_HOMESTEAD_COALESCED, 0);
+      event.add_var_param(key);
+      SAS::report_event(event);
+      SAS::associate_trails(trail, in_flight->trail);
+
+      CW_IO_STARTS("Coalesced request for " + key)
+      {
+        while ((!in_flight->complete) &&
+               (pthread_cond_timedwait(&_cond,
+                                       &_lock,
+                                       &in_flight->deadline) == 0))
+        {
+        }
+      }
+      CW_IO_COMPLETES()
+
+      in_flight->waiters--;
+
+      if (in_flight->complete)
+      {
+        HTTPCode rc = in_flight->rc;
+        result = in_flight->result;
+        pthread_mutex_unlock(&_lock);
+
+        TRC_DEBUG("Used result of in-flight request for %s", key.c_str());
+        if (_coalesced_tbl)
+        {
+          _coalesced_tbl->increment();
+        }
+
+        return rc;
+      }
+
+      TRC_DEBUG("Request for %s has not completed in %ldms - sending it again",
+                key.c_str(), _max_wait_ms);
+    }
+
+    in_flight = std::make_shared<InFlightRequest>();
+    in_flight->trail = trail;
+    clock_gettime(CLOCK_MONOTONIC, &in_flight->deadline);
+    in_flight->deadline.tv_sec += _max_wait_ms / 1000;
+    in_flight->deadline.tv_nsec += (_max_wait_ms % 1000) * 1000000L;
+    if (in_flight->deadline.tv_nsec >= 1000000000L)
+    {
+      in_flight->deadline.tv_sec += 1;
+      in_flight->deadline.tv_nsec -= 1000000000L;
+    }
+    _in_flight[key] = in_flight;
+
+    pthread_mutex_unlock(&_lock);
+
+    HTTPCode rc;
+
+    try
+    {
+      rc = request(result);
+    }
+    catch (...)
+    {
+      // Make sure that the waiting threads don't wait for a request that is
+      // never going to complete.
+      complete(key, in_flight, HTTP_SERVER_ERROR, Result());
+      throw;
+    }
+
+    complete(key, in_flight, rc, result);
+
+    return rc;
+  }
+
+private:
+  /// A request that is in flight.
+  struct InFlightRequest
+  {
+    InFlightRequest() :
+      complete(false),
+      rc(HTTP_SERVER_ERROR),
+      result(),
+      waiters(0),
+      trail(0),
+      deadline()
+    {
+    }
+
+    // Whether the request has completed, and if so its results.
+    bool complete;
+    HTTPCode rc;
+    Result result;
+
+    // The number of threads waiting for the request.
+    int waiters;
+
+    // The SAS trail the request is being made on.
+    SAS::TrailId trail;
+
+    // The time (on the monotonic clock) after which the request is treated as
+    // abandoned.
+    struct timespec deadline;
+  };
+
+  /// Saves off the result of a request and wakes up any threads waiting for
+  /// it.
+  void complete(const std::string& key,
+                const std::shared_ptr<InFlightRequest>& in_flight,
+                HTTPCode rc,
+                const Result& result)
+  {
+    pthread_mutex_lock(&_lock);
+
+    in_flight->complete = true;
+    in_flight->rc = rc;
+
+    if (in_flight->waiters > 0)
+    {
+      TRC_DEBUG("Sharing result of request for %s with %d waiting requests",
+                key.c_str(), in_flight->waiters);
+      in_flight->result = result;
+      pthread_cond_broadcast(&_cond);
+    }
+
+    // The request may have been treated as abandoned and replaced by another
+    // one, in which case leave that one in place.
+    typename std::unordered_map<std::string,
+                                std::shared_ptr<InFlightRequest>>::iterator it =
+                                                           _in_flight.find(key);
+    if ((it != _in_flight.end()) && (it->second == in_flight))
+    {
+      _in_flight.erase(it);
+    }
+
+    pthread_mutex_unlock(&_lock);
+  }
+
+  /// Returns the number of milliseconds until the time on the monotonic clock.
+  static long timespec_ms_until(const struct timespec& ts)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((ts.tv_sec - now.tv_sec) * 1000) +
+           ((ts.tv_nsec - now.tv_nsec) / 1000000);
+  }
+
+  const long _max_wait_ms;
+  SNMP::CounterTable* _coalesced_tbl;
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  std::unordered_map<std::string, std::shared_ptr<InFlightRequest>> _in_flight;
+};
+
+#endif
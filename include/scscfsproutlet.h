@@ -196,6 +196,17 @@ private:
                              pj_pool_t* pool,
                              SAS::TrailId trail);
 
+  /// Update the RequestURI with the result of an asynchronous ENUM lookup.
+  ///
+  /// @param req         - The request containing the RequestURI.
+  /// @param pool        - The pool correspnding to the request.
+  /// @param new_uri_str - The translated URI, or empty if the lookup failed.
+  /// @param trail       - The SAS trail ID.
+  void apply_enum_translation(pjsip_msg* req,
+                              pj_pool_t* pool,
+                              const std::string& new_uri_str,
+                              SAS::TrailId trail);
+
   /// Get an ACR instance from the factory.
   ///
   /// @param trail      - The SAS trail ID.
@@ -338,6 +349,10 @@ private:
   /// Apply originating services for this request.
   void apply_originating_services(pjsip_msg* req);
 
+  /// Routes a request at the end of originating processing, once any ENUM
+  /// translation has been done.
+  void route_translated_request(pjsip_msg* req);
+
   /// Apply terminating services for this request.
   void apply_terminating_services(pjsip_msg* req);
 
@@ -40,7 +40,8 @@ public:
   /// Updates the shared iFC sets
   void update_sets();
 
-  /// Get the iFCs that belong to a set of IDs
+  /// Get the iFCs that belong to a set of IDs.  The iFCs share the parsed
+  // shared iFC configuration, so don't use ifc_doc.
   virtual void get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
                                 const std::set<int32_t>& id,
                                 std::shared_ptr<xml_document<> > ifc_doc,
@@ -49,7 +50,10 @@ public:
 private:
   Alarm* _alarm;
   SNMP::CounterTable* _no_shared_ifcs_set_tbl;
-  std::map<int32_t, std::vector<std::pair<int32_t, std::string>>> _shared_ifc_sets;
+  // The shared iFC sets, keyed by set ID, as lists of iFCs with their
+  // priorities.  Each iFC shares ownership of the parsed configuration
+  // document, so iFCs handed out remain valid when the sets are reloaded.
+  std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>> _shared_ifc_sets;
   std::string _configuration;
   Updater<void, SIFCService>* _updater;
 
@@ -0,0 +1,78 @@
+/**
+ * @file simservs_cache.h  Local cache of parsed simservs documents.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SIMSERVS_CACHE_H__
+#define SIMSERVS_CACHE_H__
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+
+#include "simservs.h"
+#include "snmp_counter_table.h"
+#include "ttl_cache.h"
+
+/// A size-bounded LRU cache of the parsed simservs documents retrieved from
+/// the XDMS (Homer), keyed by IMPU.
+///
+/// Entries expire after a fixed TTL.  They can also be invalidated explicitly
+/// when a subscriber's simservs document changes.  Invalidation is local to
+/// this node.
+class SimservsCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param max_size        - The maximum number of entries to hold.
+  /// @param ttl_s           - How long an entry remains valid, in seconds.
+  /// @param hit_tbl         - Counts lookups that found a valid entry.
+  /// @param miss_tbl        - Counts lookups that didn't.
+  /// @param eviction_tbl    - Counts entries evicted to make room for new
+  ///                          ones.
+  SimservsCache(size_t max_size,
+                int ttl_s,
+                SNMP::CounterTable* hit_tbl = NULL,
+                SNMP::CounterTable* miss_tbl = NULL,
+                SNMP::CounterTable* eviction_tbl = NULL);
+  virtual ~SimservsCache();
+
+  /// Looks up the simservs for an IMPU.
+  ///
+  /// @return The cached simservs, or NULL if there is no valid entry.  The
+  ///         simservs must not be modified, as it is shared with the cache.
+  std::shared_ptr<const simservs> get(const std::string& public_id);
+
+  /// Returns a token to be passed to put() for a document that is about to be
+  /// fetched from the XDMS.  This must be called before the fetch starts.
+  uint64_t generation();
+
+  /// Stores the simservs parsed from the document fetched for an IMPU.  The
+  /// simservs is discarded if the IMPU has been invalidated since
+  /// generation() returned the given token, as it might predate it.
+  void put(const std::string& public_id,
+           const std::shared_ptr<const simservs>& user_services,
+           uint64_t generation);
+
+  /// Invalidates the entry for an IMPU.
+  void invalidate(const std::string& public_id);
+
+  /// The number of entries in the cache (including expired entries that have
+  /// not yet been removed).  Used for testing.
+  size_t size();
+
+private:
+  SNMP::CounterTable* _hit_tbl;
+  SNMP::CounterTable* _miss_tbl;
+
+  TtlCache<std::shared_ptr<const simservs>> _cache;
+};
+
+#endif
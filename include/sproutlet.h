@@ -20,6 +20,7 @@ extern "C" {
 }
 
 #include <list>
+#include <functional>
 #include "baseresolver.h"
 #include "snmp_success_fail_count_by_request_type_table.h"
 #include "fork_error_state.h"
@@ -35,6 +36,7 @@ class SproutletProxy;
 
 /// Typedefs for Sproutlet-specific types
 typedef intptr_t TimerID;
+typedef std::function<void(std::function<void()>)> ResumeFn;
 
 struct ForkState
 {
@@ -365,6 +367,24 @@ public:
   ///
   virtual bool timer_running(TimerID id) = 0;
 
+  /// Suspends processing of the transaction while the Sproutlet waits for an
+  /// asynchronous operation (such as a DNS query) to complete, so that it
+  /// doesn't block a worker thread.  The transaction is kept alive until the
+  /// returned function is called or destroyed.
+  ///
+  /// @returns             - A function that should be called once, on
+  ///                        any thread, when the operation completes.  It
+  ///                        queues the function passed to it to run on a
+  ///                        worker thread in the context of the transaction,
+  ///                        as if it were a timer expiring.  The function is
+  ///                        not run if the transaction has been terminated in
+  ///                        the meantime.  If the function is destroyed
+  ///                        without being called, the suspension is
+  ///                        released, and the request is rejected with a 500
+  ///                        if nothing else is left to complete it.
+  ///
+  virtual ResumeFn suspend() = 0;
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
@@ -726,6 +746,17 @@ protected:
   bool timer_running(TimerID id)
     {return _helper->timer_running(id);}
 
+  /// Suspends processing of the transaction while waiting for an
+  /// asynchronous operation to complete.
+  ///
+  /// @returns             - A function that should be called once when
+  ///                        the operation completes, and which runs the
+  ///                        function passed to it on a worker thread in the
+  ///                        context of the transaction.
+  ///
+  ResumeFn suspend()
+    {return _helper->suspend();}
+
   /// Returns the SAS trail identifier that should be used for any SAS events
   /// related to this service invocation.
   ///
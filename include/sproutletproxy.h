@@ -16,8 +16,13 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <list>
+#include <deque>
+#include <queue>
+#include <vector>
 
+#include "arena.h"
 #include "basicproxy.h"
+#include "flat_map.h"
 #include "pjutils.h"
 #include "sproutlet.h"
 #include "snmp_counter_table.h"
@@ -354,6 +359,7 @@ protected:
     bool schedule_timer(SproutletWrapper* tsx, void* context, TimerID& id, int duration);
     bool cancel_timer(TimerID id);
     bool timer_running(TimerID id);
+    ResumeFn suspend(SproutletWrapper* tsx);
 
     void tx_response(SproutletWrapper* sproutlet,
                      pjsip_tx_data* rsp);
@@ -431,13 +437,23 @@ protected:
     /// The root Sproutlet for this transaction.
     SproutletWrapper* _root;
 
+    /// Arena from which the bookkeeping containers below are allocated, so
+    /// that tracking the transaction's forks and timers doesn't need a heap
+    /// allocation per entry.  This must be declared before the containers
+    /// that use it.
+    Arena _arena;
+
     /// Templated type used to map from upstream Sproutlet/fork to the
     /// downstream Sproutlet or UACTsx.
     template<typename T>
     struct DMap
     {
-      typedef std::map<std::pair<SproutletWrapper*, int>, T> type;
-      typedef typename std::map<std::pair<SproutletWrapper*, int>, T>::iterator iterator;
+      typedef std::pair<SproutletWrapper*, int> key;
+      typedef std::map<key,
+                       T,
+                       std::less<key>,
+                       ArenaAllocator<std::pair<const key, T> > > type;
+      typedef typename type::iterator iterator;
     };
 
     /// Mapping from upstream Sproutlet/fork to downstream Sproutlet.
@@ -448,7 +464,11 @@ protected:
 
     /// Mapping from downstream Sproutlet or UAC transaction to upstream
     /// Sproutlet/fork.
-    typedef std::map<void*, std::pair<SproutletWrapper*, int> > UMap;
+    typedef std::map<void*,
+                     std::pair<SproutletWrapper*, int>,
+                     std::less<void*>,
+                     ArenaAllocator<std::pair<void* const,
+                                              std::pair<SproutletWrapper*, int> > > > UMap;
     UMap _umap;
 
     /// Queue of pending requests to be scheduled.
@@ -460,7 +480,8 @@ protected:
       int sproutlet_depth;
       std::string upstream_network_func;
     } PendingRequest;
-    std::queue<PendingRequest> _pending_req_q;
+    typedef std::deque<PendingRequest, ArenaAllocator<PendingRequest> > PendingRequestDeque;
+    std::queue<PendingRequest, PendingRequestDeque> _pending_req_q;
 
     /// Parent proxy object
     SproutletProxy* _sproutlet_proxy;
@@ -470,12 +491,15 @@ protected:
     /// (they are not freed when a timer pops or is cancelled for example).
     /// This prevents race conditions (such as a double free caused by one
     /// thread popping a timer and another thread cancelling it).
-    std::set<pj_timer_entry*> _timers;
+    typedef std::set<pj_timer_entry*,
+                     std::less<pj_timer_entry*>,
+                     ArenaAllocator<pj_timer_entry*> > TimerSet;
+    TimerSet _timers;
 
     /// This set holds all the timers created by sproutlet tsx that are
     /// children of this UASTsx that have not popped or been cancelled yet.
     /// The UASTsx will persist while there are pending timers.
-    std::set<pj_timer_entry*> _pending_timers;
+    TimerSet _pending_timers;
 
     /// Count of the number of UASTsx objects currently active. Used for
     /// debugging purposes.
@@ -495,6 +519,20 @@ protected:
 
   std::map<int, Sproutlet*> _ports;
 
+  /// Routing tables used to select sproutlets on the request path.  The
+  /// service table is keyed on the names held in _services and the host table
+  /// on the root URI and the alias sets, so neither copies the strings.  The
+  /// port table is indexed directly by port number.
+  std::unordered_map<pj_str_t,
+                     Sproutlet*,
+                     PJUtils::PjStrHash,
+                     PJUtils::PjStrEqual> _service_table;
+  std::unordered_map<pj_str_t,
+                     AliasMatchLocality,
+                     PJUtils::PjStrCaseHash,
+                     PJUtils::PjStrCaseEqual> _host_table;
+  std::vector<Sproutlet*> _port_table;
+
   std::list<Sproutlet*> _sproutlets;
 
   static const pj_str_t STR_SERVICE;
@@ -557,6 +595,7 @@ public:
   bool schedule_timer(void* context, TimerID& id, int duration);
   void cancel_timer(TimerID id);
   bool timer_running(TimerID id);
+  ResumeFn suspend();
   SAS::TrailId trail() const;
   bool is_uri_reflexive(const pjsip_uri*) const;
   pjsip_sip_uri* get_reflexive_uri(pj_pool_t*) const;
@@ -581,6 +620,7 @@ private:
   void rx_error(int status_code, const std::string& reason);
   void rx_fork_error(ForkErrorState fork_error, int fork_id);
   void on_timer_pop(TimerID id, void* context);
+  void on_resume(const std::function<void()>& fn);
   void register_tdata(pjsip_tx_data* tdata);
   void deregister_tdata(pjsip_tx_data* tdata);
 
@@ -594,6 +634,8 @@ private:
   int compare_sip_sc(int sc1, int sc2);
   bool is_uri_local(const pjsip_uri*) const;
   void log_inter_sproutlet(pjsip_tx_data* tdata, bool downstream);
+  std::string inter_sproutlet_description(pjsip_tx_data* tdata,
+                                          bool downstream);
   ForkErrorState get_error_state() const;
 
   SproutletProxy* _proxy;
@@ -632,10 +674,13 @@ private:
   // The depth of this wrapper in the transaction tree.  Used to detect loops.
   int _depth;
 
-  typedef std::unordered_map<const pjsip_msg*, pjsip_tx_data*> Packets;
+  // A Sproutlet only ever has a handful of messages, sends and timers
+  // outstanding, so these are held in flat containers rather than node-based
+  // ones.
+  typedef FlatMap<const pjsip_msg*, pjsip_tx_data*> Packets;
   Packets _packets;
 
-  typedef std::map<int, SproutletProxy::SendRequest> Requests;
+  typedef FlatMap<int, SproutletProxy::SendRequest> Requests;
   Requests _send_requests;
 
   typedef std::list<pjsip_tx_data*> Responses;
@@ -672,7 +717,12 @@ private:
   /// Set keeping track of pending timers for this SproutletWrapper.  The
   /// SproutletWrapper (and the SproutletTsx it wraps) won't be deleted
   /// until all these timers have popped or been cancelled.
-  std::set<TimerID> _pending_timers;
+  FlatSet<TimerID> _pending_timers;
+
+  /// The number of times the Sproutlet has suspended processing and not yet
+  /// been resumed.  As for timers, the SproutletWrapper won't be deleted
+  /// while this is non-zero.
+  int _pending_resumes;
 
   // The allowed host state for outbound requests from the sproutlet wrapped by
   // this wrapper.  If there are no addresses of the appropriate state (e.g.
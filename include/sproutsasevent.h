@@ -134,6 +134,7 @@ namespace SASEvent
   const int HTTP_HOMESTEAD_AUTH_STATUS = SPROUT_BASE + 0x0000A4;
   const int HTTP_HOMESTEAD_LOCATION = SPROUT_BASE + 0x0000A5;
   const int HTTP_HOMESTEAD_BAD_IDENTITY = SPROUT_BASE + 0x0000A6;
+  const int HTTP_HOMESTEAD_COALESCED = SPROUT_BASE + 0x0000A7;
 
   const int INVALID_IFC_IGNORED = SPROUT_BASE + 0x0000C0;
   const int INVALID_XML_IGNORED = SPROUT_BASE + 0x0000C1;
@@ -17,8 +17,10 @@ extern "C" {
 #include <pjsip.h>
 }
 
+#include <algorithm>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 #include "sas.h"
 #include "quiescing_manager.h"
@@ -28,6 +30,13 @@ extern "C" {
 /* Pre-declariations */
 class LastValueCache;
 
+// The number of pool factories that PJSIP group locks are allocated from.
+const int GRP_LOCK_POOL_SHARDS = 8;
+
+// The total size of released pools that each group lock pool factory keeps
+// for reuse.
+const pj_size_t GRP_LOCK_POOL_CACHE_CAPACITY = 1024 * 1024;
+
 /* Options */
 struct stack_data_struct
 {
@@ -35,8 +44,11 @@ struct stack_data_struct
 
   pj_caching_pool      cp;
   pj_pool_t           *pool;
+  pj_caching_pool      grp_lock_cp[GRP_LOCK_POOL_SHARDS];
+  pj_pool_t           *grp_lock_pool[GRP_LOCK_POOL_SHARDS];
   pjsip_endpoint      *endpt;
-  pj_thread_t         *pjsip_transport_thread;
+  std::vector<pj_thread_t*> pjsip_transport_threads;
+  int                  num_pjsip_threads;
   int                  pcscf_untrusted_port;
   pjsip_tpfactory     *pcscf_untrusted_tcp_factory;
   int                  pcscf_trusted_port;
@@ -78,20 +90,27 @@ struct stack_data_struct
 
 extern struct stack_data_struct stack_data;
 
+// The total size of released pools that the PJSIP pool factory keeps for
+// reuse.
+const pj_size_t PJSIP_POOL_CACHE_CAPACITY = 32 * 1024 * 1024;
+
 inline bool is_pjsip_transport_thread()
 {
 #ifdef UNIT_TEST
   // This check doesn't make sense in UT, where we use a different threading model
   return true;
 #else
-  return (pj_thread_this() == stack_data.pjsip_transport_thread);
+  pj_thread_t* this_thread = pj_thread_this();
+  return (std::find(stack_data.pjsip_transport_threads.begin(),
+                    stack_data.pjsip_transport_threads.end(),
+                    this_thread) != stack_data.pjsip_transport_threads.end());
 #endif
 }
 
 #define CHECK_PJ_TRANSPORT_THREAD() \
   if (!is_pjsip_transport_thread()) \
   { \
-    TRC_ERROR("Function expected to be called on PJSIP transport thread (%s) has been called on different thread (%s)", pj_thread_get_name(stack_data.pjsip_transport_thread), pj_thread_get_name(pj_thread_this())); \
+    TRC_ERROR("Function expected to be called on a PJSIP transport thread has been called on different thread (%s)", pj_thread_get_name(pj_thread_this())); \
   };
 
 inline void set_trail(pjsip_rx_data* rdata, SAS::TrailId trail)
@@ -153,13 +172,15 @@ extern pj_status_t init_stack(int pcscf_trusted_port,
                               QuiescingManager *quiescing_mgr,
                               const std::string& cdf_domain,
                               std::vector<std::string> sproutlet_uris,
-                              bool enable_orig_sip_to_tel_coerce);
+                              bool enable_orig_sip_to_tel_coerce,
+                              int num_pjsip_threads = 1);
 extern pj_status_t start_pjsip_thread();
 extern pj_status_t stop_pjsip_thread();
 extern void stop_stack();
 extern void destroy_stack();
 extern pj_status_t init_pjsip();
 extern void term_pjsip();
+extern pj_status_t create_grp_lock(pj_grp_lock_t** p_lock);
 
 extern const std::string* known_statnames;
 extern const int num_known_stats;
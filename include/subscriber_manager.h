@@ -102,6 +102,9 @@ public:
   ///                           It is the responsibility of the clients for free
   ///                           these bindings
   /// @param[out] irs_info      The IRS information from the HSS.
+  /// @param[in]  orig_aor      The AoR returned by get_bindings for this
+  ///                           request, or NULL to read it from the store.
+  ///                           SM takes ownership of this AoR
   /// @param[in]  trail         The SAS trail ID
   virtual HTTPCode reregister_subscriber(const std::string& aor_id,
                                          const std::string& server_name,
@@ -110,6 +113,7 @@ public:
                                          const std::vector<std::string>& binding_ids_to_remove,
                                          Bindings& all_bindings,
                                          HSSConnection::irs_info& irs_info,
+                                         AoR* orig_aor,
                                          SAS::TrailId trail);
 
   /// Removes bindings stored in SM for a given public ID.
@@ -176,6 +180,19 @@ public:
                                 Bindings& bindings,
                                 SAS::TrailId trail);
 
+  /// As above, but also passes out the AoR that the bindings were read from,
+  /// so that the caller can pass it on to reregister_subscriber rather than
+  /// the AoR being read again.
+  ///
+  /// @param[out] aor           The AoR read from the store, or NULL if the
+  ///                           lookup failed. It is the responsibility of the
+  ///                           client to free this AoR (or to pass it to
+  ///                           reregister_subscriber)
+  virtual HTTPCode get_bindings(const std::string& aor_id,
+                                Bindings& bindings,
+                                AoR** aor,
+                                SAS::TrailId trail);
+
   /// Gets all subscriptions stored for a given AoR ID. If there are any expired
   /// subscriptions, these are not returned.
   ///
@@ -213,6 +230,13 @@ public:
                                         HSSConnection::irs_info& irs_info,
                                         SAS::TrailId trail);
 
+  /// Discards any locally cached HSS subscriber state for a public ID and the
+  /// rest of its implicit registration set, so that the next lookup goes to
+  /// Homestead.
+  ///
+  /// @param[in]  public_id     The public ID whose state has changed
+  virtual void invalidate_cached_subscriber_state(const std::string& public_id);
+
   /// Update the associated URIs stored in an AoR.
   ///
   /// @param[in]  aor_id        The AoR ID to lookup in the store. It is the
@@ -282,6 +306,7 @@ private:
                                           const std::vector<std::string>& binding_ids_to_remove,
                                           Bindings& all_bindings,
                                           HSSConnection::irs_info& irs_info,
+                                          AoR* orig_aor,
                                           bool retry,
                                           SAS::TrailId trail);
   HTTPCode modify_subscriptions(const std::string& public_id,
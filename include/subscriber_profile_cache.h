@@ -0,0 +1,140 @@
+/**
+ * @file subscriber_profile_cache.h  Local cache of subscriber profiles
+ * retrieved from Homestead.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef SUBSCRIBER_PROFILE_CACHE_H__
+#define SUBSCRIBER_PROFILE_CACHE_H__
+
+#include <stdint.h>
+#include <string>
+
+#include "hssconnection.h"
+#include "snmp_counter_table.h"
+#include "ttl_cache.h"
+
+/// A size-bounded LRU cache of the parsed registration data (iFCs, associated
+/// URIs, aliases and charging addresses) returned by Homestead, keyed by IMPU.
+///
+/// Entries expire after a fixed TTL.  They are also invalidated when this node
+/// learns that the subscriber's data has changed - that is, on any
+/// registration state change it makes itself, and on Push-Profile,
+/// Registration-Termination and administrative deregistration requests.
+/// Invalidating an IMPU invalidates all the cached entries for the IMPUs in
+/// the same implicit registration set.
+///
+/// The cache can also remember that an IMPU was registered with Homestead, so
+/// that refreshes of the registration can be served from the cache (rather
+/// than sending Homestead another registration request) until the
+/// registration refresh interval has passed.
+class SubscriberProfileCache
+{
+public:
+  /// Constructor.
+  ///
+  /// @param max_size        - The maximum number of entries to hold.
+  /// @param ttl_s           - How long an entry remains valid, in seconds.
+  /// @param reg_refresh_s   - How long after a registration is sent to
+  ///                          Homestead that refreshes of it can be served
+  ///                          from the cache, in seconds.  0 means that they
+  ///                          are never served from the cache.
+  /// @param hit_tbl         - Counts lookups that found a valid entry.
+  /// @param miss_tbl        - Counts lookups that didn't.
+  /// @param eviction_tbl    - Counts entries evicted to make room for new
+  ///                          ones.
+  SubscriberProfileCache(size_t max_size,
+                         int ttl_s,
+                         int reg_refresh_s = 0,
+                         SNMP::CounterTable* hit_tbl = NULL,
+                         SNMP::CounterTable* miss_tbl = NULL,
+                         SNMP::CounterTable* eviction_tbl = NULL);
+  virtual ~SubscriberProfileCache();
+
+  /// Looks up the registration data for an IMPU.
+  ///
+  /// @return true if a valid entry was found, in which case irs_info is
+  ///         filled in from it.
+  bool get(const std::string& public_id, HSSConnection::irs_info& irs_info);
+
+  /// Returns a token to be passed to put() for data that is about to be
+  /// fetched from Homestead.  This must be called before the fetch starts.
+  uint64_t generation();
+
+  /// Stores the registration data fetched from Homestead for an IMPU.  The
+  /// data is discarded if the IMPU or any other member of its implicit
+  /// registration set has been invalidated since generation() returned the
+  /// given token, as the data might predate it.
+  void put(const std::string& public_id,
+           const HSSConnection::irs_info& irs_info,
+           uint64_t generation);
+
+  /// Looks up the registration data for a refresh of an IMPU's registration.
+  ///
+  /// @return true if the IMPU was registered with Homestead (by the given
+  ///         private ID, if one is given) within the registration refresh
+  ///         interval, and nothing has been invalidated since.  irs_info is
+  ///         filled in from the cached entry.
+  bool get_registration(const std::string& public_id,
+                        const std::string& private_id,
+                        HSSConnection::irs_info& irs_info);
+
+  /// Stores the registration data returned by Homestead for a registration
+  /// of an IMPU.  This replaces any cached entries for the implicit
+  /// registration set, as for invalidate().  The data is only stored if no
+  /// member of the implicit registration set has been invalidated since
+  /// generation() returned the given token.
+  void put_registration(const std::string& public_id,
+                        const std::string& private_id,
+                        const HSSConnection::irs_info& irs_info,
+                        uint64_t generation);
+
+  /// Invalidates the entries for an IMPU and the rest of its implicit
+  /// registration set.
+  void invalidate(const std::string& public_id);
+
+  /// The number of entries in the cache (including expired entries that have
+  /// not yet been removed).  Used for testing.
+  size_t size();
+
+private:
+  struct Profile
+  {
+    HSSConnection::irs_info irs_info;
+
+    // When the profile can no longer be used, other than for registration
+    // refreshes.
+    uint64_t expiry_ms;
+
+    // If the IMPU was registered with Homestead, the private ID it was
+    // registered by and when refreshes must next be sent to Homestead.
+    // reg_expiry_ms is 0 otherwise.
+    std::string reg_private_id;
+    uint64_t reg_expiry_ms;
+  };
+
+  // Keeps track of the registration when the profile for a registered IMPU
+  // is replaced.  Returns true if there was a registration to keep.
+  static bool keep_registration(Profile& profile, const Profile& old_profile);
+
+  static uint64_t current_time_ms();
+
+  const uint64_t _ttl_ms;
+  const uint64_t _reg_refresh_ms;
+
+  SNMP::CounterTable* _hit_tbl;
+  SNMP::CounterTable* _miss_tbl;
+
+  // The profiles, indexed by IMPU and grouped by implicit registration set.
+  // Entries for registrations are kept for the longer of the TTL and the
+  // registration refresh interval.
+  TtlCache<Profile> _cache;
+};
+
+#endif
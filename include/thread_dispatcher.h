@@ -28,6 +28,11 @@ extern "C" {
 #include "sip_event_priority.h"
 #include "eventq.h"
 
+#include <atomic>
+#include <queue>
+#include <vector>
+#include <pthread.h>
+
 pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    SNMP::EventAccumulatorByScopeTable* latency_tbl_arg,
                                    SNMP::EventAccumulatorByScopeTable* queue_size_tbl_arg,
@@ -36,7 +41,8 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    LoadMonitor* load_monitor_arg,
                                    RPHService* rph_service_arg,
                                    ExceptionHandler* exception_handler_arg,
-                                   unsigned long request_on_queue_timeout);
+                                   unsigned long request_on_queue_timeout,
+                                   int num_worker_queue_shards_arg = 0);
 
 void unregister_thread_dispatcher(void);
 
@@ -73,6 +79,10 @@ struct SipEvent
 
   // Compares two SipEvents. Returns true if rhs is 'larger' than lhs, where
   // 'larger' SipEvents are those that should be processed earlier.
+  //
+  // This reads both stop watches, so is too expensive to use for ordering a
+  // queue - PriorityEventQueueBackend implements the same ordering using
+  // start times cached when the events are queued.
   static bool compare(SipEvent lhs, SipEvent rhs)
   {
     if (lhs.priority != rhs.priority)
@@ -105,22 +115,28 @@ struct SipEvent
 // element is added to the queue or the queue is terminated.
 // Returns true if an element was processed, and false if the queue was
 // terminated.
-bool process_queue_element();
+//
+// If the dispatcher is using sharded queues, the worker index determines
+// which shard the element is preferentially taken from.
+bool process_queue_element(unsigned int worker_index = 0);
 
 // Add a Callback object to the queue, to be run on a worker thread.
 void add_callback_to_queue(PJUtils::Callback*);
 
-// Implements eventq::Backend as a std::priority_queue of SipEvent structs.
+// Implements eventq::Backend as a heap of SipEvent structs. Events are ordered
+// by priority, then by the time their stop watch was started, then by the
+// order they were queued. The start time is worked out once when the event is
+// pushed, so comparing events on the heap never needs to read the clock.
 class PriorityEventQueueBackend : public eventq<SipEvent>::Backend
 {
 public:
 
-  PriorityEventQueueBackend() : _queue(SipEvent::compare) {}
+  PriorityEventQueueBackend() : _queue(), _next_seq(0) {}
   virtual ~PriorityEventQueueBackend() {}
 
   virtual const SipEvent& front()
   {
-    return _queue.top();
+    return _queue.top().event;
   }
 
   virtual bool empty()
@@ -135,7 +151,11 @@ public:
 
   virtual void push(const SipEvent& value)
   {
-    _queue.push(value);
+    Entry entry;
+    entry.event = value;
+    entry.start_time_us = get_start_time_us(entry.event);
+    entry.seq = _next_seq++;
+    _queue.push(entry);
   }
 
   virtual void pop()
@@ -143,10 +163,125 @@ public:
     _queue.pop();
   }
 
-  // SipEvents are compared using operator()
-  std::priority_queue<SipEvent,
-                      std::deque<SipEvent>,
-                      std::function<bool(SipEvent, SipEvent)> > _queue;
+private:
+  struct Entry
+  {
+    SipEvent event;
+    unsigned long start_time_us;
+    uint64_t seq;
+  };
+
+  // Returns true if rhs is 'larger' than lhs, where 'larger' entries are
+  // those that should be processed earlier.
+  struct EntryCompare
+  {
+    bool operator()(const Entry& lhs, const Entry& rhs) const
+    {
+      if (lhs.event.priority != rhs.event.priority)
+      {
+        return lhs.event.priority < rhs.event.priority;
+      }
+      else if (lhs.start_time_us != rhs.start_time_us)
+      {
+        return lhs.start_time_us > rhs.start_time_us;
+      }
+      else
+      {
+        return lhs.seq > rhs.seq;
+      }
+    }
+  };
+
+  // Works out when the event's stop watch was started, in microseconds on
+  // the monotonic clock.
+  static unsigned long get_start_time_us(SipEvent& event);
+
+  std::priority_queue<Entry, std::vector<Entry>, EntryCompare> _queue;
+  uint64_t _next_seq;
+};
+
+// A set of priority queues of SipEvents, each serviced by a subset of the
+// worker threads.
+//
+// Received messages are hashed onto a shard by the caller (the thread
+// dispatcher uses the Call-ID), so all the messages for a given transaction
+// are queued in the same place. Workers take events from their home shard
+// first, and steal from the other shards when their home shard is empty, so
+// no worker sits idle while there is work queued anywhere. This means each
+// queue lock is only contended by a fraction of the worker threads.
+//
+// A worker also takes an event from another shard if that shard's next event
+// has a higher priority than its home shard's, so a high priority event isn't
+// stuck behind lower priority work on a busy shard. Events of the same
+// priority on different shards aren't ordered by age, and the check uses each
+// shard's priority as it was last published, so an event pushed while a
+// worker is choosing a shard may briefly be passed over.
+class ShardedSipEventQueue
+{
+public:
+  ShardedSipEventQueue(int num_shards);
+  virtual ~ShardedSipEventQueue();
+
+  // Adds an event to the specified shard (modulo the number of shards).
+  void push(unsigned int shard, const SipEvent& qe);
+
+  // Pops the next event for a worker whose home is the specified shard. Blocks
+  // until an event is available on any shard, or the queue is terminated.
+  // Returns true if an event was popped, and false if the queue was
+  // terminated.
+  bool pop(unsigned int shard, SipEvent& qe);
+
+  // Returns the total number of events queued across all shards.
+  int size();
+
+  int num_shards() const { return _shards.size(); }
+
+  // Enables deadlock detection. A shard is deadlocked if it has had events
+  // queued but has not been serviced for longer than the threshold.
+  void set_deadlock_threshold(unsigned long threshold_ms);
+  bool is_deadlocked();
+
+  // Terminates the queue, waking any waiting workers and returning the events
+  // remaining on all the shards.
+  void terminate(std::vector<SipEvent>& remaining_elts);
+
+private:
+  struct Shard
+  {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    PriorityEventQueueBackend queue;
+
+    // The number of workers currently waiting on this shard's condition, and
+    // how many of them have been signalled but not yet woken.
+    int waiting;
+    int signalled;
+
+    // The priority of the next event on the shard, or EMPTY_SHARD_PRIORITY
+    // if it is empty. This is updated with the lock held, but read without
+    // it when choosing which shard to take an event from.
+    std::atomic<int> top_priority;
+
+    // The last time (in ms) this shard was serviced, for deadlock detection.
+    unsigned long service_time_ms;
+  };
+
+  bool try_pop(Shard* shard, SipEvent& qe);
+  bool steal(unsigned int home, SipEvent& qe);
+  Shard* preferred_shard(unsigned int home);
+  bool signal_waiter(Shard* shard);
+  void wake_idle_worker(unsigned int home);
+  static void update_top_priority(Shard* shard);
+  static unsigned long now_ms();
+
+  std::vector<Shard*> _shards;
+  std::atomic<int> _size;
+  std::atomic<int> _idle_workers;
+  std::atomic<bool> _terminated;
+  unsigned long _deadlock_threshold_ms;
+
+  // The top priority of an empty shard, which is lower than any event's.
+  static const int EMPTY_SHARD_PRIORITY = -1;
 };
 
 #endif
@@ -0,0 +1,449 @@
+/**
+ * @file ttl_cache.h  Size-bounded LRU cache of entries with a TTL.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#ifndef TTL_CACHE_H__
+#define TTL_CACHE_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <deque>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "log.h"
+#include "snmp_counter_table.h"
+
+/// A thread-safe, size-bounded LRU cache of values of type V, keyed by
+/// string.  Entries are removed once they are older than a fixed TTL.
+///
+/// Each entry can be stored as part of a group of keys (for example, the
+/// IMPUs in an implicit registration set).  Invalidating any key in the group
+/// removes all the entries stored with it.
+///
+/// Values are typically fetched from elsewhere, so a value is only stored if
+/// none of its keys have been invalidated since the fetch started (as
+/// identified by the token returned by generation()).  Invalidations of
+/// unrelated keys don't affect it.  The cache remembers as many invalidated
+/// keys as it has room for entries.  Values fetched before the oldest of those
+/// are never stored, as we can no longer tell whether they are out of date.
+template <typename V>
+class TtlCache
+{
+public:
+  /// Combines a value that is being stored with the value already stored for
+  /// the same key.  Returns true if the combined entry must be kept for at
+  /// least as long as the old one would have been.
+  typedef std::function<bool(V& value, const V& old_value)> Merge;
+
+  /// Constructor.
+  ///
+  /// @param max_size        - The maximum number of entries to hold.
+  /// @param ttl_s           - How long an entry is kept for, in seconds,
+  ///                          unless it is stored with a different TTL.
+  /// @param eviction_tbl    - Counts entries evicted to make room for new
+  ///                          ones.
+  TtlCache(size_t max_size,
+           int ttl_s,
+           SNMP::CounterTable* eviction_tbl = NULL) :
+    _max_size(max_size),
+    _ttl_ms((uint64_t)ttl_s * 1000),
+    _eviction_tbl(eviction_tbl),
+    _generation(0),
+    _oldest_generation(0)
+  {
+    pthread_mutex_init(&_lock, NULL);
+  }
+
+  virtual ~TtlCache()
+  {
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Looks up the value for a key.
+  ///
+  /// @return true if an entry was found that is within its TTL, in which case
+  ///         value is set from it.
+  bool get(const std::string& key, V& value)
+  {
+    bool found = false;
+
+    pthread_mutex_lock(&_lock);
+
+    typename Index::iterator it = _entries.find(key);
+    if (it != _entries.end())
+    {
+      typename EntryList::iterator entry = it->second;
+
+      if (entry->expiry_ms > current_time_ms())
+      {
+        // Move the entry to the front of the LRU list.
+        _lru.splice(_lru.begin(), _lru, entry);
+        value = entry->value;
+        found = true;
+      }
+      else
+      {
+        TRC_DEBUG("Cached entry for %s has expired", key.c_str());
+        remove_entry(entry);
+      }
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    return found;
+  }
+
+  /// Returns a token to be passed to put() for a value that is about to be
+  /// fetched.  This must be called before the fetch starts.
+  uint64_t generation()
+  {
+    pthread_mutex_lock(&_lock);
+    uint64_t generation = _generation;
+    pthread_mutex_unlock(&_lock);
+    return generation;
+  }
+
+  /// Stores a value, replacing any entry already stored for the key.
+  ///
+  /// @param key             - The key to store the value under.
+  /// @param value           - The value.
+  /// @param generation      - The token returned by generation() before the
+  ///                          value was fetched.  The value is discarded if
+  ///                          the key or any other key in the group has been
+  ///                          invalidated since.
+  /// @param group           - The other keys that invalidate the entry.
+  /// @param merge           - If set, called to combine the value with the
+  ///                          one already stored for the key (if any).
+  /// @param ttl_s           - How long to keep the entry, in seconds.  0
+  ///                          means the cache's TTL.
+  ///
+  /// @return true if the value was stored.
+  bool put(const std::string& key,
+           const V& value,
+           uint64_t generation,
+           const std::vector<std::string>& group = std::vector<std::string>(),
+           const Merge& merge = Merge(),
+           int ttl_s = 0)
+  {
+    return store(key, value, generation, group, merge, ttl_s, false);
+  }
+
+  /// As put(), but first invalidates the key and the rest of its group, as
+  /// for invalidate().
+  bool replace(const std::string& key,
+               const V& value,
+               uint64_t generation,
+               const std::vector<std::string>& group = std::vector<std::string>(),
+               int ttl_s = 0)
+  {
+    return store(key, value, generation, group, Merge(), ttl_s, true);
+  }
+
+  /// Removes the entries for a key and the rest of its group, and stops values
+  /// for any of them that are already being fetched from being stored.
+  void invalidate(const std::string& key)
+  {
+    pthread_mutex_lock(&_lock);
+    invalidate_group(key);
+    pthread_mutex_unlock(&_lock);
+
+    TRC_DEBUG("Invalidated cached entries for %s", key.c_str());
+  }
+
+  /// The number of entries in the cache (including expired entries that have
+  /// not yet been removed).  Used for testing.
+  size_t size()
+  {
+    pthread_mutex_lock(&_lock);
+    size_t size = _entries.size();
+    pthread_mutex_unlock(&_lock);
+    return size;
+  }
+
+private:
+  struct Entry
+  {
+    std::string key;
+    V value;
+    uint64_t expiry_ms;
+
+    // The keys under which this entry is recorded in the group index.  This
+    // always includes its own key.
+    std::vector<std::string> group;
+  };
+
+  typedef std::list<Entry> EntryList;
+  typedef std::unordered_map<std::string, typename EntryList::iterator> Index;
+  typedef std::unordered_map<std::string, std::unordered_set<std::string>>
+                                                                    GroupIndex;
+
+  bool store(const std::string& key,
+             const V& value,
+             uint64_t generation,
+             const std::vector<std::string>& group,
+             const Merge& merge,
+             int ttl_s,
+             bool invalidate)
+  {
+    // Work out the keys to index the entry under before taking the lock.
+    std::vector<std::string> keys(group);
+    keys.push_back(key);
+
+    bool stored = false;
+    int evicted = 0;
+
+    pthread_mutex_lock(&_lock);
+
+    bool stale = invalidated_since(generation, keys);
+
+    if (invalidate)
+    {
+      invalidate_group(key);
+    }
+
+    if ((!stale) && (_max_size > 0))
+    {
+      V new_value(value);
+      uint64_t expiry_ms = current_time_ms() +
+                           ((ttl_s > 0) ? (uint64_t)ttl_s * 1000 : _ttl_ms);
+
+      typename Index::iterator it = _entries.find(key);
+      if (it != _entries.end())
+      {
+        if ((merge) &&
+            (merge(new_value, it->second->value)) &&
+            (it->second->expiry_ms > expiry_ms))
+        {
+          expiry_ms = it->second->expiry_ms;
+        }
+
+        remove_entry(it->second);
+      }
+
+      while (_entries.size() >= _max_size)
+      {
+        remove_entry(--_lru.end());
+        evicted++;
+      }
+
+      _lru.push_front(Entry());
+      Entry& entry = _lru.front();
+      entry.key = key;
+      entry.value = new_value;
+      entry.expiry_ms = expiry_ms;
+      entry.group.swap(keys);
+      _entries[key] = _lru.begin();
+
+      for (std::vector<std::string>::const_iterator k = entry.group.begin();
+           k != entry.group.end();
+           ++k)
+      {
+        _group_index[*k].insert(key);
+      }
+
+      stored = true;
+    }
+
+    pthread_mutex_unlock(&_lock);
+
+    if (stale)
+    {
+      // The entry might be out of date.
+      TRC_DEBUG("Not caching entry for %s fetched before an invalidation",
+                key.c_str());
+    }
+
+    if (_eviction_tbl)
+    {
+      for (int ii = 0; ii < evicted; ++ii)
+      {
+        _eviction_tbl->increment();
+      }
+    }
+
+    return stored;
+  }
+
+  // Removes the entries for a key and the rest of its group.  Must be called
+  // with the lock held.
+  void invalidate_group(const std::string& key)
+  {
+    uint64_t generation = ++_generation;
+
+    std::unordered_set<std::string> keys;
+    keys.insert(key);
+
+    // Find every entry whose group includes this key.  This includes the
+    // entry for the key itself, which is always indexed under its own key.
+    typename GroupIndex::iterator index_it = _group_index.find(key);
+    if (index_it != _group_index.end())
+    {
+      std::vector<std::string> members(index_it->second.begin(),
+                                       index_it->second.end());
+
+      for (std::vector<std::string>::const_iterator member = members.begin();
+           member != members.end();
+           ++member)
+      {
+        typename Index::iterator it = _entries.find(*member);
+        if (it != _entries.end())
+        {
+          keys.insert(it->second->group.begin(), it->second->group.end());
+          remove_entry(it->second);
+        }
+      }
+
+      // Also remove any entries for the other members of the groups, which
+      // may have been stored separately.
+      for (std::unordered_set<std::string>::const_iterator k = keys.begin();
+           k != keys.end();
+           ++k)
+      {
+        typename Index::iterator it = _entries.find(*k);
+        if (it != _entries.end())
+        {
+          remove_entry(it->second);
+        }
+      }
+    }
+
+    // Any fetches for members of the group that are already in progress might
+    // return values from before the invalidation.
+    for (std::unordered_set<std::string>::const_iterator k = keys.begin();
+         k != keys.end();
+         ++k)
+    {
+      record_invalidation(*k, generation);
+    }
+  }
+
+  // Removes an entry.  Must be called with the lock held.
+  void remove_entry(typename EntryList::iterator entry)
+  {
+    for (std::vector<std::string>::const_iterator k = entry->group.begin();
+         k != entry->group.end();
+         ++k)
+    {
+      typename GroupIndex::iterator index_it = _group_index.find(*k);
+      if (index_it != _group_index.end())
+      {
+        index_it->second.erase(entry->key);
+        if (index_it->second.empty())
+        {
+          _group_index.erase(index_it);
+        }
+      }
+    }
+
+    _entries.erase(entry->key);
+    _lru.erase(entry);
+  }
+
+  // Records that a key was invalidated at the given generation.  Must be
+  // called with the lock held.
+  void record_invalidation(const std::string& key, uint64_t generation)
+  {
+    if (_max_size == 0)
+    {
+      return;
+    }
+
+    _invalidations[key] = generation;
+    _invalidation_order.push_back(std::make_pair(generation, key));
+
+    while (_invalidation_order.size() > _max_size)
+    {
+      const std::pair<uint64_t, std::string>& oldest =
+                                                   _invalidation_order.front();
+
+      // The key may have been invalidated again since, in which case the
+      // newer record stays.
+      std::unordered_map<std::string, uint64_t>::iterator it =
+                                              _invalidations.find(oldest.second);
+      if ((it != _invalidations.end()) && (it->second == oldest.first))
+      {
+        _invalidations.erase(it);
+      }
+
+      _oldest_generation = oldest.first;
+      _invalidation_order.pop_front();
+    }
+  }
+
+  // Returns whether any of the given keys have been invalidated since the
+  // given generation.  Must be called with the lock held.
+  bool invalidated_since(uint64_t generation,
+                         const std::vector<std::string>& keys)
+  {
+    if (generation < _oldest_generation)
+    {
+      return true;
+    }
+
+    for (std::vector<std::string>::const_iterator key = keys.begin();
+         key != keys.end();
+         ++key)
+    {
+      std::unordered_map<std::string, uint64_t>::const_iterator it =
+                                                      _invalidations.find(*key);
+      if ((it != _invalidations.end()) && (it->second > generation))
+      {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  static uint64_t current_time_ms()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000 + (ts.tv_nsec / 1000000);
+  }
+
+  const size_t _max_size;
+  const uint64_t _ttl_ms;
+
+  SNMP::CounterTable* _eviction_tbl;
+
+  // A lock that protects all the following member variables.
+  pthread_mutex_t _lock;
+
+  // The entries, most recently used first.
+  EntryList _lru;
+
+  // Index of the entries by key.
+  Index _entries;
+
+  // Index of the entries by the keys in their groups.
+  GroupIndex _group_index;
+
+  // Incremented on every invalidation.
+  uint64_t _generation;
+
+  // The generation at which each recently invalidated key was last
+  // invalidated, and the same records in the order they were made.
+  std::unordered_map<std::string, uint64_t> _invalidations;
+  std::deque<std::pair<uint64_t, std::string>> _invalidation_order;
+
+  // The generation of the newest invalidation record that has been dropped.
+  // Values fetched before this are never stored.
+  uint64_t _oldest_generation;
+};
+
+#endif
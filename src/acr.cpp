@@ -151,23 +151,18 @@ RalfACR::RalfACR(RalfProcessor* ralf,
                  NodeRole role) :
   _ralf(ralf),
   _trail(trail),
-  _initiator(initiator),
   _first_req(true),
   _first_rsp(true),
-  _interim_interval(0),
-  _node_role(role),
-  _node_functionality(node_functionality),
-  _user_session_id(),
-  _status_code(0)
+  _rf(new RfFields())
 {
-  // Clear timestamps.
-  _req_timestamp.sec = 0;
-  _rsp_timestamp.sec = 0;
+  _rf->initiator = initiator;
+  _rf->node_role = role;
+  _rf->node_functionality = node_functionality;
 
   pthread_mutex_init(&_acr_lock, NULL);
 
   TRC_DEBUG("Created %s Ralf ACR",
-            ACR::node_name(_node_functionality).c_str(), this);
+            ACR::node_name(_rf->node_functionality).c_str(), this);
 }
 
 RalfACR::~RalfACR()
@@ -175,8 +170,30 @@ RalfACR::~RalfACR()
   pthread_mutex_destroy(&_acr_lock);
 }
 
+RalfACR::RfFields::RfFields() :
+  interim_interval(0),
+  user_session_id(),
+  status_code(0)
+{
+  // Clear timestamps.
+  req_timestamp.sec = 0;
+  rsp_timestamp.sec = 0;
+}
+
+void RalfACR::unshare_fields()
+{
+  if (!_rf.unique())
+  {
+    // The fields are shared with a request that hasn't been encoded yet, so
+    // leave that request with the fields as they were when it was sent.
+    _rf.reset(new RfFields(*_rf));
+  }
+}
+
 void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
 {
+  unshare_fields();
+
   if (timestamp.sec == -1)
   {
     // Timestamp is unspecified, so get the current time.
@@ -190,10 +207,10 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
     _first_req = false;
 
     // Store a timestamp for the original request.
-    _req_timestamp = timestamp;
+    _rf->req_timestamp = timestamp;
 
     // Save the method.
-    _method = PJUtils::pj_str_to_string(&req->line.req.method.name);
+    _rf->method = PJUtils::pj_str_to_string(&req->line.req.method.name);
 
     // Find the From and To headers.
     pjsip_fromto_hdr* to_hdr = (pjsip_fromto_hdr*)
@@ -204,62 +221,62 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
     // Set the record type based on the node functionality and the method.
     // This may get changed later (for example, if an INVITE transaction fails
     // we send EVENT instead of START).
-    if ((_node_functionality == PCSCF) ||
-        (_node_functionality == SCSCF))
+    if ((_rf->node_functionality == PCSCF) ||
+        (_rf->node_functionality == SCSCF))
     {
       TRC_DEBUG("Set record type for P/S-CSCF");
-      if ((_method == "REGISTER") ||
-          (_method == "SUBSCRIBE") ||
-          (_method == "NOTIFY") ||
-          (_method == "PUBLISH") ||
-          (_method == "MESSAGE"))
+      if ((_rf->method == "REGISTER") ||
+          (_rf->method == "SUBSCRIBE") ||
+          (_rf->method == "NOTIFY") ||
+          (_rf->method == "PUBLISH") ||
+          (_rf->method == "MESSAGE"))
       {
         // Non-dialog message, must be an EVENT record.
         TRC_DEBUG("Non-dialog message => EVENT_RECORD");
-        _record_type = EVENT_RECORD;
+        _rf->record_type = EVENT_RECORD;
       }
-      else if (_method == "BYE")
+      else if (_rf->method == "BYE")
       {
         // BYE request must be a STOP record.
         TRC_DEBUG("BYE => STOP_RECORD");
-        _record_type = STOP_RECORD;
+        _rf->record_type = STOP_RECORD;
       }
       else if ((to_hdr != NULL) &&
                (to_hdr->tag.slen > 0))
       {
         // Any other requests with a To tag are INTERIMs.
-        TRC_DEBUG("In-dialog %s request => INTERIM_RECORD", _method.c_str());
-        _record_type = INTERIM_RECORD;
+        TRC_DEBUG("In-dialog %s request => INTERIM_RECORD", _rf->method.c_str());
+        _rf->record_type = INTERIM_RECORD;
       }
-      else if (_method == "INVITE")
+      else if (_rf->method == "INVITE")
       {
         // INVITE with no To tag is a START.
         TRC_DEBUG("Dialog-initiating INVITE => START_RECORD");
-        _record_type = START_RECORD;
+        _rf->record_type = START_RECORD;
       }
       else
       {
         // Anything else is an EVENT.
         TRC_DEBUG("EVENT_RECORD");
-        _record_type = EVENT_RECORD;
+        _rf->record_type = EVENT_RECORD;
       }
     }
     else
     {
       // All other node types only generate EVENTs.
       TRC_DEBUG("Set record type for I-CSCF, BGCF, IBCF, AS to EVENT_RECORD");
-      _record_type = EVENT_RECORD;
+      _rf->record_type = EVENT_RECORD;
     }
 
     // Store the content of the event header if present.
-    if ((_method == "SUBSCRIBE") ||
-        (_method == "NOTIFY"))
+    if ((_rf->method == "SUBSCRIBE") ||
+        (_rf->method == "NOTIFY"))
     {
       pjsip_generic_string_hdr* event_hdr = (pjsip_generic_string_hdr*)
                              pjsip_msg_find_hdr_by_name(req, &STR_EVENT, NULL);
       if (event_hdr != NULL)
       {
-        _event = PJUtils::pj_str_to_string(&event_hdr->hvalue);
+        _rf->event = PJUtils::pj_str_to_string(&event_hdr->hvalue);
       }
     }
 
@@ -267,40 +284,40 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
         ( (req->line.req.method.id == PJSIP_OTHER_METHOD) &&
           (pj_strcmp2(&(req->line.req.method.name), "SUBSCRIBE") == 0)))
     {
-      PJUtils::get_max_expires(req, -1, _expires);
+      PJUtils::get_max_expires(req, -1, _rf->expires);
     }
     else
     {
-      _expires = -1;
+      _rf->expires = -1;
     }
 
     // Determine the number of contact headers
     pjsip_contact_hdr* contact_hdr =
             (pjsip_contact_hdr*)pjsip_msg_find_hdr(req, PJSIP_H_CONTACT, NULL);
-    _num_contacts = 0;
+    _rf->num_contacts = 0;
 
     while (contact_hdr != NULL)
     {
-      _num_contacts++;
+      _rf->num_contacts++;
       contact_hdr = (pjsip_contact_hdr*)
                      pjsip_msg_find_hdr(req, PJSIP_H_CONTACT, contact_hdr->next);
     }
 
     // Store the call ID but only if the session ID has not already been set.
-    if (_user_session_id.empty())
+    if (_rf->user_session_id.empty())
     {
       pjsip_cid_hdr* cid_hdr = (pjsip_cid_hdr*)
                                   pjsip_msg_find_hdr(req, PJSIP_H_CALL_ID, NULL);
       if (cid_hdr != NULL)
       {
-        _user_session_id = PJUtils::pj_str_to_string(&cid_hdr->id);
+        _rf->user_session_id = PJUtils::pj_str_to_string(&cid_hdr->id);
       }
     }
 
     // Store contents of From header.
     if (from_hdr != NULL)
     {
-      _from_address = hdr_contents((pjsip_hdr*)from_hdr);
+      _rf->from_address = hdr_contents((pjsip_hdr*)from_hdr);
     }
 
     // Save the username from the Authorization header if present.
@@ -309,7 +326,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
     if ((auth_hdr != NULL) &&
         (pj_stricmp(&auth_hdr->scheme, &STR_DIGEST) == 0))
     {
-      _username =
+      _rf->username =
               PJUtils::pj_str_to_string(&auth_hdr->credential.digest.username);
     }
 
@@ -324,7 +341,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
                                                            NULL);
       if (sess_expires != NULL)
       {
-        _interim_interval = sess_expires->expires;
+        _rf->interim_interval = sess_expires->expires;
       }
     }
 
@@ -333,29 +350,29 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
                                   pjsip_msg_find_hdr(req, PJSIP_H_ROUTE, NULL);
     if (route_hdr != NULL)
     {
-      _route_hdr_received = hdr_contents((pjsip_hdr*)route_hdr);
+      _rf->route_hdr_received = hdr_contents((pjsip_hdr*)route_hdr);
     }
 
-    if (_node_role == NODE_ROLE_ORIGINATING)
+    if (_rf->node_role == NODE_ROLE_ORIGINATING)
     {
       // For originating requests take the subscription identifiers from
       // P-Asserted-Identity headers in the original request.
       store_subscription_ids(req);
     }
 
-    if ((_method == "REGISTER") &&
+    if ((_rf->method == "REGISTER") &&
         (to_hdr != NULL))
     {
       // For a register method, both the subscription id and the called party
       // address are the public user identity being registered, so should be
       // the URI in the To header.
       pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(to_hdr->uri);
-      _called_party_address =
+      _rf->called_party_address =
                           PJUtils::uri_to_string(PJSIP_URI_IN_FROMTO_HDR, uri);
       SubscriptionId id;
       id.type = END_USER_SIP_URI;
-      id.id = _called_party_address;
-      _subscription_ids.push_back(id);
+      id.id = _rf->called_party_address;
+      _rf->subscription_ids.push_back(id);
     }
 
     // Store the calling party addresses (from P-Asserted-Identity headers).
@@ -363,7 +380,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
 
     // Store the RequestURI in case it is needed for a Requested-Party-Address
     // AVP or as a Media-Originator-Party AVP.
-    _requested_party_address =
+    _rf->requested_party_address =
                PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, req->line.req.uri);
 
     // Store IOIs and ICID from P-Charging-Vector header if present.
@@ -371,10 +388,10 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
 
     // In the originating case we always take SDP and other message bodies
     // from the original request.
-    if (_node_role == NODE_ROLE_ORIGINATING)
+    if (_rf->node_role == NODE_ROLE_ORIGINATING)
     {
       // Store media description if present.
-      store_media_description(req, _media);
+      store_media_description(req, _rf->media);
 
       // Store non-SDP message bodies if present.
       store_message_bodies(req);
@@ -388,7 +405,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
                             pjsip_msg_find_hdr_by_name(req, &STR_REASON, NULL);
       while (reason_hdr != NULL)
       {
-        _reasons.push_back(PJUtils::pj_str_to_string(&reason_hdr->hvalue));
+        _rf->reasons.push_back(PJUtils::pj_str_to_string(&reason_hdr->hvalue));
         reason_hdr = (pjsip_generic_string_hdr*)
                 pjsip_msg_find_hdr_by_name(req, &STR_REASON, reason_hdr->next);
       }
@@ -399,7 +416,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
                            pjsip_msg_find_hdr_by_name(req, &STR_P_A_N_I, NULL);
     while (pani_hdr != NULL)
     {
-      _access_network_info.push_back(
+      _rf->access_network_info.push_back(
                                  PJUtils::pj_str_to_string(&pani_hdr->hvalue));
       pani_hdr = (pjsip_generic_string_hdr*)
                  pjsip_msg_find_hdr_by_name(req, &STR_P_A_N_I, pani_hdr->next);
@@ -410,11 +427,11 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
                            pjsip_msg_find_hdr_by_name(req, &STR_P_V_N_I, NULL);
     if (pvni_hdr != NULL)
     {
-      _visited_network_id = PJUtils::pj_str_to_string(&pvni_hdr->hvalue);
+      _rf->visited_network_id = PJUtils::pj_str_to_string(&pvni_hdr->hvalue);
     }
 
     // Get instance-ID if this is originating case.
-    if (_node_role == NODE_ROLE_ORIGINATING)
+    if (_rf->node_role == NODE_ROLE_ORIGINATING)
     {
       store_instance_id(req);
     }
@@ -426,7 +443,7 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
   // Store the charging function addresses if present.
   store_charging_addresses(req);
 
-  if (_node_role == NODE_ROLE_TERMINATING)
+  if (_rf->node_role == NODE_ROLE_TERMINATING)
   {
     // In the terminating case, the called party address is taken from the
     // RequestURI after it has been modified by any ASs, but before it has
@@ -440,6 +457,8 @@ void RalfACR::rx_request(pjsip_msg* req, pj_time_val timestamp)
 /// Called with the request as it is forwarded by this node.
 void RalfACR::tx_request(pjsip_msg* req, pj_time_val timestamp)
 {
+  unshare_fields();
+
   if (timestamp.sec == -1)
   {
     // Timestamp is unspecified, so get the current time.
@@ -451,7 +470,7 @@ void RalfACR::tx_request(pjsip_msg* req, pj_time_val timestamp)
                                   pjsip_msg_find_hdr(req, PJSIP_H_ROUTE, NULL);
   if (route_hdr != NULL)
   {
-    _route_hdr_transmitted = hdr_contents((pjsip_hdr*)route_hdr);
+    _rf->route_hdr_transmitted = hdr_contents((pjsip_hdr*)route_hdr);
   }
 
   // If the request is an INVITE, save the delta_seconds value from the
@@ -465,12 +484,12 @@ void RalfACR::tx_request(pjsip_msg* req, pj_time_val timestamp)
                                                          NULL);
     if (sess_expires != NULL)
     {
-      _interim_interval = sess_expires->expires;
+      _rf->interim_interval = sess_expires->expires;
     }
   }
 
-  if ((_method != "REGISTER") &&
-      (_node_role == NODE_ROLE_ORIGINATING))
+  if ((_rf->method != "REGISTER") &&
+      (_rf->node_role == NODE_ROLE_ORIGINATING))
   {
     // In the originating case, the called party address is taken from the
     // RequestURI when the request is transmitted.
@@ -482,10 +501,10 @@ void RalfACR::tx_request(pjsip_msg* req, pj_time_val timestamp)
 
   // If this is a terminating request store the SDP and non-SDP bodies from
   // every transmitted request.
-  if (_node_role == NODE_ROLE_TERMINATING)
+  if (_rf->node_role == NODE_ROLE_TERMINATING)
   {
     // Store media description if present.
-    store_media_description(req, _media);
+    store_media_description(req, _rf->media);
 
     // Store non-SDP message bodies if present.
     store_message_bodies(req);
@@ -495,6 +514,8 @@ void RalfACR::tx_request(pjsip_msg* req, pj_time_val timestamp)
 /// Called with all non-100 responses as first received by the node.
 void RalfACR::rx_response(pjsip_msg* rsp, pj_time_val timestamp)
 {
+  unshare_fields();
+
   if (timestamp.sec == -1)
   {
     // Timestamp is unspecified, so get the current time.
@@ -511,7 +532,7 @@ void RalfACR::rx_response(pjsip_msg* rsp, pj_time_val timestamp)
       // Store IOIs and ICID from P-Charging-Vector header if present.
       store_charging_info(rsp);
 
-      if (_node_role == NODE_ROLE_TERMINATING)
+      if (_rf->node_role == NODE_ROLE_TERMINATING)
       {
         // For terminating requests take the subscription identifiers from
         // P-Asserted-Identity headers in the first response.
@@ -519,7 +540,7 @@ void RalfACR::rx_response(pjsip_msg* rsp, pj_time_val timestamp)
 
         // For terminating requests store media from the first received final
         // response.
-        store_media_description(rsp, _media);
+        store_media_description(rsp, _rf->media);
 
         // Store non-SDP message bodies if present.
         store_message_bodies(rsp);
@@ -537,32 +558,34 @@ void RalfACR::rx_response(pjsip_msg* rsp, pj_time_val timestamp)
   store_charging_addresses(rsp);
 
   // Store the latest status code.
-  _status_code = rsp->line.status.code;
+  _rf->status_code = rsp->line.status.code;
 }
 
 void RalfACR::tx_response(pjsip_msg* rsp, pj_time_val timestamp)
 {
+  unshare_fields();
+
   if (timestamp.sec == -1)
   {
     // Timestamp is unspecified, so get the current time.
     pj_gettimeofday(&timestamp);
   }
 
-  _rsp_timestamp = timestamp;
+  _rf->rsp_timestamp = timestamp;
 
   // Store the charging function addresses if present.
   store_charging_addresses(rsp);
 
-  if (_node_role == NODE_ROLE_ORIGINATING)
+  if (_rf->node_role == NODE_ROLE_ORIGINATING)
   {
     // For originating requests store media from the final transmitted response.
-    store_media_description(rsp, _media);
+    store_media_description(rsp, _rf->media);
 
     // Store non-SDP message bodies if present.
     store_message_bodies(rsp);
   }
 
-  if ((_method == "REGISTER") &&
+  if ((_rf->method == "REGISTER") &&
       (rsp->line.status.code == PJSIP_SC_OK))
   {
     // Store the associated URIs from the 200 OK/REGISTER response.  These
@@ -572,14 +595,14 @@ void RalfACR::tx_response(pjsip_msg* rsp, pj_time_val timestamp)
   }
 
   // Store the latest status code.
-  _status_code = rsp->line.status.code;
+  _rf->status_code = rsp->line.status.code;
 
-  if ((_record_type == START_RECORD) &&
-      (_status_code >= 300))
+  if ((_rf->record_type == START_RECORD) &&
+      (_rf->status_code >= 300))
   {
     // Failed to start the session, so convert to an EVENT record.
     TRC_DEBUG("Failed to start session, change record type to EVENT_RECORD");
-    _record_type = EVENT_RECORD;
+    _rf->record_type = EVENT_RECORD;
   }
 }
 
@@ -588,7 +611,9 @@ void RalfACR::as_info(const std::string& uri,
                       int status_code,
                       bool timeout)
 {
-  // Add an entry to the _as_information list.
+  unshare_fields();
+
+  // Add an entry to the list of AS information.
   TRC_DEBUG("Storing AS information for AS %s", uri.c_str());
   ASInformation as_info;
   as_info.uri = uri;
@@ -612,14 +637,16 @@ void RalfACR::as_info(const std::string& uri,
   {
     as_info.status_code = STATUS_CODE_NONE;
   }
-  _as_information.push_back(as_info);
+  _rf->as_information.push_back(as_info);
 }
 
 void RalfACR::server_capabilities(const ServerCapabilities& caps)
 {
+  unshare_fields();
+
   // Store the server capabilities.
   TRC_DEBUG("Storing Server-Capabilities");
-  _server_caps = caps;
+  _rf->server_caps = caps;
 }
 
 void RalfACR::send_message(pj_time_val timestamp)
@@ -631,20 +658,34 @@ void RalfACR::send_message(pj_time_val timestamp)
 
   // If we have a CCF or ECF, or this isn't a record type that needs one, send
   // the message.
-  if ((!_ccfs.empty()) ||
-      (!_ecfs.empty()) ||
-      (_record_type == INTERIM_RECORD) ||
-      (_record_type == STOP_RECORD))
+  if ((!_rf->ccfs.empty()) ||
+      (!_rf->ecfs.empty()) ||
+      (_rf->record_type == INTERIM_RECORD) ||
+      (_rf->record_type == STOP_RECORD))
   {
     // Encode and add the request to the RalfProcessor pool
     TRC_VERBOSE("Sending %s Ralf ACR (%p)",
-                ACR::node_name(_node_functionality).c_str(), this);
-    std::string path = "/call-id/" + Utils::url_escape(_user_session_id);
+                ACR::node_name(_rf->node_functionality).c_str(), this);
+    std::string path = "/call-id/" + Utils::url_escape(_rf->user_session_id);
+
+    if (timestamp.sec == -1)
+    {
+      // Timestamp is unspecified, so use the time the ACR is sent rather than
+      // the time it is encoded.
+      pj_gettimeofday(&timestamp);
+    }
 
-    // Create a Ralf request and populate it
+    // Create a Ralf request and populate it.  Encoding the message is
+    // relatively expensive (particularly for ACRs that carry SDP), so the
+    // request shares the ACR's fields and leaves the encoding to the Ralf
+    // thread.
+    std::shared_ptr<const RfFields> rf = _rf;
     RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
     rr->path = path;
-    rr->message = get_message(timestamp);
+    rr->encoder = [rf, timestamp]()
+    {
+      return encode_message(*rf, timestamp);
+    };
     rr->trail = _trail;
 
     _ralf->send_request_to_ralf(rr);
@@ -657,7 +698,7 @@ void RalfACR::send_message(pj_time_val timestamp)
      
     // LCOV_EXCL_START - TODO, may be dead code
     TRC_INFO("No CCF or ECF to send ACR for session %s to - dropping!",
-             _user_session_id.c_str());
+             _rf->user_session_id.c_str());
     SAS::Event event(_trail, SASEvent::NO_CCFS_FOR_ACR, 0);
     SAS::report_event(event);
     // LCOV_EXCL_STOP
@@ -671,6 +712,11 @@ std::string RalfACR::get_message(pj_time_val timestamp)
     return "Cancelled ACR";
   }
 
+  return encode_message(*_rf, timestamp);
+}
+
+std::string RalfACR::encode_message(const RfFields& rf, pj_time_val timestamp)
+{
   TRC_DEBUG("Building message");
 
   if (timestamp.sec == -1)
@@ -685,21 +731,21 @@ std::string RalfACR::get_message(pj_time_val timestamp)
 
   // Add the peers section with charging function addresses if this is a
   // start or event message.
-  if ((_record_type == START_RECORD) ||
-      (_record_type == EVENT_RECORD))
+  if ((rf.record_type == START_RECORD) ||
+      (rf.record_type == EVENT_RECORD))
   {
-    TRC_DEBUG("Adding peers meta-data, %d ccfs, %d ecfs", _ccfs.size(), _ecfs.size());
+    TRC_DEBUG("Adding peers meta-data, %d ccfs, %d ecfs", rf.ccfs.size(), rf.ecfs.size());
 
     writer.String("peers");
     writer.StartObject();
 
-    if (!_ccfs.empty())
+    if (!rf.ccfs.empty())
     {
       writer.String("ccf");
       writer.StartArray();
 
-      for (std::list<std::string>::const_iterator i = _ccfs.begin();
-           i != _ccfs.end();
+      for (std::list<std::string>::const_iterator i = rf.ccfs.begin();
+           i != rf.ccfs.end();
            ++i)
       {
         writer.String((*i).c_str());
@@ -708,13 +754,13 @@ std::string RalfACR::get_message(pj_time_val timestamp)
       writer.EndArray();
     }
 
-    if (!_ecfs.empty())
+    if (!rf.ecfs.empty())
     {
       writer.String("ecf");
       writer.StartArray();
 
-      for (std::list<std::string>::const_iterator i = _ecfs.begin();
-           i != _ecfs.end();
+      for (std::list<std::string>::const_iterator i = rf.ecfs.begin();
+           i != rf.ecfs.end();
            ++i)
       {
         writer.String((*i).c_str());
@@ -732,20 +778,20 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   writer.StartObject();
 
   // Add top-level fields.
-  TRC_DEBUG("Adding Account-Record-Type AVP %d", _record_type);
+  TRC_DEBUG("Adding Account-Record-Type AVP %d", rf.record_type);
   writer.String("Accounting-Record-Type");
-  writer.Int(_record_type);
+  writer.Int(rf.record_type);
 
-  if (!_username.empty())
+  if (!rf.username.empty())
   {
     writer.String("User-Name");
-    writer.String(_username.c_str());
+    writer.String(rf.username.c_str());
   }
 
-  if (_interim_interval != 0)
+  if (rf.interim_interval != 0)
   {
     writer.String("Acct-Interim-Interval");
-    writer.Int(_interim_interval);
+    writer.Int(rf.interim_interval);
   }
 
   writer.String("Event-Timestamp");
@@ -756,21 +802,21 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   writer.String("Service-Information");
   writer.StartObject();
 
-  if ((_node_functionality == PCSCF) ||
-      (_node_functionality == SCSCF) ||
-      (_node_functionality == IBCF))
+  if ((rf.node_functionality == PCSCF) ||
+      (rf.node_functionality == SCSCF) ||
+      (rf.node_functionality == IBCF))
   {
     // Add Subscription-Id AVPs on P-CSCF/S-CSCF/IBCF ACRs (should be omitted
     // on I-CSCF and BGCF).
-    TRC_DEBUG("Adding %d Subscription-Id AVPs", _subscription_ids.size());
+    TRC_DEBUG("Adding %d Subscription-Id AVPs", rf.subscription_ids.size());
 
-    if (_subscription_ids.size() > 0)
+    if (rf.subscription_ids.size() > 0)
     {
       writer.String("Subscription-Id");
       writer.StartArray();
 
-      for (std::list<SubscriptionId>::const_iterator i = _subscription_ids.begin();
-           i != _subscription_ids.end();
+      for (std::list<SubscriptionId>::const_iterator i = rf.subscription_ids.begin();
+           i != rf.subscription_ids.end();
            ++i)
       {
         writer.StartObject();
@@ -798,39 +844,39 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   writer.StartObject();
   {
     writer.String("SIP-Method");
-    writer.String(_method.c_str());
+    writer.String(rf.method.c_str());
 
-    if (!_event.empty())
+    if (!rf.event.empty())
     {
       writer.String("Event");
-      writer.String(_event.c_str());
+      writer.String(rf.event.c_str());
     }
 
-    if (_expires != -1)
+    if (rf.expires != -1)
     {
       writer.String("Expires");
-      writer.Int(_expires);
+      writer.Int(rf.expires);
     }
   }
   writer.EndObject();
 
   writer.String("Role-Of-Node");
-  writer.Int(_node_role);
+  writer.Int(rf.node_role);
   writer.String("Node-Functionality");
-  writer.Int(_node_functionality);
+  writer.Int(rf.node_functionality);
   writer.String("User-Session-Id");
-  writer.String(_user_session_id.c_str());
+  writer.String(rf.user_session_id.c_str());
 
   // Add the Calling-Party-Address AVPs.
-  TRC_DEBUG("Adding %d Calling-Party-Address AVPs", _calling_party_addresses.size());
+  TRC_DEBUG("Adding %d Calling-Party-Address AVPs", rf.calling_party_addresses.size());
 
-  if (_calling_party_addresses.size() > 0)
+  if (rf.calling_party_addresses.size() > 0)
   {
     writer.String("Calling-Party-Address");
     writer.StartArray();
 
-    for (std::list<std::string>::const_iterator i = _calling_party_addresses.begin();
-         i != _calling_party_addresses.end();
+    for (std::list<std::string>::const_iterator i = rf.calling_party_addresses.begin();
+         i != rf.calling_party_addresses.end();
          ++i)
     {
       writer.String((*i).c_str());
@@ -840,38 +886,38 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   // Add the Called-Party-Address AVP.
-  if (!_called_party_address.empty())
+  if (!rf.called_party_address.empty())
   {
     TRC_DEBUG("Adding Called-Party-Address AVP");
     writer.String("Called-Party-Address");
-    writer.String(_called_party_address.c_str());
+    writer.String(rf.called_party_address.c_str());
   }
 
-  if (_node_functionality == SCSCF)
+  if (rf.node_functionality == SCSCF)
   {
     // Add the Requested-Party-Address AVP.  This is only present if different
     // from the called party address.
-    if (_requested_party_address != _called_party_address)
+    if (rf.requested_party_address != rf.called_party_address)
     {
       TRC_DEBUG("Adding Requested-Party-Address AVP");
       writer.String("Requested-Party-Address");
-      writer.String(_requested_party_address.c_str());
+      writer.String(rf.requested_party_address.c_str());
     }
   }
 
-  if ((_node_functionality == PCSCF) ||
-      (_node_functionality == SCSCF))
+  if ((rf.node_functionality == PCSCF) ||
+      (rf.node_functionality == SCSCF))
   {
     // Add the Called-Asserted-Identity AVPs.
-    TRC_DEBUG("Adding %d Called-Asserted-Identity AVPs", _called_asserted_ids.size());
+    TRC_DEBUG("Adding %d Called-Asserted-Identity AVPs", rf.called_asserted_ids.size());
 
-    if (_called_asserted_ids.size() > 0)
+    if (rf.called_asserted_ids.size() > 0)
     {
       writer.String("Called-Asserted-Identity");
       writer.StartArray();
 
-      for (std::list<std::string>::const_iterator i = _called_asserted_ids.begin();
-           i != _called_asserted_ids.end();
+      for (std::list<std::string>::const_iterator i = rf.called_asserted_ids.begin();
+           i != rf.called_asserted_ids.end();
            ++i)
       {
         writer.String((*i).c_str());
@@ -881,18 +927,18 @@ std::string RalfACR::get_message(pj_time_val timestamp)
     }
   }
 
-  if (_node_functionality != BGCF)
+  if (rf.node_functionality != BGCF)
   {
     // Add the Associated-URI AVPs.
-    TRC_DEBUG("Adding %d Associated-URI AVPs", _associated_uris.size());
+    TRC_DEBUG("Adding %d Associated-URI AVPs", rf.associated_uris.size());
 
-    if (_associated_uris.size() > 0)
+    if (rf.associated_uris.size() > 0)
     {
       writer.String("Associated-URI");
       writer.StartArray();
 
-      for (std::list<std::string>::const_iterator i = _associated_uris.begin();
-           i != _associated_uris.end();
+      for (std::list<std::string>::const_iterator i = rf.associated_uris.begin();
+           i != rf.associated_uris.end();
            ++i)
       {
         writer.String((*i).c_str());
@@ -907,36 +953,36 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   writer.String("Time-Stamps");
   writer.StartObject();
   {
-    if (_req_timestamp.sec != 0)
+    if (rf.req_timestamp.sec != 0)
     {
       writer.String("SIP-Request-Timestamp");
-      writer.Int(_req_timestamp.sec);
+      writer.Int(rf.req_timestamp.sec);
       writer.String("SIP-Request-Timestamp-Fraction");
-      writer.Int(_req_timestamp.msec);
+      writer.Int(rf.req_timestamp.msec);
     }
 
-    if (_rsp_timestamp.sec != 0)
+    if (rf.rsp_timestamp.sec != 0)
     {
       writer.String("SIP-Response-Timestamp");
-      writer.Int(_rsp_timestamp.sec);
+      writer.Int(rf.rsp_timestamp.sec);
       writer.String("SIP-Response-Timestamp-Fraction");
-      writer.Int(_rsp_timestamp.msec);
+      writer.Int(rf.rsp_timestamp.msec);
     }
   }
   writer.EndObject();
 
-  if (_node_functionality == SCSCF)
+  if (rf.node_functionality == SCSCF)
   {
     // Add the Application-Server-Information AVPs.
-    TRC_DEBUG("Adding %d Application-Server-Information AVP groups", _as_information.size());
+    TRC_DEBUG("Adding %d Application-Server-Information AVP groups", rf.as_information.size());
 
-    if (_as_information.size() > 0)
+    if (rf.as_information.size() > 0)
     {
       writer.String("Application-Server-Information");
       writer.StartArray();
 
-      for (std::list<ASInformation>::const_iterator i = _as_information.begin();
-           i != _as_information.end();
+      for (std::list<ASInformation>::const_iterator i = rf.as_information.begin();
+           i != rf.as_information.end();
            ++i)
       {
         writer.StartObject();
@@ -969,23 +1015,23 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   // TS 32.299 there could be multiple of these, but only one
   // IMS-Charging-Identifier - but since they both come from the same SIP
   // header this seems inconsistent, so we only add a single IOI AVP group.
-  if ((!_orig_ioi.empty()) || (!_term_ioi.empty()))
+  if ((!rf.orig_ioi.empty()) || (!rf.term_ioi.empty()))
   {
     TRC_DEBUG("Adding Inter-Operator-Identifier AVP group");
     writer.String("Inter-Operator-Identifier");
     writer.StartArray();
     writer.StartObject();
     {
-      if (!_orig_ioi.empty())
+      if (!rf.orig_ioi.empty())
       {
         writer.String("Originating-IOI");
-        writer.String(_orig_ioi.c_str());
+        writer.String(rf.orig_ioi.c_str());
       }
 
-      if (!_term_ioi.empty())
+      if (!rf.term_ioi.empty())
       {
         writer.String("Terminating-IOI");
-        writer.String(_term_ioi.c_str());
+        writer.String(rf.term_ioi.c_str());
       }
     }
     writer.EndObject();
@@ -993,15 +1039,15 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   // Add Transit-IOI-List AVPs.
-  TRC_DEBUG("Adding %d Transit-IOI-List AVPs", _transit_iois.size());
+  TRC_DEBUG("Adding %d Transit-IOI-List AVPs", rf.transit_iois.size());
 
-  if (_transit_iois.size() > 0)
+  if (rf.transit_iois.size() > 0)
   {
     writer.String("Transit-IOI-List");
     writer.StartArray();
 
-    for (std::list<std::string>::const_iterator i = _transit_iois.begin();
-         i != _transit_iois.end();
+    for (std::list<std::string>::const_iterator i = rf.transit_iois.begin();
+         i != rf.transit_iois.end();
          ++i)
     {
       writer.String((*i).c_str());
@@ -1011,10 +1057,10 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   writer.String("IMS-Charging-Identifier");
-  writer.String(_icid.c_str());
+  writer.String(rf.icid.c_str());
 
   // Add the Server-Capabilities AVP if I-CSCF.
-  if (_node_functionality == ICSCF)
+  if (rf.node_functionality == ICSCF)
   {
     TRC_DEBUG("Adding Server-Capabilities AVP group");
     writer.String("Server-Capabilities");
@@ -1023,8 +1069,8 @@ std::string RalfACR::get_message(pj_time_val timestamp)
       writer.String("Mandatory-Capability");
       writer.StartArray();
 
-      for (std::vector<int>::const_iterator i = _server_caps.mandatory_caps.begin();
-           i != _server_caps.mandatory_caps.end();
+      for (std::vector<int>::const_iterator i = rf.server_caps.mandatory_caps.begin();
+           i != rf.server_caps.mandatory_caps.end();
            ++i)
       {
         writer.Int(*i);
@@ -1034,8 +1080,8 @@ std::string RalfACR::get_message(pj_time_val timestamp)
       writer.String("Optional-Capability");
       writer.StartArray();
 
-      for (std::vector<int>::const_iterator i = _server_caps.optional_caps.begin();
-           i != _server_caps.optional_caps.end();
+      for (std::vector<int>::const_iterator i = rf.server_caps.optional_caps.begin();
+           i != rf.server_caps.optional_caps.end();
            ++i)
       {
         writer.Int(*i);
@@ -1043,13 +1089,13 @@ std::string RalfACR::get_message(pj_time_val timestamp)
 
       writer.EndArray();
 
-      if (!_server_caps.scscf.empty())
+      if (!rf.server_caps.scscf.empty())
       {
         // Note that the Server-Name in Server-Capabilities is an array AVP
         // according to 6.3.4/TS 29.229.
         writer.String("Server-Name");
         writer.StartArray();
-        writer.String(_server_caps.scscf.c_str());
+        writer.String(rf.server_caps.scscf.c_str());
         writer.EndArray();
       }
     }
@@ -1061,25 +1107,25 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   // it has the information, but since a BGCF does not have to record route
   // itself, it may not have the information.  We therefore choose not to
   // include early media on BGCF ACRs.
-  if ((_node_functionality == SCSCF) ||
-      (_node_functionality == PCSCF) ||
-      (_node_functionality == IBCF))
+  if ((rf.node_functionality == SCSCF) ||
+      (rf.node_functionality == PCSCF) ||
+      (rf.node_functionality == IBCF))
   {
     // Add Early-Media-Description AVPs to Start and Event ACRs.
-    if ((_record_type == START_RECORD) ||
-        (_record_type == EVENT_RECORD))
+    if ((rf.record_type == START_RECORD) ||
+        (rf.record_type == EVENT_RECORD))
     {
-      TRC_DEBUG("Adding %d Early-Media-Description AVPs", _early_media.size());
+      TRC_DEBUG("Adding %d Early-Media-Description AVPs", rf.early_media.size());
 
-      // LCOV_EXCL_START - missing code to populate _early_media, raised in
+      // LCOV_EXCL_START - missing code to populate rf.early_media, raised in
       // clearwater-issues
-      if (_early_media.size() > 0)
+      if (rf.early_media.size() > 0)
       {
         writer.String("Early-Media-Description");
         writer.StartArray();
 
-        for (std::list<EarlyMediaDescription>::const_iterator i = _early_media.begin();
-             i != _early_media.end();
+        for (std::list<EarlyMediaDescription>::const_iterator i = rf.early_media.begin();
+             i != rf.early_media.end();
              ++i)
         {
           writer.Int(i->offer_timestamp.sec);
@@ -1092,24 +1138,24 @@ std::string RalfACR::get_message(pj_time_val timestamp)
       // LCOV_EXCL_STOP
     }
 
-    if ((_record_type == START_RECORD) ||
-        (_record_type == INTERIM_RECORD))
+    if ((rf.record_type == START_RECORD) ||
+        (rf.record_type == INTERIM_RECORD))
     {
       // Add SDP related AVPs to Start and Interim ACRs.
       TRC_DEBUG("Adding Media AVPs");
-      encode_sdp_description(&writer, _media);
+      encode_sdp_description(&writer, rf.media);
     }
 
     // Add Message-Body AVPs.
-    TRC_DEBUG("Adding %d Message-Body AVPs", _msg_bodies.size());
+    TRC_DEBUG("Adding %d Message-Body AVPs", rf.msg_bodies.size());
 
-    if (_msg_bodies.size() > 0)
+    if (rf.msg_bodies.size() > 0)
     {
       writer.String("Message-Body");
       writer.StartArray();
 
-      for (std::list<MessageBody>::const_iterator i = _msg_bodies.begin();
-           i != _msg_bodies.end();
+      for (std::list<MessageBody>::const_iterator i = rf.msg_bodies.begin();
+           i != rf.msg_bodies.end();
            ++i)
       {
         writer.StartObject();
@@ -1136,39 +1182,39 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   // Add Cause-Code AVP if STOP or EVENT message.
-  if (_record_type == STOP_RECORD)
+  if (rf.record_type == STOP_RECORD)
   {
     // Cause code is always zero for STOP requests.
     TRC_DEBUG("Adding Cause-Code(0) AVP to ACR[Stop]");
     writer.String("Cause-Code");
     writer.Int(0);
   }
-  else if ((_record_type == EVENT_RECORD) &&
-           (_status_code != 0))
+  else if ((rf.record_type == EVENT_RECORD) &&
+           (rf.status_code != 0))
   {
     // Calculate the cause code to include on the request (see 7.2.35/TS 32.299
     // for all the gory details).
     int cause_code = 0;
-    if (_status_code == PJSIP_SC_OK)
+    if (rf.status_code == PJSIP_SC_OK)
     {
-      if ((_method == "REGISTER")  &&
-          (_num_contacts == 0))
+      if ((rf.method == "REGISTER")  &&
+          (rf.num_contacts == 0))
       {
         // REGISTERs without contacts don't affect the registration state of
         // the subscriber, so use a cause code of 0
         cause_code = 0;
       }
-      // LCOV_EXCL_START - TODO, currently only stores _expires on _first_req in
+      // LCOV_EXCL_START - TODO, currently only stores rf.expires on _first_req in
       // a dialog, may not be right as SDP etc. does change in a dialog
-      else if ((_method == "SUBSCRIBE") &&
-               (_expires == 0))
+      else if ((rf.method == "SUBSCRIBE") &&
+               (rf.expires == 0))
       {
         // End of SUBSCRIBE dialog.
         cause_code = -2;
       }
       // LCOV_EXCL_STOP
-      else if ((_method == "REGISTER") &&
-               (_expires == 0))
+      else if ((rf.method == "REGISTER") &&
+               (rf.expires == 0))
       {
         // End of REGISTER dialog (nonsense I know, but it's what the spec
         // says).
@@ -1180,16 +1226,16 @@ std::string RalfACR::get_message(pj_time_val timestamp)
         cause_code = -1;
       }
     }
-    else if ((_status_code > PJSIP_SC_OK) &&
-             (_status_code < PJSIP_SC_BAD_REQUEST))
+    else if ((rf.status_code > PJSIP_SC_OK) &&
+             (rf.status_code < PJSIP_SC_BAD_REQUEST))
     {
       // 2xx or 3xx response.
-      cause_code = -_status_code;
+      cause_code = -rf.status_code;
     }
     else
     {
       // 4xx, 5xx or 6xx response.
-      cause_code = _status_code;
+      cause_code = rf.status_code;
     }
     // We don't currently support the Unspecified error (1), Unsuccessful
     // session setup (2) or Internal error (3) cause codes - in all of these
@@ -1201,15 +1247,15 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   // Add Reason-Header AVPs.
-  TRC_DEBUG("Adding %d Reason-Header AVPs", _reasons.size());
+  TRC_DEBUG("Adding %d Reason-Header AVPs", rf.reasons.size());
 
-  if (_reasons.size() > 0)
+  if (rf.reasons.size() > 0)
   {
     writer.String("Reason-Header");
     writer.StartArray();
 
-    for (std::list<std::string>::const_iterator i = _reasons.begin();
-         i != _reasons.end();
+    for (std::list<std::string>::const_iterator i = rf.reasons.begin();
+         i != rf.reasons.end();
          ++i)
     {
       writer.String((*i).c_str());
@@ -1219,15 +1265,15 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   }
 
   // Add Access-Network-Information AVPs
-  TRC_DEBUG("Adding %d Access-Network-Information AVPs", _access_network_info.size());
+  TRC_DEBUG("Adding %d Access-Network-Information AVPs", rf.access_network_info.size());
 
-  if (_access_network_info.size() > 0)
+  if (rf.access_network_info.size() > 0)
   {
     writer.String("Access-Network-Information");
     writer.StartArray();
 
-    for (std::list<std::string>::const_iterator i = _access_network_info.begin();
-         i != _access_network_info.end();
+    for (std::list<std::string>::const_iterator i = rf.access_network_info.begin();
+         i != rf.access_network_info.end();
          ++i)
     {
       writer.String((*i).c_str());
@@ -1239,37 +1285,37 @@ std::string RalfACR::get_message(pj_time_val timestamp)
   // Add From-Address AVP.
   TRC_DEBUG("Adding From-Address AVP");
   writer.String("From-Address");
-  writer.String(_from_address.c_str());
+  writer.String(rf.from_address.c_str());
 
   // Add IMS-Visited-Network-Identifier AVP if set.
-  if (!_visited_network_id.empty())
+  if (!rf.visited_network_id.empty())
   {
     TRC_DEBUG("Adding IMS-Visited-Network-Identifier AVP");
     writer.String("IMS-Visited-Network-Identifier");
-    writer.String(_visited_network_id.c_str());
+    writer.String(rf.visited_network_id.c_str());
   }
 
   // Add Route-Header-Received and Route-Header-Transmitted AVPs if set.
-  if (!_route_hdr_received.empty())
+  if (!rf.route_hdr_received.empty())
   {
     TRC_DEBUG("Adding Route-Header-Received AVP");
     writer.String("Route-Header-Received");
-    writer.String(_route_hdr_received.c_str());
+    writer.String(rf.route_hdr_received.c_str());
   }
 
-  if (!_route_hdr_transmitted.empty())
+  if (!rf.route_hdr_transmitted.empty())
   {
     TRC_DEBUG("Adding Route-Header-Transmitted AVP");
     writer.String("Route-Header-Transmitted");
-    writer.String(_route_hdr_transmitted.c_str());
+    writer.String(rf.route_hdr_transmitted.c_str());
   }
 
   // Add the Instance-Id AVP if set.
-  if (!_instance_id.empty())
+  if (!rf.instance_id.empty())
   {
     TRC_DEBUG("Adding Instance-Id AVP");
     writer.String("Instance-Id");
-    writer.String(_instance_id.c_str());
+    writer.String(rf.instance_id.c_str());
   }
 
   writer.EndObject(); // End ims information object
@@ -1283,17 +1329,21 @@ std::string RalfACR::get_message(pj_time_val timestamp)
 
 void RalfACR::set_default_ccf(const std::string& default_ccf)
 {
+  unshare_fields();
+
   // If we don't yet have a CCF, set this.  It will get overwritten if we
   // subsequently find another CCF.
-  if (_ccfs.empty())
+  if (_rf->ccfs.empty())
   {
-    _ccfs.push_back(default_ccf);
+    _rf->ccfs.push_back(default_ccf);
   }
 }
 
 void RalfACR::override_session_id(const std::string& session_id)
 {
-  _user_session_id = session_id;
+  unshare_fields();
+
+  _rf->user_session_id = session_id;
 }
 
 void RalfACR::lock()
@@ -1472,8 +1522,8 @@ void RalfACR::store_charging_addresses(pjsip_msg* msg)
 {
   // Only store charging addresses for START or EVENT ACRs - they are not
   // needed for INTERIM or STOP ACRs.
-  if ((_record_type == START_RECORD) ||
-      (_record_type == EVENT_RECORD))
+  if ((_rf->record_type == START_RECORD) ||
+      (_rf->record_type == EVENT_RECORD))
   {
     pjsip_p_c_f_a_hdr* p_cfa_hdr = (pjsip_p_c_f_a_hdr*)
                              pjsip_msg_find_hdr_by_name(msg, &STR_P_C_F_A, NULL);
@@ -1481,15 +1531,15 @@ void RalfACR::store_charging_addresses(pjsip_msg* msg)
     {
       // Clear out any existing entries.
       TRC_DEBUG("Found a P-Charging-Function-Address header");
-      _ccfs.clear();
-      _ecfs.clear();
+      _rf->ccfs.clear();
+      _rf->ecfs.clear();
 
       // Copy CCFs from the header.
       for (pjsip_param* p = p_cfa_hdr->ccf.next;
            (p != NULL) && (p != &p_cfa_hdr->ccf);
            p = p->next)
       {
-        _ccfs.push_back(PJUtils::pj_str_to_string(&p->value));
+        _rf->ccfs.push_back(PJUtils::pj_str_to_string(&p->value));
       }
 
       // Copy ECFs from the header.
@@ -1497,9 +1547,9 @@ void RalfACR::store_charging_addresses(pjsip_msg* msg)
            (p != NULL) && (p != &p_cfa_hdr->ecf);
            p = p->next)
       {
-        _ecfs.push_back(PJUtils::pj_str_to_string(&p->value));
+        _rf->ecfs.push_back(PJUtils::pj_str_to_string(&p->value));
       }
-      TRC_DEBUG("%d ccfs and %d ecfs", _ccfs.size(), _ecfs.size());
+      TRC_DEBUG("%d ccfs and %d ecfs", _rf->ccfs.size(), _rf->ecfs.size());
     }
   }
 }
@@ -1511,11 +1561,11 @@ void RalfACR::store_subscription_ids(pjsip_msg* msg)
   while (pa_id != NULL)
   {
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&pa_id->name_addr);
-    _subscription_ids.push_back(uri_to_subscription_id(uri));
+    _rf->subscription_ids.push_back(uri_to_subscription_id(uri));
     pa_id = (pjsip_routing_hdr*)
         pjsip_msg_find_hdr_by_name(msg, &STR_P_ASSERTED_IDENTITY, pa_id->next);
   }
-  TRC_DEBUG("Stored %d subscription identifiers", _subscription_ids.size());
+  TRC_DEBUG("Stored %d subscription identifiers", _rf->subscription_ids.size());
 }
 
 RalfACR::SubscriptionId RalfACR::uri_to_subscription_id(pjsip_uri* uri)
@@ -1545,7 +1595,7 @@ void RalfACR::store_calling_party_addresses(pjsip_msg* msg)
   while (pa_id != NULL)
   {
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&pa_id->name_addr);
-    _calling_party_addresses.push_back(
+    _rf->calling_party_addresses.push_back(
                          PJUtils::uri_to_string(PJSIP_URI_IN_FROMTO_HDR, uri));
     pa_id = (pjsip_routing_hdr*)
         pjsip_msg_find_hdr_by_name(msg, &STR_P_ASSERTED_IDENTITY, pa_id->next);
@@ -1554,7 +1604,7 @@ void RalfACR::store_calling_party_addresses(pjsip_msg* msg)
 
 void RalfACR::store_called_party_address(pjsip_msg* msg)
 {
-  _called_party_address =
+  _rf->called_party_address =
                PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, msg->line.req.uri);
 }
 
@@ -1565,7 +1615,7 @@ void RalfACR::store_called_asserted_ids(pjsip_msg* msg)
   while (pa_id != NULL)
   {
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&pa_id->name_addr);
-    _called_asserted_ids.push_back(
+    _rf->called_asserted_ids.push_back(
                          PJUtils::uri_to_string(PJSIP_URI_IN_FROMTO_HDR, uri));
     pa_id = (pjsip_routing_hdr*)
         pjsip_msg_find_hdr_by_name(msg, &STR_P_ASSERTED_IDENTITY, pa_id->next);
@@ -1580,7 +1630,7 @@ void RalfACR::store_associated_uris(pjsip_msg* msg)
   while (pau != NULL)
   {
     pjsip_uri* uri = (pjsip_uri*)pjsip_uri_get_uri(&pau->name_addr);
-    _associated_uris.push_back(
+    _rf->associated_uris.push_back(
                          PJUtils::uri_to_string(PJSIP_URI_IN_FROMTO_HDR, uri));
     pau = (pjsip_routing_hdr*)
              pjsip_msg_find_hdr_by_name(msg, &STR_P_ASSOCIATED_URI, pau->next);
@@ -1594,9 +1644,9 @@ void RalfACR::store_charging_info(pjsip_msg* msg)
   if (pcv_hdr != NULL)
   {
     TRC_DEBUG("Found P-Charging-Vector header, store information");
-    _icid = PJUtils::pj_str_to_string(&pcv_hdr->icid);
-    _orig_ioi = PJUtils::pj_str_to_string(&pcv_hdr->orig_ioi);
-    _term_ioi = PJUtils::pj_str_to_string(&pcv_hdr->term_ioi);
+    _rf->icid = PJUtils::pj_str_to_string(&pcv_hdr->icid);
+    _rf->orig_ioi = PJUtils::pj_str_to_string(&pcv_hdr->orig_ioi);
+    _rf->term_ioi = PJUtils::pj_str_to_string(&pcv_hdr->term_ioi);
 
     for (pjsip_param* p = pcv_hdr->other_param.next;
          (p != NULL) && (p != &pcv_hdr->other_param);
@@ -1604,7 +1654,7 @@ void RalfACR::store_charging_info(pjsip_msg* msg)
     {
       if (pj_stricmp(&p->name, &STR_TRANSIT_IOI) == 0)
       {
-        _transit_iois.push_back(PJUtils::pj_str_to_string(&p->value));
+        _rf->transit_iois.push_back(PJUtils::pj_str_to_string(&p->value));
       }
     }
   }
@@ -1615,14 +1665,14 @@ void RalfACR::store_media_description(pjsip_msg* msg, MediaDescription& descript
   // If the message has an SDP body store it in the offer or answer slot.
   pjsip_msg_body* body = msg->body;
 
-  // LCOV_EXCL_START - TODO, currently only stores _method on _first_req in a 
-  // dialog (hence _method is never ACK), may not be right as SDP etc. does 
+  // LCOV_EXCL_START - TODO, currently only stores _rf->method on _first_req in a 
+  // dialog (hence _rf->method is never ACK), may not be right as SDP etc. does 
   // change in a dialog
   if ((body != NULL) &&
       (pj_stricmp(&body->content_type.type, &STR_APPLICATION) == 0) &&
       (pj_stricmp(&body->content_type.subtype, &STR_SDP) == 0))
   {
-    if (_method == "ACK")
+    if (_rf->method == "ACK")
     {
       // ACKs can only every carry answers.
       store_media_components(msg, description.answer);
@@ -1654,9 +1704,9 @@ void RalfACR::store_media_components(pjsip_msg* msg, MediaComponents& components
   // - whether the SDP is on the request or response
   // - the orientation of this transaction relative to the initial
   //   transaction that set up the dialog
-  if (((_initiator == Initiator::CALLING_PARTY) &&
+  if (((_rf->initiator == Initiator::CALLING_PARTY) &&
        (msg->type == PJSIP_REQUEST_MSG)) ||
-      ((_initiator == Initiator::CALLED_PARTY) &&
+      ((_rf->initiator == Initiator::CALLED_PARTY) &&
        (msg->type == PJSIP_RESPONSE_MSG)))
   {
     components.initiator_flag = Initiator::CALLING_PARTY;
@@ -1680,7 +1730,7 @@ void RalfACR::store_media_components(pjsip_msg* msg, MediaComponents& components
   }
   else if (msg->type == PJSIP_RESPONSE_MSG)
   {
-    components.initiator_party = _requested_party_address;
+    components.initiator_party = _rf->requested_party_address;
   }
 }
 
@@ -1714,9 +1764,9 @@ void RalfACR::store_message_bodies(pjsip_msg* msg)
     }
 
     // LCOV_EXCL_START - TODO
-    if (((_initiator == Initiator::CALLING_PARTY) &&
+    if (((_rf->initiator == Initiator::CALLING_PARTY) &&
          (msg->type == PJSIP_REQUEST_MSG)) ||
-        ((_initiator == Initiator::CALLED_PARTY) &&
+        ((_rf->initiator == Initiator::CALLED_PARTY) &&
          (msg->type == PJSIP_RESPONSE_MSG)))
     {
       body.originator = Originator::CALLING_PARTY;
@@ -1727,7 +1777,7 @@ void RalfACR::store_message_bodies(pjsip_msg* msg)
     }
     // LCOV_EXCL_STOP
 
-    _msg_bodies.push_back(body);
+    _rf->msg_bodies.push_back(body);
   }
 }
 
@@ -1749,7 +1799,7 @@ void RalfACR::store_instance_id(pjsip_msg* msg)
       if (instance.size() >= 2)
       {
         // Found the instance identifier, so convert to a string and dequote.
-        _instance_id = instance.substr(1, instance.size() - 2);
+        _rf->instance_id = instance.substr(1, instance.size() - 2);
         break;
       }
     }
@@ -1776,10 +1826,10 @@ std::string RalfACR::hdr_contents(pjsip_hdr* hdr)
 RalfACRFactory::RalfACRFactory(RalfProcessor* ralf,
                                ACR::Node node_functionality) :
   _ralf(ralf),
-  _node_functionality(node_functionality)
+  _rf->node_functionality(node_functionality)
 {
   TRC_DEBUG("Created RalfACR factory for node type %s",
-            ACR::node_name(_node_functionality).c_str());
+            ACR::node_name(_rf->node_functionality).c_str());
 }
 
 /// RalfACRFactory Destructor.
@@ -1793,9 +1843,9 @@ ACR* RalfACRFactory::get_acr(SAS::TrailId trail,
                              ACR::NodeRole role)
 {
   TRC_DEBUG("Create RalfACR for node type %s with role %s",
-            ACR::node_name(_node_functionality).c_str(),
+            ACR::node_name(_rf->node_functionality).c_str(),
             ACR::node_role_str(role).c_str());
 
-  return (ACR*)new RalfACR(_ralf, trail, _node_functionality, initiator, role);
+  return (ACR*)new RalfACR(_ralf, trail, _rf->node_functionality, initiator, role);
 }
 
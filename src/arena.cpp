@@ -0,0 +1,88 @@
+/**
+ * @file arena.cpp  Memory arena for short-lived bookkeeping containers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string.h>
+
+#include "arena.h"
+
+Arena::Arena() :
+  _next(_initial),
+  _end(_initial + INITIAL_SIZE),
+  _blocks(NULL),
+  _heap_blocks(0)
+{
+  memset(_free, 0, sizeof(_free));
+}
+
+Arena::~Arena()
+{
+  while (_blocks != NULL)
+  {
+    Block* block = _blocks;
+    _blocks = block->next;
+    ::operator delete(block);
+  }
+}
+
+void* Arena::allocate(size_t size)
+{
+  if (size > MAX_SMALL_SIZE)
+  {
+    return ::operator new(size);
+  }
+
+  // Reuse a freed chunk of the same size if there is one.
+  size_t sc = size_class(size);
+  if (_free[sc] != NULL)
+  {
+    FreeChunk* chunk = _free[sc];
+    _free[sc] = chunk->next;
+    return chunk;
+  }
+
+  size_t rounded = sc * ALIGNMENT;
+  if ((size_t)(_end - _next) < rounded)
+  {
+    // The current block is exhausted, so start a new one.  Whatever is left
+    // of the old block is wasted, but this is at most MAX_SMALL_SIZE bytes.
+    // The header is padded to keep the chunks aligned.
+    const size_t header = size_class(sizeof(Block)) * ALIGNMENT;
+    Block* block = static_cast<Block*>(::operator new(header + BLOCK_SIZE));
+    block->next = _blocks;
+    _blocks = block;
+    _heap_blocks++;
+    _next = reinterpret_cast<char*>(block) + header;
+    _end = _next + BLOCK_SIZE;
+  }
+
+  void* ptr = _next;
+  _next += rounded;
+  return ptr;
+}
+
+void Arena::deallocate(void* ptr, size_t size)
+{
+  if (ptr == NULL)
+  {
+    return;
+  }
+
+  if (size > MAX_SMALL_SIZE)
+  {
+    ::operator delete(ptr);
+    return;
+  }
+
+  size_t sc = size_class(size);
+  FreeChunk* chunk = static_cast<FreeChunk*>(ptr);
+  chunk->next = _free[sc];
+  _free[sc] = chunk;
+}
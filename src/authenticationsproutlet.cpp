@@ -524,21 +524,11 @@ AuthenticationVector* AuthenticationSproutletTsx::get_av_from_store(const std::s
   return av;
 }
 
-void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* credentials,
-                                                  pj_bool_t stale,
-                                                  std::string resync,
-                                                  pjsip_msg* req,
-                                                  pjsip_msg* rsp)
+// Works out the authorization type to request from the HSS, following Annex
+// P.4 of TS 33.203.  Currently only support AKA and SIP Digest, so only
+// implement the subset of steps required to distinguish between the two.
+static std::string get_auth_type(pjsip_digest_credential* credentials)
 {
-  // Get the public and private identities from the request.
-  std::string impi;
-  std::string impu_for_hss;
-  bool av_source_unavailable = false;
-  ImpiStore::Impi* impi_obj = nullptr;
-
-  // Set up the authorization type, following Annex P.4 of TS 33.203.  Currently
-  // only support AKA and SIP Digest, so only implement the subset of steps
-  // required to distinguish between the two.
   std::string auth_type;
   if (credentials != NULL)
   {
@@ -562,11 +552,36 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
     }
   }
 
+  return auth_type;
+}
+
+// Whether the authentication vector to challenge a request must come from the
+// HSS.
+bool AuthenticationSproutletTsx::av_required_from_hss(pjsip_msg* req)
+{
+  // This is the case for a REGISTER, or a request that Sprout should
+  // authenticate by treating it like a REGISTER.
+  return ((req->line.req.method.id == PJSIP_REGISTER_METHOD) ||
+          (PJUtils::is_param_in_route_hdr(route_hdr(), &STR_AUTO_REG)));
+}
+
+void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* credentials,
+                                                  pj_bool_t stale,
+                                                  std::string resync,
+                                                  pjsip_msg* req,
+                                                  pjsip_msg* rsp)
+{
+  // Get the public and private identities from the request.
+  std::string impi;
+  std::string impu_for_hss;
+  bool av_source_unavailable = false;
+  ImpiStore::Impi* impi_obj = nullptr;
+  std::string auth_type = get_auth_type(credentials);
+
   // Get an authentication vector to challenge this request.
   AuthenticationVector* av = NULL;
 
-  if ((req->line.req.method.id == PJSIP_REGISTER_METHOD) ||
-      (PJUtils::is_param_in_route_hdr(route_hdr(), &STR_AUTO_REG)))
+  if (av_required_from_hss(req))
   {
     // This is either a REGISTER, or a request that Sprout should authenticate
     // by treating it like a REGISTER. Get the Authentication Vector from the
@@ -591,6 +606,8 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
       av = verify_auth_vector(doc, impi);
     }
     delete doc; doc = NULL;
+
+    challenge_with_av(av, av_source_unavailable, impi, impu_for_hss, NULL, stale, req, rsp);
   }
   else
   {
@@ -623,8 +640,71 @@ void AuthenticationSproutletTsx::create_challenge(pjsip_digest_credential* crede
         delete impi_obj; impi_obj = NULL;
       }
     }
+
+    challenge_with_av(av, av_source_unavailable, impi, "", impi_obj, stale, req, rsp);
   }
+}
+
+// Gets an authentication vector from the HSS to challenge a request without
+// blocking this thread, then creates the challenge and sends the response.
+void AuthenticationSproutletTsx::create_challenge_async(pjsip_digest_credential* credentials,
+                                                        pj_bool_t stale,
+                                                        std::string resync,
+                                                        pjsip_msg* req,
+                                                        pjsip_msg* rsp,
+                                                        ACR* acr)
+{
+  std::string impi;
+  std::string impu_for_hss;
+  PJUtils::get_impi_and_impu(req, impi, impu_for_hss, get_pool(req), trail());
+  TRC_DEBUG("Get AV asynchronously from HSS for impi=%s impu=%s",
+            impi.c_str(), impu_for_hss.c_str());
+
+  // Processing carries on when the HSS responds.  The ACR is owned by the
+  // callback, so that it is freed even if the transaction ends first.
+  std::shared_ptr<ACR> acr_ptr(acr);
+  ResumeFn resume = suspend();
+  _authentication->_hss->get_auth_vector_async(
+                                impi,
+                                impu_for_hss,
+                                get_auth_type(credentials),
+                                resync,
+                                _scscf_uri,
+                                trail(),
+                                [this, resume, impi, impu_for_hss, stale, req, rsp, acr_ptr]
+                                (HTTPCode http_code, rapidjson::Document* doc)
+  {
+    std::shared_ptr<rapidjson::Document> doc_ptr(doc);
+    resume([this, http_code, doc_ptr, impi, impu_for_hss, stale, req, rsp, acr_ptr]()
+    {
+      bool av_source_unavailable = ((http_code == HTTP_SERVER_UNAVAILABLE) ||
+                                    (http_code == HTTP_GATEWAY_TIMEOUT));
+      AuthenticationVector* av = NULL;
+
+      if (doc_ptr != NULL)
+      {
+        av = verify_auth_vector(doc_ptr.get(), impi);
+      }
 
+      challenge_with_av(av, av_source_unavailable, impi, impu_for_hss, NULL, stale, req, rsp);
+      send_auth_response(req, rsp, acr_ptr.get());
+    });
+  });
+}
+
+// Adds a challenge using the authentication vector to the response, and
+// stores it.  Takes ownership of the authentication vector and IMPI object.
+// If there's no authentication vector, sets the response's status code to
+// reflect why.
+void AuthenticationSproutletTsx::challenge_with_av(AuthenticationVector* av,
+                                                   bool av_source_unavailable,
+                                                   const std::string& impi,
+                                                   const std::string& impu_for_hss,
+                                                   ImpiStore::Impi* impi_obj,
+                                                   pj_bool_t stale,
+                                                   pjsip_msg* req,
+                                                   pjsip_msg* rsp)
+{
   if (av != NULL)
   {
     // Retrieved a valid authentication vector, so generate the challenge.
@@ -1233,6 +1313,15 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     }
 
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
+
+    if ((_authentication->_hss->is_async()) && (av_required_from_hss(req)))
+    {
+      // Don't block this thread waiting for the HSS.  The response is sent
+      // once the challenge has been created.
+      create_challenge_async(credentials, stale, resync, req, rsp, acr);
+      return;
+    }
+
     create_challenge(credentials, stale, resync, req, rsp);
   }
   else
@@ -1278,14 +1367,22 @@ void AuthenticationSproutletTsx::on_rx_initial_request(pjsip_msg* req)
     rsp = create_response(req, static_cast<pjsip_status_code>(sc));
   }
 
+  send_auth_response(req, rsp, acr);
+  delete acr;
+}
+
+// Sends the response to a request that hasn't been authenticated, along with
+// the ACR.
+void AuthenticationSproutletTsx::send_auth_response(pjsip_msg* req,
+                                                    pjsip_msg* rsp,
+                                                    ACR* acr)
+{
   // Send the ACR.
   acr->tx_response(rsp);
   acr->send();
 
   send_response(rsp);
   free_msg(req);
-
-  delete acr;
 }
 
 void AuthenticationSproutletTsx::on_rx_response(pjsip_msg* rsp, int fork_id)
@@ -799,10 +799,10 @@ int BasicProxy::UASTsx::process_routing()
 pj_status_t BasicProxy::UASTsx::create_pjsip_transaction(pjsip_rx_data* rdata)
 {
   // Create a group lock, and take it.  This avoids the transaction being
-  // destroyed before we even get our hands on it.  It is okay to use our
-  // global pool here as PJSIP creates its own pool for the lock, using the
-  // same factory as the supplied pool.
-  pj_status_t status = pj_grp_lock_create(stack_data.pool, NULL, &_lock);
+  // destroyed before we even get our hands on it.  The lock gets its own pool
+  // from one of the dedicated group lock pool factories, so creating it
+  // doesn't contend with other threads on the global pool.
+  pj_status_t status = create_grp_lock(&_lock);
   if (status != PJ_SUCCESS)
   {
     // LCOV_EXCL_START
@@ -1867,7 +1867,7 @@ pj_status_t UASTransaction::create(pjsip_rx_data* rdata,
   // Create a group lock, and take it.  This avoids the transaction being
   // destroyed before we even get our hands on it.
   pj_grp_lock_t* lock;
-  pj_status_t status = pj_grp_lock_create(stack_data.pool, NULL, &lock);
+  pj_status_t status = create_grp_lock(&lock);
   if (status != PJ_SUCCESS)
   {
     return status;
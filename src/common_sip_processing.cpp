@@ -37,6 +37,7 @@ extern "C" {
 #include "utils.h"
 #include "health_checker.h"
 #include "uri_classifier.h"
+#include "msg_trace.h"
 
 static SNMP::CounterByScopeTable* requests_counter = NULL;
 static HealthChecker* health_checker = NULL;
@@ -85,6 +86,16 @@ static void local_log_rx_msg(pjsip_rx_data* rdata)
               rdata->pkt_info.src_port,
               (int)rdata->msg_info.len,
               rdata->msg_info.msg_buf);
+
+  if (MsgTrace::sample())
+  {
+    MsgTrace::record(std::string("RX ") + pjsip_rx_data_get_info(rdata) +
+                     " from " + rdata->tp_info.transport->type_name + " " +
+                     rdata->pkt_info.src_name + ":" +
+                     std::to_string(rdata->pkt_info.src_port),
+                     rdata->msg_info.msg_buf,
+                     rdata->msg_info.len);
+  }
 }
 
 
@@ -101,6 +112,16 @@ static void local_log_tx_msg(pjsip_tx_data* tdata)
               tdata->tp_info.dst_port,
               (int)(tdata->buf.cur - tdata->buf.start),
               tdata->buf.start);
+
+  if (MsgTrace::sample())
+  {
+    MsgTrace::record(std::string("TX ") + pjsip_tx_data_get_info(tdata) +
+                     " to " + tdata->tp_info.transport->type_name + " " +
+                     tdata->tp_info.dst_name + ":" +
+                     std::to_string(tdata->tp_info.dst_port),
+                     tdata->buf.start,
+                     (int)(tdata->buf.cur - tdata->buf.start));
+  }
 }
 
 // LCOV_EXCL_START - can't meaningfully test SAS in UT
@@ -19,17 +19,31 @@
 #include <arpa/nameser.h>
 #include <boost/algorithm/string/predicate.hpp>
 #include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 
 #include "dnsresolver.h"
 #include "log.h"
 #include "sproutsasevent.h"
 
-DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
+DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers,
+                         int port) :
                          _req_pending(false),
                          _trail(0),
                          _domain(""),
                          _status(ARES_SUCCESS),
-                         _naptr_reply(NULL)
+                         _naptr_reply(NULL),
+                         _ttl(0)
+{
+  init_channel(_channel, _ares_addrs, servers, port);
+}
+
+
+void DNSResolver::init_channel(ares_channel& channel,
+                               struct ares_addr_port_node* ares_addrs,
+                               const std::vector<struct IP46Address>& servers,
+                               int port)
 {
   // Set options to ensure we always get a response as quickly as possible -
   // we are on the call path!
@@ -44,7 +58,7 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
   options.ndots = 0;
   options.servers = NULL;
   options.nservers = 0;
-  ares_init_options(&_channel,
+  ares_init_options(&channel,
                     &options,
                     ARES_OPT_FLAGS |
                     ARES_OPT_TIMEOUTMS |
@@ -53,10 +67,11 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
                     ARES_OPT_SERVERS);
 
   // Point the DNS resolver at the desired server.  We must use
-  // ares_set_servers rather than setting it in the options for IPv6 support,
+  // ares_set_servers_ports rather than setting it in the options for IPv6
+  // support, and so that the port is honoured.
 
   // Convert our vector of IP46Addresses into the linked list of
-  // ares_addr_nodes which ares_set_server takes.
+  // ares_addr_port_nodes which ares_set_servers_ports takes.
   size_t server_count = std::min((size_t)3u, servers.size());
 
   for (size_t ii = 0;
@@ -64,18 +79,20 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
        ii++)
   {
     IP46Address server = servers[ii];
-    struct ares_addr_node* ares_addr = &_ares_addrs[ii];
-    memset(ares_addr, 0, sizeof(struct ares_addr_node));
+    struct ares_addr_port_node* ares_addr = &ares_addrs[ii];
+    memset(ares_addr, 0, sizeof(struct ares_addr_port_node));
 
     if (ii > 0)
     {
       // LCOV_EXCL_START
       int prev_idx = ii - 1;
-      _ares_addrs[prev_idx].next = ares_addr;
+      ares_addrs[prev_idx].next = ares_addr;
       // LCOV_EXCL_STOP
     }
 
     ares_addr->family = server.af;
+    ares_addr->udp_port = port;
+    ares_addr->tcp_port = port;
 
     if (server.af == AF_INET)
     {
@@ -88,7 +105,7 @@ DNSResolver::DNSResolver(const std::vector<struct IP46Address>& servers) :
       // LCOV_EXCL_STOP
     }
   }
-  ares_set_servers(_channel, &(_ares_addrs[0]));
+  ares_set_servers_ports(channel, &(ares_addrs[0]));
 }
 
 
@@ -114,7 +131,7 @@ void DNSResolver::destroy(DNSResolver* resolver)
 
 
 // LCOV_EXCL_START
-int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
   send_naptr_query(domain, trail);
   CW_IO_STARTS("DNS NAPTR query")
@@ -125,11 +142,13 @@ int DNSResolver::perform_naptr_query(const std::string& domain, struct ares_napt
 
   // Save off the results...
   naptr_reply = _naptr_reply;
+  ttl = _ttl;
   int status = _status;
   // ...and then clear out our state.
   _trail = 0;
   _domain = "";
   _naptr_reply = NULL;
+  _ttl = 0;
   _status = ARES_SUCCESS;
 
   return status;
@@ -141,12 +160,17 @@ void DNSResolver::free_naptr_reply(struct ares_naptr_reply* naptr_reply) const
   ares_free_data(naptr_reply);
 }
 
-void DNSResolver::send_naptr_query(const std::string& domain, SAS::TrailId trail)
+void DNSResolver::log_naptr_query(const std::string& domain, SAS::TrailId trail)
 {
-  // Log the query.
   SAS::Event event(trail, SASEvent::TX_ENUM_REQ, 0);
   event.add_var_param(domain);
   SAS::report_event(event);
+}
+
+void DNSResolver::send_naptr_query(const std::string& domain, SAS::TrailId trail)
+{
+  // Log the query.
+  log_naptr_query(domain, trail);
   _trail = trail;
   _domain = domain;
 
@@ -240,32 +264,63 @@ void DNSResolver::ares_callback(int status,
                                 unsigned char* abuf,
                                 int alen)
 {
-  _status = status;
+  _status = parse_naptr_response(_domain,
+                                 _trail,
+                                 status,
+                                 abuf,
+                                 alen,
+                                 _naptr_reply,
+                                 _ttl);
+  _req_pending = false;
+}
+
+
+int DNSResolver::parse_naptr_response(const std::string& domain,
+                                      SAS::TrailId trail,
+                                      int status,
+                                      unsigned char* abuf,
+                                      int alen,
+                                      struct ares_naptr_reply*& naptr_reply,
+                                      int& ttl)
+{
+  ttl = 0;
+
   if (status == ARES_SUCCESS)
   {
     // Log that we've succeeded.
-    SAS::Event event(_trail, SASEvent::RX_ENUM_RSP, 0);
-    event.add_var_param(_domain);
+    SAS::Event event(trail, SASEvent::RX_ENUM_RSP, 0);
+    event.add_var_param(domain);
     event.add_var_param(alen, abuf);
     SAS::report_event(event);
 
     // Parse the reply.
-    _status = ares_parse_naptr_reply(abuf, alen, &_naptr_reply);
-    if (_status != ARES_SUCCESS)
+    status = ares_parse_naptr_reply(abuf, alen, &naptr_reply);
+    if (status != ARES_SUCCESS)
+    {
+      TRC_WARNING("Unparseable DNS ENUM response from host %s: %s", domain.c_str(), ares_strerror(status));
+    }
+    else
     {
-      TRC_WARNING("Unparseable DNS ENUM response from host %s: %s", _domain.c_str(), ares_strerror(status));
+      ttl = response_ttl(abuf, alen);
     }
   }
   else
   {
     // Log that we've failed.
-    TRC_WARNING("DNS ENUM query failed for host %s: %s", _domain.c_str(), ares_strerror(status));
-    SAS::Event event(_trail, SASEvent::RX_ENUM_ERR, 0);
+    TRC_WARNING("DNS ENUM query failed for host %s: %s", domain.c_str(), ares_strerror(status));
+    SAS::Event event(trail, SASEvent::RX_ENUM_ERR, 0);
     event.add_static_param(status);
-    event.add_var_param(_domain);
+    event.add_var_param(domain);
     SAS::report_event(event);
+
+    // The domain doesn't exist, which we may be able to cache.
+    if ((status == ARES_ENOTFOUND) && (abuf != NULL))
+    {
+      ttl = response_ttl(abuf, alen);
+    }
   }
-  _req_pending = false;
+
+  return status;
 }
 
 
@@ -273,4 +328,367 @@ DNSResolver* DNSResolverFactory::new_resolver(const std::vector<struct IP46Addre
 {
   return new DNSResolver(servers);
 }
+
+AsyncDNSResolver* DNSResolverFactory::new_async_resolver(const std::vector<struct IP46Address>& servers) const
+{
+  return new AsyncDNSResolver(servers);
+}
 // LCOV_EXCL_STOP
+
+
+// Skips over a (possibly compressed) domain name in a DNS message, returning
+// the offset of the first byte after it, or -1 if the name is malformed.
+static int skip_dns_name(const unsigned char* abuf, int alen, int offset)
+{
+  while (offset < alen)
+  {
+    unsigned char len = abuf[offset];
+    if ((len & 0xc0) == 0xc0)
+    {
+      // A pointer to a name elsewhere in the message ends the name.
+      return offset + 2;
+    }
+    else if (len == 0)
+    {
+      return offset + 1;
+    }
+    offset += len + 1;
+  }
+  return -1;
+}
+
+static uint16_t read_dns_uint16(const unsigned char* p)
+{
+  return ((uint16_t)p[0] << 8) | (uint16_t)p[1];
+}
+
+static uint32_t read_dns_uint32(const unsigned char* p)
+{
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+         ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+int DNSResolver::response_ttl(const unsigned char* abuf, int alen)
+{
+  if ((abuf == NULL) || (alen < NS_HFIXEDSZ))
+  {
+    return 0;
+  }
+
+  int qdcount = read_dns_uint16(abuf + 4);
+  int ancount = read_dns_uint16(abuf + 6);
+  int nscount = read_dns_uint16(abuf + 8);
+
+  // Skip the questions.
+  int offset = NS_HFIXEDSZ;
+  for (int ii = 0; (ii < qdcount) && (offset >= 0); ii++)
+  {
+    offset = skip_dns_name(abuf, alen, offset);
+    offset = (offset >= 0) ? offset + NS_QFIXEDSZ : offset;
+  }
+
+  // Walk the answers, and then the authority records if there are no answers.
+  int rr_count = (ancount > 0) ? ancount : nscount;
+  int64_t ttl = -1;
+
+  for (int ii = 0; (ii < rr_count) && (offset >= 0); ii++)
+  {
+    offset = skip_dns_name(abuf, alen, offset);
+    if ((offset < 0) || (offset + NS_RRFIXEDSZ > alen))
+    {
+      return 0;
+    }
+
+    int type = read_dns_uint16(abuf + offset);
+    int64_t rr_ttl = read_dns_uint32(abuf + offset + 4);
+    int rdlength = read_dns_uint16(abuf + offset + 8);
+    offset += NS_RRFIXEDSZ;
+    if (offset + rdlength > alen)
+    {
+      return 0;
+    }
+
+    if (ancount == 0)
+    {
+      // This is a negative response, so look for the SOA record.  Its
+      // negative caching TTL is the lower of its own TTL and its MINIMUM
+      // field, which is the last field in the record.
+      if ((type == ns_t_soa) && (rdlength >= 20))
+      {
+        int64_t minimum = read_dns_uint32(abuf + offset + rdlength - 4);
+        ttl = std::min(rr_ttl, minimum);
+        break;
+      }
+    }
+    else if ((ttl < 0) || (rr_ttl < ttl))
+    {
+      ttl = rr_ttl;
+    }
+
+    offset += rdlength;
+  }
+
+  // TTLs with the top bit set are treated as 0 (RFC 2181, 8).
+  return ((ttl > 0) && (ttl <= INT32_MAX)) ? (int)ttl : 0;
+}
+
+
+AsyncDNSResolver::AsyncDNSResolver(const std::vector<struct IP46Address>& servers,
+                                   int port) :
+  _queued_queries(),
+  _terminated(false)
+{
+  DNSResolver::init_channel(_channel, _ares_addrs, servers, port);
+  pthread_mutex_init(&_lock, NULL);
+
+  // Create the pipe used to wake the I/O thread.  Both ends are
+  // non-blocking, so that the I/O thread can drain it and so that waking the
+  // I/O thread never blocks.
+  if (pipe(_wake_pipe) != 0)
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to create pipe for DNS I/O thread: %d", errno);
+    _wake_pipe[0] = -1;
+    _wake_pipe[1] = -1;
+    // LCOV_EXCL_STOP
+  }
+  else
+  {
+    fcntl(_wake_pipe[0], F_SETFL, fcntl(_wake_pipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(_wake_pipe[1], F_SETFL, fcntl(_wake_pipe[1], F_GETFL) | O_NONBLOCK);
+  }
+
+  int rc = pthread_create(&_io_thread, NULL, io_thread_fn, this);
+  if (rc != 0)
+  {
+    // LCOV_EXCL_START
+    TRC_ERROR("Failed to create DNS I/O thread: %d", rc);
+    _terminated = true;
+    // LCOV_EXCL_STOP
+  }
+}
+
+
+AsyncDNSResolver::~AsyncDNSResolver()
+{
+  pthread_mutex_lock(&_lock);
+  bool running = !_terminated;
+  _terminated = true;
+  pthread_mutex_unlock(&_lock);
+
+  if (running)
+  {
+    wake_io_thread();
+    pthread_join(_io_thread, NULL);
+  }
+
+  // Fail any queries that the I/O thread didn't get round to sending, then
+  // destroy the channel, which fails any queries that are still outstanding.
+  while (!_queued_queries.empty())
+  {
+    Query* query = _queued_queries.front();
+    _queued_queries.pop_front();
+    query->callback(ARES_EDESTRUCTION, NULL, 0);
+    delete query;
+  }
+
+  ares_destroy(_channel);
+
+  if (_wake_pipe[0] != -1)
+  {
+    close(_wake_pipe[0]);
+    close(_wake_pipe[1]);
+  }
+
+  pthread_mutex_destroy(&_lock);
+}
+
+
+void AsyncDNSResolver::send_naptr_query(const std::string& domain,
+                                        SAS::TrailId trail,
+                                        NaptrCallback callback)
+{
+  DNSResolver::log_naptr_query(domain, trail);
+  TRC_DEBUG("Queueing DNS NAPTR query for %s", domain.c_str());
+
+  Query* query = new Query;
+  query->domain = domain;
+  query->trail = trail;
+  query->callback = callback;
+
+  pthread_mutex_lock(&_lock);
+  bool terminated = _terminated;
+  if (!terminated)
+  {
+    _queued_queries.push_back(query);
+  }
+  pthread_mutex_unlock(&_lock);
+
+  if (terminated)
+  {
+    // LCOV_EXCL_START
+    TRC_WARNING("DNS NAPTR query for %s sent after resolver terminated",
+                domain.c_str());
+    callback(ARES_EDESTRUCTION, NULL, 0);
+    delete query;
+    // LCOV_EXCL_STOP
+  }
+  else
+  {
+    wake_io_thread();
+  }
+}
+
+
+void AsyncDNSResolver::free_naptr_reply(struct ares_naptr_reply* naptr_reply) const
+{
+  ares_free_data(naptr_reply);
+}
+
+
+void* AsyncDNSResolver::io_thread_fn(void* resolver)
+{
+  ((AsyncDNSResolver*)resolver)->io_thread();
+  return NULL;
+}
+
+
+void AsyncDNSResolver::io_thread()
+{
+  while (true)
+  {
+    pthread_mutex_lock(&_lock);
+    bool terminated = _terminated;
+    pthread_mutex_unlock(&_lock);
+
+    if (terminated)
+    {
+      break;
+    }
+
+    // Poll the wake pipe plus the sockets ares is using.
+    struct pollfd fds[ARES_GETSOCK_MAXNUM + 1];
+    fds[0].fd = _wake_pipe[0];
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    int num_fds = 1;
+
+    ares_socket_t scks[ARES_GETSOCK_MAXNUM];
+    int rw_bits = ares_getsock(_channel, scks, ARES_GETSOCK_MAXNUM);
+    for (int sck_idx = 0; sck_idx < ARES_GETSOCK_MAXNUM; sck_idx++)
+    {
+      struct pollfd* fd = &fds[num_fds];
+      fd->fd = scks[sck_idx];
+      fd->events = 0;
+      fd->revents = 0;
+      if (ARES_GETSOCK_READABLE(rw_bits, sck_idx))
+      {
+        fd->events |= POLLRDNORM | POLLIN;
+      }
+      if (ARES_GETSOCK_WRITABLE(rw_bits, sck_idx))
+      {
+        fd->events |= POLLWRNORM | POLLOUT;
+      }
+      if (fd->events != 0)
+      {
+        num_fds++;
+      }
+    }
+
+    // Wait until the next ares timeout, or indefinitely if there are no
+    // queries outstanding.
+    struct timeval tv;
+    int timeout_ms = -1;
+    if (ares_timeout(_channel, NULL, &tv) != NULL)
+    {
+      timeout_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    }
+
+    int rc = poll(fds, num_fds, timeout_ms);
+
+    if (rc > 0)
+    {
+      for (int fd_idx = 1; fd_idx < num_fds; fd_idx++)
+      {
+        struct pollfd* fd = &fds[fd_idx];
+        if (fd->revents != 0)
+        {
+          ares_process_fd(_channel,
+                          fd->revents & (POLLRDNORM | POLLIN) ? fd->fd : ARES_SOCKET_BAD,
+                          fd->revents & (POLLWRNORM | POLLOUT) ? fd->fd : ARES_SOCKET_BAD);
+        }
+      }
+
+      if (fds[0].revents != 0)
+      {
+        // Drain the wake pipe, then send any new queries.
+        char buf[64];
+        while (read(_wake_pipe[0], buf, sizeof(buf)) > 0)
+        {
+        }
+        send_queued_queries();
+      }
+    }
+    else if (rc == 0)
+    {
+      // No events, so just call into ares to let it handle timeouts.
+      ares_process_fd(_channel, ARES_SOCKET_BAD, ARES_SOCKET_BAD);
+    }
+  }
+}
+
+
+void AsyncDNSResolver::send_queued_queries()
+{
+  std::deque<Query*> queries;
+  pthread_mutex_lock(&_lock);
+  queries.swap(_queued_queries);
+  pthread_mutex_unlock(&_lock);
+
+  for (std::deque<Query*>::const_iterator query = queries.begin();
+       query != queries.end();
+       ++query)
+  {
+    TRC_DEBUG("Sending DNS NAPTR query for %s", (*query)->domain.c_str());
+    ares_query(_channel,
+               (*query)->domain.c_str(),
+               ns_c_in,
+               ns_t_naptr,
+               AsyncDNSResolver::ares_callback,
+               *query);
+  }
+}
+
+
+void AsyncDNSResolver::wake_io_thread()
+{
+  char c = 0;
+  if (write(_wake_pipe[1], &c, 1) != 1)
+  {
+    // LCOV_EXCL_START - the pipe is only full if the I/O thread already has
+    // a wake-up pending.
+    TRC_DEBUG("Failed to wake DNS I/O thread: %d", errno);
+    // LCOV_EXCL_STOP
+  }
+}
+
+
+void AsyncDNSResolver::ares_callback(void* arg,
+                                     int status,
+                                     int timeouts,
+                                     unsigned char* abuf,
+                                     int alen)
+{
+  Query* query = (Query*)arg;
+  struct ares_naptr_reply* naptr_reply = NULL;
+  int ttl = 0;
+  status = DNSResolver::parse_naptr_response(query->domain,
+                                             query->trail,
+                                             status,
+                                             abuf,
+                                             alen,
+                                             naptr_reply,
+                                             ttl);
+  query->callback(status, naptr_reply, ttl);
+  delete query;
+}
@@ -148,7 +148,7 @@ void JSONEnumService::update_enum()
   try
   {
     std::vector<NumberPrefix> new_number_prefixes;
-    std::map<std::string, NumberPrefix> new_prefix_regex_map;
+    PrefixTrie<NumberPrefix> new_prefix_trie;
 
     JSON_ASSERT_CONTAINS(doc, "number_blocks");
     JSON_ASSERT_ARRAY(doc["number_blocks"]);
@@ -173,11 +173,10 @@ void JSONEnumService::update_enum()
 
         if (parse_regex_replace(regex, pfix.match, pfix.replace))
         {
-          // Create an array in order of entries in json file, and a map
-          // (automatically sorted in order of key length) so we can later
-          // match numbers to the most specific prefixes
+          // Create an array in order of entries in json file, and a trie so
+          // we can later match numbers to the most specific prefixes
           new_number_prefixes.push_back(pfix);
-          new_prefix_regex_map.insert(std::make_pair(prefix, pfix));
+          new_prefix_trie.insert(prefix, pfix);
           TRC_STATUS("  Adding number prefix %s, regex=%s",
                      pfix.prefix.c_str(), regex.c_str());
         }
@@ -196,10 +195,11 @@ void JSONEnumService::update_enum()
       }
     }
 
-    // Take a write lock on the mutex in RAII style
+    // Take a write lock on the mutex in RAII style.  The old configuration is
+    // swapped out, and freed after the lock is released.
     boost::lock_guard<boost::shared_mutex> write_lock(_number_prefixes_rw_lock);
-    _number_prefixes = new_number_prefixes;
-    _prefix_regex_map = new_prefix_regex_map;
+    _number_prefixes.swap(new_number_prefixes);
+    _prefix_trie.swap(new_prefix_trie);
   }
   catch (JsonFormatError err)
   {
@@ -276,36 +276,32 @@ std::string JSONEnumService::lookup_uri_from_user(const std::string &user, SAS::
 // the object.
 const JSONEnumService::NumberPrefix* JSONEnumService::prefix_match(const std::string& number) const
 {
-  // Iterate through map in reverse order (already sorted by key length during
-  // construction) to find the most specific matching prefix
-  for (std::map<std::string, NumberPrefix>::const_reverse_iterator it =
-                                                     _prefix_regex_map.rbegin();
-       it != _prefix_regex_map.rend();
-       it++)
+  // Find the most specific matching prefix.  The number has already been
+  // converted to an AUS, so has no visual separators.
+  const std::pair<std::string, NumberPrefix>* match =
+                                   _prefix_trie.longest_match(number, true);
+  if (match == NULL)
   {
-    int len = std::min(number.size(), (*it).first.size());
-
-    TRC_DEBUG("Comparing first %d numbers of %s against prefix %s",
-              len, number.c_str(), (*it).first.c_str());
-
-    if (Utils::remove_visual_separators(number).
-                                      compare(0, len, (*it).first, 0, len) == 0)
-    {
-      // Found a match, so return it.
-      TRC_DEBUG("Match found");
-      return &((*it).second);
-    }
+    return NULL;
   }
 
-  return NULL;
+  TRC_DEBUG("Number %s matches prefix %s",
+            number.c_str(), match->first.c_str());
+  return &(match->second);
 }
 
 DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
                                const std::string& dns_suffix,
                                const DNSResolverFactory* resolver_factory,
-                               CommunicationMonitor* comm_monitor) :
+                               CommunicationMonitor* comm_monitor,
+                               size_t cache_size,
+                               SNMP::CounterTable* cache_hit_tbl,
+                               SNMP::CounterTable* cache_miss_tbl,
+                               SNMP::CounterTable* cache_eviction_tbl) :
                                _dns_suffix(dns_suffix),
                                _resolver_factory(resolver_factory),
+                               _async_resolver(NULL),
+                               _rule_cache(NULL),
                                _comm_monitor(comm_monitor)
 {
   // Initialize the ares library.  This might have already been done by curl
@@ -352,6 +348,17 @@ DNSEnumService::DNSEnumService(const std::vector<std::string>& dns_servers,
   // We store a DNSResolver in thread-local data, so create the thread-local
   // store.
   pthread_key_create(&_thread_local, (void(*)(void*))DNSResolver::destroy);
+
+  // Asynchronous lookups all share a single resolver.
+  _async_resolver = _resolver_factory->new_async_resolver(_servers);
+
+  if (cache_size > 0)
+  {
+    _rule_cache = new RuleCache(cache_size,
+                                cache_hit_tbl,
+                                cache_miss_tbl,
+                                cache_eviction_tbl);
+  }
 }
 
 
@@ -367,8 +374,16 @@ DNSEnumService::~DNSEnumService()
     DNSResolver::destroy(resolver);
   }
 
+  // Destroying the asynchronous resolver fails any outstanding lookups, so
+  // must be done while the rest of this object is still intact.
+  delete _async_resolver;
+  _async_resolver = NULL;
+
   delete _resolver_factory;
   _resolver_factory = NULL;
+
+  delete _rule_cache;
+  _rule_cache = NULL;
 }
 
 
@@ -380,6 +395,100 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
     return std::string();
   }
 
+  Lookup lookup(user, trail);
+  // Get the resolver to use.  This comes from thread-local data.
+  DNSResolver* resolver = get_resolver();
+  // Spin round until we've finished (successfully or otherwise) or we've done
+  // the maximum number of queries.
+  while (lookup.in_progress())
+  {
+    // Translate the key into a domain and, unless we have the answer cached,
+    // issue a query for it.
+    std::string domain = key_to_domain(lookup.string);
+    if (!apply_cached_rules(lookup, domain))
+    {
+      struct ares_naptr_reply* naptr_reply = NULL;
+      int ttl = 0;
+      int status = resolver->perform_naptr_query(domain, naptr_reply, ttl, trail);
+      process_naptr_reply(lookup, domain, status, naptr_reply, ttl);
+
+      // Free off the NAPTR reply if we have one.
+      if (naptr_reply != NULL)
+      {
+        resolver->free_naptr_reply(naptr_reply);
+        naptr_reply = NULL;
+      }
+    }
+  }
+
+  return finish_lookup(lookup);
+}
+
+
+void DNSEnumService::lookup_uri_from_user_async(const std::string& user,
+                                                SAS::TrailId trail,
+                                                LookupCallback callback) const
+{
+  if (user.empty())
+  {
+    TRC_INFO("No dial string supplied, so don't do ENUM lookup");
+    callback(std::string());
+    return;
+  }
+
+  // The lookup is freed when it finishes.
+  Lookup* lookup = new Lookup(user, trail);
+  lookup->callback = callback;
+  continue_async_lookup(lookup);
+}
+
+
+void DNSEnumService::continue_async_lookup(Lookup* lookup) const
+{
+  while (lookup->in_progress())
+  {
+    std::string domain = key_to_domain(lookup->string);
+    if (!apply_cached_rules(*lookup, domain))
+    {
+      _async_resolver->send_naptr_query(domain,
+                                        lookup->trail,
+                                        [this, lookup, domain](int status,
+                                                               struct ares_naptr_reply* naptr_reply,
+                                                               int ttl)
+      {
+        // This runs on the resolver's I/O thread.
+        process_naptr_reply(*lookup, domain, status, naptr_reply, ttl);
+
+        if (naptr_reply != NULL)
+        {
+          _async_resolver->free_naptr_reply(naptr_reply);
+        }
+
+        continue_async_lookup(lookup);
+      });
+      return;
+    }
+  }
+
+  // The lookup has finished - possibly without any queries, if everything
+  // was cached, in which case the callback is called before
+  // lookup_uri_from_user_async returns.
+  std::string uri = finish_lookup(*lookup);
+  LookupCallback callback = lookup->callback;
+  delete lookup;
+  callback(uri);
+}
+
+
+DNSEnumService::Lookup::Lookup(const std::string& user, SAS::TrailId trail) :
+  user(user),
+  trail(trail),
+  dns_queries(0),
+  complete(false),
+  failed(false),
+  server_contacted(false),
+  server_failed(false)
+{
   // Log starting ENUM processing.
   SAS::Event event(trail, SASEvent::ENUM_START, 0);
   event.add_var_param(user);
@@ -388,108 +497,145 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
   // Determine the Application Unique String (AUS) from the user.  This is
   // used to form the first key, and also as the input into the regular
   // expressions.
-  std::string aus = user_to_aus(user);
-  std::string string = aus;
-  // Get the resolver to use.  This comes from thread-local data.
-  DNSResolver* resolver = get_resolver();
-  // Spin round until we've finished (successfully or otherwise) or we've done
-  // the maximum number of queries.
-  bool complete = false;
-  bool failed = false;
-  bool server_failed = false;
-  int dns_queries = 0;
-  while ((!complete) &&
-         (!failed) &&
-         (dns_queries < MAX_DNS_QUERIES))
-  {
-    // Translate the key into a domain and issue a query for it.
-    std::string domain = key_to_domain(string);
-    struct ares_naptr_reply* naptr_reply = NULL;
-    int status = resolver->perform_naptr_query(domain, naptr_reply, trail);
+  aus = user_to_aus(user);
+  string = aus;
+}
+
+
+bool DNSEnumService::apply_cached_rules(Lookup& lookup,
+                                        const std::string& domain) const
+{
+  RuleSet rules;
+  if ((_rule_cache == NULL) || (!_rule_cache->get(domain, rules)))
+  {
+    return false;
+  }
+
+  TRC_DEBUG("Using cached ENUM rules for %s", domain.c_str());
+  apply_rules(lookup, (rules != NULL) ? ARES_SUCCESS : ARES_ENOTFOUND, rules);
+  return true;
+}
+
+
+void DNSEnumService::process_naptr_reply(Lookup& lookup,
+                                         const std::string& domain,
+                                         int status,
+                                         const struct ares_naptr_reply* naptr_reply,
+                                         int ttl) const
+{
+  lookup.server_contacted = true;
+
+  RuleSet rules;
+  if (status == ARES_SUCCESS)
+  {
+    // Parse the reply into a sorted list of rules.
+    std::vector<Rule>* parsed_rules = new std::vector<Rule>();
+    parse_naptr_reply(naptr_reply, *parsed_rules);
+    rules.reset(parsed_rules);
+  }
+
+  // Cache the result if we can.  We only cache the domain not existing, not
+  // other errors, as these are likely to be transient.
+  if ((_rule_cache != NULL) && (ttl > 0))
+  {
     if (status == ARES_SUCCESS)
     {
-      // Parse the reply into a sorted list of rules.
-      std::vector<Rule> rules;
-      parse_naptr_reply(naptr_reply, rules);
-      // Now spin through the rules, looking for the first match.
-      std::vector<DNSEnumService::Rule>::const_iterator rule;
-      for (rule = rules.begin();
-           rule != rules.end();
-           ++rule)
-      {
-        if (rule->matches(string))
-        {
-          // We found a match, so apply the regular expression to the AUS (not
-          // the previous string - this is what ENUM mandates).  If this was a
-          // terminal rule, we now have a SIP URI and we're finished.
-          // Otherwise, the output of the regular expression is used as the
-          // next key.
-          try
-          {
-            string = rule->replace(aus, trail);
-            complete = rule->is_terminal();
-          }
-          catch(...) // LCOV_EXCL_START Only throws if expression too complex or similar hard-to-hit conditions
-          {
-            TRC_ERROR("Failed to translate number with regex");
-            failed = true;
-            // LCOV_EXCL_STOP
-          }
-          break;
-        }
-      }
-      // If we didn't find a match (and so hit the end of the list), consider
-      // this a failure.
-      failed = failed || (rule == rules.end());
+      _rule_cache->put(domain, rules, ttl);
     }
     else if (status == ARES_ENOTFOUND)
     {
-      // Our DNS query failed, so give up, but this is not an ENUM server issue -
-      // we just tried to look up an unknown name.
-      failed = true;
-    }
-    else
-    {
-      // Our DNS query failed. Give up, and track an ENUM server failure.
-      failed = true;
-      server_failed = true;
+      _rule_cache->put(domain,
+                       RuleSet(),
+                       std::min(ttl, (int)MAX_NEGATIVE_CACHE_TTL_S));
     }
+  }
+
+  apply_rules(lookup, status, rules);
+}
 
 
-    // Free off the NAPTR reply if we have one.
-    if (naptr_reply != NULL)
+void DNSEnumService::apply_rules(Lookup& lookup,
+                                 int status,
+                                 const RuleSet& rules) const
+{
+  if (status == ARES_SUCCESS)
+  {
+    // Spin through the rules, looking for the first match.
+    std::vector<DNSEnumService::Rule>::const_iterator rule;
+    for (rule = rules->begin();
+         rule != rules->end();
+         ++rule)
     {
-      resolver->free_naptr_reply(naptr_reply);
-      naptr_reply = NULL;
+      if (rule->matches(lookup.string))
+      {
+        // We found a match, so apply the regular expression to the AUS (not
+        // the previous string - this is what ENUM mandates).  If this was a
+        // terminal rule, we now have a SIP URI and we're finished.
+        // Otherwise, the output of the regular expression is used as the
+        // next key.
+        try
+        {
+          lookup.string = rule->replace(lookup.aus, lookup.trail);
+          lookup.complete = rule->is_terminal();
+        }
+        catch(...) // LCOV_EXCL_START Only throws if expression too complex or similar hard-to-hit conditions
+        {
+          TRC_ERROR("Failed to translate number with regex");
+          lookup.failed = true;
+          // LCOV_EXCL_STOP
+        }
+        break;
+      }
     }
-
-    dns_queries++;
+    // If we didn't find a match (and so hit the end of the list), consider
+    // this a failure.
+    lookup.failed = lookup.failed || (rule == rules->end());
+  }
+  else if (status == ARES_ENOTFOUND)
+  {
+    // Our DNS query failed, so give up, but this is not an ENUM server issue -
+    // we just tried to look up an unknown name.
+    lookup.failed = true;
+  }
+  else
+  {
+    // Our DNS query failed. Give up, and track an ENUM server failure.
+    lookup.failed = true;
+    lookup.server_failed = true;
   }
 
+  lookup.dns_queries++;
+}
+
+
+std::string DNSEnumService::finish_lookup(const Lookup& lookup) const
+{
+  std::string uri;
+
   // Log that we've finished processing (and whether it was successful or not).
-  if (complete)
+  if (lookup.complete)
   {
-    TRC_DEBUG("Enum lookup completes: %s", string.c_str());
-    SAS::Event event(trail, SASEvent::ENUM_COMPLETE, 0);
-    event.add_var_param(user);
-    event.add_var_param(string);
+    TRC_DEBUG("Enum lookup completes: %s", lookup.string.c_str());
+    SAS::Event event(lookup.trail, SASEvent::ENUM_COMPLETE, 0);
+    event.add_var_param(lookup.user);
+    event.add_var_param(lookup.string);
     SAS::report_event(event);
+    uri = lookup.string;
   }
   else
   {
-    TRC_WARNING("Enum lookup did not complete for user %s", user.c_str());
-    SAS::Event event(trail, SASEvent::ENUM_INCOMPLETE, 0);
-    event.add_var_param(user);
-    SAS::report_event(event);
     // On failure, we must return an empty (rather than incomplete) string.
-    string = std::string("");
+    TRC_WARNING("Enum lookup did not complete for user %s", lookup.user.c_str());
+    SAS::Event event(lookup.trail, SASEvent::ENUM_INCOMPLETE, 0);
+    event.add_var_param(lookup.user);
+    SAS::report_event(event);
   }
 
   // Report state of last communication attempt (which may potentially set/clear
-  // an associated alarm).
-  if (_comm_monitor)
+  // an associated alarm), if we made one.
+  if ((_comm_monitor) && (lookup.server_contacted))
   {
-    if (server_failed)
+    if (lookup.server_failed)
     {
       _comm_monitor->inform_failure();
     }
@@ -499,7 +645,7 @@ std::string DNSEnumService::lookup_uri_from_user(const std::string& user, SAS::T
     }
   }
 
-  return string;
+  return uri;
 }
 
 
@@ -621,3 +767,56 @@ bool DNSEnumService::Rule::compare_order_preference(DNSEnumService::Rule first,
           ((first._order == second._order) &&
            (first._preference < second._preference)));
 }
+
+
+DNSEnumService::RuleCache::RuleCache(size_t max_size,
+                                     SNMP::CounterTable* hit_tbl,
+                                     SNMP::CounterTable* miss_tbl,
+                                     SNMP::CounterTable* eviction_tbl) :
+  _hit_tbl(hit_tbl),
+  _miss_tbl(miss_tbl),
+  // Every entry is stored with the TTL from its DNS response, so the cache
+  // has no default TTL.
+  _cache(max_size, 0, eviction_tbl)
+{
+}
+
+
+bool DNSEnumService::RuleCache::get(const std::string& domain, RuleSet& rules)
+{
+  bool found = _cache.get(domain, rules);
+
+  SNMP::CounterTable* tbl = (found) ? _hit_tbl : _miss_tbl;
+  if (tbl)
+  {
+    tbl->increment();
+  }
+
+  return found;
+}
+
+
+void DNSEnumService::RuleCache::put(const std::string& domain,
+                                    const RuleSet& rules,
+                                    int ttl_s)
+{
+  // ENUM entries are never invalidated, so the generation is only needed to
+  // satisfy the cache's interface.
+  _cache.put(domain,
+             rules,
+             _cache.generation(),
+             std::vector<std::string>(),
+             TtlCache<RuleSet>::Merge(),
+             ttl_s);
+
+  TRC_DEBUG("Cached %s ENUM result for %s for %d seconds",
+            (rules != NULL) ? "positive" : "negative",
+            domain.c_str(),
+            ttl_s);
+}
+
+
+size_t DNSEnumService::RuleCache::size()
+{
+  return _cache.size();
+}
@@ -16,7 +16,6 @@
 #include "sprout_pd_definitions.h"
 #include "utils.h"
 #include "xml_utils.h"
-#include "rapidxml/rapidxml_print.hpp"
 
 FIFCService::FIFCService(Alarm* alarm,
                          std::string configuration):
@@ -68,8 +67,9 @@ void FIFCService::update_fifcs()
     return;
   }
 
-  // Now parse the document.
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  // Now parse the document.  This is kept for as long as any iFCs from it are
+  // in use.
+  std::shared_ptr<rapidxml::xml_document<>> root(new rapidxml::xml_document<>);
 
   // Check the file contains valid xml.
   try
@@ -83,7 +83,6 @@ void FIFCService::update_fifcs()
               err.what());
     CL_SPROUT_FIFC_FILE_INVALID_XML.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
@@ -94,19 +93,15 @@ void FIFCService::update_fifcs()
               "invalid (missing FallbackIFCsSet block)");
     CL_SPROUT_FIFC_FILE_MISSING_FALLBACK_IFCS_SET.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
   // If we have reached this point, we are definitely going to update the current
   // fallback ifc list.
-  // Take a lock while we do so.
-  boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
   bool any_errors = false;
-  _fallback_ifcs.clear();
 
   // Parse any iFCs that are present.
-  std::multimap<int32_t, std::string> ifc_map;
+  std::multimap<int32_t, Ifc> ifc_map;
   rapidxml::xml_node<>* fifc_set = root->first_node(FIFCService::FALLBACK_IFCS_SET);
   rapidxml::xml_node<>* ifc = NULL;
   for (ifc = fifc_set->first_node(RegDataXMLUtils::IFC);
@@ -134,19 +129,22 @@ void FIFCService::update_fifcs()
     }
     // Creating the iFC always passes, and the iFC isn't validated any
     // further at this stage.
-    std::string ifc_str;
-    rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-    ifc_map.insert(std::make_pair(priority, ifc_str));
+    ifc_map.insert(std::make_pair(priority, Ifc(ifc, root)));
   }
 
-  std::vector<std::string> ifcs_vec;
-  for (std::pair<int32_t, std::string> ifc_pair : ifc_map)
+  std::vector<Ifc> ifcs_vec;
+  for (const std::pair<int32_t, Ifc>& ifc_pair : ifc_map)
   {
     ifcs_vec.push_back(ifc_pair.second);
   }
 
   TRC_DEBUG("Adding %lu fallback iFC(s)", ifcs_vec.size());
-  _fallback_ifcs = ifcs_vec;
+
+  {
+    // Swap in the new list, taking a lock while we do so.
+    boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
+    _fallback_ifcs.swap(ifcs_vec);
+  }
 
   if (any_errors)
   {
@@ -157,7 +155,6 @@ void FIFCService::update_fifcs()
     clear_alarm();
   }
 
-  delete root; root = NULL;
   return;
 }
 
@@ -166,13 +163,7 @@ std::vector<Ifc> FIFCService::get_fallback_ifcs(rapidxml::xml_document<>* ifc_do
   // Take a read lock on the mutex in RAII style
   boost::shared_lock<boost::shared_mutex> read_lock(_sets_rw_lock);
 
-  std::vector<Ifc> ifc_vec;
-  for (std::string ifc : _fallback_ifcs)
-  {
-    ifc_vec.push_back(Ifc(ifc, ifc_doc));
-  }
-
-  return ifc_vec;
+  return _fallback_ifcs;
 }
 
 void FIFCService::set_alarm()
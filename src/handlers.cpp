@@ -28,6 +28,7 @@ extern "C" {
 #include "uri_classifier.h"
 #include "sprout_xml_utils.h"
 #include "subscriber_data_utils.h"
+#include "msg_trace.h"
 
 
 static void report_sip_all_register_marker(SAS::TrailId trail, std::string uri_str)
@@ -211,6 +212,10 @@ HTTPCode DeregistrationTask::deregister_bindings(
   std::vector<std::string> binding_ids;
   Bindings unused_bindings;
 
+  // The HSS has deregistered the subscriber, so any profile we have cached for
+  // them is out of date.
+  _cfg->_sm->invalidate_cached_subscriber_state(aor_id);
+
   // Get bindings in this AoR from database
   HTTPCode rc = _cfg->_sm->get_bindings(aor_id, bindings, trail());
   if (rc != HTTP_OK)
@@ -490,6 +495,30 @@ void DeleteImpuTask::run()
   return;
 }
 
+void InvalidateSimservsTask::run()
+{
+  // This interface only supports DELETEs
+  if (_req.method() != htp_method_DELETE)
+  {
+    send_http_reply(HTTP_BADMETHOD);
+    delete this;
+    return;
+  }
+
+  // Extract the IMPU whose simservs have changed. The URL is of the form
+  //
+  //   /simservs/<public ID>
+  const std::string prefix = "/simservs/";
+  std::string impu = _req.full_path().substr(prefix.length());
+  TRC_DEBUG("Request to invalidate cached simservs for %s", impu.c_str());
+
+  _cfg->_cache->invalidate(impu);
+
+  send_http_reply(HTTP_OK);
+  delete this;
+  return;
+}
+
 // Deals with requests sent from Homestead in Push Profile Requests.
 void PushProfileTask::run()
 {
@@ -575,7 +604,34 @@ HTTPCode PushProfileTask::get_associated_uris(std::string body,
 
 HTTPCode PushProfileTask::update_associated_uris(SAS::TrailId trail)
 {
+  // The subscriber's profile has changed, so discard any copies we have
+  // cached, including under IMPUs that the new profile no longer contains.
+  _cfg->_sm->invalidate_cached_subscriber_state(_default_public_id);
+  for (std::string uri : _associated_uris.get_all_uris())
+  {
+    if (uri != _default_public_id)
+    {
+      _cfg->_sm->invalidate_cached_subscriber_state(uri);
+    }
+  }
+
   return _cfg->_sm->update_associated_uris(_default_public_id,
                                            _associated_uris,
                                            trail);
 }
+
+void GetMessageTracesTask::run()
+{
+  // This interface is read only so reject any non-GETs.
+  if (_req.method() != htp_method_GET)
+  {
+    send_http_reply(HTTP_BADMETHOD);
+    delete this;
+    return;
+  }
+
+  _req.add_content(MsgTrace::dump());
+  send_http_reply(HTTP_OK);
+
+  delete this;
+}
@@ -26,6 +26,7 @@
 #include "snmp_continuous_accumulator_table.h"
 #include "xml_utils.h"
 #include "sprout_xml_utils.h"
+#include "subscriber_profile_cache.h"
 
 const std::string HSSConnection::REG = "reg";
 const std::string HSSConnection::CALL = "call";
@@ -35,6 +36,12 @@ const std::string HSSConnection::DEREG_TIMEOUT = "dereg-timeout";
 const std::string HSSConnection::AUTH_TIMEOUT = "dereg-auth-timeout";
 const std::string HSSConnection::AUTH_FAIL = "dereg-auth-failed";
 
+// A request to Homestead that has been in flight for this many times the
+// Homestead timeout (which applies to each attempt, rather than the request as
+// a whole) is assumed to have been abandoned, so identical requests stop
+// waiting for it.
+static const long COALESCED_REQUEST_MAX_WAIT_FACTOR = 4;
+
 HSSConnection::HSSConnection(const std::string& server,
                              HttpResolver* resolver,
                              LoadMonitor *load_monitor,
@@ -46,7 +53,11 @@ HSSConnection::HSSConnection(const std::string& server,
                              SNMP::EventAccumulatorTable* homestead_lir_latency_tbl,
                              CommunicationMonitor* comm_monitor,
                              SIFCService* sifc_service,
-                             long homestead_timeout_ms) :
+                             long homestead_timeout_ms,
+                             SubscriberProfileCache* profile_cache,
+                             int async_threads,
+                             ExceptionHandler* exception_handler,
+                             SNMP::CounterTable* coalesced_tbl) :
   _client(new HttpClient(false,
                          resolver,
                          homestead_count_tbl,
@@ -64,13 +75,33 @@ HSSConnection::HSSConnection(const std::string& server,
   _sar_latency_tbl(homestead_sar_latency_tbl),
   _uar_latency_tbl(homestead_uar_latency_tbl),
   _lir_latency_tbl(homestead_lir_latency_tbl),
-  _sifc_service(sifc_service)
+  _sifc_service(sifc_service),
+  _profile_cache(profile_cache),
+  _reg_data_requests(homestead_timeout_ms * COALESCED_REQUEST_MAX_WAIT_FACTOR,
+                     coalesced_tbl),
+  _location_requests(homestead_timeout_ms * COALESCED_REQUEST_MAX_WAIT_FACTOR,
+                     coalesced_tbl),
+  _async_pool(NULL)
 {
+  if (async_threads > 0)
+  {
+    _async_pool = new AsyncPool(async_threads,
+                                async_threads * MAX_QUEUED_ASYNC_REQUESTS_PER_THREAD,
+                                exception_handler);
+    _async_pool->start();
+  }
 }
 
 
 HSSConnection::~HSSConnection()
 {
+  if (_async_pool != NULL)
+  {
+    _async_pool->stop();
+    _async_pool->join();
+    delete _async_pool; _async_pool = NULL;
+  }
+
   delete _http; _http = NULL;
   delete _client; _client = NULL;
 }
@@ -499,10 +530,60 @@ HTTPCode HSSConnection::put_homestead_xml(const irs_query& irs_query,
   return http_code;
 }
 
+// Only registration data for subscribers that are registered (or
+// unregistered but with services) is cached.  Homestead's response to a call
+// request for a subscriber in any other state can change its state, so these
+// requests must always go to Homestead.
+static bool is_cacheable(const HSSConnection::irs_info& irs_info)
+{
+  return ((irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED) ||
+          (irs_info._regstate == RegDataXMLUtils::STATE_UNREGISTERED));
+}
+
 HTTPCode HSSConnection::update_registration_state(const irs_query& irs_query,
                                                   irs_info& irs_info,
                                                   SAS::TrailId trail)
 {
+  // Calls for a subscriber can be served from the local cache, unless the
+  // caller has asked for fresh data.  So can refreshes of a registration that
+  // was recently sent to Homestead, if the cache is configured to allow it.
+  // Any other request type changes the registration state, so is passed to
+  // Homestead and then invalidates the cached data.
+  bool use_cache = ((_profile_cache != NULL) &&
+                    (irs_query._req_type == HSSConnection::CALL) &&
+                    (irs_query._cache_allowed) &&
+                    (irs_query._wildcard.empty()));
+  bool use_reg_cache = ((_profile_cache != NULL) &&
+                        (irs_query._req_type == HSSConnection::REG) &&
+                        (irs_query._cache_allowed) &&
+                        (irs_query._wildcard.empty()));
+  uint64_t generation = 0;
+
+  if (use_cache)
+  {
+    if (_profile_cache->get(irs_query._public_id, irs_info))
+    {
+      return HTTP_OK;
+    }
+
+    generation = _profile_cache->generation();
+  }
+  else if (use_reg_cache)
+  {
+    if (_profile_cache->get_registration(irs_query._public_id,
+                                         irs_query._private_id,
+                                         irs_info))
+    {
+      TRC_DEBUG("Not sending registration refresh for %s to Homestead",
+                irs_query._public_id.c_str());
+      irs_info._prev_regstate = RegDataXMLUtils::STATE_REGISTERED;
+      irs_info._reg_from_cache = true;
+      return HTTP_OK;
+    }
+
+    generation = _profile_cache->generation();
+  }
+
   // Needs to be a shared pointer - multiple Ifcs objects will need a reference
   // to it, so we want to delete the underlying pointer when they all go out
   // of scope.
@@ -519,6 +600,29 @@ HTTPCode HSSConnection::update_registration_state(const irs_query& irs_query,
                                      ims_subscription_expected,
                                      trail) ? HTTP_OK : HTTP_SERVER_ERROR;
   }
+
+  if (use_cache)
+  {
+    if ((http_code == HTTP_OK) && (is_cacheable(irs_info)))
+    {
+      _profile_cache->put(irs_query._public_id, irs_info, generation);
+    }
+  }
+  else if ((use_reg_cache) &&
+           (http_code == HTTP_OK) &&
+           (irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED))
+  {
+    _profile_cache->put_registration(irs_query._public_id,
+                                     irs_query._private_id,
+                                     irs_info,
+                                     generation);
+  }
+  else if ((_profile_cache != NULL) &&
+           (irs_query._req_type != HSSConnection::CALL))
+  {
+    _profile_cache->invalidate(irs_query._public_id);
+  }
+
   return http_code;
 }
 
@@ -526,24 +630,64 @@ HTTPCode HSSConnection::get_registration_data(const std::string& public_id,
                                               irs_info& irs_info,
                                               SAS::TrailId trail)
 {
-  // Needs to be a shared pointer - multiple Ifcs objects will need a reference
-  // to it, so we want to delete the underlying pointer when they all go out
-  // of scope.
-  std::shared_ptr<rapidxml::xml_document<>> root;
+  uint64_t generation = 0;
 
-  HTTPCode http_code = get_homestead_xml(public_id, root, trail);
-  if (http_code == HTTP_OK)
+  if (_profile_cache != NULL)
   {
-    http_code = decode_homestead_xml(public_id,
-                                     irs_info,
-                                     root,
-                                     _sifc_service,
-                                     false,
-                                     trail) ? HTTP_OK : HTTP_SERVER_ERROR;
+    if (_profile_cache->get(public_id, irs_info))
+    {
+      return HTTP_OK;
+    }
+
+    generation = _profile_cache->generation();
   }
+
+  // If another thread is already getting the data for this subscriber, use
+  // its result rather than sending the same request again.  The decoded data
+  // can be shared between threads, as the subscriber profile cache does.
+  HTTPCode http_code = _reg_data_requests.send(
+                                         public_id,
+                                         irs_info,
+                                         [&](HSSConnection::irs_info& info)
+  {
+    // Needs to be a shared pointer - multiple Ifcs objects will need a
+    // reference to it, so we want to delete the underlying pointer when they
+    // all go out of scope.
+    std::shared_ptr<rapidxml::xml_document<>> root;
+
+    HTTPCode rc = get_homestead_xml(public_id, root, trail);
+    if (rc == HTTP_OK)
+    {
+      rc = decode_homestead_xml(public_id,
+                                info,
+                                root,
+                                _sifc_service,
+                                false,
+                                trail) ? HTTP_OK : HTTP_SERVER_ERROR;
+    }
+
+    return rc;
+  },
+  trail);
+
+  if ((_profile_cache != NULL) &&
+      (http_code == HTTP_OK) &&
+      (is_cacheable(irs_info)))
+  {
+    _profile_cache->put(public_id, irs_info, generation);
+  }
+
   return http_code;
 }
 
+void HSSConnection::invalidate_cached_registration_data(const std::string& public_id)
+{
+  if (_profile_cache != NULL)
+  {
+    _profile_cache->invalidate(public_id);
+  }
+}
+
 HTTPCode HSSConnection::get_homestead_xml(const std::string& public_id,
                                           std::shared_ptr<rapidxml::xml_document<>>& root,
                                           SAS::TrailId trail)
@@ -670,18 +814,151 @@ HTTPCode HSSConnection::get_location_data(const std::string& public_user_identit
     path += prefix + "auth-type=" + Utils::url_escape(auth_type);
   }
 
-  HTTPCode rc = get_json_object(path, location_data, trail);
+  // If another thread is already making this request, use its result rather
+  // than sending the same request again.  Only the request that is actually
+  // sent counts towards the latency statistics.
+  std::shared_ptr<const rapidjson::Document> shared_location_data;
+  HTTPCode rc = _location_requests.send(
+                          path,
+                          shared_location_data,
+                          [&](std::shared_ptr<const rapidjson::Document>& data)
+  {
+    rapidjson::Document* doc = NULL;
+    HTTPCode request_rc = get_json_object(path, doc, trail);
+    data.reset(doc);
+
+    unsigned long latency_us = 0;
+    // Only accumulate the latency if we haven't already applied a
+    // penalty
+    if ((request_rc != HTTP_SERVER_UNAVAILABLE) &&
+        (request_rc != HTTP_GATEWAY_TIMEOUT)    &&
+        (stopWatch.read(latency_us)))
+    {
+      _latency_tbl->accumulate(latency_us);
+      _lir_latency_tbl->accumulate(latency_us);
+    }
 
-  unsigned long latency_us = 0;
-  // Only accumulate the latency if we haven't already applied a
-  // penalty
-  if ((rc != HTTP_SERVER_UNAVAILABLE) &&
-      (rc != HTTP_GATEWAY_TIMEOUT)    &&
-      (stopWatch.read(latency_us)))
+    return request_rc;
+  },
+  trail);
+
+  // The caller owns the document it is given, so give it a copy.
+  location_data = NULL;
+  if (shared_location_data != NULL)
   {
-    _latency_tbl->accumulate(latency_us);
-    _lir_latency_tbl->accumulate(latency_us);
+    location_data = new rapidjson::Document;
+    location_data->CopyFrom(*shared_location_data,
+                            location_data->GetAllocator());
   }
 
   return rc;
 }
+
+bool HSSConnection::is_async() const
+{
+  return (_async_pool != NULL);
+}
+
+void HSSConnection::send_async(AsyncRequest* request)
+{
+  if (_async_pool != NULL)
+  {
+    if (!_async_pool->try_add_work(request))
+    {
+      // Homestead isn't keeping up, so fail the request rather than letting
+      // the queue grow without limit.
+      TRC_DEBUG("Rejecting HSS request as too many are queued");
+      request->responded = true;
+      request->reject();
+      delete request;
+    }
+  }
+  else
+  {
+    process_async_request(request);
+  }
+}
+
+void HSSConnection::process_async_request(AsyncRequest* request)
+{
+  request->send();
+  request->responded = true;
+  request->respond();
+  delete request;
+}
+
+void HSSConnection::exception_callback(AsyncRequest* request)
+{
+  if (!request->responded)
+  {
+    request->responded = true;
+    request->respond();
+  }
+  delete request;
+}
+
+HSSConnection::AsyncPool::AsyncPool(unsigned int num_threads,
+                                    int max_queued,
+                                    ExceptionHandler* exception_handler) :
+  ThreadPool<AsyncRequest*>(num_threads,
+                            exception_handler,
+                            &HSSConnection::exception_callback,
+                            0),
+  _max_queued(max_queued),
+  _queued(0)
+{
+}
+
+bool HSSConnection::AsyncPool::try_add_work(AsyncRequest* request)
+{
+  if (++_queued > _max_queued)
+  {
+    --_queued;
+    return false;
+  }
+
+  add_work(request);
+  return true;
+}
+
+void HSSConnection::AsyncPool::process_work(AsyncRequest*& request)
+{
+  --_queued;
+  HSSConnection::process_async_request(request);
+  request = NULL;
+}
+
+// The result of an asynchronous request, shared between the functions that
+// make the request and report the result.  This starts off as a failure, in
+// case the request doesn't complete.
+struct JsonResult
+{
+  HTTPCode rc = HTTP_SERVER_ERROR;
+  rapidjson::Document* doc = NULL;
+};
+
+void HSSConnection::get_auth_vector_async(const std::string& private_user_id,
+                                          const std::string& public_user_id,
+                                          const std::string& auth_type,
+                                          const std::string& resync_auth,
+                                          const std::string& server_name,
+                                          SAS::TrailId trail,
+                                          JsonCallback callback)
+{
+  std::shared_ptr<JsonResult> result = std::make_shared<JsonResult>();
+  AsyncRequest* request = new AsyncRequest();
+  request->send = [=]()
+  {
+    result->rc = get_auth_vector(private_user_id,
+                                 public_user_id,
+                                 auth_type,
+                                 resync_auth,
+                                 server_name,
+                                 result->doc,
+                                 trail);
+  };
+  request->respond = [result, callback]() { callback(result->rc, result->doc); };
+  request->reject = [callback]() { callback(HTTP_SERVER_UNAVAILABLE, NULL); };
+  request->responded = false;
+  send_async(request);
+}
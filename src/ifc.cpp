@@ -11,6 +11,10 @@
 
 #include <boost/regex.hpp>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <sstream>
+#include <pthread.h>
 
 extern "C" {
 #include <pjlib-util.h>
@@ -44,9 +48,835 @@ using namespace rapidxml;
 #define ORIGINATING_UNREGISTERED 3
 #define ORIGINATING_CDIV 4
 
+// Whether a REGISTER matches a RegistrationType from an iFC.
+static bool reg_type_matches(int reg_type,
+                             const bool is_initial_registration,
+                             const bool dereg)
+{
+  switch (reg_type)
+  {
+  case INITIAL_REGISTRATION:
+    return (is_initial_registration && !dereg);
+  case REREGISTRATION:
+    return (!is_initial_registration && !dereg);
+  case DEREGISTRATION:
+    return dereg;
+  default:
+    // LCOV_EXCL_START Unreachable
+    TRC_WARNING("Impossible case %d", reg_type);
+    return false;
+    // LCOV_EXCL_STOP
+  }
+}
+
+// Whether a request matches a SessionCase from an iFC.
+static bool session_case_matches(int direction,
+                                 const SessionCase& session_case,
+                                 const bool is_registered)
+{
+  switch (direction)
+  {
+  case ORIGINATING_REGISTERED:
+    return (session_case == SessionCase::Originating) && is_registered;
+  case TERMINATING_REGISTERED:
+    return (session_case == SessionCase::Terminating) && is_registered;
+  case TERMINATING_UNREGISTERED:
+    return (session_case == SessionCase::Terminating) && !is_registered;
+  case ORIGINATING_UNREGISTERED:
+    return (session_case == SessionCase::Originating) && !is_registered;
+  case ORIGINATING_CDIV:
+    return (session_case == SessionCase::OriginatingCdiv);
+  default:
+    // LCOV_EXCL_START Unreachable
+    TRC_WARNING("Impossible case %d", direction);
+    return false;
+    // LCOV_EXCL_STOP
+  }
+}
+
+// Returns the part of the Request URI that a RequestURI SPT matches against.
+static std::string req_uri_test_string(pjsip_msg* msg)
+{
+  if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
+  {
+    pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+    // Match against the telephone-subscriber part of the Req URI, as per Table F.1
+    // of 3GPP TS 29.228.
+    return PJUtils::pj_str_to_string(&req_uri->number);
+  }
+  else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
+  {
+    pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+    // There is nothing in TS 29.228 about what to match against in the case
+    // of a urn URI. So just pull out the entire content (which is everything
+    // after "urn:").
+    return PJUtils::pj_str_to_string(&req_uri->content);
+  }
+  else
+  {
+    pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
+
+    // Compare against the hostport part of the Req URI, as per Table F.1
+    // of 3GPP TS 29.228.
+    std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
+
+    if (req_uri->port != 0)
+    {
+      hostport += ":" + std::to_string(req_uri->port);
+    }
+
+    return hostport;
+  }
+}
+
+// Whether a REGISTER matches any of the RegistrationTypes from a Method SPT.
+// A Method SPT that doesn't list any RegistrationTypes matches every REGISTER.
+static bool reg_types_match(const std::vector<int>& reg_types,
+                            const bool is_initial_registration,
+                            pjsip_msg* msg)
+{
+  if (reg_types.empty())
+  {
+    return true;
+  }
+
+  // Find expiry value from SIP message if it is present to determine whether
+  // we have a de-registration.
+  pj_bool_t dereg = PJUtils::is_deregistration(msg);
+
+  for (int reg_type : reg_types)
+  {
+    if (reg_type_matches(reg_type, is_initial_registration, dereg))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Whether a request matches a RequestURI SPT.
+static bool req_uri_matches(pjsip_msg* msg, const boost::regex& req_uri_regex)
+{
+  return boost::regex_search(req_uri_test_string(msg), req_uri_regex);
+}
+
+// Whether a request has a header that matches a SIPHeader SPT.  If the SPT
+// has a Content element, content_matches is called with the value of each
+// header whose name matches, and returns whether the value matches.
+template <typename ContentMatcher>
+static bool header_matches(pjsip_msg* msg,
+                           const boost::regex& header_regex,
+                           const bool has_content,
+                           ContentMatcher content_matches)
+{
+  for (pjsip_hdr* header = msg->hdr.next;
+       header != &msg->hdr;
+       header = header->next)
+  {
+    if ((boost::regex_search(header->name.ptr,
+                             header->name.ptr + header->name.slen,
+                             header_regex)) &&
+        ((!has_content) ||
+         (content_matches(PJUtils::get_header_value(header)))))
+    {
+      // Stop processing other headers once we have a match.
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Whether a request has an SDP body with a line that matches a
+// SessionDescription SPT.  The Line regex is matched against the first
+// character of each SDP line.  If the SPT has a Content element,
+// content_matches is called with the rest of each SDP line whose type matches
+// (after the equals sign), and returns whether it matches.
+template <typename ContentMatcher>
+static bool sdp_matches(pjsip_msg* msg,
+                        const boost::regex& line_regex,
+                        const bool has_content,
+                        ContentMatcher content_matches)
+{
+  bool ret = false;
+
+  // Check if the message body is SDP.
+  if ((msg->body) &&
+      (!pj_stricmp2(&msg->body->content_type.type, "application")) &&
+      (!pj_stricmp2(&msg->body->content_type.subtype, "sdp")) &&
+      (msg->body->data != NULL))
+  {
+    // Split the message body into each SDP line.
+    std::stringstream sdp((char *)msg->body->data);
+    std::string sdp_line;
+    while ((std::getline(sdp, sdp_line, '\n')) && (ret == false))
+    {
+      // Match the line regex on the first character of the SDP line.
+      std::string sdp_identifier(1, sdp_line[0]);
+      if (boost::regex_search(sdp_identifier, line_regex))
+      {
+        if (!has_content)
+        {
+          // We've found a matching line type, and don't have to match on
+          // content.
+          ret = true;
+        }
+        else if (sdp_line.find_first_of("=") == 1)
+        {
+          // Consider the content of the SDP line after the equals sign.
+          sdp_line.erase(0,2);
+          ret = content_matches(sdp_line);
+        }
+        else
+        {
+          TRC_WARNING("Found badly formatted SDP line: %s", sdp_line.c_str());
+        }
+      }
+    }
+  }
+
+  return ret;
+}
+
+// SIP methods that compiled Method SPTs are matched on with a bitmask.  The
+// first entries are in the same order as pjsip_method_e.
+static const char* const KNOWN_METHODS[] =
+{
+  "INVITE", "CANCEL", "ACK", "BYE", "REGISTER", "OPTIONS",
+  "PRACK", "SUBSCRIBE", "NOTIFY", "PUBLISH", "INFO", "REFER", "MESSAGE",
+  "UPDATE"
+};
+static const size_t NUM_KNOWN_METHODS = sizeof(KNOWN_METHODS) /
+                                        sizeof(KNOWN_METHODS[0]);
+
+// Returns the bit for a method name from an iFC, or 0 if it isn't one of
+// KNOWN_METHODS.
+static uint32_t method_bit(const std::string& method)
+{
+  for (size_t ii = 0; ii < NUM_KNOWN_METHODS; ++ii)
+  {
+    if (method == KNOWN_METHODS[ii])
+    {
+      return 1u << ii;
+    }
+  }
+
+  return 0;
+}
+
+// Returns the bit for the method of a request, or 0 if it isn't one of
+// KNOWN_METHODS.  Method names are case-sensitive, so this checks the name
+// even when PJSIP has recognised the method.
+static uint32_t method_bit(const pjsip_method& method)
+{
+  if (method.id != PJSIP_OTHER_METHOD)
+  {
+    return (pj_strcmp2(&method.name, KNOWN_METHODS[method.id]) == 0) ?
+           (1u << method.id) : 0;
+  }
+
+  for (size_t ii = PJSIP_OTHER_METHOD; ii < NUM_KNOWN_METHODS; ++ii)
+  {
+    if (pj_strcmp2(&method.name, KNOWN_METHODS[ii]) == 0)
+    {
+      return 1u << ii;
+    }
+  }
+
+  return 0;
+}
+
+// Returns the start of the explanation of an iFC match that is logged to SAS.
+static std::string ifc_match_preamble(bool cnf)
+{
+  std::string spt_relation = cnf ? "OR" : "AND";
+  std::string group_relation = cnf ? "AND" : "OR";
+  std::string ifc_match = "";
+  ifc_match.append(spt_relation).append(" each SPT match result to determine group result.\n");
+  ifc_match.append(group_relation).append(" each group result to determine overall iFC match.\n\n");
+  return ifc_match;
+}
+
+/// An iFC compiled for matching.  Everything that matching needs from the
+/// XML - the printed iFC for SAS, the ServerName, the trigger point structure
+/// and the regular expressions in the SPTs - is extracted once when the iFC is
+/// loaded, rather than on every request.
+///
+/// Only iFCs that are valid (i.e. whose matching would never report an invalid
+/// or unusual iFC) are compiled, so matching a compiled iFC gives exactly the
+/// same result and SAS events as walking the XML.
+class CompiledIfc
+{
+public:
+  /// Compiles an iFC, returning NULL if it isn't valid.
+  static std::shared_ptr<const CompiledIfc> compile(xml_node<>* ifc);
+
+  bool matches(const SessionCase& session_case,
+               const bool is_registered,
+               const bool is_initial_registration,
+               pjsip_msg* msg,
+               SAS::TrailId trail) const;
+
+private:
+  enum SptClass
+  {
+    SPT_METHOD,
+    SPT_SIP_HEADER,
+    SPT_SESSION_CASE,
+    SPT_REQUEST_URI,
+    SPT_SESSION_DESCRIPTION,
+    SPT_UNKNOWN
+  };
+
+  struct Spt
+  {
+    SptClass spt_class;
+    std::string class_name;
+    bool negated;
+
+    // Indexes into _group_ids of the groups this SPT is in.
+    std::vector<size_t> groups;
+
+    // Method SPTs.  The method is matched using its bit from KNOWN_METHODS,
+    // or by name if it isn't one of those.  REGISTER methods may also match
+    // on registration type.
+    std::string method;
+    uint32_t method_mask;
+    bool match_reg_types;
+    std::vector<int> reg_types;
+
+    // SessionCase SPTs.
+    int direction;
+
+    // The Header, RequestURI or Line regular expression, and the Content
+    // regular expression if there is one.
+    boost::regex regex;
+    bool has_content;
+    boost::regex content_regex;
+
+    Spt() :
+      spt_class(SPT_UNKNOWN),
+      negated(false),
+      method_mask(0),
+      match_reg_types(false),
+      direction(0),
+      has_content(false)
+    {
+    }
+  };
+
+  CompiledIfc() :
+    _has_ppi(false),
+    _ppi_registered(false),
+    _has_trigger(false),
+    _cnf(false),
+    _has_method_spt(false)
+  {
+  }
+
+  static bool compile_spt(xml_node<>* spt_node, Spt& spt);
+
+  static bool spt_matches(const Spt& spt,
+                          const SessionCase& session_case,
+                          const bool is_registered,
+                          const bool is_initial_registration,
+                          pjsip_msg* msg,
+                          uint32_t msg_method);
+
+  std::string _ifc_str;
+  std::string _server_name;
+  bool _has_ppi;
+  bool _ppi_registered;
+  bool _has_trigger;
+  bool _cnf;
+  bool _has_method_spt;
+  std::vector<Spt> _spts;
+
+  // The IDs of all the groups in the trigger point, in ascending order.
+  std::vector<int32_t> _group_ids;
+};
+
+std::shared_ptr<const CompiledIfc> CompiledIfc::compile(xml_node<>* ifc)
+{
+  if (ifc == NULL)
+  {
+    return nullptr;
+  }
+
+  std::shared_ptr<CompiledIfc> compiled(new CompiledIfc());
+
+  try
+  {
+    rapidxml::print(std::back_inserter(compiled->_ifc_str), *ifc, 0);
+
+    xml_node<>* as = ifc->first_node(RegDataXMLUtils::APPLICATION_SERVER);
+    if (as == NULL)
+    {
+      return nullptr;
+    }
+
+    compiled->_server_name = XMLUtils::get_first_node_value(as, RegDataXMLUtils::SERVER_NAME);
+    if (compiled->_server_name.empty())
+    {
+      return nullptr;
+    }
+
+    xml_node<>* profile_part_indicator = ifc->first_node(RegDataXMLUtils::PROFILE_PART_INDICATOR);
+    if (profile_part_indicator)
+    {
+      compiled->_has_ppi = true;
+      compiled->_ppi_registered = XMLUtils::parse_integer(profile_part_indicator,
+                                                          "ProfilePartIndicator",
+                                                          0,
+                                                          1) == 0;
+    }
+
+    xml_node<>* trigger = ifc->first_node(RegDataXMLUtils::TRIGGER_POINT);
+    if (!trigger)
+    {
+      return compiled;
+    }
+
+    compiled->_has_trigger = true;
+    compiled->_cnf = XMLUtils::parse_bool(trigger->first_node(RegDataXMLUtils::CONDITION_TYPE_CNF),
+                                          RegDataXMLUtils::CONDITION_TYPE_CNF);
+
+    // The group IDs of each SPT, which are converted to indexes into
+    // _group_ids once we've seen all the groups.
+    std::vector<std::vector<int32_t> > spt_group_ids;
+
+    for (xml_node<>* spt_node = trigger->first_node(RegDataXMLUtils::SPT);
+         spt_node;
+         spt_node = spt_node->next_sibling(RegDataXMLUtils::SPT))
+    {
+      Spt spt;
+      xml_node<>* neg_node = spt_node->first_node(RegDataXMLUtils::CONDITION_NEGATED);
+      spt.negated = neg_node && XMLUtils::parse_bool(neg_node, RegDataXMLUtils::CONDITION_NEGATED);
+
+      if (!compile_spt(spt_node, spt))
+      {
+        return nullptr;
+      }
+
+      if (spt.spt_class == SPT_METHOD)
+      {
+        compiled->_has_method_spt = true;
+      }
+
+      std::vector<int32_t> group_ids;
+      for (xml_node<>* group_node = spt_node->first_node(RegDataXMLUtils::GROUP);
+           group_node;
+           group_node = group_node->next_sibling(RegDataXMLUtils::GROUP))
+      {
+        int32_t group_id = XMLUtils::parse_integer(group_node,
+                                                   "Group ID",
+                                                   0,
+                                                   std::numeric_limits<int32_t>::max());
+        group_ids.push_back(group_id);
+        compiled->_group_ids.push_back(group_id);
+      }
+
+      compiled->_spts.push_back(spt);
+      spt_group_ids.push_back(group_ids);
+    }
+
+    std::vector<int32_t>& all_ids = compiled->_group_ids;
+    std::sort(all_ids.begin(), all_ids.end());
+    all_ids.erase(std::unique(all_ids.begin(), all_ids.end()), all_ids.end());
+
+    for (size_t ii = 0; ii < compiled->_spts.size(); ++ii)
+    {
+      for (int32_t group_id : spt_group_ids[ii])
+      {
+        compiled->_spts[ii].groups.push_back(
+          std::lower_bound(all_ids.begin(), all_ids.end(), group_id) - all_ids.begin());
+      }
+    }
+  }
+  catch (xml_error err)
+  {
+    return nullptr;
+  }
+
+  return compiled;
+}
+
+// Compiles a single SPT, returning false if it isn't valid.  This follows the
+// checks made by Ifc::spt_matches.
+bool CompiledIfc::compile_spt(xml_node<>* spt_node, Spt& spt)
+{
+  // Find the class node.
+  xml_node<>* node = spt_node->first_node();
+
+  for (; node; node = node->next_sibling())
+  {
+    const char* name = node->name();
+
+    if ((strcmp(name, RegDataXMLUtils::CONDITION_NEGATED) != 0) &&
+        (strcmp(name, RegDataXMLUtils::GROUP) != 0))
+    {
+      if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
+      {
+        return false;
+      }
+      break;
+    }
+  }
+
+  if (!node)
+  {
+    return false;
+  }
+
+  spt.class_name = node->name();
+
+  if (spt.class_name == RegDataXMLUtils::METHOD)
+  {
+    spt.spt_class = SPT_METHOD;
+    spt.method = node->value();
+    spt.method_mask = method_bit(spt.method);
+
+    xml_node<>* ext_node = node->next_sibling();
+    if ((spt.method == "REGISTER") &&
+        (ext_node) &&
+        (strcmp(ext_node->name(), RegDataXMLUtils::EXTENSION) == 0))
+    {
+      spt.match_reg_types = true;
+      for (xml_node<>* reg_type_node = ext_node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
+           reg_type_node;
+           reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
+      {
+        spt.reg_types.push_back(XMLUtils::parse_integer(reg_type_node,
+                                                        "registration type",
+                                                        0,
+                                                        2));
+      }
+    }
+  }
+  else if (spt.class_name == RegDataXMLUtils::SIP_HEADER)
+  {
+    spt.spt_class = SPT_SIP_HEADER;
+    xml_node<>* spt_header = node->first_node(RegDataXMLUtils::HEADER);
+    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
+
+    if (!spt_header)
+    {
+      return false;
+    }
+
+    spt.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_header),
+                             boost::regex_constants::icase |
+                             boost::regex_constants::no_except);
+    if (spt.regex.status())
+    {
+      return false;
+    }
+
+    if (spt_content)
+    {
+      spt.has_content = true;
+      spt.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                       boost::regex_constants::no_except);
+      if (spt.content_regex.status())
+      {
+        return false;
+      }
+    }
+  }
+  else if (spt.class_name == RegDataXMLUtils::SESSION_CASE)
+  {
+    spt.spt_class = SPT_SESSION_CASE;
+    spt.direction = XMLUtils::parse_integer(node, "session case", 0, 4);
+  }
+  else if (spt.class_name == RegDataXMLUtils::REQUEST_URI)
+  {
+    spt.spt_class = SPT_REQUEST_URI;
+    std::string req_uri = XMLUtils::get_text_or_cdata(node);
+
+    // Leave iFCs that need an unusual iFC event on each request to the XML
+    // walker.
+    if ((req_uri.compare(0, 4, "sip:") == 0) ||
+        (req_uri.compare(0, 4, "tel:") == 0))
+    {
+      return false;
+    }
+
+    spt.regex = boost::regex(req_uri, boost::regex_constants::no_except);
+    if (spt.regex.status())
+    {
+      return false;
+    }
+  }
+  else if (spt.class_name == RegDataXMLUtils::SESSION_DESCRIPTION)
+  {
+    spt.spt_class = SPT_SESSION_DESCRIPTION;
+    xml_node<>* spt_line = node->first_node(RegDataXMLUtils::LINE);
+    xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
+
+    if (!spt_line)
+    {
+      return false;
+    }
+
+    spt.regex = boost::regex(XMLUtils::get_text_or_cdata(spt_line),
+                             boost::regex_constants::no_except);
+    if (spt.regex.status())
+    {
+      return false;
+    }
+
+    if (spt_content)
+    {
+      spt.has_content = true;
+      spt.content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                       boost::regex_constants::no_except);
+      if (spt.content_regex.status())
+      {
+        return false;
+      }
+    }
+  }
+  else
+  {
+    spt.spt_class = SPT_UNKNOWN;
+  }
+
+  return true;
+}
+
+bool CompiledIfc::spt_matches(const Spt& spt,
+                              const SessionCase& session_case,
+                              const bool is_registered,
+                              const bool is_initial_registration,
+                              pjsip_msg* msg,
+                              uint32_t msg_method)
+{
+  bool ret = false;
+
+  switch (spt.spt_class)
+  {
+  case SPT_METHOD:
+    ret = (spt.method_mask != 0) ?
+          ((msg_method & spt.method_mask) != 0) :
+          (pj_strcmp2(&msg->line.req.method.name, spt.method.c_str()) == 0);
+
+    if ((ret) && (spt.match_reg_types))
+    {
+      ret = reg_types_match(spt.reg_types, is_initial_registration, msg);
+    }
+    break;
+
+  case SPT_SIP_HEADER:
+    ret = header_matches(msg,
+                         spt.regex,
+                         spt.has_content,
+                         [&spt](const std::string& value)
+                         {
+                           return boost::regex_search(value, spt.content_regex);
+                         });
+    break;
+
+  case SPT_SESSION_CASE:
+    ret = session_case_matches(spt.direction, session_case, is_registered);
+    break;
+
+  case SPT_REQUEST_URI:
+    ret = req_uri_matches(msg, spt.regex);
+    break;
+
+  case SPT_SESSION_DESCRIPTION:
+    ret = sdp_matches(msg,
+                      spt.regex,
+                      spt.has_content,
+                      [&spt](const std::string& content)
+                      {
+                        return boost::regex_search(content, spt.content_regex);
+                      });
+    break;
+
+  default:
+    TRC_WARNING("Unimplemented iFC service point trigger class: %s",
+                spt.class_name.c_str());
+    ret = false;
+    break;
+  }
+
+  TRC_DEBUG("SPT class %s: result %s", spt.class_name.c_str(), ret ? "true" : "false");
+  return ret;
+}
+
+// Check whether the message matches the compiled iFC.  This must report the
+// same SAS events as Ifc::dom_filter_matches.
+bool CompiledIfc::matches(const SessionCase& session_case,
+                          const bool is_registered,
+                          const bool is_initial_registration,
+                          pjsip_msg* msg,
+                          SAS::TrailId trail) const
+{
+  SAS::Event testing(trail, SASEvent::IFC_TESTING, 0);
+  testing.add_var_param(_ifc_str);
+  SAS::report_event(testing);
+
+  if ((_has_ppi) && (_ppi_registered != is_registered))
+  {
+    TRC_DEBUG("iFC ProfilePartIndicator %s doesn't match",
+              _ppi_registered ? "reg" : "unreg");
+
+    SAS::Event event(trail, SASEvent::IFC_NOT_MATCHED_PPI, 0);
+    event.add_var_param(_server_name);
+    SAS::report_event(event);
+
+    return false;
+  }
+
+  if (!_has_trigger)
+  {
+    TRC_DEBUG("iFC has no trigger point - unconditional match");  // 3GPP TS 29.228 sB.2.2
+
+    SAS::Event event(trail, SASEvent::IFC_MATCHED, 0);
+    event.add_var_param(_server_name);
+    SAS::report_event(event);
+
+    return true;
+  }
+
+  // In CNF we OR each SPT into its group(s) and AND the groups together, so
+  // each group starts off false.  In DNF we do the converse.
+  std::vector<bool> groups(_group_ids.size(), !_cnf);
+  std::string ifc_match = ifc_match_preamble(_cnf);
+
+  // Look up the request's method once for all the Method SPTs.
+  uint32_t msg_method = _has_method_spt ? method_bit(msg->line.req.method) : 0;
+
+  for (const Spt& spt : _spts)
+  {
+    bool spt_matched = spt_matches(spt,
+                                   session_case,
+                                   is_registered,
+                                   is_initial_registration,
+                                   msg,
+                                   msg_method) != spt.negated;
+
+    for (size_t group : spt.groups)
+    {
+      groups[group] = _cnf ? (groups[group] || spt_matched) :
+                             (groups[group] && spt_matched);
+
+      ifc_match.append("SPT in group ").append(std::to_string(_group_ids[group]))
+        .append(" is ").append(spt_matched ? "matched.\n" : "not matched.\n");
+    }
+  }
+
+  bool ret = _cnf;
+
+  for (size_t group = 0; group < groups.size(); ++group)
+  {
+    std::string group_result = groups[group] ? "matched" : "not matched";
+    ifc_match.append("Group ").append(std::to_string(_group_ids[group]))
+      .append(" is ").append(group_result).append(".\n");
+
+    ret = _cnf ? (ret && groups[group]) : (ret || groups[group]);
+  }
+
+  if (ret)
+  {
+    TRC_DEBUG("iFC matches");
+    SAS::Event event(trail, SASEvent::IFC_MATCHED, 0);
+    event.add_var_param(_server_name);
+    event.add_var_param(ifc_match);
+    SAS::report_event(event);
+  }
+  else
+  {
+    TRC_DEBUG("iFC does not match");
+    SAS::Event event(trail, SASEvent::IFC_NOT_MATCHED, 0);
+    event.add_var_param(_server_name);
+    event.add_var_param(ifc_match);
+    SAS::report_event(event);
+  }
+
+  TRC_DEBUG("%s", ifc_match.c_str());
+  return ret;
+}
+
+/// Compiles an iFC the second time it, or a copy of it, is matched.
+class IfcCompilation
+{
+public:
+  IfcCompilation() :
+    _matches(0),
+    _done(false)
+  {
+    pthread_mutex_init(&_lock, NULL);
+  }
+
+  ~IfcCompilation()
+  {
+    pthread_mutex_destroy(&_lock);
+  }
+
+  /// Returns the compiled form of the iFC to match against, or NULL if the
+  /// iFC should be matched by walking its XML.
+  const CompiledIfc* get(xml_node<>* ifc)
+  {
+    if (_done.load(std::memory_order_acquire))
+    {
+      return _compiled.get();
+    }
+
+    if (_matches.fetch_add(1) == 0)
+    {
+      // This is the first match, which might well be the only one.
+      return NULL;
+    }
+
+    pthread_mutex_lock(&_lock);
+    if (!_done.load(std::memory_order_relaxed))
+    {
+      _compiled = CompiledIfc::compile(ifc);
+      _done.store(true, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&_lock);
+
+    return _compiled.get();
+  }
+
+  bool is_compiled() const
+  {
+    return (_done.load(std::memory_order_acquire)) && (_compiled != nullptr);
+  }
+
+private:
+  std::atomic<int> _matches;
+  std::atomic<bool> _done;
+  pthread_mutex_t _lock;
+
+  // The compiled form of the iFC, or NULL if it couldn't be compiled.  Only
+  // set once, before _done.
+  std::shared_ptr<const CompiledIfc> _compiled;
+};
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc) :
+  _ifc(ifc),
+  _compilation(std::make_shared<IfcCompilation>())
+{
+}
+
+Ifc::Ifc(rapidxml::xml_node<>* ifc,
+         std::shared_ptr<rapidxml::xml_document<>> ifc_doc) :
+  _ifc(ifc),
+  _compilation(std::make_shared<IfcCompilation>()),
+  _ifc_doc(ifc_doc)
+{
+}
+
 Ifc::Ifc(std::string ifc_str,
          rapidxml::xml_document<>* ifc_doc) :
-  _ifc(NULL)
+  _ifc(NULL),
+  _compilation(std::make_shared<IfcCompilation>())
 {
   rapidxml::xml_document<>* new_document = new rapidxml::xml_document<>();
 
@@ -61,6 +891,11 @@ Ifc::Ifc(std::string ifc_str,
   delete new_document;
 }
 
+bool Ifc::is_compiled() const
+{
+  return _compilation->is_compiled();
+}
+
 void Ifc::handle_invalid_ifc(std::string error,
                              std::string server_name,
                              int sas_event_id,
@@ -137,64 +972,28 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
 
   if (strcmp(RegDataXMLUtils::METHOD, name) == 0)
   {
+    ret = (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0);
+
     // If we have a REGISTER we may need to match on RegistrationType.
-    if ((strcmp("REGISTER", node->value()) == 0) &&
-        (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0))
+    if ((ret) && (strcmp("REGISTER", node->value()) == 0))
     {
-      ret = true;
       node = node->next_sibling();
-      if (node)
+      if ((node) && (strcmp(node->name(), RegDataXMLUtils::EXTENSION) == 0))
       {
-        name = node->name();
-        if (strcmp(name, RegDataXMLUtils::EXTENSION) == 0)
+        std::vector<int> reg_types;
+        for (xml_node<>* reg_type_node = node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
+             reg_type_node;
+             reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
         {
-          for (xml_node<>* reg_type_node = node->first_node(RegDataXMLUtils::REGISTRATION_TYPE);
-               reg_type_node;
-               reg_type_node = reg_type_node->next_sibling(RegDataXMLUtils::REGISTRATION_TYPE))
-          {
-            name = reg_type_node->name();
-            int reg_type = XMLUtils::parse_integer(reg_type_node,
-                                                   "registration type",
-                                                   0,
-                                                   2);
-
-            // Find expiry value from SIP message if it is present to determine
-            // whether we have a de-registration.  Set an arbitrary default value of
-            // an hour.
-            pj_bool_t dereg = PJUtils::is_deregistration(msg);
-
-            switch (reg_type)
-            {
-            case INITIAL_REGISTRATION:
-              ret = (is_initial_registration && !dereg);
-              break;
-            case REREGISTRATION:
-              ret = (!is_initial_registration && !dereg);
-              break;
-            case DEREGISTRATION:
-              ret = dereg;
-              break;
-            default:
-              // LCOV_EXCL_START Unreachable
-              TRC_WARNING("Impossible case %d", reg_type);
-              ret = false;
-              break;
-              // LCOV_EXCL_STOP
-            }
-
-            // If we've found a match, break out of the for loop.
-            if (ret)
-            {
-              break;
-            }
-          }
+          reg_types.push_back(XMLUtils::parse_integer(reg_type_node,
+                                                      "registration type",
+                                                      0,
+                                                      2));
         }
+
+        ret = reg_types_match(reg_types, is_initial_registration, msg);
       }
     }
-    else
-    {
-      ret = (pj_strcmp2(&msg->line.req.method.name, node->value()) == 0);
-    }
   }
   else if (strcmp(RegDataXMLUtils::SIP_HEADER, name) == 0)
   {
@@ -202,7 +1001,6 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
     xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
     boost::regex header_regex;
     boost::regex content_regex;
-    pjsip_hdr* header = NULL;
 
     if (!spt_header)
     {
@@ -219,109 +1017,35 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
                          server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
     }
 
-    for (header = msg->hdr.next; header != &msg->hdr; header = header->next)
+    ret = header_matches(msg,
+                         header_regex,
+                         (spt_content != NULL),
+                         [&](const std::string& value)
     {
-      if (boost::regex_search(PJUtils::pj_str_to_string(&(header->name)), header_regex))
+      // status() is nonzero for an uninitialised regex, so we check this in
+      // order to only compile it once, and only if a header name matches.
+      if (content_regex.status())
       {
-        if (!spt_content)
+        content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                     boost::regex_constants::no_except);
+        if (content_regex.status())
         {
-          // We've found a matching header, and don't have to match on content
-          ret = true;
-        }
-        else
-        {
-          std::string header_value = PJUtils::get_header_value(header);
-          // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once
-          if (content_regex.status())
-          {
-            content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                         boost::regex_constants::no_except);
-            if (content_regex.status())
-            {
-              handle_invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
-                                 server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-            }
-          }
-
-          if (boost::regex_search(header_value, content_regex))
-          {
-            // We've found a matching header, and have matching content in one field
-            ret = true;
-          }
+          handle_invalid_ifc("Invalid regular expression in Content element for SIPHeader service point trigger",
+                             server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
         }
       }
-      if (ret)
-      {
-        // Stop processing other headers once we have a match
-        break;
-      }
-    }
+
+      return boost::regex_search(value, content_regex);
+    });
   }
   else if (strcmp(RegDataXMLUtils::SESSION_CASE, name) == 0)
   {
     int direction = XMLUtils::parse_integer(node, "session case", 0, 4);
-    switch (direction)
-    {
-    case ORIGINATING_REGISTERED:
-      ret = (session_case == SessionCase::Originating) && is_registered;
-      break;
-    case TERMINATING_REGISTERED:
-      ret = (session_case == SessionCase::Terminating) && is_registered;
-      break;
-    case TERMINATING_UNREGISTERED:
-      ret = (session_case == SessionCase::Terminating) && !is_registered;
-      break;
-    case ORIGINATING_UNREGISTERED:
-      ret = (session_case == SessionCase::Originating) && !is_registered;
-      break;
-    case ORIGINATING_CDIV:
-      ret = (session_case == SessionCase::OriginatingCdiv);
-      break;
-    default:
-      // LCOV_EXCL_START Unreachable
-      TRC_WARNING("Impossible case %d", direction);
-      ret = false;
-      break;
-    // LCOV_EXCL_STOP
-    }
+    ret = session_case_matches(direction, session_case, is_registered);
   }
   else if (strcmp(RegDataXMLUtils::REQUEST_URI, name) == 0)
   {
     boost::regex req_uri_regex;
-    std::string test_string;
-
-    if (PJSIP_URI_SCHEME_IS_TEL(msg->line.req.uri))
-    {
-      pjsip_tel_uri* req_uri =  (pjsip_tel_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // Match against the telephone-subscriber part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      test_string = PJUtils::pj_str_to_string(&req_uri->number);
-    }
-    else if (PJSIP_URI_SCHEME_IS_URN(msg->line.req.uri))
-    {
-      pjsip_other_uri* req_uri = (pjsip_other_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // There is nothing in TS 29.228 about what to match against in the case
-      // of a urn URI. So just pull out the entire content (which is everything
-      // after "urn:").
-      test_string = PJUtils::pj_str_to_string(&req_uri->content);
-    }
-    else
-    {
-      pjsip_sip_uri* req_uri = (pjsip_sip_uri*)pjsip_uri_get_uri(msg->line.req.uri);
-
-      // Compare against the hostport part of the Req URI, as per Table F.1
-      // of 3GPP TS 29.228.
-      std::string hostport = PJUtils::pj_str_to_string(&req_uri->host);
-
-      if (req_uri->port != 0)
-      {
-        hostport += ":" + std::to_string(req_uri->port);
-      }
-
-      test_string = hostport;
-    }
 
     std::string req_uri = XMLUtils::get_text_or_cdata(node);
     if ((req_uri.compare(0, 4, "sip:") == 0) ||
@@ -339,7 +1063,8 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
       handle_invalid_ifc("Invalid regular expression in Request URI service point trigger",
                          server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
     }
-      ret = boost::regex_search(test_string, req_uri_regex);
+
+    ret = req_uri_matches(msg, req_uri_regex);
   }
   else if (strcmp(RegDataXMLUtils::SESSION_DESCRIPTION, name) == 0)
   {
@@ -347,7 +1072,6 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
     xml_node<>* spt_content = node->first_node(RegDataXMLUtils::CONTENT);
     boost::regex line_regex;
     boost::regex content_regex;
-    char newline = '\n';
 
     if (!spt_line)
     {
@@ -363,61 +1087,26 @@ bool Ifc::spt_matches(const SessionCase& session_case,  //< The session case
                          server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
     }
 
-    // Check if the message body is SDP.
-    if (msg->body &&
-        (!pj_stricmp2(&msg->body->content_type.type, "application")) &&
-        (!pj_stricmp2(&msg->body->content_type.subtype, "sdp")))
+    ret = sdp_matches(msg,
+                      line_regex,
+                      (spt_content != NULL),
+                      [&](const std::string& content)
     {
-      if (msg->body->data != NULL)
+      // status() is nonzero for an uninitialised regex, so we check this in
+      // order to only compile it once, and only if a line matches.
+      if (content_regex.status())
       {
-        // Split the message body into each SDP line.
-        std::stringstream sdp((char *)msg->body->data);
-        std::string sdp_line;
-        while((std::getline(sdp, sdp_line, newline)) && (ret == false))
+        content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
+                                     boost::regex_constants::no_except);
+        if (content_regex.status())
         {
-          // Match the line regex on the first character of the SDP line.
-          std::string sdp_identifier(1, sdp_line[0]);
-          if (boost::regex_search(sdp_identifier, line_regex))
-          {
-            if (!spt_content)
-            {
-              // We've found a matching line type, and don't have to match on content.
-              ret = true;
-            }
-            else
-            {
-              // status() is nonzero for an uninitialised regex, so we check this in order to only compile it once.
-              if (content_regex.status())
-              {
-                content_regex = boost::regex(XMLUtils::get_text_or_cdata(spt_content),
-                                             boost::regex_constants::no_except);
-                if (content_regex.status())
-                {
-                  handle_invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
-                                     server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
-                }
-              }
-
-              // Check the second character of the line is an equals sign, and then
-              // consider the content of the SDP line.
-              if (sdp_line.find_first_of("=") == 1)
-              {
-                sdp_line.erase(0,2);
-                if (boost::regex_search(sdp_line, content_regex))
-                {
-                  // We've found a matching line.
-                  ret = true;
-                }
-              }
-              else
-              {
-                TRC_WARNING("Found badly formatted SDP line: %s", sdp_line.c_str());
-              }
-            }
-          }
+          handle_invalid_ifc("Invalid regular expression in Content element for Session Description service point trigger",
+                             server_name, SASEvent::INVALID_IFC_IGNORED, 0, trail);
         }
       }
-    }
+
+      return boost::regex_search(content, content_regex);
+    });
   }
   else
   {
@@ -439,6 +1128,29 @@ bool Ifc::filter_matches(const SessionCase& session_case,
                          const bool is_initial_registration,
                          pjsip_msg* msg,
                          SAS::TrailId trail) const
+{
+  const CompiledIfc* compiled = _compilation->get(_ifc);
+  if (compiled != NULL)
+  {
+    return compiled->matches(session_case,
+                             is_registered,
+                             is_initial_registration,
+                             msg,
+                             trail);
+  }
+
+  return dom_filter_matches(session_case,
+                            is_registered,
+                            is_initial_registration,
+                            msg,
+                            trail);
+}
+
+bool Ifc::dom_filter_matches(const SessionCase& session_case,
+                             const bool is_registered,
+                             const bool is_initial_registration,
+                             pjsip_msg* msg,
+                             SAS::TrailId trail) const
 {
   std::string ifc_str;
   rapidxml::print(std::back_inserter(ifc_str), *_ifc, 0);
@@ -512,11 +1224,7 @@ bool Ifc::filter_matches(const SessionCase& session_case,
     // we AND all the groups together. In DNF we do the converse.
     std::map<int32_t, bool> groups;
 
-    std:: string spt_relation = cnf ? "OR" : "AND";
-    std:: string group_relation = cnf ? "AND" : "OR";
-    std:: string ifc_match = "";
-    ifc_match.append(spt_relation).append(" each SPT match result to determine group result.\n");
-    ifc_match.append(group_relation).append(" each group result to determine overall iFC match.\n\n");
+    std::string ifc_match = ifc_match_preamble(cnf);
 
     for (xml_node<>* spt = trigger->first_node(RegDataXMLUtils::SPT);
          spt;
@@ -42,6 +42,8 @@ extern "C" {
 #include "stack.h"
 #include "bono.h"
 #include "hssconnection.h"
+#include "subscriber_profile_cache.h"
+#include "simservs_cache.h"
 #include "xdmconnection.h"
 #include "bono.h"
 #include "websockets.h"
@@ -62,6 +64,7 @@ extern "C" {
 #include "chronoshandlers.h"
 #include "s4_chronoshandlers.h"
 #include "handlers.h"
+#include "msg_trace.h"
 #include "s4_handlers.h"
 #include "httpstack.h"
 #include "sproutlet.h"
@@ -116,6 +119,9 @@ enum OptionTypes
   OPT_STATELESS_PROXIES,
   OPT_MAX_SPROUTLET_DEPTH,
   OPT_RALF_THREADS,
+  OPT_RALF_BATCH_SIZE,
+  OPT_RALF_BATCH_LINGER,
+  OPT_RALF_SPOOL_SIZE,
   OPT_NON_REGISTERING_PBXES,
   OPT_PBX_SERVICE_ROUTE,
   OPT_NON_REGISTER_AUTHENTICATION,
@@ -139,6 +145,7 @@ enum OptionTypes
   OPT_DUMMY_APP_SERVER,
   OPT_HTTP_ACR_LOGGING,
   OPT_HOMESTEAD_TIMEOUT,
+  OPT_HOMESTEAD_ASYNC_THREADS,
   OPT_ORIG_SIP_TO_TEL_COERCE,
   OPT_REQUEST_ON_QUEUE_TIMEOUT,
   OPT_BLACKLISTED_SCSCFS,
@@ -146,6 +153,14 @@ enum OptionTypes
   OPT_REMOTE_ALIASES,
   OPT_ALWAYS_SERVE_REMOTE_ALIASES,
   OPT_RAM_RECORD_EVERYTHING,
+  OPT_WORKER_QUEUE_SHARDS,
+  OPT_MSG_TRACE_SAMPLE_RATE,
+  OPT_SUBSCRIBER_PROFILE_CACHE_SIZE,
+  OPT_SUBSCRIBER_PROFILE_CACHE_TTL,
+  OPT_SUBSCRIBER_PROFILE_REG_REFRESH,
+  OPT_ENUM_CACHE_SIZE,
+  OPT_SIMSERVS_CACHE_SIZE,
+  OPT_SIMSERVS_CACHE_TTL,
 };
 
 
@@ -214,6 +229,9 @@ const static struct pj_getopt_option long_opt[] =
   { "stateless-proxies",            required_argument, 0, OPT_STATELESS_PROXIES},
   { "non-registering-pbxes",        required_argument, 0, OPT_NON_REGISTERING_PBXES},
   { "ralf-threads",                 required_argument, 0, OPT_RALF_THREADS},
+  { "ralf-batch-size",              required_argument, 0, OPT_RALF_BATCH_SIZE},
+  { "ralf-batch-linger",            required_argument, 0, OPT_RALF_BATCH_LINGER},
+  { "ralf-spool-size",              required_argument, 0, OPT_RALF_SPOOL_SIZE},
   { "non-register-authentication",  required_argument, 0, OPT_NON_REGISTER_AUTHENTICATION},
   { "pbx-service-route",            required_argument, 0, OPT_PBX_SERVICE_ROUTE},
   { "force-3pr-body",               no_argument,       0, OPT_FORCE_THIRD_PARTY_REGISTER_BODY},
@@ -233,10 +251,19 @@ const static struct pj_getopt_option long_opt[] =
   { "dummy-app-server",             required_argument, 0, OPT_DUMMY_APP_SERVER},
   { "http-acr-logging",             no_argument,       0, OPT_HTTP_ACR_LOGGING},
   { "homestead-timeout",            required_argument, 0, OPT_HOMESTEAD_TIMEOUT},
+  { "homestead-async-threads",      required_argument, 0, OPT_HOMESTEAD_ASYNC_THREADS},
   { "request-on-queue-timeout",     required_argument, 0, OPT_REQUEST_ON_QUEUE_TIMEOUT},
   { "blacklisted-scscfs",           required_argument, 0, OPT_BLACKLISTED_SCSCFS},
   { "enable-orig-sip-to-tel-coerce",no_argument,       0, OPT_ORIG_SIP_TO_TEL_COERCE},
   { "ram-record-everything",        no_argument,       0, OPT_RAM_RECORD_EVERYTHING},
+  { "worker-queue-shards",          required_argument, 0, OPT_WORKER_QUEUE_SHARDS},
+  { "msg-trace-sample-rate",        required_argument, 0, OPT_MSG_TRACE_SAMPLE_RATE},
+  { "subscriber-profile-cache-size",required_argument, 0, OPT_SUBSCRIBER_PROFILE_CACHE_SIZE},
+  { "subscriber-profile-cache-ttl", required_argument, 0, OPT_SUBSCRIBER_PROFILE_CACHE_TTL},
+  { "subscriber-profile-reg-refresh", required_argument, 0, OPT_SUBSCRIBER_PROFILE_REG_REFRESH},
+  { "enum-cache-size",              required_argument, 0, OPT_ENUM_CACHE_SIZE},
+  { "simservs-cache-size",          required_argument, 0, OPT_SIMSERVS_CACHE_SIZE},
+  { "simservs-cache-ttl",           required_argument, 0, OPT_SIMSERVS_CACHE_TTL},
   { NULL,                           0,                 0, 0}
 };
 
@@ -315,6 +342,13 @@ static void usage(void)
        "                            If 'pcscf,icscf,as', it also Record-Routes between every AS.\n"
        " -G, --ralf <server>        Name/IP address of Ralf (Rf) billing server.\n"
        "     --ralf-threads N       Number of Ralf threads (default: 25)\n"
+       "     --ralf-batch-size N    Maximum number of ACRs a Ralf thread sends in one go (default: 1)\n"
+       "     --ralf-batch-linger N  Time in milliseconds to wait for a batch of ACRs to fill up\n"
+       "                            before sending it (default: 10)\n"
+       "     --ralf-spool-size N    Maximum number of ACRs waiting to be sent to Ralf. Further ACRs are\n"
+       "                            dropped rather than delaying SIP processing. 0 means there is no\n"
+       "                            limit on waiting ACRs, but SIP processing is delayed if Ralf falls\n"
+       "                            behind (default: 0)\n"
        " -X, --xdms <server>        Name/IP address of XDM server\n"
        "     --dns-server <server>[,<server2>,<server3>]\n"
        "                            IP addresses of the DNS servers to use (defaults to 127.0.0.1)\n"
@@ -322,6 +356,8 @@ static void usage(void)
        "                            IP addresses of ENUM server (can't be enabled at same\n"
        "                            time as -f)\n"
        " -x, --enum-suffix <suffix> Suffix appended to ENUM domains (default: .e164.arpa)\n"
+       "     --enum-cache-size N    The maximum number of ENUM server responses to cache, each for the\n"
+       "                            TTL in the response. 0 disables the cache (default: 0)\n"
        " -f, --enum-file <file>     JSON ENUM config file (can't be enabled at same time as\n"
        "                            -E)\n"
        "     --default-tel-uri-translation\n"
@@ -356,9 +392,15 @@ static void usage(void)
        "                            Specify the HTTP bind address\n"
        " -o  --http-port <port>     Specify the HTTP bind port\n"
        " -q  --http-threads N       Number of HTTP threads (default: 1)\n"
-       " -P, --pjsip-threads N      Number of PJSIP threads (default: 1)\n"
+       " -P, --pjsip-threads N      Number of PJSIP transport threads (default: 1). If more than\n"
+       "                            one, each UDP port is opened once per thread with SO_REUSEPORT\n"
+       "                            so that received traffic is spread across the threads\n"
        " -B, --billing-cdf <server> Billing CDF server\n"
        " -W, --worker-threads N     Number of worker threads (default: 1)\n"
+       "     --worker-queue-shards N\n"
+       "                            Number of queues to spread work for the worker threads across.\n"
+       "                            Messages for the same dialog always use the same queue, and idle\n"
+       "                            workers take work from other queues (default: 1)\n"
        " -a, --analytics <directory>\n"
        "                            Generate analytics logs in specified directory\n"
        " -A, --authentication       Enable authentication\n"
@@ -456,12 +498,39 @@ static void usage(void)
        "     --http-acr-logging     Whether to include the bodies of ACR HTTP requests when they are logged \n"
        "                            to SAS\n"
        "     --homestead-timeout    The timeout in ms to use on HTTP requests to Homestead\n"
+       "     --homestead-async-threads N\n"
+       "                            The number of threads to fetch authentication vectors from Homestead\n"
+       "                            on, so that challenges don't block a worker thread. Fetches are\n"
+       "                            rejected if too many are waiting for a thread. 0 makes these\n"
+       "                            requests on the worker thread (default: 0)\n"
+       "     --subscriber-profile-cache-size N\n"
+       "                            The maximum number of subscriber profiles retrieved from Homestead\n"
+       "                            to cache locally. 0 disables the cache (default: 0)\n"
+       "     --subscriber-profile-cache-ttl <secs>\n"
+       "                            How long a cached subscriber profile may be used for. Changes made\n"
+       "                            through other nodes may not be seen until this expires (default: 30)\n"
+       "     --subscriber-profile-reg-refresh <secs>\n"
+       "                            How long after a subscriber's registration is sent to Homestead that\n"
+       "                            refreshes of it by the same private ID are handled using the cached\n"
+       "                            subscriber profile rather than being sent to Homestead. Only used if\n"
+       "                            the subscriber profile cache is enabled. 0 sends every registration\n"
+       "                            to Homestead (default: 0)\n"
+       "     --simservs-cache-size N\n"
+       "                            The maximum number of simservs documents retrieved from the XDMS\n"
+       "                            to cache locally for the MMTEL AS. 0 disables the cache (default: 0)\n"
+       "     --simservs-cache-ttl <secs>\n"
+       "                            How long a cached simservs document may be used for, unless it is\n"
+       "                            invalidated through the /simservs/<IMPU> HTTP interface (default: 30)\n"
        "     --blacklisted-scscfs   List of URIs of blacklisted S-CSCFs\n"
        " -N, --plugin-option <plugin>,<name>,<value>\n"
        "                            Provide an option value to a plugin.\n"
        " -F, --log-file <directory>\n"
        "                            Log to file in specified directory\n"
        " -L, --log-level N          Set log level to N (default: 4)\n"
+       "     --msg-trace-sample-rate N\n"
+       "                            Keep a copy of one in every N SIP messages handled by each thread\n"
+       "                            in memory, to be dumped on a crash or from the management\n"
+       "                            interface. 0 disables message tracing (default: 0)\n"
        " -d, --daemon               Run as daemon\n"
        " -t, --interactive          Run in foreground with interactive menu\n"
        " -h, --help                 Show this help screen\n"
@@ -536,6 +605,21 @@ bool parse_port(const std::string& port_str, int& port)
     return -1;                                                                 \
   }
 
+#define VALIDATE_INT_PARAM_NON_NEGATIVE(PARAMETER, PARAMETER_NAME, TRC_STATEMENT) \
+  int parameter;                                                               \
+  bool rc = validated_atoi(pj_optarg, parameter);                              \
+                                                                               \
+  if ((rc) && (parameter >= 0))                                                \
+  {                                                                            \
+    PARAMETER = parameter;                                                     \
+    TRC_INFO(""#TRC_STATEMENT" set to %d", parameter);                         \
+  }                                                                            \
+  else                                                                         \
+  {                                                                            \
+    TRC_ERROR("Invalid value for "#PARAMETER_NAME": %s", pj_optarg);           \
+    return -1;                                                                 \
+  }
+
 static pj_status_t init_logging_options(int argc, char* argv[], struct options* options)
 {
   int c;
@@ -816,6 +900,30 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_RALF_BATCH_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->ralf_batch_size,
+                                    ralf_batch_size,
+                                    Ralf batch size);
+      }
+      break;
+
+    case OPT_RALF_BATCH_LINGER:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->ralf_batch_linger_ms,
+                                        ralf_batch_linger,
+                                        Ralf batch linger time);
+      }
+      break;
+
+    case OPT_RALF_SPOOL_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->ralf_spool_size,
+                                        ralf_spool_size,
+                                        Ralf spool size);
+      }
+      break;
+
     case 'E':
       options->enum_servers.clear();
       Utils::split_string(std::string(pj_optarg), ',', options->enum_servers, 0, false);
@@ -940,6 +1048,14 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case 'P':
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->pjsip_threads,
+                                    pjsip_threads,
+                                    Number of PJSIP transport threads);
+      }
+      break;
+
     case 'B':
       options->billing_cdf = std::string(pj_optarg);
       TRC_INFO("Use %s as billing cdf server", options->billing_cdf.c_str());
@@ -1248,6 +1364,14 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_HOMESTEAD_ASYNC_THREADS:
+      {
+        VALIDATE_INT_PARAM(options->homestead_async_threads,
+                           homestead_async_threads,
+                           Homestead async threads);
+      }
+      break;
+
     case OPT_LISTEN_PORT:
       {
         int listen_port;
@@ -1274,6 +1398,70 @@ static pj_status_t init_options(int argc, char* argv[], struct options* options)
       }
       break;
 
+    case OPT_WORKER_QUEUE_SHARDS:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->worker_queue_shards,
+                                    worker_queue_shards,
+                                    Number of worker queue shards);
+      }
+      break;
+
+    case OPT_MSG_TRACE_SAMPLE_RATE:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->msg_trace_sample_rate,
+                                        msg_trace_sample_rate,
+                                        Message trace sample rate);
+      }
+      break;
+
+    case OPT_SUBSCRIBER_PROFILE_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->subscriber_profile_cache_size,
+                                        subscriber_profile_cache_size,
+                                        Subscriber profile cache size);
+      }
+      break;
+
+    case OPT_SUBSCRIBER_PROFILE_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->subscriber_profile_cache_ttl,
+                                    subscriber_profile_cache_ttl,
+                                    Subscriber profile cache TTL);
+      }
+      break;
+
+    case OPT_SUBSCRIBER_PROFILE_REG_REFRESH:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->subscriber_profile_reg_refresh,
+                                        subscriber_profile_reg_refresh,
+                                        Subscriber profile registration refresh interval);
+      }
+      break;
+
+    case OPT_ENUM_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->enum_cache_size,
+                                        enum_cache_size,
+                                        ENUM cache size);
+      }
+      break;
+
+    case OPT_SIMSERVS_CACHE_SIZE:
+      {
+        VALIDATE_INT_PARAM_NON_NEGATIVE(options->simservs_cache_size,
+                                        simservs_cache_size,
+                                        Simservs cache size);
+      }
+      break;
+
+    case OPT_SIMSERVS_CACHE_TTL:
+      {
+        VALIDATE_INT_PARAM_NON_ZERO(options->simservs_cache_ttl,
+                                    simservs_cache_ttl,
+                                    Simservs cache TTL);
+      }
+      break;
+
     SPROUTLET_MACRO(SPROUTLET_OPTIONS)
 
     case 'h':
@@ -1317,6 +1505,7 @@ void signal_handler(int sig)
   TRC_COMMIT();
 
   RamRecorder::dump("/var/log/sprout");
+  MsgTrace::dump("/var/log/sprout");
 
   // Dump a core.
   abort();
@@ -1387,6 +1576,8 @@ void reg_httpthread_with_pjsip(evhtp_t * htp, evthr_t * httpthread, void * arg)
 // globally scoped.
 LoadMonitor* load_monitor = NULL;
 HSSConnection* hss_connection = NULL;
+SubscriberProfileCache* subscriber_profile_cache = NULL;
+SimservsCache* simservs_cache = NULL;
 Store* local_data_store = NULL;
 std::vector<Store*> remote_data_stores;
 Store* local_impi_data_store = NULL;
@@ -1680,10 +1871,12 @@ int main(int argc, char* argv[])
   opt.record_routing_model = 1;
   opt.default_session_expires = 10 * 60;
   opt.worker_threads = 1;
+  opt.worker_queue_shards = 1;
   opt.analytics_enabled = PJ_FALSE;
   opt.http_address = "127.0.0.1";
   opt.http_port = 9888;
   opt.http_threads = 1;
+  opt.pjsip_threads = 1;
   opt.dns_servers.push_back("127.0.0.1");
   opt.billing_cdf = "";
   opt.emerg_reg_accepted = PJ_FALSE;
@@ -1709,6 +1902,9 @@ int main(int argc, char* argv[])
   opt.stateless_proxies.clear();
   opt.max_sproutlet_depth = SproutletProxy::DEFAULT_MAX_SPROUTLET_DEPTH;
   opt.ralf_threads = 25;
+  opt.ralf_batch_size = 1;
+  opt.ralf_batch_linger_ms = 10;
+  opt.ralf_spool_size = 0;
   opt.non_register_auth_mode = NonRegisterAuthentication::NEVER;
   opt.force_third_party_register_body = false;
   opt.listen_port = 0;
@@ -1722,9 +1918,17 @@ int main(int argc, char* argv[])
   opt.dummy_app_server = "";
   opt.http_acr_logging = false;
   opt.homestead_timeout = 750;
+  opt.homestead_async_threads = 0;
   opt.enable_orig_sip_to_tel_coerce = false;
   opt.request_on_queue_timeout = 4000;
   opt.ram_record_everything = false;
+  opt.msg_trace_sample_rate = 0;
+  opt.subscriber_profile_cache_size = 0;
+  opt.subscriber_profile_cache_ttl = 30;
+  opt.subscriber_profile_reg_refresh = 0;
+  opt.enum_cache_size = 0;
+  opt.simservs_cache_size = 0;
+  opt.simservs_cache_ttl = 30;
   opt.always_serve_remote_aliases = false;
 
   status = init_logging_options(argc, argv, &opt);
@@ -1753,6 +1957,12 @@ int main(int argc, char* argv[])
     RamRecorder::recordEverything();
   }
 
+  if (opt.msg_trace_sample_rate > 0)
+  {
+    TRC_INFO("Tracing one in %d SIP messages", opt.msg_trace_sample_rate);
+    MsgTrace::set_sample_rate(opt.msg_trace_sample_rate);
+  }
+
   // We should now have a connection to syslog so we can write the started ENT
   // log.
   CL_SPROUT_STARTED.log();
@@ -1912,6 +2122,17 @@ int main(int argc, char* argv[])
   SNMP::EventAccumulatorTable* homestead_uar_latency_table = NULL;
   SNMP::EventAccumulatorTable* homestead_lir_latency_table = NULL;
   SNMP::CounterTable* no_shared_ifcs_set_table = NULL;
+  SNMP::CounterTable* profile_cache_hit_tbl = NULL;
+  SNMP::CounterTable* profile_cache_miss_tbl = NULL;
+  SNMP::CounterTable* profile_cache_eviction_tbl = NULL;
+  SNMP::CounterTable* enum_cache_hit_tbl = NULL;
+  SNMP::CounterTable* enum_cache_miss_tbl = NULL;
+  SNMP::CounterTable* enum_cache_eviction_tbl = NULL;
+  SNMP::CounterTable* simservs_cache_hit_tbl = NULL;
+  SNMP::CounterTable* simservs_cache_miss_tbl = NULL;
+  SNMP::CounterTable* simservs_cache_eviction_tbl = NULL;
+  SNMP::CounterTable* homestead_coalesced_tbl = NULL;
+  SNMP::CounterTable* ralf_dropped_acrs_tbl = NULL;
 
   SNMP::ContinuousAccumulatorByScopeTable* token_rate_table = NULL;
   SNMP::ScalarByScopeTable* smoothed_latency_scalar = NULL;
@@ -1992,6 +2213,33 @@ int main(int argc, char* argv[])
                                                            "1.2.826.0.1.1578918.9.3.44");
     accept_for_remote_alias_tbl = SNMP::CounterTable::create("accept_for_remote_alias",
                                                            "1.2.826.0.1.1578918.9.3.45");
+
+    profile_cache_hit_tbl = SNMP::CounterTable::create("subscriber_profile_cache_hits",
+                                                       "1.2.826.0.1.1578918.9.3.46");
+    profile_cache_miss_tbl = SNMP::CounterTable::create("subscriber_profile_cache_misses",
+                                                        "1.2.826.0.1.1578918.9.3.47");
+    profile_cache_eviction_tbl = SNMP::CounterTable::create("subscriber_profile_cache_evictions",
+                                                            "1.2.826.0.1.1578918.9.3.48");
+
+    enum_cache_hit_tbl = SNMP::CounterTable::create("enum_cache_hits",
+                                                    "1.2.826.0.1.1578918.9.3.49");
+    enum_cache_miss_tbl = SNMP::CounterTable::create("enum_cache_misses",
+                                                     "1.2.826.0.1.1578918.9.3.50");
+    enum_cache_eviction_tbl = SNMP::CounterTable::create("enum_cache_evictions",
+                                                         "1.2.826.0.1.1578918.9.3.51");
+
+    simservs_cache_hit_tbl = SNMP::CounterTable::create("simservs_cache_hits",
+                                                        "1.2.826.0.1.1578918.9.3.52");
+    simservs_cache_miss_tbl = SNMP::CounterTable::create("simservs_cache_misses",
+                                                         "1.2.826.0.1.1578918.9.3.53");
+    simservs_cache_eviction_tbl = SNMP::CounterTable::create("simservs_cache_evictions",
+                                                             "1.2.826.0.1.1578918.9.3.54");
+
+    homestead_coalesced_tbl = SNMP::CounterTable::create("homestead_coalesced_requests",
+                                                         "1.2.826.0.1.1578918.9.3.55");
+
+    ralf_dropped_acrs_tbl = SNMP::CounterTable::create("ralf_dropped_acrs",
+                                                       "1.2.826.0.1.1578918.9.3.56");
   }
 
   // Create Sprout's alarm objects.
@@ -2091,7 +2339,8 @@ int main(int argc, char* argv[])
                       quiescing_mgr,
                       opt.billing_cdf,
                       sproutlet_uris,
-                      opt.enable_orig_sip_to_tel_coerce);
+                      opt.enable_orig_sip_to_tel_coerce,
+                      opt.pjsip_threads);
 
   if (status != PJ_SUCCESS)
   {
@@ -2134,7 +2383,11 @@ int main(int argc, char* argv[])
 
     ralf_processor = new RalfProcessor(ralf_connection,
                                        exception_handler,
-                                       opt.ralf_threads);
+                                       opt.ralf_threads,
+                                       opt.ralf_batch_size,
+                                       opt.ralf_batch_linger_ms,
+                                       opt.ralf_spool_size,
+                                       ralf_dropped_acrs_tbl);
   }
   else
   {
@@ -2154,6 +2407,27 @@ int main(int argc, char* argv[])
                                              AlarmDef::SPROUT_SIFC_STATUS,
                                              AlarmDef::CRITICAL),
                                    no_shared_ifcs_set_table);
+
+    if (opt.subscriber_profile_cache_size > 0)
+    {
+      TRC_STATUS("Caching up to %d subscriber profiles for %d seconds",
+                 opt.subscriber_profile_cache_size,
+                 opt.subscriber_profile_cache_ttl);
+
+      if (opt.subscriber_profile_reg_refresh > 0)
+      {
+        TRC_STATUS("Sending registration refreshes to Homestead at most every %d seconds",
+                   opt.subscriber_profile_reg_refresh);
+      }
+
+      subscriber_profile_cache = new SubscriberProfileCache(opt.subscriber_profile_cache_size,
+                                                            opt.subscriber_profile_cache_ttl,
+                                                            opt.subscriber_profile_reg_refresh,
+                                                            profile_cache_hit_tbl,
+                                                            profile_cache_miss_tbl,
+                                                            profile_cache_eviction_tbl);
+    }
+
     hss_connection = new HSSConnection(opt.hss_server,
                                        http_resolver,
                                        load_monitor,
@@ -2165,7 +2439,11 @@ int main(int argc, char* argv[])
                                        homestead_lir_latency_table,
                                        hss_comm_monitor,
                                        sifc_service,
-                                       opt.homestead_timeout);
+                                       opt.homestead_timeout,
+                                       subscriber_profile_cache,
+                                       opt.homestead_async_threads,
+                                       exception_handler,
+                                       homestead_coalesced_tbl);
   }
 
   // Create FIFC service
@@ -2188,7 +2466,11 @@ int main(int argc, char* argv[])
     enum_service = new DNSEnumService(opt.enum_servers,
                                       opt.enum_suffix,
                                       new DNSResolverFactory(),
-                                      enum_comm_monitor);
+                                      enum_comm_monitor,
+                                      opt.enum_cache_size,
+                                      enum_cache_hit_tbl,
+                                      enum_cache_miss_tbl,
+                                      enum_cache_eviction_tbl);
   }
   else if (!opt.enum_file.empty())
   {
@@ -2330,6 +2612,18 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if ((opt.simservs_cache_size > 0) && (opt.xdm_server != ""))
+  {
+    TRC_STATUS("Caching up to %d simservs documents for %d seconds",
+               opt.simservs_cache_size,
+               opt.simservs_cache_ttl);
+    simservs_cache = new SimservsCache(opt.simservs_cache_size,
+                                       opt.simservs_cache_ttl,
+                                       simservs_cache_hit_tbl,
+                                       simservs_cache_miss_tbl,
+                                       simservs_cache_eviction_tbl);
+  }
+
   // Load the sproutlet plugins.
   PluginLoader* loader = new PluginLoader("/usr/share/clearwater/sprout/plugins",
                                           opt);
@@ -2396,7 +2690,8 @@ int main(int argc, char* argv[])
                          load_monitor,
                          rph_service,
                          exception_handler,
-                         opt.request_on_queue_timeout);
+                         opt.request_on_queue_timeout,
+                         opt.worker_queue_shards);
 
   // Create worker threads first as they take work from the PJSIP threads so
   // need to be ready.
@@ -2447,6 +2742,12 @@ int main(int argc, char* argv[])
 
   HttpStackUtils::SpawningHandler<DeleteImpuTask, DeleteImpuTask::Config> delete_impu_handler(&delete_impu_config);
 
+  InvalidateSimservsTask::Config invalidate_simservs_config(simservs_cache);
+  HttpStackUtils::SpawningHandler<InvalidateSimservsTask, InvalidateSimservsTask::Config> invalidate_simservs_handler(&invalidate_simservs_config);
+
+  GetMessageTracesTask::Config get_msg_traces_config;
+  HttpStackUtils::SpawningHandler<GetMessageTracesTask, GetMessageTracesTask::Config> get_msg_traces_handler(&get_msg_traces_config);
+
   if (opt.enabled_scscf)
   {
     try
@@ -2461,6 +2762,11 @@ int main(int argc, char* argv[])
                                        &deregistration_handler);
       http_stack_sig->register_handler("^/registrations/[^/]+$",
                                        &push_profile_handler);
+      if (simservs_cache != NULL)
+      {
+        http_stack_sig->register_handler("^/simservs/[^/]+$",
+                                         &invalidate_simservs_handler);
+      }
       http_stack_sig->bind_tcp_socket(opt.http_address, opt.http_port);
       http_stack_sig->start(&reg_httpthread_with_pjsip);
     }
@@ -2481,6 +2787,8 @@ int main(int argc, char* argv[])
                                         &get_subscriptions_handler);
       http_stack_mgmt->register_handler("^/impu/[^/]+$",
                                         &delete_impu_handler);
+      http_stack_mgmt->register_handler("^/message-traces$",
+                                        &get_msg_traces_handler);
       http_stack_mgmt->bind_unix_socket(SPROUT_HTTP_MGMT_SOCKET_PATH);
       http_stack_mgmt->start(&reg_httpthread_with_pjsip);
     }
@@ -2570,6 +2878,8 @@ int main(int argc, char* argv[])
   delete http_stack_mgmt; http_stack_mgmt = NULL;
   delete chronos_connection;
   delete hss_connection;
+  delete subscriber_profile_cache;
+  delete simservs_cache;
   delete fifc_service;
   delete sifc_service;
   delete sas_service;
@@ -2653,6 +2963,17 @@ int main(int argc, char* argv[])
   delete homestead_uar_latency_table;
   delete homestead_lir_latency_table;
   delete no_shared_ifcs_set_table;
+  delete profile_cache_hit_tbl;
+  delete profile_cache_miss_tbl;
+  delete profile_cache_eviction_tbl;
+  delete enum_cache_hit_tbl;
+  delete enum_cache_miss_tbl;
+  delete enum_cache_eviction_tbl;
+  delete simservs_cache_hit_tbl;
+  delete simservs_cache_miss_tbl;
+  delete simservs_cache_eviction_tbl;
+  delete homestead_coalesced_tbl;
+  delete ralf_dropped_acrs_tbl;
 
   delete token_rate_table;
   delete smoothed_latency_scalar;
@@ -74,6 +74,20 @@ AppServerTsx* Mmtel::get_app_tsx(SproutletHelper* helper,
 // with all services disabled.
 simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
 {
+  // Use the cached configuration if there is one.  The caller owns the
+  // returned object, so hand it a copy.
+  uint64_t generation = 0;
+  if (_simservs_cache != NULL)
+  {
+    std::shared_ptr<const simservs> cached = _simservs_cache->get(public_id);
+    if (cached != NULL)
+    {
+      TRC_DEBUG("Using cached simservs configuration for %s", public_id.c_str());
+      return new simservs(*cached);
+    }
+    generation = _simservs_cache->generation();
+  }
+
   // Fetch the user's simservs configuration from the XDMS
   TRC_DEBUG("Fetching simservs configuration for %s", public_id.c_str());
   {
@@ -93,6 +107,13 @@ simservs* Mmtel::get_user_services(std::string public_id, SAS::TrailId trail)
   // Parse the retrieved XDMS information
   simservs *user_services = new simservs(simservs_xml);
 
+  if (_simservs_cache != NULL)
+  {
+    _simservs_cache->put(public_id,
+                         std::make_shared<const simservs>(*user_services),
+                         generation);
+  }
+
   return user_services;
 }
 
@@ -77,7 +77,7 @@ bool MMTELASPlugin::load(struct options& opt, std::list<Sproutlet*>& sproutlets)
                                           _xdm_latency_tbl);
 
       // Load the MMTEL AppServer
-      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection);
+      _mmtel = new Mmtel(opt.prefix_mmtel, _xdm_connection, simservs_cache);
       _mmtel_sproutlet = new SproutletAppServerShim(_mmtel,
                                                     opt.port_mmtel,
                                                     opt.uri_mmtel,
@@ -0,0 +1,450 @@
+/**
+ * @file msg_trace.cpp  Sampled SIP message traces held in per-thread buffers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+extern "C" {
+#include <pjlib.h>
+}
+
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+
+#include "msg_trace.h"
+
+namespace MsgTrace
+{
+
+/// A single traced message.  The sequence number is odd while the owning
+/// thread is writing to the slot, so that a dump running on another thread
+/// can detect (and skip) a slot that changed while it was being copied.
+struct Slot
+{
+  std::atomic<uint64_t> seq;
+  struct timeval time;
+  char description[MAX_DESCRIPTION_LEN];
+  int msg_len;
+  int len;
+  char data[MAX_MSG_LEN];
+};
+
+/// The trace buffer for a single thread.  Only the owning thread writes to
+/// the buffer.
+struct Ring
+{
+  std::string thread_name;
+  unsigned int sample_count;
+  std::atomic<uint64_t> next;
+  Slot slots[SLOTS_PER_THREAD];
+};
+
+static std::atomic<int> _sample_rate(0);
+
+// Every thread's buffer, so that they can all be dumped.  Buffers are never
+// freed, so traces from threads that have exited are still dumped.  This is a
+// fixed size array rather than a container so that it can be read without a
+// lock (including from a signal handler).  Threads beyond the first MAX_RINGS
+// still record traces, but they aren't dumped.
+static const int MAX_RINGS = 1024;
+static std::atomic<Ring*> _rings[MAX_RINGS];
+static std::atomic<int> _num_rings(0);
+
+static pthread_once_t _key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _ring_key;
+
+static void create_ring_key()
+{
+  pthread_key_create(&_ring_key, NULL);
+}
+
+/// Returns the calling thread's buffer, creating it if necessary.
+static Ring* this_thread_ring()
+{
+  pthread_once(&_key_once, create_ring_key);
+  Ring* ring = (Ring*)pthread_getspecific(_ring_key);
+
+  if (ring == NULL)
+  {
+    ring = new Ring();
+    ring->sample_count = 0;
+    ring->next.store(0);
+    for (int ii = 0; ii < SLOTS_PER_THREAD; ++ii)
+    {
+      ring->slots[ii].seq.store(0);
+    }
+
+    if (pj_thread_is_registered())
+    {
+      ring->thread_name = pj_thread_get_name(pj_thread_this());
+    }
+    else
+    {
+      ring->thread_name = "thread " + std::to_string((unsigned long)pthread_self());
+    }
+
+    int index = _num_rings.fetch_add(1);
+    if (index < MAX_RINGS)
+    {
+      _rings[index].store(ring, std::memory_order_release);
+    }
+
+    pthread_setspecific(_ring_key, ring);
+  }
+
+  return ring;
+}
+
+/// Claims the next slot in the calling thread's buffer and fills in the
+/// description.  The slot must be released with end_write.
+static Slot* begin_write(Ring* ring, const std::string& description)
+{
+  Slot* slot = &ring->slots[ring->next.load(std::memory_order_relaxed) %
+                            SLOTS_PER_THREAD];
+  slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  gettimeofday(&slot->time, NULL);
+  strncpy(slot->description, description.c_str(), MAX_DESCRIPTION_LEN - 1);
+  slot->description[MAX_DESCRIPTION_LEN - 1] = '\0';
+
+  return slot;
+}
+
+static void end_write(Ring* ring, Slot* slot)
+{
+  slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_release);
+  ring->next.store(ring->next.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+}
+
+void set_sample_rate(int sample_rate)
+{
+  _sample_rate.store(sample_rate);
+}
+
+bool sample()
+{
+  int sample_rate = _sample_rate.load(std::memory_order_relaxed);
+
+  if (sample_rate == 0)
+  {
+    return false;
+  }
+
+  Ring* ring = this_thread_ring();
+  return ((++ring->sample_count % sample_rate) == 0);
+}
+
+void record(const std::string& description, const char* buf, int len)
+{
+  Ring* ring = this_thread_ring();
+  Slot* slot = begin_write(ring, description);
+
+  slot->msg_len = std::max(0, len);
+  slot->len = std::min(slot->msg_len, MAX_MSG_LEN);
+  memcpy(slot->data, buf, slot->len);
+
+  end_write(ring, slot);
+}
+
+void record(const std::string& description, pjsip_msg* msg)
+{
+  Ring* ring = this_thread_ring();
+  Slot* slot = begin_write(ring, description);
+
+  // Print straight into the slot.  This fails if the message doesn't fit, in
+  // which case print it in full to a temporary buffer and keep the start.
+  pj_ssize_t size = pjsip_msg_print(msg, slot->data, MAX_MSG_LEN);
+
+  if (size >= 0)
+  {
+    slot->msg_len = size;
+    slot->len = size;
+  }
+  else
+  {
+    char* buf = new char[PJSIP_MAX_PKT_LEN];
+    size = std::max(0L, pjsip_msg_print(msg, buf, PJSIP_MAX_PKT_LEN));
+    slot->msg_len = size;
+    slot->len = std::min(slot->msg_len, MAX_MSG_LEN);
+    memcpy(slot->data, buf, slot->len);
+    delete[] buf;
+  }
+
+  end_write(ring, slot);
+}
+
+/// Appends a consistent copy of a slot to the dump.  Returns false if the
+/// slot was being written to.
+static bool dump_slot(const Slot* slot, std::string& out)
+{
+  uint64_t seq = slot->seq.load(std::memory_order_acquire);
+  if (seq & 1)
+  {
+    return false;
+  }
+
+  struct timeval time = slot->time;
+  std::string description(slot->description,
+                          strnlen(slot->description, MAX_DESCRIPTION_LEN));
+  int msg_len = slot->msg_len;
+  int len = std::min(std::max(0, slot->len), MAX_MSG_LEN);
+  std::string data(slot->data, len);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->seq.load(std::memory_order_relaxed) != seq)
+  {
+    // The slot has been overwritten while we were copying it.
+    return false;
+  }
+
+  struct tm tm;
+  char timestamp[64];
+  gmtime_r(&time.tv_sec, &tm);
+  size_t ts_len = strftime(timestamp, sizeof(timestamp), "%d-%m-%Y %H:%M:%S", &tm);
+  snprintf(timestamp + ts_len,
+           sizeof(timestamp) - ts_len,
+           ".%03ld UTC",
+           (long)(time.tv_usec / 1000));
+
+  out.append(timestamp).append(" ").append(description);
+  out.append(" (").append(std::to_string(msg_len)).append(" bytes");
+  if (len < msg_len)
+  {
+    out.append(", truncated to ").append(std::to_string(len));
+  }
+  out.append("):\n--start msg--\n\n").append(data).append("\n--end msg--\n");
+
+  return true;
+}
+
+/// Returns the ring at the given index, or NULL if it isn't there yet.
+static const Ring* ring_at(int index)
+{
+  return _rings[index].load(std::memory_order_acquire);
+}
+
+static int num_rings()
+{
+  return std::min(_num_rings.load(std::memory_order_acquire), MAX_RINGS);
+}
+
+std::string dump()
+{
+  std::string out;
+
+  for (int jj = 0; jj < num_rings(); ++jj)
+  {
+    const Ring* ring = ring_at(jj);
+    if (ring == NULL)
+    {
+      continue;
+    }
+
+    uint64_t next = ring->next.load(std::memory_order_acquire);
+    uint64_t first = (next > SLOTS_PER_THREAD) ? (next - SLOTS_PER_THREAD) : 0;
+
+    if (first == next)
+    {
+      continue;
+    }
+
+    out.append("Traces from ").append(ring->thread_name).append("\n");
+    for (uint64_t ii = first; ii < next; ++ii)
+    {
+      dump_slot(&ring->slots[ii % SLOTS_PER_THREAD], out);
+    }
+    out.append("\n");
+  }
+
+  return out;
+}
+
+// Helpers for writing the dump from a signal handler, which mustn't allocate
+// memory or use stdio.
+
+/// Appends a string to a fixed size buffer, truncating if necessary.
+static void append_str(char* buf, size_t size, size_t& pos, const char* str)
+{
+  while ((*str != '\0') && (pos + 1 < size))
+  {
+    buf[pos++] = *str++;
+  }
+  buf[pos] = '\0';
+}
+
+/// Appends a number to a fixed size buffer, zero-padded to min_digits.
+static void append_num(char* buf,
+                       size_t size,
+                       size_t& pos,
+                       uint64_t num,
+                       int min_digits = 1)
+{
+  char digits[24];
+  int len = 0;
+
+  do
+  {
+    digits[len++] = '0' + (num % 10);
+    num /= 10;
+  }
+  while ((num > 0) && (len < (int)sizeof(digits)));
+
+  while (len < min_digits)
+  {
+    digits[len++] = '0';
+  }
+
+  while ((len > 0) && (pos + 1 < size))
+  {
+    buf[pos++] = digits[--len];
+  }
+  buf[pos] = '\0';
+}
+
+static void write_all(int fd, const char* buf, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t written = write(fd, buf, len);
+    if (written <= 0)
+    {
+      return;
+    }
+    buf += written;
+    len -= written;
+  }
+}
+
+/// Writes a slot straight from the buffer.  The slot may be overwritten while
+/// this is going on, in which case the dump says so.
+static void write_slot(int fd, const Slot* slot)
+{
+  uint64_t seq = slot->seq.load(std::memory_order_acquire);
+  if (seq & 1)
+  {
+    return;
+  }
+
+  int msg_len = slot->msg_len;
+  int len = std::min(std::max(0, slot->len), MAX_MSG_LEN);
+
+  char header[MAX_DESCRIPTION_LEN + 128];
+  size_t pos = 0;
+  header[0] = '\0';
+  append_num(header, sizeof(header), pos, slot->time.tv_sec);
+  append_str(header, sizeof(header), pos, ".");
+  append_num(header, sizeof(header), pos, slot->time.tv_usec / 1000, 3);
+  append_str(header, sizeof(header), pos, " ");
+  write_all(fd, header, pos);
+  write_all(fd,
+            slot->description,
+            strnlen(slot->description, MAX_DESCRIPTION_LEN));
+
+  pos = 0;
+  append_str(header, sizeof(header), pos, " (");
+  append_num(header, sizeof(header), pos, msg_len);
+  append_str(header, sizeof(header), pos, " bytes");
+  if (len < msg_len)
+  {
+    append_str(header, sizeof(header), pos, ", truncated to ");
+    append_num(header, sizeof(header), pos, len);
+  }
+  append_str(header, sizeof(header), pos, "):\n--start msg--\n\n");
+  write_all(fd, header, pos);
+  write_all(fd, slot->data, len);
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (slot->seq.load(std::memory_order_relaxed) != seq)
+  {
+    const char* overwritten = "\n(overwritten while dumping)";
+    write_all(fd, overwritten, strlen(overwritten));
+  }
+
+  const char* end = "\n--end msg--\n";
+  write_all(fd, end, strlen(end));
+}
+
+void dump(const char* directory)
+{
+  if (_sample_rate.load(std::memory_order_relaxed) == 0)
+  {
+    return;
+  }
+
+  char filename[1024];
+  size_t pos = 0;
+  filename[0] = '\0';
+  append_str(filename, sizeof(filename), pos, directory);
+  append_str(filename, sizeof(filename), pos, "/msgtrace.");
+  append_num(filename, sizeof(filename), pos, time(NULL));
+  append_str(filename, sizeof(filename), pos, ".txt");
+
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0)
+  {
+    return;
+  }
+
+  for (int jj = 0; jj < num_rings(); ++jj)
+  {
+    const Ring* ring = ring_at(jj);
+    if (ring == NULL)
+    {
+      continue;
+    }
+
+    uint64_t next = ring->next.load(std::memory_order_acquire);
+    uint64_t first = (next > SLOTS_PER_THREAD) ? (next - SLOTS_PER_THREAD) : 0;
+
+    if (first == next)
+    {
+      continue;
+    }
+
+    const char* prefix = "Traces from ";
+    write_all(fd, prefix, strlen(prefix));
+    write_all(fd, ring->thread_name.c_str(), ring->thread_name.size());
+    write_all(fd, "\n", 1);
+
+    for (uint64_t ii = first; ii < next; ++ii)
+    {
+      write_slot(fd, &ring->slots[ii % SLOTS_PER_THREAD]);
+    }
+
+    write_all(fd, "\n", 1);
+  }
+
+  close(fd);
+}
+
+void clear()
+{
+  for (int jj = 0; jj < num_rings(); ++jj)
+  {
+    Ring* ring = _rings[jj].load(std::memory_order_acquire);
+    if (ring != NULL)
+    {
+      ring->sample_count = 0;
+      ring->next.store(0);
+    }
+  }
+}
+
+}
@@ -32,6 +32,12 @@ static int xml_print_body(struct pjsip_msg_body *msg_body,
                       PJ_TRUE);
 }
 
+// Stands in for the registration ids when printing a reg-info document that
+// is shared between subscriptions.  Angle brackets are escaped in almost
+// everything else in the document, so this shouldn't appear anywhere else.
+// If it does, each NOTIFY builds its own document instead.
+static const pj_str_t REG_ID_PLACEHOLDER = pj_str((char*)"<reg-id>");
+
 NotifySender::NotifySender()
 {
 }
@@ -117,6 +123,12 @@ void NotifySender::send_notifys(const std::string& aor_id,
     }
   }
 
+  // The reg-info document is the same for every subscription (apart from the
+  // registration ids), so it is printed once, when the first NOTIFY is
+  // needed.
+  std::vector<std::string> reg_state_xml;
+  bool reg_state_xml_printed = false;
+
   for (SubscriberDataUtils::ClassifiedSubscription* classified_subscription :
                                                        classified_subscriptions)
   {
@@ -126,6 +138,44 @@ void NotifySender::send_notifys(const std::string& aor_id,
                 classified_subscription->_id.c_str(),
                 classified_subscription->_reasons.c_str());
 
+      if (!reg_state_xml_printed)
+      {
+        // Log any URIs that are left out of the NOTIFYs because they are
+        // barred.
+        std::vector<std::string> barred_uris =
+                                            associated_uris.get_barred_uris();
+
+        if (!barred_uris.empty())
+        {
+          std::stringstream ss;
+          std::copy(barred_uris.begin(),
+                    barred_uris.end(),
+                    std::ostream_iterator<std::string>(ss, ","));
+          std::string list = ss.str();
+          if (!list.empty())
+          {
+            // Strip the trailing comma.
+            list = list.substr(0, list.length() - 1);
+          }
+
+          SAS::Event event(trail, SASEvent::OMIT_BARRED_ID_FROM_NOTIFY, 0);
+          event.add_var_param(list);
+          SAS::report_event(event);
+        }
+
+        if (!notify_print_reg_state_xml(aor_id,
+                                        associated_uris,
+                                        classified_bindings,
+                                        reg_state,
+                                        reg_state_xml))
+        {
+          TRC_DEBUG("Failed to print shared NOTIFY body");
+          reg_state_xml.clear();
+        }
+
+        reg_state_xml_printed = true;
+      }
+
       if (classified_subscription->_subscription_event ==
           SubscriberDataUtils::SubscriptionEvent::TERMINATED)
       {
@@ -142,6 +192,7 @@ void NotifySender::send_notifys(const std::string& aor_id,
                                          cseq,
                                          classified_bindings,
                                          reg_state,
+                                         reg_state_xml,
                                          now,
                                          trail);
 
@@ -199,6 +250,7 @@ pj_status_t NotifySender::create_subscription_notify(
                                   int cseq,
                                   const ClassifiedBindings& classified_bindings,
                                   const RegistrationState& reg_state,
+                                  const std::vector<std::string>& reg_state_xml,
                                   int now,
                                   SAS::TrailId trail)
 {
@@ -219,6 +271,7 @@ pj_status_t NotifySender::create_subscription_notify(
                                      cseq,
                                      classified_bindings,
                                      reg_state,
+                                     reg_state_xml,
                                      state,
                                      expiry,
                                      trail);
@@ -235,6 +288,7 @@ pj_status_t NotifySender::create_notify(
                                     int cseq,
                                     const ClassifiedBindings& classified_bindings,
                                     const RegistrationState& reg_state,
+                                    const std::vector<std::string>& reg_state_xml,
                                     const SubscriptionState& subscription_state,
                                     int expiry,
                                     SAS::TrailId trail)
@@ -319,6 +373,7 @@ pj_status_t NotifySender::create_notify(
                                 subscription,
                                 classified_bindings,
                                 reg_state,
+                                reg_state_xml,
                                 trail);
     (*tdata_notify)->msg->body = body2;
   }
@@ -371,17 +426,59 @@ pj_status_t NotifySender::notify_create_body(
                                   Subscription* subscription,
                                   const ClassifiedBindings& classified_bindings,
                                   const RegistrationState& reg_state,
+                                  const std::vector<std::string>& reg_state_xml,
                                   SAS::TrailId trail)
 {
   TRC_DEBUG("Create body of a SIP NOTIFY");
 
+  pj_str_t reg_id;
+  pj_strdup2(pool, &reg_id, Utils::xml_escape(subscription->_to_tag).c_str());
+
+  body->content_type.type = STR_MIME_TYPE;
+  body->content_type.subtype = STR_MIME_SUBTYPE;
+
+  if (!reg_state_xml.empty())
+  {
+    // Fill in this subscription's registration ids in the shared document.
+    pj_size_t len = 0;
+
+    for (const std::string& segment : reg_state_xml)
+    {
+      len += segment.size();
+    }
+
+    len += (reg_state_xml.size() - 1) * reg_id.slen;
+
+    char* text = (char*)pj_pool_alloc(pool, len);
+    char* p = text;
+
+    for (size_t ii = 0; ii < reg_state_xml.size(); ++ii)
+    {
+      if (ii > 0)
+      {
+        pj_memcpy(p, reg_id.ptr, reg_id.slen);
+        p += reg_id.slen;
+      }
+
+      pj_memcpy(p, reg_state_xml[ii].data(), reg_state_xml[ii].size());
+      p += reg_state_xml[ii].size();
+    }
+
+    body->data = text;
+    body->len = len;
+
+    body->print_body = &pjsip_print_text_body;
+    body->clone_data = &pjsip_clone_text_data;
+
+    return PJ_SUCCESS;
+  }
+
   pj_xml_node* doc = notify_create_reg_state_xml(pool,
                                                  aor,
                                                  associated_uris,
-                                                 subscription,
+                                                 &reg_id,
                                                  classified_bindings,
-                                                 reg_state,
-                                                 trail);
+                                                 reg_state);
 
   if (doc == NULL)
   {
@@ -391,9 +488,6 @@ pj_status_t NotifySender::notify_create_body(
     // LCOV_EXCL_STOP
   }
 
-  body->content_type.type = STR_MIME_TYPE;
-  body->content_type.subtype = STR_MIME_SUBTYPE;
-
   body->data = doc;
   body->len = 0;
 
@@ -402,15 +496,69 @@ pj_status_t NotifySender::notify_create_body(
   return PJ_SUCCESS;
 }
 
+bool NotifySender::notify_print_reg_state_xml(
+                                  const std::string& aor,
+                                  const AssociatedURIs& associated_uris,
+                                  const ClassifiedBindings& classified_bindings,
+                                  const RegistrationState& reg_state,
+                                  std::vector<std::string>& reg_state_xml)
+{
+  TRC_DEBUG("Print the shared XML body for SIP NOTIFYs");
+
+  pj_pool_t* tmp_pool = pj_pool_create(&stack_data.cp.factory,
+                                       "NotifySender",
+                                       4096,
+                                       4096,
+                                       NULL);
+
+  pj_xml_node* doc = notify_create_reg_state_xml(tmp_pool,
+                                                 aor,
+                                                 associated_uris,
+                                                 &REG_ID_PLACEHOLDER,
+                                                 classified_bindings,
+                                                 reg_state);
+
+  // The document has to fit in a SIP message, so print it into a buffer of
+  // that size.
+  std::vector<char> buf(PJSIP_MAX_PKT_LEN);
+  int len = pj_xml_print(doc, buf.data(), buf.size(), PJ_TRUE);
+
+  pj_pool_release(tmp_pool);
+
+  if (len < 0)
+  {
+    // LCOV_EXCL_START
+    return false;
+    // LCOV_EXCL_STOP
+  }
+
+  // Split the document either side of each registration id.
+  std::string xml(buf.data(), len);
+  std::string placeholder(REG_ID_PLACEHOLDER.ptr, REG_ID_PLACEHOLDER.slen);
+  size_t start = 0;
+  size_t pos;
+
+  while ((pos = xml.find(placeholder, start)) != std::string::npos)
+  {
+    reg_state_xml.push_back(xml.substr(start, pos - start));
+    start = pos + placeholder.size();
+  }
+
+  reg_state_xml.push_back(xml.substr(start));
+
+  // There should be one registration id per unbarred IMPU.
+  return (reg_state_xml.size() ==
+          associated_uris.get_unbarred_uris().size() + 1);
+}
+
 // Create complete XML body for a NOTIFY
 pj_xml_node* NotifySender::notify_create_reg_state_xml(
                                   pj_pool_t* pool,
                                   const std::string& aor,
                                   const AssociatedURIs& associated_uris,
-                                  Subscription* subscription,
+                                  const pj_str_t* reg_id,
                                   const ClassifiedBindings& classified_bindings,
-                                  const RegistrationState& reg_state,
-                                  SAS::TrailId trail)
+                                  const RegistrationState& reg_state)
 {
   TRC_DEBUG("Create the XML body for a SIP NOTIFY");
 
@@ -444,28 +592,6 @@ pj_xml_node* NotifySender::notify_create_reg_state_xml(
   // assumes that the same binding/contact data needs to be reported for each
   // IMPU.
 
-  // Log any URIs that have been left out of the P-Associated-URI because they
-  // are barred.
-  std::vector<std::string> barred_uris = associated_uris.get_barred_uris();
-
-  if (!barred_uris.empty())
-  {
-    std::stringstream ss;
-    std::copy(barred_uris.begin(),
-              barred_uris.end(),
-              std::ostream_iterator<std::string>(ss, ","));
-    std::string list = ss.str();
-    if (!list.empty())
-    {
-      // Strip the trailing comma.
-      list = list.substr(0, list.length() - 1);
-    }
-
-    SAS::Event event(trail, SASEvent::OMIT_BARRED_ID_FROM_NOTIFY, 0);
-    event.add_var_param(list);
-    SAS::report_event(event);
-  }
-
   // Iterate over the unbarred IMPUs in the IRS, inserting a registration
   // element for each one
   std::vector<std::string> irs_impus = associated_uris.get_unbarred_uris();
@@ -500,15 +626,12 @@ pj_xml_node* NotifySender::notify_create_reg_state_xml(
 
     pj_str_t reg_aor;
     pj_strdup2(pool, &reg_aor, Utils::xml_escape(unescaped_aor).c_str());
-    std::string unescaped_reg_id = subscription->_to_tag;
-    pj_str_t reg_id;
-    pj_strdup2(pool, &reg_id, Utils::xml_escape(unescaped_reg_id).c_str());
     pj_str_t reg_state_str;
     reg_state_str = (reg_state == RegistrationState::ACTIVE) ? STR_ACTIVE :
                                                                STR_TERMINATED;
     pj_xml_node* reg_node = create_reg_node(pool,
                                             &reg_aor,
-                                            &reg_id,
+                                            reg_id,
                                             &reg_state_str);
 
     // Create the contact nodes
@@ -650,7 +773,7 @@ pj_xml_node* NotifySender::notify_create_reg_state_xml(
 // Return a XML registration node with the attributes populated
 pj_xml_node* NotifySender::create_reg_node(pj_pool_t* pool,
                                            pj_str_t* aor,
-                                           pj_str_t* id,
+                                           const pj_str_t* id,
                                            pj_str_t* state)
 {
   TRC_DEBUG("Create registration node");
@@ -2531,65 +2531,94 @@ void PJUtils::translate_request_uri(pjsip_msg* req,
     std::string new_uri_str = query_enum(req,
                                          enum_service,
                                          trail);
+    apply_enum_translation(req, pool, new_uri_str, should_override_npdi, trail);
+  }
+  else if (uri_class == LOCAL_PHONE_NUMBER)
+  {
+    TRC_DEBUG("Not doing ENUM lookup as URI was classified as local DN");
+    SAS::Event event(trail, SASEvent::NO_ENUM_LOOKUP_LOCAL_DN, 0);
+    event.add_var_param(PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, uri));
+    SAS::report_event(event);
+  }
+}
 
-    if (!new_uri_str.empty())
-    {
-      pjsip_uri* new_uri = (pjsip_uri*)PJUtils::uri_from_string(new_uri_str,
-                                                                pool);
+bool PJUtils::enum_lookup_required(pjsip_msg* req, std::string& user)
+{
+  pjsip_uri* uri = req->line.req.uri;
+  URIClass uri_class = URIClassifier::classify_uri(uri, false, true);
 
-      if (new_uri == NULL)
-      {
-        // The ENUM lookup has returned an invalid URI. Reject the
-        // request.
-        TRC_WARNING("Invalid ENUM response: %s", new_uri_str.c_str());
-        SAS::Event event(trail, SASEvent::ENUM_INVALID, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-        return;
-      }
+  if ((uri_class == GLOBAL_PHONE_NUMBER) ||
+      (uri_class == NP_DATA) ||
+      (uri_class == FINAL_NP_DATA))
+  {
+    pj_str_t pj_user = PJUtils::user_from_uri(uri);
+    user = PJUtils::pj_str_to_string(&pj_user);
+    return true;
+  }
 
-      // The URI was successfully translated, so see what it is.
-      URIClass new_uri_class = URIClassifier::classify_uri(new_uri, false, true);
-      std::string rn;
-      get_rn(new_uri, rn);
+  return false;
+}
 
-      if ((new_uri_class == HOME_DOMAIN_SIP_URI) ||
-          (new_uri_class == NODE_LOCAL_SIP_URI) ||
-          (new_uri_class == OFFNET_SIP_URI))
-      {
-        // Translation to a real SIP URI - this always takes priority.
-        TRC_DEBUG("Translated URI %s is a real SIP URI - replacing Request-URI",
-                  new_uri_str.c_str());
-        req->line.req.uri = new_uri;
-        SAS::Event event(trail, SASEvent::SIP_URI_FROM_ENUM, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-      }
-      else if ((new_uri_class == NP_DATA) || (new_uri_class == FINAL_NP_DATA))
-      {
-        if (should_update_np_data(uri_class, new_uri_class, new_uri_str, rn, should_override_npdi, trail))
-        {
-          req->line.req.uri = new_uri;
-        }
-      }
-      else
-      {
-        // We got a TEL URI of some description - update the Request-URI anyway and expect a
-        // downstream MGCF to sort it out.
-        TRC_DEBUG("Translated URI %s is not a SIP URI - replacing Request-URI anyway",
-                  new_uri_str.c_str());
-        req->line.req.uri = new_uri;
-        SAS::Event event(trail, SASEvent::NON_SIP_URI_FROM_ENUM, 0);
-        event.add_var_param(new_uri_str);
-        SAS::report_event(event);
-      }
+void PJUtils::apply_enum_translation(pjsip_msg* req,
+                                     pj_pool_t* pool,
+                                     const std::string& new_uri_str,
+                                     bool should_override_npdi,
+                                     SAS::TrailId trail)
+{
+  if (new_uri_str.empty())
+  {
+    return;
+  }
+
+  URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, false, true);
+  pjsip_uri* new_uri = (pjsip_uri*)PJUtils::uri_from_string(new_uri_str,
+                                                            pool);
+
+  if (new_uri == NULL)
+  {
+    // The ENUM lookup has returned an invalid URI. Reject the
+    // request.
+    TRC_WARNING("Invalid ENUM response: %s", new_uri_str.c_str());
+    SAS::Event event(trail, SASEvent::ENUM_INVALID, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+    return;
+  }
+
+  // The URI was successfully translated, so see what it is.
+  URIClass new_uri_class = URIClassifier::classify_uri(new_uri, false, true);
+  std::string rn;
+  get_rn(new_uri, rn);
+
+  if ((new_uri_class == HOME_DOMAIN_SIP_URI) ||
+      (new_uri_class == NODE_LOCAL_SIP_URI) ||
+      (new_uri_class == OFFNET_SIP_URI))
+  {
+    // Translation to a real SIP URI - this always takes priority.
+    TRC_DEBUG("Translated URI %s is a real SIP URI - replacing Request-URI",
+              new_uri_str.c_str());
+    req->line.req.uri = new_uri;
+    SAS::Event event(trail, SASEvent::SIP_URI_FROM_ENUM, 0);
+    event.add_var_param(new_uri_str);
+    SAS::report_event(event);
+  }
+  else if ((new_uri_class == NP_DATA) || (new_uri_class == FINAL_NP_DATA))
+  {
+    std::string new_uri_copy = new_uri_str;
+    if (should_update_np_data(uri_class, new_uri_class, new_uri_copy, rn, should_override_npdi, trail))
+    {
+      req->line.req.uri = new_uri;
     }
   }
-  else if (uri_class == LOCAL_PHONE_NUMBER)
+  else
   {
-    TRC_DEBUG("Not doing ENUM lookup as URI was classified as local DN");
-    SAS::Event event(trail, SASEvent::NO_ENUM_LOOKUP_LOCAL_DN, 0);
-    event.add_var_param(PJUtils::uri_to_string(PJSIP_URI_IN_REQ_URI, uri));
+    // We got a TEL URI of some description - update the Request-URI anyway and expect a
+    // downstream MGCF to sort it out.
+    TRC_DEBUG("Translated URI %s is not a SIP URI - replacing Request-URI anyway",
+              new_uri_str.c_str());
+    req->line.req.uri = new_uri;
+    SAS::Event event(trail, SASEvent::NON_SIP_URI_FROM_ENUM, 0);
+    event.add_var_param(new_uri_str);
     SAS::report_event(event);
   }
 }
@@ -8,59 +8,279 @@
  * Otherwise no rights are granted except for those provided to you by
  * Metaswitch Networks in a separate written agreement.
  */
+#include <algorithm>
+
 #include "ralf_processor.h"
 #include "exception_handler.h"
+#include "log.h"
+
+// The number of batches that can be waiting for a Ralf thread before callers
+// block, if there's no spool.
+static const unsigned int MAX_QUEUED_BATCHES = 100;
 
 /// Constructor.
 RalfProcessor::RalfProcessor(HttpConnection* ralf_connection,
                              ExceptionHandler* exception_handler,
-                             const int ralf_threads) :
+                             const int ralf_threads,
+                             const int max_batch_size,
+                             const int batch_linger_ms,
+                             const int spool_size,
+                             SNMP::CounterTable* dropped_tbl) :
   _thread_pool(new Pool(ralf_connection,
                         exception_handler,
                         &exception_callback,
-                        ralf_threads))
+                        ralf_threads,
+                        (spool_size > 0) ? 0 : MAX_QUEUED_BATCHES)),
+  _max_batch_size(std::max(max_batch_size, 1)),
+  _batch_linger_ms(batch_linger_ms),
+  _spool_size(std::max(spool_size, 0)),
+  _dropped_tbl(dropped_tbl),
+  _pending_batch(NULL),
+  _pending_batch_deadline(),
+  _spooled(0),
+  _dropping(false),
+  _terminated(false),
+  _flush_thread_started(false)
 {
+  pthread_condattr_t cond_attr;
+  pthread_condattr_init(&cond_attr);
+  pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+  pthread_mutex_init(&_lock, NULL);
+  pthread_cond_init(&_cond, &cond_attr);
+
+  pthread_condattr_destroy(&cond_attr);
+
   _thread_pool->start();
+
+  // Batches only need flushing if they can hold more than one request.
+  if (_max_batch_size > 1)
+  {
+    int rc = pthread_create(&_flush_thread, NULL, &flush_thread_fn, this);
+
+    if (rc == 0)
+    {
+      _flush_thread_started = true;
+    }
+    else
+    {
+      // LCOV_EXCL_START
+      TRC_ERROR("Failed to start Ralf batch flush thread (%d) - not batching",
+                rc);
+      _max_batch_size = 1;
+      // LCOV_EXCL_STOP
+    }
+  }
 }
 
 /// Destructor.
 RalfProcessor::~RalfProcessor()
 {
+  if (_flush_thread_started)
+  {
+    pthread_mutex_lock(&_lock);
+    _terminated = true;
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+
+    pthread_join(_flush_thread, NULL);
+  }
+
   if (_thread_pool != NULL)
   {
     _thread_pool->stop();
     _thread_pool->join();
     delete _thread_pool; _thread_pool = NULL;
   }
+
+  if (_pending_batch != NULL)
+  {
+    batch_complete(_pending_batch); _pending_batch = NULL;
+  }
+
+  pthread_cond_destroy(&_cond);
+  pthread_mutex_destroy(&_lock);
 }
 
-/// Adds a ralf request to the queue
+/// Adds a ralf request to the current batch, and adds the batch to the queue
+/// if it's full.
 void RalfProcessor::send_request_to_ralf(RalfRequest* rr)
 {
-  _thread_pool->add_work(rr);
+  RalfBatch* full_batch = NULL;
+
+  pthread_mutex_lock(&_lock);
+
+  if ((_spool_size > 0) && (_spooled >= _spool_size))
+  {
+    // Ralf isn't keeping up, and there's no room left to hold the request
+    // until it does.  Drop it, rather than blocking the caller.
+    bool log_drop = !_dropping;
+    _dropping = true;
+    pthread_mutex_unlock(&_lock);
+
+    if (log_drop)
+    {
+      TRC_WARNING("%zu requests waiting to be sent to Ralf - dropping ACRs",
+                  _spool_size);
+    }
+
+    TRC_DEBUG("Dropping request to Ralf for %s", rr->path.c_str());
+    if (_dropped_tbl)
+    {
+      _dropped_tbl->increment();
+    }
+
+    delete rr; rr = NULL;
+    return;
+  }
+
+  _spooled++;
+
+  if (_pending_batch == NULL)
+  {
+    _pending_batch = new RalfBatch();
+    _pending_batch->processor = this;
+    _pending_batch->requests.reserve(_max_batch_size);
+
+    if (_max_batch_size > 1)
+    {
+      // Start the clock on sending this batch, and let the flush thread know.
+      clock_gettime(CLOCK_MONOTONIC, &_pending_batch_deadline);
+      _pending_batch_deadline.tv_sec += _batch_linger_ms / 1000;
+      _pending_batch_deadline.tv_nsec += (_batch_linger_ms % 1000) * 1000000L;
+      if (_pending_batch_deadline.tv_nsec >= 1000000000L)
+      {
+        _pending_batch_deadline.tv_sec += 1;
+        _pending_batch_deadline.tv_nsec -= 1000000000L;
+      }
+
+      pthread_cond_signal(&_cond);
+    }
+  }
+
+  _pending_batch->requests.push_back(rr);
+
+  if (_pending_batch->requests.size() >= _max_batch_size)
+  {
+    full_batch = _pending_batch;
+    _pending_batch = NULL;
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  // Queue the batch outside the lock, as this blocks if there's no spool and
+  // the queue is full.
+  if (full_batch != NULL)
+  {
+    _thread_pool->add_work(full_batch);
+  }
+}
+
+void RalfProcessor::batch_complete(RalfBatch* batch)
+{
+  pthread_mutex_lock(&_lock);
+
+  _spooled -= batch->requests.size();
+
+  if ((_dropping) && (_spooled < _spool_size))
+  {
+    _dropping = false;
+    TRC_STATUS("Ralf has caught up - no longer dropping ACRs");
+  }
+
+  pthread_mutex_unlock(&_lock);
+
+  for (RalfRequest* rr : batch->requests)
+  {
+    delete rr;
+  }
+
+  delete batch; batch = NULL;
+}
+
+void* RalfProcessor::flush_thread_fn(void* processor)
+{
+  ((RalfProcessor*)processor)->flush_batches();
+  return NULL;
+}
+
+void RalfProcessor::flush_batches()
+{
+  pthread_mutex_lock(&_lock);
+
+  while (!_terminated)
+  {
+    if (_pending_batch == NULL)
+    {
+      pthread_cond_wait(&_cond, &_lock);
+      continue;
+    }
+
+    struct timespec deadline = _pending_batch_deadline;
+    pthread_cond_timedwait(&_cond, &_lock, &deadline);
+
+    // The batch may have filled up and been sent (and possibly replaced by a
+    // new one) while we were waiting, so check it is still due.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    if ((_pending_batch != NULL) &&
+        ((now.tv_sec > _pending_batch_deadline.tv_sec) ||
+         ((now.tv_sec == _pending_batch_deadline.tv_sec) &&
+          (now.tv_nsec >= _pending_batch_deadline.tv_nsec))))
+    {
+      RalfBatch* batch = _pending_batch;
+      _pending_batch = NULL;
+
+      pthread_mutex_unlock(&_lock);
+      TRC_DEBUG("Sending batch of %zu Ralf requests after linger time",
+                batch->requests.size());
+      _thread_pool->add_work(batch);
+      pthread_mutex_lock(&_lock);
+    }
+  }
+
+  // Send anything left over.
+  RalfBatch* batch = _pending_batch;
+  _pending_batch = NULL;
+  pthread_mutex_unlock(&_lock);
+
+  if (batch != NULL)
+  {
+    _thread_pool->add_work(batch);
+  }
 }
 
-// Send the ACR to Ralf
-void RalfProcessor::Pool::process_work(RalfProcessor::RalfRequest*& rr)
+// Send the ACRs to Ralf
+void RalfProcessor::Pool::process_work(RalfProcessor::RalfBatch*& batch)
 {
-  // Send the request. Penalties are set via the load monitor if the
-  // request fails in the HttpClient
-  _ralf_connection->create_request(HttpClient::RequestType::POST, rr->path)
-  .set_sas_trail(rr->trail)
-  .set_body(rr->message)
-  .send();
-
-  delete rr; rr = NULL;
+  // Send the requests one after another, reusing this thread's connection to
+  // Ralf.  Penalties are set via the load monitor if a request fails in the
+  // HttpClient
+  for (RalfProcessor::RalfRequest*& rr : batch->requests)
+  {
+    rr->encode();
+
+    _ralf_connection->create_request(HttpClient::RequestType::POST, rr->path)
+    .set_sas_trail(rr->trail)
+    .set_body(rr->message)
+    .send();
+
+    delete rr; rr = NULL;
+  }
+
+  batch->processor->batch_complete(batch); batch = NULL;
 }
 
 RalfProcessor::Pool::Pool(HttpConnection* ralf_connection,
-                          ExceptionHandler* exception_handler, 
-                          void (*callback)(RalfProcessor::RalfRequest*),
-                          unsigned int num_threads) :
-  ThreadPool<RalfProcessor::RalfRequest*>(num_threads, 
-                                          exception_handler, 
-                                          callback, 
-                                          100),
+                          ExceptionHandler* exception_handler,
+                          void (*callback)(RalfProcessor::RalfBatch*),
+                          unsigned int num_threads,
+                          unsigned int max_queue) :
+  ThreadPool<RalfProcessor::RalfBatch*>(num_threads,
+                                        exception_handler,
+                                        callback,
+                                        max_queue),
   _ralf_connection(ralf_connection)
 {}
 
@@ -364,8 +364,14 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
   //    Despite getting the previous registration state of the subscriber, we
   //    still don't have enough information to be able to tell what type of
   //    registration request we have.
+  //    The AoR that the bindings were read from is passed on to the SM if this
+  //    turns out to be a reregister, so that it doesn't have to read it again.
   Bindings current_bindings;
-  rc = _registrar->_sm->get_bindings(default_impu, current_bindings, trail());
+  AoR* current_aor = NULL;
+  rc = _registrar->_sm->get_bindings(default_impu,
+                                     current_bindings,
+                                     &current_aor,
+                                     trail());
 
   if ((rc != HTTP_OK) && (rc != HTTP_NOT_FOUND))
   {
@@ -398,6 +404,46 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
     return;
   }
 
+  if ((irs_info._reg_from_cache) && (current_bindings.empty()))
+  {
+    // We didn't tell Homestead about this registration because we thought it
+    // was a refresh, but the subscriber has no bindings, so it's actually an
+    // initial registration (e.g. the bindings have expired).  Homestead must
+    // be told about this, so ask again without using the cache.
+    TRC_DEBUG("No bindings for %s - sending registration to Homestead",
+              default_impu.c_str());
+    irs_query._cache_allowed = false;
+    irs_info = HSSConnection::irs_info();
+    rc = _registrar->_sm->get_subscriber_state(irs_query, irs_info, trail());
+    st_code = determine_sm_sip_response(rc, irs_info._regstate, "REGISTER");
+
+    if (st_code != PJSIP_SC_OK)
+    {
+      TRC_DEBUG("Failed to get subscriber information for %s - error is %d",
+                public_id.c_str(), st_code);
+      SAS::Event event(trail(), SASEvent::REGISTER_FAILED_INVALIDPUBPRIV, 0);
+      event.add_var_param(public_id);
+      event.add_var_param(private_id);
+      SAS::report_event(event);
+
+      acr->send();
+      delete acr;
+      delete current_aor; current_aor = NULL;
+
+      if (num_contact_headers != 0)
+      {
+        _registrar->_reg_stats_tbls->de_reg_tbl->increment_attempts();
+        _registrar->_reg_stats_tbls->de_reg_tbl->increment_failures();
+      }
+
+      pjsip_msg* rsp = create_response(req, st_code);
+      send_response(rsp);
+      free_msg(req);
+
+      return;
+    }
+  }
+
   // 4. We've successfully got the current bindings. Parse the register to work
   //    out what changes we want to make. We can also work out what type of
   //    register this is.
@@ -423,6 +469,7 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
       (rt == RegisterType::FETCH_INITIAL))
   {
     TRC_DEBUG("Processing an initial register for %s", default_impu.c_str());
+    delete current_aor; current_aor = NULL;
     rc = _registrar->_sm->register_subscriber(default_impu,
                                               _scscf_uri,
                                               irs_info._associated_uris,
@@ -441,7 +488,9 @@ void RegistrarSproutletTsx::process_register_request(pjsip_msg *req)
                                                 binding_ids_to_remove,
                                                 all_bindings,
                                                 irs_info,
+                                                current_aor,
                                                 trail());
+    current_aor = NULL;
   }
 
   if (rc == HTTP_OK)
@@ -70,8 +70,32 @@ void RegistrationSender::register_with_application_servers(pjsip_msg* received_r
                             matched_dummy_as,
                             trail);
 
+  // Work out the parts of the registers that are the same for every
+  // application server (including printing the received register and its
+  // response, which is expensive) once.  Then build all the registers from
+  // this before sending any of them, so that they go out back to back.
+  ThirdPartyRegisterTemplate reg_template;
+  std::vector<pjsip_tx_data*> registers;
+
+  if (!as_list.empty())
+  {
+    build_register_template(received_register_message,
+                            ok_response_msg,
+                            as_list,
+                            reg_template);
+  }
+
+  for (const AsInvocation& as : as_list)
+  {
+    registers.push_back(build_register_to_as(reg_template,
+                                             served_user,
+                                             as,
+                                             expires,
+                                             trail));
+  }
+
   // Loop through the application servers and send the registers.
-  for (AsInvocation as : as_list)
+  for (size_t ii = 0; ii < as_list.size(); ++ii)
   {
     if (_third_party_reg_stats_tbls != NULL)
     {
@@ -89,13 +113,15 @@ void RegistrationSender::register_with_application_servers(pjsip_msg* received_r
       }
     }
 
-    send_register_to_as(received_register_message,
-                        ok_response_msg,
-                        served_user,
-                        as,
-                        expires,
-                        is_initial_registration,
-                        trail);
+    if (registers[ii] != NULL)
+    {
+      send_register_to_as(registers[ii],
+                          served_user,
+                          as_list[ii],
+                          expires,
+                          is_initial_registration,
+                          trail);
+    }
   }
 
   // If we didn't match any application servers (dummy or otherwise) and this is
@@ -285,13 +311,81 @@ void RegistrationSender::match_application_servers(pjsip_msg* received_register_
   }
 }
 
-void RegistrationSender::send_register_to_as(pjsip_msg* received_register_msg,
-                                             pjsip_msg* ok_response_msg,
-                                             const std::string& served_user,
-                                             const AsInvocation& as,
-                                             int expires,
-                                             bool is_initial_registration,
-                                             SAS::TrailId trail)
+void RegistrationSender::build_register_template(pjsip_msg* received_register_msg,
+                                                 pjsip_msg* ok_response_msg,
+                                                 const std::vector<AsInvocation>& application_servers,
+                                                 ThirdPartyRegisterTemplate& reg_template)
+{
+  reg_template.include_register_info = ((received_register_msg != NULL) &&
+                                        (ok_response_msg != NULL));
+
+  if (!reg_template.include_register_info)
+  {
+    return;
+  }
+
+  // TODO: modify orig-ioi of P-Charging-Vector and remove term-ioi
+
+  // Copy P-Access-Network-Info, P-Visited-Network-Id and P-Charging-Vector
+  // from original message, and P-Charging-Function-Addresses from the OK
+  // response.
+  const pj_str_t* request_hdr_names[] = {&STR_P_A_N_I, &STR_P_V_N_I, &STR_P_C_V};
+  for (const pj_str_t* hdr_name : request_hdr_names)
+  {
+    pjsip_hdr* hdr = (pjsip_hdr*)pjsip_msg_find_hdr_by_name(received_register_msg,
+                                                            hdr_name,
+                                                            NULL);
+    if (hdr != NULL)
+    {
+      reg_template.headers.push_back(hdr);
+    }
+  }
+
+  pjsip_hdr* pcfa_hdr = (pjsip_hdr*)pjsip_msg_find_hdr_by_name(ok_response_msg,
+                                                               &STR_P_C_F_A,
+                                                               NULL);
+  if (pcfa_hdr != NULL)
+  {
+    reg_template.headers.push_back(pcfa_hdr);
+  }
+
+  // Print the received register and its response if any of the application
+  // servers want them in the body.
+  bool include_request = _force_third_party_register_body;
+  bool include_response = _force_third_party_register_body;
+
+  for (const AsInvocation& as : application_servers)
+  {
+    include_request = include_request || as.include_register_request;
+    include_response = include_response || as.include_register_response;
+  }
+
+  char buf[MAX_SIP_MSG_SIZE];
+
+  if (include_request)
+  {
+    pj_ssize_t size = pjsip_msg_print(received_register_msg, buf, sizeof(buf));
+    if (size > 0)
+    {
+      reg_template.register_request.assign(buf, size);
+    }
+  }
+
+  if (include_response)
+  {
+    pj_ssize_t size = pjsip_msg_print(ok_response_msg, buf, sizeof(buf));
+    if (size > 0)
+    {
+      reg_template.register_response.assign(buf, size);
+    }
+  }
+}
+
+pjsip_tx_data* RegistrationSender::build_register_to_as(const ThirdPartyRegisterTemplate& reg_template,
+                                                        const std::string& served_user,
+                                                        const AsInvocation& as,
+                                                        int expires,
+                                                        SAS::TrailId trail)
 {
   pj_status_t status;
   pjsip_tx_data *tdata;
@@ -319,31 +413,24 @@ void RegistrationSender::send_register_to_as(pjsip_msg* received_register_msg,
     //LCOV_EXCL_START
     TRC_DEBUG("Failed to build third-party REGISTER request for server %s",
               as.server_name.c_str());
-    return;
+    return NULL;
     //LCOV_EXCL_STOP
   }
 
   // Expires header based on 200 OK response
-  pjsip_expires_hdr_create(tdata->pool, expires);
   pjsip_expires_hdr* expires_hdr = pjsip_expires_hdr_create(tdata->pool, expires);
   pjsip_msg_add_hdr(tdata->msg, (pjsip_hdr*)expires_hdr);
 
-  // TODO: modify orig-ioi of P-Charging-Vector and remove term-ioi
-
-  if (received_register_msg && ok_response_msg)
+  if (reg_template.include_register_info)
   {
-    // Copy P-Access-Network-Info, P-Visited-Network-Id and P-Charging-Vector
-    // from original message
-    PJUtils::clone_header(&STR_P_A_N_I, received_register_msg, tdata->msg, tdata->pool);
-    PJUtils::clone_header(&STR_P_V_N_I, received_register_msg, tdata->msg, tdata->pool);
-    PJUtils::clone_header(&STR_P_C_V, received_register_msg, tdata->msg, tdata->pool);
-
-    // Copy P-Charging-Function-Addresses from the OK response.
-    PJUtils::clone_header(&STR_P_C_F_A, ok_response_msg, tdata->msg, tdata->pool);
+    for (pjsip_hdr* hdr : reg_template.headers)
+    {
+      pjsip_msg_add_hdr(tdata->msg,
+                        (pjsip_hdr*)pjsip_hdr_clone(tdata->pool, hdr));
+    }
 
     // Build up this multipart body incrementally, based on the ServiceInfo,
     // IncludeRegisterRequest and IncludeRegisterResponse fields.
-    char buf[MAX_SIP_MSG_SIZE];
     pjsip_msg_body *final_body = pjsip_multipart_create(tdata->pool, NULL, NULL);
 
     // If we only have one part, we don't want a multipart MIME body - store the reference to each one here to use instead
@@ -367,8 +454,10 @@ void RegistrationSender::send_register_to_as(pjsip_msg* received_register_msg,
     if (as.include_register_request || _force_third_party_register_body)
     {
       pjsip_multipart_part *request_part = pjsip_multipart_create_part(tdata->pool);
-      pjsip_msg_print(received_register_msg, buf, sizeof(buf));
-      pj_str_t request_str = pj_str(buf);
+      pj_str_t request_str;
+      pj_strset(&request_str,
+                const_cast<char*>(reg_template.register_request.data()),
+                reg_template.register_request.length());
       request_part->body = pjsip_msg_body_create(tdata->pool, &STR_MESSAGE, &STR_SIP, &request_str),
       possible_final_body = request_part->body;
       multipart_parts++;
@@ -380,8 +469,10 @@ void RegistrationSender::send_register_to_as(pjsip_msg* received_register_msg,
     if (as.include_register_response || _force_third_party_register_body)
     {
       pjsip_multipart_part *response_part = pjsip_multipart_create_part(tdata->pool);
-      pjsip_msg_print(ok_response_msg, buf, sizeof(buf));
-      pj_str_t response_str = pj_str(buf);
+      pj_str_t response_str;
+      pj_strset(&response_str,
+                const_cast<char*>(reg_template.register_response.data()),
+                reg_template.register_response.length());
       response_part->body = pjsip_msg_body_create(tdata->pool, &STR_MESSAGE, &STR_SIP, &response_str),
       possible_final_body = response_part->body;
       multipart_parts++;
@@ -409,6 +500,18 @@ void RegistrationSender::send_register_to_as(pjsip_msg* received_register_msg,
   // Set the SAS trail on the request.
   set_trail(tdata, trail);
 
+  return tdata;
+}
+
+void RegistrationSender::send_register_to_as(pjsip_tx_data* tdata,
+                                             const std::string& served_user,
+                                             const AsInvocation& as,
+                                             int expires,
+                                             bool is_initial_registration,
+                                             SAS::TrailId trail)
+{
+  pj_status_t status;
+
   if (Log::enabled(Log::VERBOSE_LEVEL))
   {
     char buf[PJSIP_MAX_PKT_LEN];
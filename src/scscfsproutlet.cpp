@@ -306,6 +306,20 @@ void SCSCFSproutlet::translate_request_uri(pjsip_msg* req,
 }
 
 
+// Apply the result of an asynchronous ENUM lookup.
+void SCSCFSproutlet::apply_enum_translation(pjsip_msg* req,
+                                            pj_pool_t* pool,
+                                            const std::string& new_uri_str,
+                                            SAS::TrailId trail)
+{
+  PJUtils::apply_enum_translation(req,
+                                  pool,
+                                  new_uri_str,
+                                  should_override_npdi(),
+                                  trail);
+}
+
+
 // Get an ACR instance from the factory.
 ACR* SCSCFSproutlet::get_acr(SAS::TrailId trail,
                              ACR::Initiator initiator,
@@ -1452,35 +1466,34 @@ void SCSCFSproutletTsx::apply_originating_services(pjsip_msg* req)
       add_to_dialog(req, false, ACR::NODE_ROLE_ORIGINATING);
     }
 
-    if (_scscf->_enum_service)
+    std::string user;
+
+    if ((_scscf->_enum_service) &&
+        (_scscf->_enum_service->is_async()) &&
+        (PJUtils::enum_lookup_required(req, user)))
+    {
+      // Translate the RequestURI using ENUM without blocking this thread.
+      // Processing carries on when the lookup completes.
+      TRC_DEBUG("Translating URI asynchronously");
+      ResumeFn resume = suspend();
+      _scscf->_enum_service->lookup_uri_from_user_async(
+                                   user,
+                                   trail(),
+                                   [this, req, resume](const std::string& new_uri)
+      {
+        resume([this, req, new_uri]()
+        {
+          _scscf->apply_enum_translation(req, get_pool(req), new_uri, trail());
+          route_translated_request(req);
+        });
+      });
+    }
+    else if (_scscf->_enum_service)
     {
       // Attempt to translate the RequestURI using ENUM or an alternative
       // database.
       _scscf->translate_request_uri(req, get_pool(req), trail());
-
-      URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, true, true);
-      if ((uri_class == LOCAL_PHONE_NUMBER) ||
-          (uri_class == GLOBAL_PHONE_NUMBER) ||
-          (uri_class == NP_DATA) ||
-          (uri_class == FINAL_NP_DATA))
-      {
-        route_to_bgcf(req, SASEvent::PHONE_ROUTING_TO_BGCF);
-      }
-      else if (uri_class == OFFNET_SIP_URI)
-      {
-        // Destination is off-net, so route to the BGCF.
-        route_to_bgcf(req, SASEvent::OFFNET_ROUTING_TO_BGCF);
-      }
-      else if (uri_class != UNKNOWN)
-      {
-        // Destination is on-net so route to the I-CSCF.
-        route_to_icscf(req);
-      }
-      else
-      {
-        // Non-sip: or -tel: URI is invalid at this point, so just reject the request
-        reject_invalid_uri(req);
-      }
+      route_translated_request(req);
     }
     else
     {
@@ -1510,6 +1523,36 @@ void SCSCFSproutletTsx::apply_originating_services(pjsip_msg* req)
 }
 
 
+// Route a request at the end of originating processing, once any ENUM
+// translation has been done.
+void SCSCFSproutletTsx::route_translated_request(pjsip_msg* req)
+{
+  URIClass uri_class = URIClassifier::classify_uri(req->line.req.uri, true, true);
+  if ((uri_class == LOCAL_PHONE_NUMBER) ||
+      (uri_class == GLOBAL_PHONE_NUMBER) ||
+      (uri_class == NP_DATA) ||
+      (uri_class == FINAL_NP_DATA))
+  {
+    route_to_bgcf(req, SASEvent::PHONE_ROUTING_TO_BGCF);
+  }
+  else if (uri_class == OFFNET_SIP_URI)
+  {
+    // Destination is off-net, so route to the BGCF.
+    route_to_bgcf(req, SASEvent::OFFNET_ROUTING_TO_BGCF);
+  }
+  else if (uri_class != UNKNOWN)
+  {
+    // Destination is on-net so route to the I-CSCF.
+    route_to_icscf(req);
+  }
+  else
+  {
+    // Non-sip: or -tel: URI is invalid at this point, so just reject the request
+    reject_invalid_uri(req);
+  }
+}
+
+
 // Apply terminating services for this request.
 void SCSCFSproutletTsx::apply_terminating_services(pjsip_msg* req)
 {
@@ -19,7 +19,6 @@
 #include "sproutsasevent.h"
 #include "sprout_pd_definitions.h"
 #include "utils.h"
-#include "rapidxml/rapidxml_print.hpp"
 
 SIFCService::SIFCService(Alarm* alarm,
                          SNMP::CounterTable* no_shared_ifcs_set_tbl,
@@ -65,8 +64,9 @@ void SIFCService::update_sets()
     return;
   }
 
-  // Now parse the document
-  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  // Now parse the document.  This is kept for as long as any iFCs from it are
+  // in use.
+  std::shared_ptr<rapidxml::xml_document<>> root(new rapidxml::xml_document<>);
 
   try
   {
@@ -79,7 +79,6 @@ void SIFCService::update_sets()
               err.what());
     CL_SPROUT_SIFC_FILE_INVALID_XML.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
@@ -88,14 +87,12 @@ void SIFCService::update_sets()
     TRC_ERROR("Invalid shared iFCs configuration file - missing SharedIFCsSets block");
     CL_SPROUT_SIFC_FILE_MISSING_SHARED_IFCS_SETS.log();
     set_alarm();
-    delete root; root = NULL;
     return;
   }
 
   // At this point, we're definitely going to override the iFCs we've got.
-  // Update our map, taking a lock while we do so.
-  boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
-  _shared_ifc_sets.clear();
+  // Build the new sets, then swap them in under the lock.
+  std::map<int32_t, std::vector<std::pair<int32_t, Ifc>>> shared_ifc_sets;
   bool any_errors = false;
 
   rapidxml::xml_node<>* sets = root->first_node(SIFCService::SHARED_IFCS_SETS);
@@ -128,7 +125,7 @@ void SIFCService::update_sets()
       continue;
     }
 
-    if (_shared_ifc_sets.count(set_id) != 0)
+    if (shared_ifc_sets.count(set_id) != 0)
     {
       TRC_ERROR("Invalid shared iFC block - SetID (%d) is repeated. Skipping this entry",
                 set_id);
@@ -137,7 +134,7 @@ void SIFCService::update_sets()
       continue;
     }
 
-    std::vector<std::pair<int32_t, std::string>> ifc_set;
+    std::vector<std::pair<int32_t, Ifc>> ifc_set;
 
     for (rapidxml::xml_node<>* ifc = set->first_node(RegDataXMLUtils::IFC);
          ifc != NULL;
@@ -165,13 +162,16 @@ void SIFCService::update_sets()
       // Creating the iFC always passes; we don't validate the iFC any further
       // at this stage. We've validated this against a schema before allowing
       // any upload though.
-      std::string ifc_str;
-      rapidxml::print(std::back_inserter(ifc_str), *ifc, 0);
-      ifc_set.push_back(std::make_pair(priority, ifc_str));
+      ifc_set.push_back(std::make_pair(priority, Ifc(ifc, root)));
     }
 
     TRC_STATUS("Adding %lu iFCs for ID %d", ifc_set.size(), set_id);
-    _shared_ifc_sets.insert(std::make_pair(set_id, ifc_set));
+    shared_ifc_sets.insert(std::make_pair(set_id, ifc_set));
+  }
+
+  {
+    boost::lock_guard<boost::shared_mutex> write_lock(_sets_rw_lock);
+    _shared_ifc_sets.swap(shared_ifc_sets);
   }
 
   if (any_errors)
@@ -182,8 +182,6 @@ void SIFCService::update_sets()
   {
     clear_alarm();
   }
-
-  delete root; root = NULL;
 }
 
 SIFCService::~SIFCService()
@@ -204,16 +202,16 @@ void SIFCService::get_ifcs_from_id(std::multimap<int32_t, Ifc>& ifc_map,
   for (int id : ids)
   {
     TRC_DEBUG("Getting the shared iFCs for ID %d", id);
-    std::map<int, std::vector<std::pair<int32_t, std::string>>>::const_iterator i =
+    std::map<int, std::vector<std::pair<int32_t, Ifc>>>::const_iterator i =
                                                       _shared_ifc_sets.find(id);
 
     if (i != _shared_ifc_sets.end())
     {
       TRC_DEBUG("Found iFC set for ID %d", id);
 
-      for (std::pair<int32_t, std::string> ifc : i->second)
+      for (const std::pair<int32_t, Ifc>& ifc : i->second)
       {
-        ifc_map.insert(std::make_pair(ifc.first, Ifc(ifc.second, ifc_doc.get())));
+        ifc_map.insert(ifc);
       }
     }
     else
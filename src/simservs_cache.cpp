@@ -0,0 +1,76 @@
+/**
+ * @file simservs_cache.cpp  Local cache of parsed simservs documents.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include "log.h"
+#include "simservs_cache.h"
+
+SimservsCache::SimservsCache(size_t max_size,
+                             int ttl_s,
+                             SNMP::CounterTable* hit_tbl,
+                             SNMP::CounterTable* miss_tbl,
+                             SNMP::CounterTable* eviction_tbl) :
+  _hit_tbl(hit_tbl),
+  _miss_tbl(miss_tbl),
+  _cache(max_size, ttl_s, eviction_tbl)
+{
+}
+
+
+SimservsCache::~SimservsCache()
+{
+}
+
+
+std::shared_ptr<const simservs> SimservsCache::get(const std::string& public_id)
+{
+  std::shared_ptr<const simservs> user_services;
+
+  if (_cache.get(public_id, user_services))
+  {
+    TRC_DEBUG("Found cached simservs for %s", public_id.c_str());
+    if (_hit_tbl)
+    {
+      _hit_tbl->increment();
+    }
+  }
+  else if (_miss_tbl)
+  {
+    _miss_tbl->increment();
+  }
+
+  return user_services;
+}
+
+
+uint64_t SimservsCache::generation()
+{
+  return _cache.generation();
+}
+
+
+void SimservsCache::put(const std::string& public_id,
+                        const std::shared_ptr<const simservs>& user_services,
+                        uint64_t generation)
+{
+  _cache.put(public_id, user_services, generation);
+}
+
+
+void SimservsCache::invalidate(const std::string& public_id)
+{
+  _cache.invalidate(public_id);
+}
+
+
+size_t SimservsCache::size()
+{
+  return _cache.size();
+}
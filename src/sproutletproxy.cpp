@@ -18,9 +18,12 @@ extern "C" {
 }
 
 #include <sstream>
+#include <memory>
+#include <atomic>
 
 #include "log.h"
 #include "pjutils.h"
+#include "msg_trace.h"
 #include "sproutsasevent.h"
 #include "sproutletproxy.h"
 #include "snmp_sip_request_types.h"
@@ -61,6 +64,28 @@ SproutletProxy::SproutletProxy(pjsip_endpoint* endpt,
                                                        stack_data.pool,
                                                        false);
 
+  // Build the table of local hostnames.  Entries are only added if not
+  // already present, so a host that is both the root and an alias, or both a
+  // local and a remote alias, is treated as local.
+  if (_root_uri != NULL)
+  {
+    _host_table.emplace(_root_uri->host, AliasMatchLocality::LOCAL);
+  }
+
+  for (std::unordered_set<std::string>::const_iterator it = _host_local_aliases.begin();
+       it != _host_local_aliases.end();
+       ++it)
+  {
+    _host_table.emplace(pj_str((char*)it->c_str()), AliasMatchLocality::LOCAL);
+  }
+
+  for (std::unordered_set<std::string>::const_iterator it = _host_remote_aliases.begin();
+       it != _host_remote_aliases.end();
+       ++it)
+  {
+    _host_table.emplace(pj_str((char*)it->c_str()), AliasMatchLocality::REMOTE);
+  }
+
   for (std::list<Sproutlet*>::iterator it = _sproutlets.begin();
        it != _sproutlets.end();
        ++it)
@@ -122,7 +147,8 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
   }
   else
   {
-    _services.insert(std::make_pair(sproutlet->service_name(), sproutlet));
+    i = _services.insert(std::make_pair(sproutlet->service_name(), sproutlet)).first;
+    _service_table.emplace(pj_str((char*)i->first.c_str()), sproutlet);
   }
 
   std::list<std::string> aliases = sproutlet->aliases();
@@ -144,7 +170,8 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
     }
     else
     {
-      _services.insert(std::make_pair(*j, sproutlet));
+      k = _services.insert(std::make_pair(*j, sproutlet)).first;
+      _service_table.emplace(pj_str((char*)k->first.c_str()), sproutlet);
     }
   }
 
@@ -167,6 +194,12 @@ bool SproutletProxy::register_sproutlet(Sproutlet* sproutlet)
     else
     {
       _ports.insert(std::make_pair(port, sproutlet));
+
+      if ((port > 0) && ((size_t)port >= _port_table.size()))
+      {
+        _port_table.resize(port + 1, NULL);
+      }
+      _port_table[port] = sproutlet;
     }
   }
 
@@ -283,10 +316,11 @@ SproutletProxy::SproutletMatch
       event.add_static_param(port);
       SAS::report_event(event);
 
-      std::map<int, Sproutlet*>::const_iterator it = _ports.find(port);
-      if (it != _ports.end())
+      Sproutlet* sproutlet = ((port > 0) && ((size_t)port < _port_table.size())) ?
+                               _port_table[port] : NULL;
+      if (sproutlet != NULL)
       {
-        sproutlet_match = SproutletMatch(it->second, match_locality);
+        sproutlet_match = SproutletMatch(sproutlet, match_locality);
         alias = sproutlet_match.sproutlet->service_name();
         std::string uri_str = PJUtils::uri_to_string(PJSIP_URI_IN_ROUTING_HDR, (pjsip_uri*)uri);
         SAS::Event event(trail, SASEvent::SPROUTLET_SELECTION_PORT, 0);
@@ -327,8 +361,10 @@ SproutletProxy::SproutletMatch
   // Now we know we have a SIP URI, cast to one.
   pjsip_sip_uri* sip_uri = (pjsip_sip_uri*)uri;
 
-  std::string service_name;
-  std::map<std::string, Sproutlet*>::const_iterator it;
+  std::unordered_map<pj_str_t,
+                     Sproutlet*,
+                     PJUtils::PjStrHash,
+                     PJUtils::PjStrEqual>::const_iterator it;
 
   // First check if there is a services parameter, and if it matches a
   // sproutlet.
@@ -343,12 +379,11 @@ SproutletProxy::SproutletMatch
     if (is_alias_match(match))
     {
       // Check if this service matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&services_param->value);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      it = _service_table.find(services_param->value);
+      if (it != _service_table.end())
       {
         sproutlet_match = SproutletMatch(it->second, match);
-        alias = service_name;
+        alias = PJUtils::pj_str_to_string(&services_param->value);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = SERVICE_NAME;
       }
@@ -369,14 +404,15 @@ SproutletProxy::SproutletMatch
     if (sep != NULL)
     {
       // Extract the possible service name
-      service_name = std::string(hostname.ptr, sep - hostname.ptr);
+      pj_str_t service_name = {hostname.ptr, sep - hostname.ptr};
 
       // Remove the service name part and the period from the hostname.
       hostname.slen -= (sep - hostname.ptr + 1);
       hostname.ptr = sep + 1;
 
-      TRC_DEBUG("Possible service name %s will be used if %.*s is a local hostname",
-                service_name.c_str(),
+      TRC_DEBUG("Possible service name %.*s will be used if %.*s is a local hostname",
+                service_name.slen,
+                service_name.ptr,
                 hostname.slen,
                 hostname.ptr);
 
@@ -385,11 +421,11 @@ SproutletProxy::SproutletMatch
       {
         // Check if the part of the hostname before the first '.' matches
         // a sproutlet.
-        it = _services.find(service_name);
-        if (it != _services.end())
+        it = _service_table.find(service_name);
+        if (it != _service_table.end())
         {
           sproutlet_match = SproutletMatch(it->second, match);
-          alias = service_name;
+          alias = PJUtils::pj_str_to_string(&service_name);
           local_hostname = PJUtils::pj_str_to_string(&hostname);
           selection_type = DOMAIN_PART;
         }
@@ -408,12 +444,11 @@ SproutletProxy::SproutletMatch
     if (is_alias_match(match))
     {
       // Check if the user part matches a sproutlet.
-      service_name = PJUtils::pj_str_to_string(&sip_uri->user);
-      it = _services.find(service_name);
-      if (it != _services.end())
+      it = _service_table.find(sip_uri->user);
+      if (it != _service_table.end())
       {
         sproutlet_match = SproutletMatch(it->second, match);
-        alias = service_name;
+        alias = PJUtils::pj_str_to_string(&sip_uri->user);
         local_hostname = PJUtils::pj_str_to_string(&sip_uri->host);
         selection_type = USER_PART;
       }
@@ -652,29 +687,14 @@ std::string SproutletProxy::get_local_hostname(const pjsip_sip_uri* uri,
 SproutletProxy::AliasMatchLocality
   SproutletProxy::get_host_locality(const pj_str_t* host) const
 {
-  if (!pj_stricmp(host, &_root_uri->host))
+  std::unordered_map<pj_str_t,
+                     AliasMatchLocality,
+                     PJUtils::PjStrCaseHash,
+                     PJUtils::PjStrCaseEqual>::const_iterator it =
+                                                       _host_table.find(*host);
+  if (it != _host_table.end())
   {
-    return AliasMatchLocality::LOCAL;
-  }
-
-  for (std::unordered_set<std::string>::const_iterator it = _host_local_aliases.begin();
-       it != _host_local_aliases.end();
-       ++it)
-  {
-    if (!pj_stricmp2(host, it->c_str()))
-    {
-      return AliasMatchLocality::LOCAL;
-    }
-  }
-
-  for (std::unordered_set<std::string>::const_iterator it = _host_remote_aliases.begin();
-     it != _host_remote_aliases.end();
-     ++it)
-  {
-    if (!pj_stricmp2(host, it->c_str()))
-    {
-      return AliasMatchLocality::REMOTE;
-    }
+    return it->second;
   }
 
   return AliasMatchLocality::NO_MATCH;
@@ -772,13 +792,16 @@ void SproutletProxy::UASTsx::Callback::run()
 SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
   BasicProxy::UASTsx(proxy),
   _root(NULL),
-  _dmap_sproutlet(),
-  _dmap_uac(),
-  _umap(),
-  _pending_req_q(),
+  _arena(),
+  _dmap_sproutlet(std::less<DMap<SproutletWrapper*>::key>(),
+                  DMap<SproutletWrapper*>::type::allocator_type(&_arena)),
+  _dmap_uac(std::less<DMap<UACTsx*>::key>(),
+            DMap<UACTsx*>::type::allocator_type(&_arena)),
+  _umap(std::less<void*>(), UMap::allocator_type(&_arena)),
+  _pending_req_q(PendingRequestDeque(PendingRequestDeque::allocator_type(&_arena))),
   _sproutlet_proxy(proxy),
-  _timers(),
-  _pending_timers()
+  _timers(std::less<pj_timer_entry*>(), TimerSet::allocator_type(&_arena)),
+  _pending_timers(std::less<pj_timer_entry*>(), TimerSet::allocator_type(&_arena))
 {
   int instances = ++_num_instances;
   TRC_DEBUG("Sproutlet Proxy transaction (%p) created. There are now %d instances",
@@ -788,7 +811,7 @@ SproutletProxy::UASTsx::UASTsx(SproutletProxy* proxy) :
 
 SproutletProxy::UASTsx::~UASTsx()
 {
-  for (std::set<pj_timer_entry*>::const_iterator timer = _timers.begin();
+  for (TimerSet::const_iterator timer = _timers.begin();
        timer != _timers.end();
        ++timer)
   {
@@ -1293,6 +1316,58 @@ bool SproutletProxy::UASTsx::timer_running(TimerID id)
 }
 
 
+ResumeFn SproutletProxy::UASTsx::suspend(SproutletWrapper* tsx)
+{
+  // Create the Callback that will resume the transaction now, while we're in
+  // the transaction context, as its constructor increments _pending_callbacks
+  // (which keeps this UASTsx alive until the Callback has run).  The function
+  // it runs is filled in when the Sproutlet resumes.
+  std::shared_ptr<std::function<void()>> resume_fn =
+                                   std::make_shared<std::function<void()>>();
+  Callback* callback = new Callback(this, [this, tsx, resume_fn]()
+  {
+    tsx->on_resume(*resume_fn);
+    schedule_requests();
+  });
+
+  // The Callback is owned by a Suspension shared between all copies of the
+  // returned function.  If they are all destroyed without it being called,
+  // the Callback is queued anyway with nothing to run, so that the
+  // suspension is released and this UASTsx isn't leaked.
+  struct Suspension
+  {
+    std::atomic<Callback*> callback;
+    std::shared_ptr<std::function<void()>> resume_fn;
+
+    void resume(const std::function<void()>& fn)
+    {
+      // This may be called on any thread, so always queue the Callback to
+      // run on a worker thread.  We relinquish ownership of the Callback.
+      Callback* cb = callback.exchange(NULL);
+      if (cb != NULL)
+      {
+        *resume_fn = fn;
+        PJUtils::run_callback_on_worker_thread(cb, false);
+      }
+    }
+
+    ~Suspension()
+    {
+      resume(std::function<void()>());
+    }
+  };
+
+  std::shared_ptr<Suspension> suspension = std::make_shared<Suspension>();
+  suspension->callback = callback;
+  suspension->resume_fn = resume_fn;
+
+  return [suspension](std::function<void()> fn)
+  {
+    suspension->resume(fn);
+  };
+}
+
+
 void SproutletProxy::UASTsx::on_timer_pop(pj_timer_heap_t* th,
                                           pj_timer_entry* tentry)
 {
@@ -1662,6 +1737,7 @@ SproutletWrapper::SproutletWrapper(SproutletProxy* proxy,
   _process_actions_entered(0),
   _forks(),
   _pending_timers(),
+  _pending_resumes(0),
   _allowed_host_state(BaseResolver::ALL_LISTS),
   _trail_id(trail_id)
 {
@@ -2149,6 +2225,13 @@ bool SproutletWrapper::schedule_timer(void* context, TimerID& id, int duration)
   return scheduled;
 }
 
+ResumeFn SproutletWrapper::suspend()
+{
+  TRC_DEBUG("%s suspending processing", _id.c_str());
+  _pending_resumes++;
+  return _proxy_tsx->suspend(this);
+}
+
 void SproutletWrapper::cancel_timer(TimerID id)
 {
   if (_proxy_tsx->cancel_timer(id))
@@ -2264,12 +2347,9 @@ void SproutletWrapper::rx_request(pjsip_tx_data* req, int allowed_host_state)
     pj_strdup2(req->pool, &hvia->transport, "TCP");
   }
 
-  // Log the request at VERBOSE level before we send it out to aid in
+  // Log the request at VERBOSE level (or trace it if sampled) to aid in
   // tracking its path through the sproutlets.
-  if (Log::enabled(Log::VERBOSE_LEVEL))
-  {
-    log_inter_sproutlet(req, true);
-  }
+  log_inter_sproutlet(req, true);
 
   // Clone the request to get a mutable copy to pass to the Sproutlet.
   pjsip_msg* clone = original_request();
@@ -2310,12 +2390,9 @@ void SproutletWrapper::rx_response(pjsip_tx_data* rsp,
   event.add_static_param(fork_id);
   SAS::report_event(event);
 
-  // Log the response at VERBOSE level before we send it out to aid in
+  // Log the response at VERBOSE level (or trace it if sampled) to aid in
   // tracking its path through the sproutlets.
-  if (Log::enabled(Log::VERBOSE_LEVEL))
-  {
-    log_inter_sproutlet(rsp, false);
-  }
+  log_inter_sproutlet(rsp, false);
 
   register_tdata(rsp);
   if ((PJSIP_IS_STATUS_IN_CLASS(rsp->msg->line.status.code, 100)) &&
@@ -2447,6 +2524,48 @@ void SproutletWrapper::on_timer_pop(TimerID id, void* context)
   process_actions(false);
 }
 
+void SproutletWrapper::on_resume(const std::function<void()>& fn)
+{
+  _pending_resumes--;
+
+  if (!fn)
+  {
+    TRC_WARNING("%s dropped its resume function without calling it",
+                _id.c_str());
+
+    if ((!_complete) &&
+        (count_pending_responses() == 0) &&
+        (_pending_timers.empty()) &&
+        (_pending_resumes == 0) &&
+        (_req->msg->line.req.method.id != PJSIP_ACK_METHOD))
+    {
+      // Nothing is left that could drive the Sproutlet on to a final
+      // response, so fail the request rather than leave it hanging.
+      pjsip_msg* req = original_request();
+      if (req != NULL)
+      {
+        pjsip_msg* rsp = create_response(req, PJSIP_SC_INTERNAL_SERVER_ERROR);
+        free_msg(req);
+        if (rsp != NULL)
+        {
+          send_response(rsp);
+        }
+      }
+    }
+  }
+  else if (!_complete)
+  {
+    TRC_DEBUG("%s resuming processing", _id.c_str());
+    fn();
+  }
+  else
+  {
+    TRC_DEBUG("%s has completed while suspended - not resuming", _id.c_str());
+  }
+
+  process_actions(false);
+}
+
 void SproutletWrapper::register_tdata(pjsip_tx_data* tdata)
 {
   TRC_DEBUG("Adding message %p => txdata %p mapping",
@@ -2500,7 +2619,7 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   // forwarded/generated by the Sproutlet.
   while (!_send_requests.empty())
   {
-    std::map<int, SproutletProxy::SendRequest>::iterator i = _send_requests.begin();
+    Requests::iterator i = _send_requests.begin();
     int fork_id = i->first;
     SproutletProxy::SendRequest req = i->second;
     _send_requests.erase(i);
@@ -2539,10 +2658,12 @@ void SproutletWrapper::process_actions(bool complete_after_actions)
   if ((_complete) &&
       (count_pending_responses() == 0) &&
       (_pending_timers.empty()) &&
+      (_pending_resumes == 0) &&
       (_process_actions_entered == 0))
   {
     // Sproutlet has sent a final response, has no downstream forks waiting
-    // a response, and has no pending timers, so should destroy itself.
+    // a response, and has no pending timers or resumes, so should destroy
+    // itself.
     TRC_VERBOSE("%s suiciding", _id.c_str());
     delete this;
   }
@@ -2799,6 +2920,21 @@ int SproutletWrapper::compare_sip_sc(int sc1, int sc2)
 void SproutletWrapper::log_inter_sproutlet(pjsip_tx_data* tdata,
                                            bool downstream)
 {
+  // Check whether the message is needed at all before serialising it - this
+  // is called for every message on every hop.
+  bool trace = MsgTrace::sample();
+
+  if (!Log::enabled(Log::VERBOSE_LEVEL))
+  {
+    if (trace)
+    {
+      // Not logging, so print the message straight into the trace buffer.
+      MsgTrace::record(inter_sproutlet_description(tdata, downstream),
+                       tdata->msg);
+    }
+    return;
+  }
+
   char buf[PJSIP_MAX_PKT_LEN];
   pj_ssize_t size;
 
@@ -2823,6 +2959,21 @@ void SproutletWrapper::log_inter_sproutlet(pjsip_tx_data* tdata,
               _service_name.c_str(),
               (int)size,
               buf);
+
+  if (trace)
+  {
+    MsgTrace::record(inter_sproutlet_description(tdata, downstream),
+                     buf,
+                     size);
+  }
+}
+
+std::string SproutletWrapper::inter_sproutlet_description(pjsip_tx_data* tdata,
+                                                          bool downstream)
+{
+  return std::string("Routing ") + pjsip_tx_data_get_info(tdata) +
+         ((downstream) ? " to downstream sproutlet " : " to upstream sproutlet ") +
+         _service_name;
 }
 
 bool SproutletWrapper::is_network_func_boundary() const
@@ -22,6 +22,7 @@ extern "C" {
 #include <sched.h>
 
 // Common STL includes.
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include <map>
@@ -33,6 +34,7 @@ extern "C" {
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/resource.h>
+#include <sys/socket.h>
 
 #include "constants.h"
 #include "eventq.h"
@@ -152,18 +154,22 @@ static void on_io_started(const std::string& msg)
 }
 
 /// PJSIP threads are donated to PJSIP to handle receiving at transport level
-/// and timers.
+/// and timers. There may be several of these, all polling the endpoint's
+/// ioqueue - each ready socket is dispatched to just one of them, so they can
+/// receive and parse messages from different sockets in parallel.
 static int pjsip_thread_func(void *p)
 {
   pj_time_val delay = {0, 10};
 
-  PJ_UNUSED_ARG(p);
+  int thread_index = (int)(intptr_t)p;
 
   // Get the Kernel's ID for this thread so we can log it out.
   pid_t tid;
   tid = syscall(SYS_gettid);
 
-  TRC_STATUS("PJSIP transport thread started with kernel thread ID %d", tid);
+  TRC_STATUS("PJSIP transport thread %d started with kernel thread ID %d",
+             thread_index,
+             tid);
 
   // Increase the priority of the transport thread (by giving it a real-time
   // scheduling policy and a non-zero priority). This means that the transport
@@ -183,8 +189,8 @@ static int pjsip_thread_func(void *p)
 
   pj_bool_t curr_quiescing = PJ_FALSE;
 
-  // Log whenever we do any I/O on this thread. There is only one transport
-  // thread so blocking on it is a really bad idea!
+  // Log whenever we do any I/O on this thread. There are only a handful of
+  // transport threads so blocking on them is a really bad idea!
   Utils::IOHook io_hook(&on_io_started,
                         Utils::IOHook::NOOP_ON_COMPLETE);
 
@@ -192,9 +198,11 @@ static int pjsip_thread_func(void *p)
   {
     pjsip_endpt_handle_events(stack_data.endpt, &delay);
 
-    // Check if our quiescing state has changed, and act appropriately
+    // Check if our quiescing state has changed, and act appropriately. Only
+    // the first transport thread does this, so the quiescing manager sees
+    // each change exactly once.
     pj_bool_t new_quiescing = quiescing;
-    if (curr_quiescing != new_quiescing)
+    if ((thread_index == 0) && (curr_quiescing != new_quiescing))
     {
       TRC_STATUS("Quiescing state changed");
       curr_quiescing = new_quiescing;
@@ -300,6 +308,53 @@ pj_status_t fill_transport_details(int port,
 }
 
 
+/// Creates a UDP socket bound to the specified address with SO_REUSEPORT set,
+/// and attaches it to PJSIP as a UDP transport. Several of these sockets can
+/// be bound to the same port, and the kernel then spreads received datagrams
+/// across them.
+static pj_status_t attach_reuseport_udp_transport(pj_sockaddr* addr,
+                                                  pjsip_host_port* published_name)
+{
+  pj_sock_t sock;
+  pj_status_t status = pj_sock_socket(addr->addr.sa_family,
+                                      pj_SOCK_DGRAM(),
+                                      0,
+                                      &sock);
+  if (status != PJ_SUCCESS)
+  {
+    return status;
+  }
+
+  int enabled = 1;
+  status = pj_sock_setsockopt(sock,
+                              pj_SOL_SOCKET(),
+                              SO_REUSEPORT,
+                              &enabled,
+                              sizeof(enabled));
+
+  if (status == PJ_SUCCESS)
+  {
+    status = pj_sock_bind(sock, addr, pj_sockaddr_get_len(addr));
+  }
+
+  if (status != PJ_SUCCESS)
+  {
+    pj_sock_close(sock);
+    return status;
+  }
+
+  // PJSIP owns the socket from here on, including on failure.
+  pjsip_transport_type_e type = (addr->addr.sa_family == PJ_AF_INET6) ?
+                                  PJSIP_TRANSPORT_UDP6 : PJSIP_TRANSPORT_UDP;
+  return pjsip_udp_transport_attach2(stack_data.endpt,
+                                     type,
+                                     sock,
+                                     published_name,
+                                     50,
+                                     NULL);
+}
+
+
 pj_status_t create_udp_transport(int port, pj_str_t& host)
 {
   pj_status_t status;
@@ -315,9 +370,33 @@ pj_status_t create_udp_transport(int port, pj_str_t& host)
     return status;
   }
 
-  // The UDP function call depends on the address type, which should be IPv4
-  // or IPv6, otherwise something has gone wrong so don't try to start transport.
-  if (addr.addr.sa_family == PJ_AF_INET)
+  // If there are several transport threads, give each its own socket on this
+  // port so that received datagrams are spread across the threads (otherwise
+  // only one thread can be reading from the port at a time).
+  //
+  // This only spreads receiving. PJSIP has no way to attach a receive-only
+  // UDP transport, so all of these sockets are registered as transports, and
+  // the transport manager picks the one registered last for any message that
+  // isn't tied to a particular transport. A response sent back over the
+  // transport its request arrived on uses that socket, but other UDP messages
+  // are all sent from the last socket. This is correct, as every socket has
+  // the same address, but sending isn't spread across the sockets.
+  //
+  // Otherwise, the UDP function call depends on the address type, which should
+  // be IPv4 or IPv6, otherwise something has gone wrong so don't try to start
+  // transport.
+  if ((stack_data.num_pjsip_threads > 1) &&
+      ((addr.addr.sa_family == PJ_AF_INET) ||
+       (addr.addr.sa_family == PJ_AF_INET6)))
+  {
+    for (int ii = 0;
+         (ii < stack_data.num_pjsip_threads) && (status == PJ_SUCCESS);
+         ++ii)
+    {
+      status = attach_reuseport_udp_transport(&addr, &published_name);
+    }
+  }
+  else if (addr.addr.sa_family == PJ_AF_INET)
   {
     status = pjsip_udp_transport_start(stack_data.endpt,
                                        &addr.ipv4,
@@ -554,8 +633,15 @@ pj_status_t init_pjsip()
   status = pjlib_util_init();
   PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
 
-  // Must create a pool factory before we can allocate any memory.
-  pj_caching_pool_init(&stack_data.cp, &pj_pool_factory_default_policy, 0);
+  // Must create a pool factory before we can allocate any memory. The factory
+  // keeps released pools (up to a bounded total size) for reuse, rather than
+  // returning them to the heap. This matters because every received message
+  // is cloned into its own pool before it is queued for the worker threads
+  // (and every transmitted message has its own pool), so without this each
+  // message costs at least one malloc/free pair on the transport thread.
+  pj_caching_pool_init(&stack_data.cp,
+                       &pj_pool_factory_default_policy,
+                       PJSIP_POOL_CACHE_CAPACITY);
   // Create the endpoint.
   status = pjsip_endpt_create(&stack_data.cp.factory, NULL, &stack_data.endpt);
   PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
@@ -582,6 +668,24 @@ pj_status_t init_pjsip()
                                    4000,
                                    NULL);
 
+  // Create the pool factories for group locks.  Each group lock gets its own
+  // small pool from the factory, which goes back to the factory's cache when
+  // the lock is destroyed and is reused by a later lock.  Group locks are
+  // created for every transaction, so they have factories of their own to
+  // avoid contending with message allocations on the main factory's lock,
+  // and several of them to avoid contending with each other.
+  for (int ii = 0; ii < GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    pj_caching_pool_init(&stack_data.grp_lock_cp[ii],
+                         &pj_pool_factory_default_policy,
+                         GRP_LOCK_POOL_CACHE_CAPACITY);
+    stack_data.grp_lock_pool[ii] = pj_pool_create(&stack_data.grp_lock_cp[ii].factory,
+                                                  "grp-locks",
+                                                  64,
+                                                  64,
+                                                  NULL);
+  }
+
   status = register_custom_headers();
   PJ_ASSERT_RETURN(status == PJ_SUCCESS, status);
 
@@ -592,13 +696,27 @@ pj_status_t start_pjsip_thread()
 {
   pj_status_t status = PJ_SUCCESS;
 
-  status = pj_thread_create(stack_data.pool, "pjsip", &pjsip_thread_func,
-                            NULL, 0, 0, &stack_data.pjsip_transport_thread);
-  if (status != PJ_SUCCESS)
+  // Create all the thread objects before starting any of them, so that
+  // is_pjsip_transport_thread() gives the right answer from the moment they
+  // start running.
+  stack_data.pjsip_transport_threads.resize(stack_data.num_pjsip_threads);
+
+  for (int ii = 0; ii < stack_data.num_pjsip_threads; ++ii)
   {
-    TRC_ERROR("Error creating PJSIP thread, %s",
-              PJUtils::pj_status_to_string(status).c_str());
-    return 1;
+    status = pj_thread_create(stack_data.pool, "pjsip", &pjsip_thread_func,
+                              (void*)(intptr_t)ii, 0, PJ_THREAD_SUSPENDED,
+                              &stack_data.pjsip_transport_threads[ii]);
+    if (status != PJ_SUCCESS)
+    {
+      TRC_ERROR("Error creating PJSIP thread, %s",
+                PJUtils::pj_status_to_string(status).c_str());
+      return 1;
+    }
+  }
+
+  for (int ii = 0; ii < stack_data.num_pjsip_threads; ++ii)
+  {
+    pj_thread_resume(stack_data.pjsip_transport_threads[ii]);
   }
 
   return PJ_SUCCESS;
@@ -625,7 +743,8 @@ pj_status_t init_stack(int pcscf_trusted_port,
                        QuiescingManager *quiescing_mgr_arg,
                        const std::string& cdf_domain,
                        std::vector<std::string> sproutlet_uris,
-                       bool enable_orig_sip_to_tel_coerce)
+                       bool enable_orig_sip_to_tel_coerce,
+                       int num_pjsip_threads)
 {
   pj_status_t status;
   pj_sockaddr pri_addr;
@@ -655,6 +774,7 @@ pj_status_t init_stack(int pcscf_trusted_port,
   stack_data.sip_tcp_connect_timeout = sip_tcp_connect_timeout;
   stack_data.sip_tcp_send_timeout = sip_tcp_send_timeout;
   stack_data.enable_orig_sip_to_tel_coerce = enable_orig_sip_to_tel_coerce;
+  stack_data.num_pjsip_threads = num_pjsip_threads;
 
   // Work out local and public hostnames and cluster domain names.
   stack_data.local_host = (local_host != "") ? pj_str(local_host_cstr) : *pj_gethostname();
@@ -944,13 +1064,19 @@ pj_status_t init_stack(int pcscf_trusted_port,
 
 pj_status_t stop_pjsip_thread()
 {
-  // Set the quit flag to signal the PJSIP thread to exit, then wait
+  // Set the quit flag to signal the PJSIP threads to exit, then wait
   // for them to exit.
   quit_flag = PJ_TRUE;
 
-  pj_thread_join(stack_data.pjsip_transport_thread);
+  for (std::vector<pj_thread_t*>::iterator ii =
+                                    stack_data.pjsip_transport_threads.begin();
+       ii != stack_data.pjsip_transport_threads.end();
+       ++ii)
+  {
+    pj_thread_join(*ii);
+  }
 
-  stack_data.pjsip_transport_thread = NULL;
+  stack_data.pjsip_transport_threads.clear();
 
   return PJ_SUCCESS;
 }
@@ -959,10 +1085,24 @@ void term_pjsip()
 {
   pjsip_endpt_destroy(stack_data.endpt);
   pj_pool_release(stack_data.pool);
+  for (int ii = 0; ii < GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    pj_pool_release(stack_data.grp_lock_pool[ii]);
+    pj_caching_pool_destroy(&stack_data.grp_lock_cp[ii]);
+  }
   pj_caching_pool_destroy(&stack_data.cp);
   pj_shutdown();
 }
 
+/// Creates a PJSIP group lock, allocated from one of the group lock pool
+/// factories in turn.
+pj_status_t create_grp_lock(pj_grp_lock_t** p_lock)
+{
+  static std::atomic<unsigned int> next_shard(0);
+  unsigned int shard = next_shard++ % GRP_LOCK_POOL_SHARDS;
+  return pj_grp_lock_create(stack_data.grp_lock_pool[shard], NULL, p_lock);
+}
+
 void stop_stack()
 {
   PJUtils::term();
@@ -110,6 +110,7 @@ HTTPCode SubscriberManager::register_subscriber_internal(const std::string& aor_
                                             {},
                                             all_bindings,
                                             irs_info,
+                                            NULL,
                                             false,
                                             trail);
     }
@@ -166,6 +167,7 @@ HTTPCode SubscriberManager::reregister_subscriber(const std::string& aor_id,
                                                   const std::vector<std::string>& binding_ids_to_remove,
                                                   Bindings& all_bindings,
                                                   HSSConnection::irs_info& irs_info,
+                                                  AoR* orig_aor,
                                                   SAS::TrailId trail)
 {
   return reregister_subscriber_internal(aor_id,
@@ -175,6 +177,7 @@ HTTPCode SubscriberManager::reregister_subscriber(const std::string& aor_id,
                                         binding_ids_to_remove,
                                         all_bindings,
                                         irs_info,
+                                        orig_aor,
                                         true,
                                         trail);
 }
@@ -186,6 +189,7 @@ HTTPCode SubscriberManager::reregister_subscriber_internal(const std::string& ao
                                                            const std::vector<std::string>& binding_ids_to_remove,
                                                            Bindings& all_bindings,
                                                            HSSConnection::irs_info& irs_info,
+                                                           AoR* orig_aor,
                                                            bool retry,
                                                            SAS::TrailId trail)
 {
@@ -193,12 +197,18 @@ HTTPCode SubscriberManager::reregister_subscriber_internal(const std::string& ao
 
   int now = time(NULL);
 
-  AoR* orig_aor = NULL;
-  uint64_t unused_version;
-  HTTPCode rc = _s4->handle_get(aor_id,
-                                &orig_aor,
-                                unused_version,
-                                trail);
+  // Use the AoR that the caller has already read for this request if there is
+  // one, rather than reading it again.
+  HTTPCode rc = HTTP_OK;
+
+  if (orig_aor == NULL)
+  {
+    uint64_t unused_version;
+    rc = _s4->handle_get(aor_id,
+                         &orig_aor,
+                         unused_version,
+                         trail);
+  }
 
   // We are reregistering a subscriber, so there must be an existing AoR in the
   // store.
@@ -689,14 +699,25 @@ HTTPCode SubscriberManager::deregister_subscriber(const std::string& public_id,
 HTTPCode SubscriberManager::get_bindings(const std::string& aor_id,
                                          Bindings& bindings,
                                          SAS::TrailId trail)
+{
+  AoR* aor = NULL;
+  HTTPCode rc = get_bindings(aor_id, bindings, &aor, trail);
+  delete aor; aor = NULL;
+  return rc;
+}
+
+HTTPCode SubscriberManager::get_bindings(const std::string& aor_id,
+                                         Bindings& bindings,
+                                         AoR** aor,
+                                         SAS::TrailId trail)
 {
   TRC_DEBUG("Retrieving bindings for AoR %s",
             aor_id.c_str());
 
-  AoR* aor = NULL;
+  *aor = NULL;
   uint64_t unused_version;
   HTTPCode rc = _s4->handle_get(aor_id,
-                                &aor,
+                                aor,
                                 unused_version,
                                 trail);
   if (rc != HTTP_OK)
@@ -704,15 +725,15 @@ HTTPCode SubscriberManager::get_bindings(const std::string& aor_id,
     TRC_DEBUG("Retrieving bindings for AoR %s failed during GET with return code %d",
               aor_id.c_str(),
               rc);
+    delete *aor; *aor = NULL;
     return rc;
   }
 
   // Set the bindings to return to the caller.
-  bindings = SubscriberDataUtils::copy_active_bindings(aor->bindings(),
+  bindings = SubscriberDataUtils::copy_active_bindings((*aor)->bindings(),
                                                        time(NULL),
                                                        trail);
 
-  delete aor; aor = NULL;
   return HTTP_OK;
 }
 
@@ -771,6 +792,11 @@ HTTPCode SubscriberManager::get_subscriber_state(const HSSConnection::irs_query&
   return http_code;
 }
 
+void SubscriberManager::invalidate_cached_subscriber_state(const std::string& public_id)
+{
+  _hss_connection->invalidate_cached_registration_data(public_id);
+}
+
 HTTPCode SubscriberManager::update_associated_uris(const std::string& aor_id,
                                                    const AssociatedURIs& associated_uris,
                                                    SAS::TrailId trail)
@@ -0,0 +1,203 @@
+/**
+ * @file subscriber_profile_cache.cpp  Local cache of subscriber profiles
+ * retrieved from Homestead.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <time.h>
+#include <algorithm>
+
+#include "log.h"
+#include "xml_utils.h"
+#include "subscriber_profile_cache.h"
+
+SubscriberProfileCache::SubscriberProfileCache(size_t max_size,
+                                               int ttl_s,
+                                               int reg_refresh_s,
+                                               SNMP::CounterTable* hit_tbl,
+                                               SNMP::CounterTable* miss_tbl,
+                                               SNMP::CounterTable* eviction_tbl) :
+  _ttl_ms((uint64_t)ttl_s * 1000),
+  _reg_refresh_ms((uint64_t)reg_refresh_s * 1000),
+  _hit_tbl(hit_tbl),
+  _miss_tbl(miss_tbl),
+  _cache(max_size, ttl_s, eviction_tbl)
+{
+}
+
+
+SubscriberProfileCache::~SubscriberProfileCache()
+{
+}
+
+
+bool SubscriberProfileCache::get(const std::string& public_id,
+                                 HSSConnection::irs_info& irs_info)
+{
+  bool found = false;
+
+  Profile profile;
+  if (_cache.get(public_id, profile))
+  {
+    if (profile.expiry_ms > current_time_ms())
+    {
+      irs_info = profile.irs_info;
+      found = true;
+    }
+    else
+    {
+      // The entry is too old to use here, but can still be used for
+      // registration refreshes, so leave it in place.
+      TRC_DEBUG("Cached subscriber profile for %s has expired",
+                public_id.c_str());
+    }
+  }
+
+  if (found)
+  {
+    TRC_DEBUG("Found cached subscriber profile for %s", public_id.c_str());
+    if (_hit_tbl)
+    {
+      _hit_tbl->increment();
+    }
+  }
+  else if (_miss_tbl)
+  {
+    _miss_tbl->increment();
+  }
+
+  return found;
+}
+
+
+bool SubscriberProfileCache::get_registration(const std::string& public_id,
+                                              const std::string& private_id,
+                                              HSSConnection::irs_info& irs_info)
+{
+  if (_reg_refresh_ms == 0)
+  {
+    return false;
+  }
+
+  bool found = false;
+
+  // A registration by a different private ID must go to Homestead so that
+  // it learns about the private ID.
+  Profile profile;
+  if ((_cache.get(public_id, profile)) &&
+      (profile.reg_expiry_ms > current_time_ms()) &&
+      ((private_id.empty()) || (private_id == profile.reg_private_id)) &&
+      (profile.irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED))
+  {
+    irs_info = profile.irs_info;
+    found = true;
+  }
+
+  if (found)
+  {
+    TRC_DEBUG("Found cached registration for %s", public_id.c_str());
+  }
+
+  return found;
+}
+
+
+uint64_t SubscriberProfileCache::generation()
+{
+  return _cache.generation();
+}
+
+
+void SubscriberProfileCache::put(const std::string& public_id,
+                                 const HSSConnection::irs_info& irs_info,
+                                 uint64_t generation)
+{
+  Profile profile;
+  profile.irs_info = irs_info;
+  profile.expiry_ms = current_time_ms() + _ttl_ms;
+  profile.reg_expiry_ms = 0;
+
+  _cache.put(public_id,
+             profile,
+             generation,
+             irs_info._associated_uris.get_all_uris(),
+             keep_registration);
+}
+
+
+void SubscriberProfileCache::put_registration(const std::string& public_id,
+                                              const std::string& private_id,
+                                              const HSSConnection::irs_info& irs_info,
+                                              uint64_t generation)
+{
+  // The registration may have changed the state of the whole IRS, so get rid
+  // of everything cached for it.
+  if (_reg_refresh_ms == 0)
+  {
+    _cache.invalidate(public_id);
+    return;
+  }
+
+  uint64_t now_ms = current_time_ms();
+
+  Profile profile;
+  profile.irs_info = irs_info;
+  profile.expiry_ms = now_ms + _ttl_ms;
+  profile.reg_private_id = private_id;
+  profile.reg_expiry_ms = now_ms + _reg_refresh_ms;
+
+  // Keep the entry until the registration must be refreshed, even if that's
+  // after the profile expires.
+  bool stored = _cache.replace(public_id,
+                               profile,
+                               generation,
+                               irs_info._associated_uris.get_all_uris(),
+                               (int)(std::max(_ttl_ms, _reg_refresh_ms) / 1000));
+
+  TRC_DEBUG("%s registration of %s",
+            stored ? "Cached" : "Not caching",
+            public_id.c_str());
+}
+
+
+void SubscriberProfileCache::invalidate(const std::string& public_id)
+{
+  _cache.invalidate(public_id);
+}
+
+
+size_t SubscriberProfileCache::size()
+{
+  return _cache.size();
+}
+
+
+bool SubscriberProfileCache::keep_registration(Profile& profile,
+                                               const Profile& old_profile)
+{
+  bool kept = false;
+
+  if ((old_profile.reg_expiry_ms > 0) &&
+      (profile.irs_info._regstate == RegDataXMLUtils::STATE_REGISTERED))
+  {
+    profile.reg_private_id = old_profile.reg_private_id;
+    profile.reg_expiry_ms = old_profile.reg_expiry_ms;
+    kept = true;
+  }
+
+  return kept;
+}
+
+
+uint64_t SubscriberProfileCache::current_time_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000 + (ts.tv_nsec / 1000000);
+}
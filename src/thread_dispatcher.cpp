@@ -17,6 +17,8 @@ extern "C" {
 }
 #include <arpa/inet.h>
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <vector>
 #include <map>
@@ -60,6 +62,13 @@ static eventq<struct SipEvent> sip_event_queue(0,
                                                true,
                                                sip_event_queue_backend);
 
+// Sharded queues for incoming events. This is only used (in place of the
+// single queue above) if the dispatcher is configured with multiple shards.
+static ShardedSipEventQueue* sharded_event_queue = NULL;
+
+// Callbacks have no transaction affinity, so are spread across the shards.
+static std::atomic<unsigned int> next_callback_shard(0);
+
 // Deadlock detection threshold for the message queue (in milliseconds).  This
 // is set to roughly twice the expected maximum service time for each message
 // (currently four seconds, allowing for four Homestead/Homer interactions
@@ -156,7 +165,43 @@ static void dump_message_details(pjsip_rx_data* rdata)
   }
 }
 
-bool process_queue_element()
+static bool pop_event(unsigned int worker_index, SipEvent& qe)
+{
+  if (sharded_event_queue != NULL)
+  {
+    return sharded_event_queue->pop(worker_index, qe);
+  }
+  else
+  {
+    return sip_event_queue.pop(qe);
+  }
+}
+
+static void push_event(unsigned int shard, const SipEvent& qe)
+{
+  if (sharded_event_queue != NULL)
+  {
+    sharded_event_queue->push(shard, qe);
+  }
+  else
+  {
+    sip_event_queue.push(qe);
+  }
+}
+
+static int event_queue_size()
+{
+  return (sharded_event_queue != NULL) ? sharded_event_queue->size() :
+                                         sip_event_queue.size();
+}
+
+static bool event_queue_is_deadlocked()
+{
+  return (sharded_event_queue != NULL) ? sharded_event_queue->is_deadlocked() :
+                                         sip_event_queue.is_deadlocked();
+}
+
+bool process_queue_element(unsigned int worker_index)
 {
   TRC_DEBUG("Attempting to process queue element");
   bool rc;
@@ -164,7 +209,7 @@ bool process_queue_element()
 
   unsigned long target_latency_us = load_monitor->get_target_latency_us();
 
-  rc = sip_event_queue.pop(qe);
+  rc = pop_event(worker_index, qe);
 
   if (rc)
   {
@@ -354,7 +399,8 @@ bool process_queue_element()
 /// Worker threads handle most SIP message processing.
 int worker_thread(void* p)
 {
-  TRC_DEBUG("Worker thread started");
+  unsigned int worker_index = (unsigned int)(intptr_t)p;
+  TRC_DEBUG("Worker thread %u started", worker_index);
 
   // This thread is not allowed to do IO without using the CW_IO_START and
   // CW_IO_COMPLETES macros. Doing so means that sprout's overload algorithms
@@ -364,7 +410,7 @@ int worker_thread(void* p)
   bool rc = true;
 
   while (rc) {
-    rc = process_queue_element();
+    rc = process_queue_element(worker_index);
   }
 
   TRC_DEBUG("Worker thread ended");
@@ -511,6 +557,31 @@ static SIPEventPriorityLevel get_rx_msg_priority(pjsip_rx_data* rdata,
   return PJUtils::get_priority_of_message(rdata->msg_info.msg, rph_service, trail);
 }
 
+// Determines which queue shard a SIP message should be queued on. This hashes
+// the Call-ID so that all messages for a dialog (and therefore for each of its
+// transactions) land on the same shard, falling back to the top Via branch if
+// there is no Call-ID.
+static unsigned int get_rx_msg_shard(pjsip_rx_data* rdata)
+{
+  const pj_str_t* key = NULL;
+
+  if (rdata->msg_info.cid != NULL)
+  {
+    key = &rdata->msg_info.cid->id;
+  }
+  else if (rdata->msg_info.via != NULL)
+  {
+    key = &rdata->msg_info.via->branch_param;
+  }
+
+  if (key == NULL)
+  {
+    return next_callback_shard++; // LCOV_EXCL_LINE
+  }
+
+  return pj_hash_calc(0, key->ptr, key->slen);
+}
+
 static pj_status_t reject_with_retry_header(pjsip_rx_data* rdata,
                                             pjsip_status_code code)
 {
@@ -585,7 +656,7 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   TRC_DEBUG("Admitted request %p", rdata);
 
   // Check that the worker threads are not all deadlocked.
-  if (sip_event_queue.is_deadlocked())
+  if (event_queue_is_deadlocked())
   {
     // LCOV_EXCL_START
     // The queue has not been serviced for sufficiently long to imply that
@@ -644,14 +715,14 @@ static pj_bool_t threads_on_rx_msg(pjsip_rx_data* rdata)
   // Track the current queue size
   if (queue_size_table)
   {
-    queue_size_table->accumulate(sip_event_queue.size()); // LCOV_EXCL_LINE
+    queue_size_table->accumulate(event_queue_size()); // LCOV_EXCL_LINE
   }
   // Increment the number of items put on the queue for a worker thread.
   if (queue_success_fail_table)
   {
     queue_success_fail_table->increment_attempts(qe.priority); // LCOV_EXCL_LINE
   }
-  sip_event_queue.push(qe);
+  push_event(get_rx_msg_shard(clone_rdata), qe);
 
   // return TRUE to flag that we have absorbed the incoming message.
   return PJ_TRUE;
@@ -665,12 +736,26 @@ pj_status_t init_thread_dispatcher(int num_worker_threads_arg,
                                    LoadMonitor* load_monitor_arg,
                                    RPHService* rph_service_arg,
                                    ExceptionHandler* exception_handler_arg,
-                                   unsigned long request_on_queue_timeout_ms_arg)
+                                   unsigned long request_on_queue_timeout_ms_arg,
+                                   int num_worker_queue_shards_arg)
 {
   // Set up the vectors of threads.  The threads don't get created until
   // start_worker_threads is called.
   worker_threads.resize(num_worker_threads_arg);
 
+  // If we've been asked for more than one queue shard, use sharded queues in
+  // place of the single event queue. There's no point having more shards than
+  // worker threads, as each shard needs at least one worker calling it home.
+  delete sharded_event_queue; sharded_event_queue = NULL;
+  int num_shards = std::min(num_worker_queue_shards_arg, num_worker_threads_arg);
+
+  if (num_shards > 1)
+  {
+    TRC_STATUS("Using %d sharded worker queues", num_shards);
+    sharded_event_queue = new ShardedSipEventQueue(num_shards);
+    sharded_event_queue->set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
+  }
+
   // Enable deadlock detection on the message queue.
   sip_event_queue.set_deadlock_threshold(MSG_Q_DEADLOCK_TIME);
 
@@ -709,7 +794,7 @@ pj_status_t start_worker_threads()
   {
     pj_thread_t* thread;
     status = pj_thread_create(stack_data.pool, "worker", &worker_thread,
-                              NULL, 0, 0, &thread);
+                              (void*)(intptr_t)ii, 0, 0, &thread);
     if (status != PJ_SUCCESS)
     {
       TRC_ERROR("Error creating worker thread, %s",
@@ -733,7 +818,14 @@ void stop_worker_threads()
 
   // Terminate the queue and delete all elements remaining on it
   std::vector<SipEvent> remaining_elts;
-  sip_event_queue.terminate(remaining_elts);
+  if (sharded_event_queue != NULL)
+  {
+    sharded_event_queue->terminate(remaining_elts);
+  }
+  else
+  {
+    sip_event_queue.terminate(remaining_elts);
+  }
   for (std::vector<SipEvent>::iterator qe = remaining_elts.begin();
        qe != remaining_elts.end();
        ++qe)
@@ -770,6 +862,8 @@ void stop_worker_threads()
 void unregister_thread_dispatcher(void)
 {
   pjsip_endpt_unregister_module(stack_data.endpt, &mod_thread_dispatcher);
+
+  delete sharded_event_queue; sharded_event_queue = NULL;
 }
 
 void add_callback_to_queue(PJUtils::Callback* cb)
@@ -798,5 +892,301 @@ void add_callback_to_queue(PJUtils::Callback* cb)
   TRC_DEBUG("Queuing callback %p for worker threads with priority %d",
             cb,
             qe.priority);
-  sip_event_queue.push(qe);
+  push_event(next_callback_shard++, qe);
+}
+
+unsigned long PriorityEventQueueBackend::get_start_time_us(SipEvent& event)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  unsigned long now_us = (now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+
+  unsigned long elapsed_us = 0;
+  if (!event.stop_watch.read(elapsed_us))
+  {
+    // We're extremely unlikely to end up in this case, but if we do, treat
+    // the event as if it has only just started.
+    TRC_ERROR("Failed to read stopwatch."); // LCOV_EXCL_LINE
+  }
+
+  return (elapsed_us < now_us) ? (now_us - elapsed_us) : 0;
+}
+
+ShardedSipEventQueue::ShardedSipEventQueue(int num_shards) :
+  _shards(),
+  _size(0),
+  _idle_workers(0),
+  _terminated(false),
+  _deadlock_threshold_ms(0)
+{
+  for (int ii = 0; ii < num_shards; ++ii)
+  {
+    Shard* shard = new Shard();
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->cond, NULL);
+    shard->waiting = 0;
+    shard->signalled = 0;
+    shard->top_priority = EMPTY_SHARD_PRIORITY;
+    shard->service_time_ms = now_ms();
+    _shards.push_back(shard);
+  }
+}
+
+ShardedSipEventQueue::~ShardedSipEventQueue()
+{
+  for (Shard* shard : _shards)
+  {
+    pthread_cond_destroy(&shard->cond);
+    pthread_mutex_destroy(&shard->lock);
+    delete shard; shard = NULL;
+  }
+}
+
+void ShardedSipEventQueue::push(unsigned int shard_ix, const SipEvent& qe)
+{
+  shard_ix = shard_ix % _shards.size();
+  Shard* shard = _shards[shard_ix];
+
+  pthread_mutex_lock(&shard->lock);
+
+  if (shard->queue.empty())
+  {
+    // The shard has been idle, so start the deadlock clock from now.
+    shard->service_time_ms = now_ms();
+  }
+
+  shard->queue.push(qe);
+  update_top_priority(shard);
+  ++_size;
+
+  bool has_waiter = signal_waiter(shard);
+
+  pthread_mutex_unlock(&shard->lock);
+
+  // This must read _idle_workers after incrementing _size - see pop().
+  if ((!has_waiter) && (_idle_workers > 0))
+  {
+    // All the workers on this shard are busy, but there are idle workers
+    // elsewhere that can steal this event.
+    wake_idle_worker(shard_ix);
+  }
+}
+
+bool ShardedSipEventQueue::pop(unsigned int shard_ix, SipEvent& qe)
+{
+  shard_ix = shard_ix % _shards.size();
+  Shard* shard = _shards[shard_ix];
+
+  while (!_terminated)
+  {
+    Shard* preferred = preferred_shard(shard_ix);
+
+    if (((preferred != shard) && (try_pop(preferred, qe))) ||
+        (try_pop(shard, qe)) ||
+        (steal(shard_ix, qe)))
+    {
+      return true;
+    }
+
+    // There's no work queued anywhere, so wait on the home shard until an
+    // event is pushed.
+    pthread_mutex_lock(&shard->lock);
+
+    ++shard->waiting;
+    ++_idle_workers;
+
+    // A push to another shard only wakes an idle worker if it sees one counted
+    // in _idle_workers after it has incremented _size. Now that this worker is
+    // counted, check _size again, so that either we see the event or the push
+    // sees us. In the latter case the wake up can't be missed, as we hold the
+    // shard lock until we wait.
+    if ((_size == 0) && (!_terminated))
+    {
+      pthread_cond_wait(&shard->cond, &shard->lock);
+
+      if (shard->signalled > 0)
+      {
+        --shard->signalled;
+      }
+    }
+
+    --_idle_workers;
+    --shard->waiting;
+
+    pthread_mutex_unlock(&shard->lock);
+  }
+
+  return false;
+}
+
+int ShardedSipEventQueue::size()
+{
+  return _size;
+}
+
+void ShardedSipEventQueue::set_deadlock_threshold(unsigned long threshold_ms)
+{
+  _deadlock_threshold_ms = threshold_ms;
+}
+
+bool ShardedSipEventQueue::is_deadlocked()
+{
+  if (_deadlock_threshold_ms == 0)
+  {
+    return false;
+  }
+
+  bool deadlocked = false;
+  unsigned long now = now_ms();
+
+  for (Shard* shard : _shards)
+  {
+    pthread_mutex_lock(&shard->lock);
+    deadlocked = ((!shard->queue.empty()) &&
+                  (now > shard->service_time_ms + _deadlock_threshold_ms));
+    pthread_mutex_unlock(&shard->lock);
+
+    if (deadlocked)
+    {
+      break;
+    }
+  }
+
+  return deadlocked;
+}
+
+void ShardedSipEventQueue::terminate(std::vector<SipEvent>& remaining_elts)
+{
+  _terminated = true;
+
+  for (Shard* shard : _shards)
+  {
+    pthread_mutex_lock(&shard->lock);
+
+    while (!shard->queue.empty())
+    {
+      remaining_elts.push_back(shard->queue.front());
+      shard->queue.pop();
+      --_size;
+    }
+
+    update_top_priority(shard);
+    pthread_cond_broadcast(&shard->cond);
+    pthread_mutex_unlock(&shard->lock);
+  }
+}
+
+bool ShardedSipEventQueue::try_pop(Shard* shard, SipEvent& qe)
+{
+  bool popped = false;
+
+  pthread_mutex_lock(&shard->lock);
+
+  if (!shard->queue.empty())
+  {
+    qe = shard->queue.front();
+    shard->queue.pop();
+    update_top_priority(shard);
+    shard->service_time_ms = now_ms();
+    --_size;
+    popped = true;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return popped;
+}
+
+bool ShardedSipEventQueue::steal(unsigned int home, SipEvent& qe)
+{
+  // Nothing to steal if all the queued work is on the home shard (which we
+  // have just found to be empty).
+  if (_size == 0)
+  {
+    return false;
+  }
+
+  for (size_t ii = 1; ii < _shards.size(); ++ii)
+  {
+    if (try_pop(_shards[(home + ii) % _shards.size()], qe))
+    {
+      TRC_DEBUG("Worker on shard %u stole work from shard %u",
+                home, (unsigned int)((home + ii) % _shards.size()));
+      return true;
+    }
+  }
+
+  return false;
+}
+
+// Returns the shard that a worker with the specified home shard should take
+// its next event from. This is the home shard, unless another shard's next
+// event has a higher priority.
+ShardedSipEventQueue::Shard* ShardedSipEventQueue::preferred_shard(unsigned int home)
+{
+  Shard* preferred = _shards[home];
+  int preferred_priority = preferred->top_priority.load(std::memory_order_relaxed);
+
+  for (size_t ii = 1; ii < _shards.size(); ++ii)
+  {
+    Shard* shard = _shards[(home + ii) % _shards.size()];
+    int priority = shard->top_priority.load(std::memory_order_relaxed);
+
+    if (priority > preferred_priority)
+    {
+      preferred = shard;
+      preferred_priority = priority;
+    }
+  }
+
+  return preferred;
+}
+
+// Signals a worker waiting on the shard that hasn't already been signalled,
+// if there is one. Returns whether a worker was signalled. Must be called with
+// the shard lock held.
+bool ShardedSipEventQueue::signal_waiter(Shard* shard)
+{
+  bool signalled = (shard->waiting > shard->signalled);
+
+  if (signalled)
+  {
+    ++shard->signalled;
+    pthread_cond_signal(&shard->cond);
+  }
+
+  return signalled;
+}
+
+void ShardedSipEventQueue::wake_idle_worker(unsigned int home)
+{
+  for (size_t ii = 1; ii < _shards.size(); ++ii)
+  {
+    Shard* shard = _shards[(home + ii) % _shards.size()];
+    pthread_mutex_lock(&shard->lock);
+    bool woken = signal_waiter(shard);
+    pthread_mutex_unlock(&shard->lock);
+
+    if (woken)
+    {
+      break;
+    }
+  }
+}
+
+// Publishes the priority of the shard's next event. Must be called with the
+// shard lock held whenever the shard's queue changes.
+void ShardedSipEventQueue::update_top_priority(Shard* shard)
+{
+  shard->top_priority.store(shard->queue.empty() ?
+                              EMPTY_SHARD_PRIORITY :
+                              (int)shard->queue.front().priority,
+                            std::memory_order_relaxed);
+}
+
+unsigned long ShardedSipEventQueue::now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
 }
@@ -26,6 +26,7 @@ extern "C" {
 #include "pjutils.h"
 #include "stack.h"
 #include "acr.h"
+#include "mock_ralf_processor.h"
 
 #include "rapidjson/error/en.h"
 
@@ -35,6 +36,8 @@ using testing::ElementsAre;
 using testing::MatchesRegex;
 using testing::HasSubstr;
 using testing::Not;
+using testing::SaveArg;
+using testing::_;
 
 class SIPRequest
 {
@@ -1603,3 +1606,50 @@ TEST_F(ACRTest, BGCFOrigCallStart)
   EXPECT_TRUE(compare_acr(acr_message, "acr_bgcforigcall_start.json"));
   delete acr;
 }
+
+// Tests that sending an ACR hands Ralf a snapshot of the ACR to encode, rather
+// than the encoded message, and that the snapshot isn't affected by what
+// happens to the ACR after it is sent.
+TEST_F(ACRTest, SendEncodesSnapshot)
+{
+  pj_time_val ts;
+  MockRalfProcessor ralf;
+
+  RalfACRFactory f(&ralf, ACR::SCSCF);
+  ACR* acr = f.get_acr(0, ACR::CALLING_PARTY, ACR::NODE_ROLE_ORIGINATING);
+
+  SIPRequest invite = invite_msg();
+  ts.sec = 1;
+  ts.msec = 0;
+  acr->rx_request(parse_msg(invite.get()), ts);
+
+  SIPResponse invite200ok = invite200ok_msg();
+  ts.msec = 20;
+  acr->tx_response(parse_msg(invite200ok.get()), ts);
+
+  std::string expected = acr->get_message(ts);
+
+  RalfProcessor::RalfRequest* rr = NULL;
+  EXPECT_CALL(ralf, send_request_to_ralf(_)).WillOnce(SaveArg<0>(&rr));
+  acr->send(ts);
+  ASSERT_TRUE(rr != NULL);
+  EXPECT_EQ("/call-id/0123456789abcdef-10.83.18.38", rr->path);
+  EXPECT_EQ("", rr->message);
+
+  // Carry on using the ACR, and delete it, before the message is encoded.
+  // Changes to the ACR don't affect the message that has been sent.
+  SIPRequest ack("ACK");
+  ts.msec = 40;
+  acr->rx_request(parse_msg(ack.get()), ts);
+  acr->override_session_id("other-session-id");
+  EXPECT_THAT(acr->get_message(ts), HasSubstr("other-session-id"));
+  delete acr;
+
+  rr->encode();
+  EXPECT_EQ(expected, rr->message);
+
+  // Encoding again leaves the message alone.
+  rr->encode();
+  EXPECT_EQ(expected, rr->message);
+  delete rr;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file arena_test.cpp UT for the memory arena and flat containers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <set>
+#include <string>
+#include "gtest/gtest.h"
+
+#include "arena.h"
+#include "flat_map.h"
+
+// Small allocations are aligned, distinct, and come from the embedded buffer
+// until it is exhausted.
+TEST(ArenaTest, SmallAllocations)
+{
+  Arena arena;
+  std::set<void*> ptrs;
+
+  for (size_t ii = 0; ii < Arena::INITIAL_SIZE / 64; ++ii)
+  {
+    void* ptr = arena.allocate(50);
+    EXPECT_EQ(0u, (uintptr_t)ptr % Arena::ALIGNMENT);
+    EXPECT_TRUE(ptrs.insert(ptr).second);
+  }
+  EXPECT_EQ(0, arena.heap_blocks());
+
+  arena.allocate(64);
+  EXPECT_EQ(1, arena.heap_blocks());
+}
+
+// Freed chunks are reused for allocations of the same size class.
+TEST(ArenaTest, Reuse)
+{
+  Arena arena;
+
+  void* ptr1 = arena.allocate(24);
+  void* ptr2 = arena.allocate(100);
+  arena.deallocate(ptr1, 24);
+  arena.deallocate(ptr2, 100);
+
+  EXPECT_EQ(ptr2, arena.allocate(97));
+  EXPECT_EQ(ptr1, arena.allocate(32));
+  EXPECT_NE(ptr1, arena.allocate(24));
+}
+
+// Large allocations go to the heap, and don't use up the arena.
+TEST(ArenaTest, LargeAllocations)
+{
+  Arena arena;
+
+  void* ptr = arena.allocate(Arena::MAX_SMALL_SIZE + 1);
+  memset(ptr, 0, Arena::MAX_SMALL_SIZE + 1);
+  arena.deallocate(ptr, Arena::MAX_SMALL_SIZE + 1);
+  EXPECT_EQ(0, arena.heap_blocks());
+}
+
+// Standard containers work with the allocator, and are freed when the arena
+// is destroyed.
+TEST(ArenaTest, Containers)
+{
+  Arena arena;
+  typedef std::map<int,
+                   std::string,
+                   std::less<int>,
+                   ArenaAllocator<std::pair<const int, std::string> > > Map;
+  Map map((std::less<int>()), Map::allocator_type(&arena));
+
+  for (int ii = 0; ii < 1000; ++ii)
+  {
+    map[ii] = std::to_string(ii);
+  }
+  for (int ii = 0; ii < 1000; ii += 2)
+  {
+    map.erase(ii);
+  }
+
+  EXPECT_EQ(500u, map.size());
+  EXPECT_EQ("999", map[999]);
+  EXPECT_TRUE(map.find(998) == map.end());
+}
+
+// FlatMap behaves like a map, and keeps its entries in key order.
+TEST(FlatMapTest, Mainline)
+{
+  FlatMap<int, std::string> map;
+  EXPECT_TRUE(map.empty());
+
+  map[3] = "three";
+  map[1] = "one";
+  EXPECT_TRUE(map.insert(std::make_pair(2, std::string("two"))).second);
+  EXPECT_FALSE(map.insert(std::make_pair(2, std::string("deux"))).second);
+  map[1] = "un";
+
+  ASSERT_EQ(3u, map.size());
+  EXPECT_EQ(1, map.begin()->first);
+  EXPECT_EQ("un", map.begin()->second);
+  EXPECT_EQ("two", map.find(2)->second);
+  EXPECT_TRUE(map.find(4) == map.end());
+
+  EXPECT_EQ(1u, map.erase(2));
+  EXPECT_EQ(0u, map.erase(2));
+  map.erase(map.begin());
+  ASSERT_EQ(1u, map.size());
+  EXPECT_EQ(3, map.begin()->first);
+}
+
+// FlatSet behaves like a set.
+TEST(FlatMapTest, Set)
+{
+  FlatSet<long> set;
+
+  EXPECT_TRUE(set.insert(5).second);
+  EXPECT_TRUE(set.insert(2).second);
+  EXPECT_FALSE(set.insert(5).second);
+  EXPECT_EQ(2u, set.size());
+  EXPECT_EQ(2, *set.begin());
+  EXPECT_EQ(1u, set.count(5));
+
+  EXPECT_EQ(1u, set.erase(5));
+  EXPECT_EQ(0u, set.erase(5));
+  EXPECT_EQ(0u, set.count(5));
+  EXPECT_EQ(1u, set.size());
+}
@@ -803,6 +803,61 @@ TEST_F(AuthenticationTest, AuthorizationEmergencyRegExtraContact)
   _hss_connection->delete_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP");
 }
 
+// Tests that the challenge to a REGISTER is only sent once the HSS has
+// responded, if the AV is fetched asynchronously.
+TEST_F(AuthenticationTest, AsyncAvChallenge)
+{
+  _hss_connection->set_async(true);
+  _hss_connection->set_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP",
+                              "{\"digest\":{\"realm\":\"homedomain\",\"qop\":\"auth\",\"ha1\":\"12345678123456781234567812345678\"}}");
+
+  AuthenticationMessage msg("REGISTER");
+  msg._auth_hdr = false;
+  inject_msg(msg.get());
+
+  // Nothing is sent while the request to the HSS is outstanding.
+  ASSERT_EQ(0, txdata_count());
+  ASSERT_EQ(1u, _hss_connection->pending_async_request_count());
+
+  // Expect a 401 Not Authorized response with a challenge once it completes.
+  _hss_connection->complete_async_request();
+  ASSERT_EQ(1, txdata_count());
+  pjsip_tx_data* tdata = current_txdata();
+  RespMatcher(401).matches(tdata->msg);
+  std::string auth = get_headers(tdata->msg, "WWW-Authenticate");
+  std::map<std::string, std::string> auth_params;
+  parse_www_authenticate(auth, auth_params);
+  EXPECT_EQ("homedomain", auth_params["realm"]);
+  EXPECT_EQ("MD5", auth_params["algorithm"]);
+  free_txdata();
+
+  _hss_connection->delete_result("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP");
+  _hss_connection->set_async(false);
+}
+
+// Tests that a REGISTER is rejected if the HSS is overloaded, when the AV is
+// fetched asynchronously.
+TEST_F(AuthenticationTest, AsyncAvHssOverloaded)
+{
+  _hss_connection->set_async(true);
+  _hss_connection->set_rc("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP",
+                          503);
+
+  AuthenticationMessage msg("REGISTER");
+  msg._auth_hdr = false;
+  inject_msg(msg.get());
+  ASSERT_EQ(0, txdata_count());
+
+  // Expect a 504 Server Timeout response.
+  _hss_connection->complete_async_request();
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(504).matches(current_txdata()->msg);
+  free_txdata();
+
+  _hss_connection->delete_rc("/impi/6505550001%40homedomain/av?impu=sip%3A6505550001%40homedomain&server-name=sip%3Ascscf.sprout.homedomain%3A5058%3Btransport%3DTCP");
+  _hss_connection->set_async(false);
+}
+
 
 TEST_F(AuthenticationTest, DigestAuthSuccess)
 {
@@ -338,6 +338,47 @@ protected:
 
 using TestingCommon::Message;
 
+// Tests that group locks come from the dedicated pool factories, and that
+// their pools are kept for reuse once the locks are destroyed.
+TEST_F(BasicProxyTest, GrpLockPoolsRecycled)
+{
+  size_t used_before = 0;
+  for (int ii = 0; ii < GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    used_before += stack_data.grp_lock_cp[ii].used_count;
+  }
+
+  std::vector<pj_grp_lock_t*> locks;
+  for (int ii = 0; ii < 2 * GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    pj_grp_lock_t* lock;
+    ASSERT_EQ(PJ_SUCCESS, create_grp_lock(&lock));
+    locks.push_back(lock);
+  }
+
+  size_t used_during = 0;
+  for (int ii = 0; ii < GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    used_during += stack_data.grp_lock_cp[ii].used_count;
+  }
+  EXPECT_EQ(used_before + locks.size(), used_during);
+
+  for (size_t ii = 0; ii < locks.size(); ++ii)
+  {
+    pj_grp_lock_destroy(locks[ii]);
+  }
+
+  size_t used_after = 0;
+  size_t cached_after = 0;
+  for (int ii = 0; ii < GRP_LOCK_POOL_SHARDS; ++ii)
+  {
+    used_after += stack_data.grp_lock_cp[ii].used_count;
+    cached_after += stack_data.grp_lock_cp[ii].capacity;
+  }
+  EXPECT_EQ(used_before, used_after);
+  EXPECT_GT(cached_after, 0u);
+}
+
 TEST_F(BasicProxyTest, RouteOnRouteHeaders)
 {
   // Tests routing of requests on normal loose routing Route headers.
@@ -0,0 +1,398 @@
+/**
+ * @file dnsresolver_test.cpp UT for the asynchronous DNS resolver.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <vector>
+#include <list>
+#include <chrono>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "gtest/gtest.h"
+
+#include "dnsresolver.h"
+#include "enumservice.h"
+
+/// A DNS server listening on a local UDP port, which answers every NAPTR
+/// query with a single terminal ENUM rule after a fixed delay.  Queries are
+/// answered concurrently, as a real server would.
+class StubDNSServer
+{
+public:
+  StubDNSServer(int delay_ms) :
+    _delay_ms(delay_ms),
+    _terminated(false)
+  {
+    _fd = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    bind(_fd, (struct sockaddr*)&addr, sizeof(addr));
+    socklen_t addr_len = sizeof(addr);
+    getsockname(_fd, (struct sockaddr*)&addr, &addr_len);
+    _port = ntohs(addr.sin_port);
+
+    pthread_create(&_thread, NULL, thread_fn, this);
+  }
+
+  ~StubDNSServer()
+  {
+    _terminated = true;
+    pthread_join(_thread, NULL);
+    close(_fd);
+  }
+
+  int port() const { return _port; }
+
+private:
+  struct Response
+  {
+    std::chrono::steady_clock::time_point due;
+    std::string msg;
+    struct sockaddr_in addr;
+  };
+
+  static void* thread_fn(void* server)
+  {
+    ((StubDNSServer*)server)->run();
+    return NULL;
+  }
+
+  void run()
+  {
+    while (!_terminated)
+    {
+      struct pollfd fd = {_fd, POLLIN, 0};
+      if (poll(&fd, 1, 5) > 0)
+      {
+        char buf[512];
+        Response rsp;
+        socklen_t addr_len = sizeof(rsp.addr);
+        ssize_t len = recvfrom(_fd, buf, sizeof(buf), 0,
+                               (struct sockaddr*)&rsp.addr, &addr_len);
+        if (len > 12)
+        {
+          rsp.due = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(_delay_ms);
+          rsp.msg = build_response(std::string(buf, len));
+          _responses.push_back(rsp);
+        }
+      }
+
+      std::chrono::steady_clock::time_point now =
+                                               std::chrono::steady_clock::now();
+      for (std::list<Response>::iterator rsp = _responses.begin();
+           rsp != _responses.end();)
+      {
+        if (rsp->due <= now)
+        {
+          sendto(_fd, rsp->msg.data(), rsp->msg.size(), 0,
+                 (struct sockaddr*)&rsp->addr, sizeof(rsp->addr));
+          rsp = _responses.erase(rsp);
+        }
+        else
+        {
+          ++rsp;
+        }
+      }
+    }
+  }
+
+  static void add_string(std::string& msg, const std::string& str)
+  {
+    msg.push_back((char)str.size());
+    msg.append(str);
+  }
+
+  static void add_short(std::string& msg, int value)
+  {
+    msg.push_back((char)(value >> 8));
+    msg.push_back((char)(value & 0xff));
+  }
+
+  // Builds the answer to a query.
+  static std::string build_response(const std::string& query)
+  {
+    // Find the end of the question name, then skip the type and class.
+    size_t question_end = 12;
+    while ((question_end < query.size()) && (query[question_end] != 0))
+    {
+      question_end += (unsigned char)query[question_end] + 1;
+    }
+    question_end += 5;
+
+    std::string rdata;
+    add_short(rdata, 10);
+    add_short(rdata, 100);
+    add_string(rdata, "u");
+    add_string(rdata, "E2U+sip");
+    add_string(rdata, "!(^.*$)!sip:\\1@stub.example.com!");
+    rdata.push_back(0);
+
+    std::string rsp = query.substr(0, 2);
+    add_short(rsp, 0x8180);
+    add_short(rsp, 1);
+    add_short(rsp, 1);
+    add_short(rsp, 0);
+    add_short(rsp, 0);
+    rsp.append(query, 12, question_end - 12);
+    add_short(rsp, 0xc00c);
+    add_short(rsp, 35);
+    add_short(rsp, 1);
+    add_short(rsp, 0);
+    add_short(rsp, 300);
+    add_short(rsp, rdata.size());
+    rsp.append(rdata);
+    return rsp;
+  }
+
+  int _delay_ms;
+  volatile bool _terminated;
+  int _fd;
+  int _port;
+  pthread_t _thread;
+  std::list<Response> _responses;
+};
+
+/// Resolver factory that points resolvers at the stub server.
+class StubDNSResolverFactory : public DNSResolverFactory
+{
+public:
+  StubDNSResolverFactory(int port) : _port(port) {}
+
+  DNSResolver* new_resolver(const std::vector<struct IP46Address>& servers) const
+  {
+    return new DNSResolver(servers, _port);
+  }
+
+  AsyncDNSResolver* new_async_resolver(const std::vector<struct IP46Address>& servers) const
+  {
+    return new AsyncDNSResolver(servers, _port);
+  }
+
+private:
+  int _port;
+};
+
+/// Collects the results of asynchronous lookups, which arrive on the
+/// resolver's I/O thread.
+class Results
+{
+public:
+  Results()
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+  }
+
+  ~Results()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  void add(const std::string& result)
+  {
+    pthread_mutex_lock(&_lock);
+    _results.push_back(result);
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  // Waits for the given number of results, for up to 5s.
+  std::vector<std::string> wait(size_t count)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 5;
+
+    pthread_mutex_lock(&_lock);
+    while ((_results.size() < count) &&
+           (pthread_cond_timedwait(&_cond, &_lock, &deadline) == 0))
+    {
+    }
+    std::vector<std::string> results = _results;
+    pthread_mutex_unlock(&_lock);
+    return results;
+  }
+
+private:
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  std::vector<std::string> _results;
+};
+
+// How long the stub DNS server takes to answer each query.
+static const int DELAY_MS = 50;
+
+class AsyncDNSResolverTest : public ::testing::Test
+{
+protected:
+  AsyncDNSResolverTest() : _server(DELAY_MS)
+  {
+    IP46Address server;
+    server.af = AF_INET;
+    server.addr.ipv4.s_addr = htonl(INADDR_LOOPBACK);
+    _servers.push_back(server);
+  }
+
+  StubDNSServer _server;
+  std::vector<struct IP46Address> _servers;
+};
+
+// Queries are answered through the callback, along with the TTL.
+TEST_F(AsyncDNSResolverTest, NaptrQuery)
+{
+  AsyncDNSResolver resolver(_servers, _server.port());
+  Results results;
+
+  resolver.send_naptr_query("4.3.2.1.e164.arpa",
+                            0,
+                            [&](int status,
+                                struct ares_naptr_reply* naptr_reply,
+                                int ttl)
+  {
+    std::string result = ares_strerror(status);
+    if (naptr_reply != NULL)
+    {
+      result = (char*)naptr_reply->regexp;
+      resolver.free_naptr_reply(naptr_reply);
+    }
+    results.add(result + " " + std::to_string(ttl));
+  });
+
+  std::vector<std::string> result = results.wait(1);
+  ASSERT_EQ(1u, result.size());
+  EXPECT_EQ("!(^.*$)!sip:\\1@stub.example.com! 300", result[0]);
+}
+
+// Queries still outstanding when the resolver is destroyed fail.
+TEST_F(AsyncDNSResolverTest, DestroyedWithQueryOutstanding)
+{
+  Results results;
+  {
+    AsyncDNSResolver resolver(_servers, _server.port());
+    resolver.send_naptr_query("4.3.2.1.e164.arpa",
+                              0,
+                              [&](int status,
+                                  struct ares_naptr_reply* naptr_reply,
+                                  int ttl)
+    {
+      results.add(ares_strerror(status));
+    });
+  }
+
+  std::vector<std::string> result = results.wait(1);
+  ASSERT_EQ(1u, result.size());
+  EXPECT_EQ(ares_strerror(ARES_EDESTRUCTION), result[0]);
+}
+
+// ENUM lookups give the same results whether they are done synchronously or
+// asynchronously, and asynchronous lookups can be outstanding concurrently.
+TEST_F(AsyncDNSResolverTest, EnumSyncAndAsyncLookups)
+{
+  const int NUM_LOOKUPS = 10;
+  DNSEnumService enum_service({"127.0.0.1"},
+                              ".e164.arpa",
+                              new StubDNSResolverFactory(_server.port()));
+
+  EXPECT_EQ("sip:1234@stub.example.com",
+            enum_service.lookup_uri_from_user("1234", 0));
+
+  Results results;
+  for (int ii = 0; ii < NUM_LOOKUPS; ++ii)
+  {
+    enum_service.lookup_uri_from_user_async("1234",
+                                            0,
+                                            [&](const std::string& uri)
+    {
+      results.add(uri);
+    });
+  }
+  std::vector<std::string> uris = results.wait(NUM_LOOKUPS);
+
+  ASSERT_EQ((size_t)NUM_LOOKUPS, uris.size());
+  for (int ii = 0; ii < NUM_LOOKUPS; ++ii)
+  {
+    EXPECT_EQ("sip:1234@stub.example.com", uris[ii]);
+  }
+}
+
+// Builds a DNS response with the given resource records in the answer or
+// authority section.
+static std::string dns_response(int ancount,
+                                int nscount,
+                                const std::string& records)
+{
+  std::string rsp("\x12\x34\x81\x80\x00\x01", 6);
+  rsp.push_back((char)(ancount >> 8));
+  rsp.push_back((char)ancount);
+  rsp.push_back((char)(nscount >> 8));
+  rsp.push_back((char)nscount);
+  rsp.append(std::string("\x00\x00", 2));
+  rsp.append(std::string("\x01" "4" "\x04" "e164" "\x04" "arpa" "\x00"
+                         "\x00\x23\x00\x01", 17));
+  rsp.append(records);
+  return rsp;
+}
+
+// Builds a resource record for the question name.
+static std::string dns_record(int type, uint32_t ttl, const std::string& rdata)
+{
+  std::string rr("\xc0\x0c", 2);
+  rr.push_back((char)(type >> 8));
+  rr.push_back((char)type);
+  rr.append(std::string("\x00\x01", 2));
+  rr.push_back((char)(ttl >> 24));
+  rr.push_back((char)(ttl >> 16));
+  rr.push_back((char)(ttl >> 8));
+  rr.push_back((char)ttl);
+  rr.push_back((char)(rdata.size() >> 8));
+  rr.push_back((char)rdata.size());
+  rr.append(rdata);
+  return rr;
+}
+
+static int response_ttl(const std::string& rsp)
+{
+  return DNSResolver::response_ttl((const unsigned char*)rsp.data(), rsp.size());
+}
+
+// The TTL of a response is the lowest TTL of its answers or, for a negative
+// response, the negative caching TTL from its SOA record.
+TEST(DNSResolverTest, ResponseTtl)
+{
+  std::string naptr_rdata(8, '\0');
+  EXPECT_EQ(60, response_ttl(dns_response(2, 0,
+                                          dns_record(35, 300, naptr_rdata) +
+                                          dns_record(35, 60, naptr_rdata))));
+
+  // The SOA record has two names (compressed here) then five 32-bit fields,
+  // the last of which is the MINIMUM.
+  std::string soa_rdata("\xc0\x0c\xc0\x0c"
+                        "\x00\x00\x00\x01\x00\x00\x00\x02\x00\x00\x00\x03"
+                        "\x00\x00\x00\x04\x00\x00\x00\x78", 24);
+  EXPECT_EQ(120, response_ttl(dns_response(0, 1, dns_record(6, 3600, soa_rdata))));
+  EXPECT_EQ(30, response_ttl(dns_response(0, 1, dns_record(6, 30, soa_rdata))));
+
+  // Negative responses without an SOA record, and malformed responses, can't
+  // be cached.
+  EXPECT_EQ(0, response_ttl(dns_response(0, 0, "")));
+  std::string truncated = dns_response(1, 0, dns_record(35, 300, naptr_rdata));
+  truncated.resize(truncated.size() - 1);
+  EXPECT_EQ(0, response_ttl(truncated));
+  EXPECT_EQ(0, response_ttl("\x12\x34"));
+}
@@ -21,6 +21,7 @@
 #include "fakelogger.h"
 #include "test_utils.hpp"
 #include "mockcommunicationmonitor.h"
+#include "fakesnmp.hpp"
 #include "sprout_alarmdefinition.h"
 
 using namespace std;
@@ -52,6 +53,11 @@ class DNSEnumServiceTest : public EnumServiceTest
     _ipv6_servers.push_back("0102:0304:0506:0708:090a:0b0c:0d0e:0f10");
     _bad_servers.push_back("foobar");
   }
+
+  virtual ~DNSEnumServiceTest()
+  {
+    cwtest_reset_time();
+  }
 private:
   std::vector<std::string> _servers;
   std::vector<std::string> _different_servers;
@@ -76,6 +82,23 @@ public:
     EXPECT_EQ(_out, ret);
   }
 
+  // Does the lookup asynchronously.  This relies on the lookup completing
+  // before lookup_uri_from_user_async returns, as it does with the fake
+  // resolvers.
+  void test_async(EnumService& enum_)
+  {
+    SCOPED_TRACE(_in);
+    bool called = false;
+    string ret;
+    enum_.lookup_uri_from_user_async(_in, 0, [&](const string& uri)
+    {
+      called = true;
+      ret = uri;
+    });
+    EXPECT_TRUE(called);
+    EXPECT_EQ(_out, ret);
+  }
+
 private:
   string _in; //^ input
   string _out; //^ expected output
@@ -342,6 +365,140 @@ TEST_F(DNSEnumServiceTest, LoopingRuleTest)
   EXPECT_EQ(FakeDNSResolver::_num_calls, 5);
 }
 
+TEST_F(DNSEnumServiceTest, AsyncTest)
+{
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  EXPECT_TRUE(enum_.is_async());
+  ET("1234", "sip:1234@ut.cw-ngv.com").test_async(enum_);
+  ET("", "").test_async(enum_);
+  ET("5678", "").test_async(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, AsyncNonTerminalRuleTest)
+{
+  struct ares_naptr_reply naptr_reply[] = {{NULL, (unsigned char*)"", (unsigned char*)"e2u+sip", (unsigned char*)"!1234!5678!", ".", 1, 1}};
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  ET("1234", "sip:1234@ut.cw-ngv.com").test_async(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, AsyncLoopingRuleTest)
+{
+  struct ares_naptr_reply naptr_reply[] = {{NULL, (unsigned char*)"", (unsigned char*)"e2u+sip", (unsigned char*)"!(^.*$)!\\1!", ".", 1, 1}};
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory());
+  ET("1234", "").test_async(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 5);
+}
+
+TEST_F(DNSEnumServiceTest, CacheTest)
+{
+  // Results are cached for their TTL, and hits and misses are counted.
+  SNMP::FakeCounterTable hit_tbl;
+  SNMP::FakeCounterTable miss_tbl;
+  FakeDNSResolver::_ttl = 300;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100, &hit_tbl, &miss_tbl);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("12-34", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+  EXPECT_EQ(1, hit_tbl._count);
+  EXPECT_EQ(1, miss_tbl._count);
+
+  cwtest_advance_time_ms(299 * 1000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  cwtest_advance_time_ms(1000);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, CacheNonTerminalRuleTest)
+{
+  // Each step of a lookup is cached, and cached results are used by
+  // asynchronous lookups too.
+  struct ares_naptr_reply naptr_reply[] = {{NULL, (unsigned char*)"", (unsigned char*)"e2u+sip", (unsigned char*)"!1234!5678!", ".", 1, 1}};
+  FakeDNSResolver::_ttl = 300;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test_async(enum_);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test_async(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, NegativeCacheTest)
+{
+  // Domains that don't exist are cached, but for no more than the maximum
+  // negative caching TTL.
+  FakeDNSResolver::_ttl = 3600;
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  ET("1234", "").test(enum_);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 1);
+
+  cwtest_advance_time_ms(300 * 1000);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, CacheZeroTtlTest)
+{
+  // Results with no TTL aren't cached.
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 100);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 2);
+}
+
+TEST_F(DNSEnumServiceTest, CacheErrorTest)
+{
+  // Server errors aren't cached.
+  FakeDNSResolver::_ttl = 300;
+  DNSEnumService enum_(_servers, ".e164.arpa", new BrokenDNSResolverFactory(), NULL, 100);
+  ET("1234", "").test(enum_);
+  EXPECT_EQ(0u, enum_._rule_cache->size());
+}
+
+TEST_F(DNSEnumServiceTest, CacheEvictionTest)
+{
+  // The least recently used entry is evicted when the cache is full.
+  SNMP::FakeCounterTable eviction_tbl;
+  FakeDNSResolver::_ttl = 300;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("8.7.6.5.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), NULL, 1, NULL, NULL, &eviction_tbl);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("5678", "sip:5678@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  EXPECT_EQ(FakeDNSResolver::_num_calls, 3);
+  EXPECT_EQ(2, eviction_tbl._count);
+  EXPECT_EQ(1u, enum_._rule_cache->size());
+}
+
+TEST_F(DNSEnumServiceTest, CacheCommMonMockTest)
+{
+  // Lookups answered entirely from the cache don't count as contact with the
+  // ENUM server.
+  AlarmManager am;
+  MockCommunicationMonitor cm_(&am);
+  EXPECT_CALL(cm_, inform_success(_)).Times(1);
+  FakeDNSResolver::_ttl = 300;
+  FakeDNSResolver::_database.insert(std::make_pair(std::string("4.3.2.1.e164.arpa"), (struct ares_naptr_reply*)basic_naptr_reply));
+  DNSEnumService enum_(_servers, ".e164.arpa", new FakeDNSResolverFactory(), &cm_, 100);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+  ET("1234", "sip:1234@ut.cw-ngv.com").test(enum_);
+}
+
 TEST_F(DNSEnumServiceTest, DifferentServerTest)
 {
   FakeDNSResolverFactory::_expected_server.addr.ipv4.s_addr = htonl(0x01020304);
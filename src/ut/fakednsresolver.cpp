@@ -21,14 +21,22 @@
 
 
 int FakeDNSResolver::_num_calls = 0;
+int FakeDNSResolver::_ttl = 0;
 std::map<std::string,struct ares_naptr_reply*> FakeDNSResolver::_database = std::map<std::string,struct ares_naptr_reply*>();
 // By default, expect requests for 127.0.0.1.
 struct IP46Address FakeDNSResolverFactory::_expected_server = {AF_INET, {{htonl(0x7f000001)}}};
 
 
-int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+int FakeDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
+{
+  return lookup(domain, naptr_reply, ttl);
+}
+
+
+int FakeDNSResolver::lookup(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl)
 {
   ++_num_calls;
+  ttl = _ttl;
   // Look up the query domain and return the reply if found.
   std::map<std::string,struct ares_naptr_reply*>::iterator i = _database.find(domain);
   if (i != _database.end())
@@ -56,8 +64,28 @@ DNSResolver* FakeDNSResolverFactory::new_resolver(const std::vector<struct IP46A
   return new FakeDNSResolver(servers);
 }
 
-int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail)
+void FakeAsyncDNSResolver::send_naptr_query(const std::string& domain, SAS::TrailId trail, NaptrCallback callback)
+{
+  struct ares_naptr_reply* naptr_reply = NULL;
+  int ttl = 0;
+  int status = FakeDNSResolver::lookup(domain, naptr_reply, ttl);
+  callback(status, naptr_reply, ttl);
+}
+
+
+void FakeAsyncDNSResolver::free_naptr_reply(struct ares_naptr_reply* naptr_reply) const
+{
+}
+
+
+AsyncDNSResolver* FakeDNSResolverFactory::new_async_resolver(const std::vector<struct IP46Address>& servers) const
+{
+  return new FakeAsyncDNSResolver(servers);
+}
+
+int BrokenDNSResolver::perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail)
 {
+  ttl = 0;
   return ARES_ESERVFAIL;
 }
 
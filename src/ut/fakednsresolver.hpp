@@ -21,24 +21,39 @@ class FakeDNSResolver : public DNSResolver
 {
 public:
   inline FakeDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
   // Reset the static data.
-  static inline void reset() { _num_calls = 0; _database.clear(); };
+  static inline void reset() { _num_calls = 0; _ttl = 0; _database.clear(); };
+  // Look up a domain in the database, counting the call.
+  static int lookup(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl);
 
   // Number of calls that have been made so far.
   static int _num_calls;
+  // The TTL to return with every response (positive or negative).
+  static int _ttl;
   // Database mapping domain names to NAPTR responses.
   static std::map<std::string,struct ares_naptr_reply*> _database;
 
 };
 
+/// Fake AsyncDNSResolver which returns responses directly from the
+/// FakeDNSResolver database, calling the callback before returning.
+class FakeAsyncDNSResolver : public AsyncDNSResolver
+{
+public:
+  inline FakeAsyncDNSResolver(const std::vector<struct IP46Address>& servers) : AsyncDNSResolver(servers) {};
+  virtual void send_naptr_query(const std::string& domain, SAS::TrailId trail, NaptrCallback callback);
+  virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
+};
+
 /// Fake DNSResolverFactory that checks parameters and then creates a
 /// FakeDNSResolver.
 class FakeDNSResolverFactory : public DNSResolverFactory
 {
 public:
   virtual DNSResolver* new_resolver(const std::vector<struct IP46Address>& server) const;
+  virtual AsyncDNSResolver* new_async_resolver(const std::vector<struct IP46Address>& server) const;
 
   // The server for which we expect to create resolvers.
   static struct IP46Address _expected_server;
@@ -50,7 +65,7 @@ class BrokenDNSResolver : public DNSResolver
 {
 public:
   inline BrokenDNSResolver(const std::vector<struct IP46Address>& servers) : DNSResolver(servers) {};
-  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, SAS::TrailId trail);
+  virtual int perform_naptr_query(const std::string& domain, struct ares_naptr_reply*& naptr_reply, int& ttl, SAS::TrailId trail);
   virtual void free_naptr_reply(struct ares_naptr_reply* naptr_reply) const;
 };
 
@@ -35,7 +35,8 @@ FakeHSSConnection::FakeHSSConnection(MockHSSConnection* hss_connection_observer)
                 &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
                 NULL,
                 NULL,
-                0)
+                0),
+  _async(false)
 {
   _hss_connection_observer = hss_connection_observer;
 }
@@ -44,6 +45,12 @@ FakeHSSConnection::FakeHSSConnection(MockHSSConnection* hss_connection_observer)
 FakeHSSConnection::~FakeHSSConnection()
 {
   flush_all();
+
+  while (!_pending_async_requests.empty())
+  {
+    delete _pending_async_requests.front();
+    _pending_async_requests.pop_front();
+  }
 }
 
 void FakeHSSConnection::flush_all()
@@ -286,3 +293,22 @@ HTTPCode FakeHSSConnection::update_registration_state(const HSSConnection::irs_q
                                                   irs_info,
                                                   trail);
 }
+
+void FakeHSSConnection::send_async(AsyncRequest* request)
+{
+  if (_async)
+  {
+    _pending_async_requests.push_back(request);
+  }
+  else
+  {
+    HSSConnection::send_async(request);
+  }
+}
+
+void FakeHSSConnection::complete_async_request()
+{
+  AsyncRequest* request = _pending_async_requests.front();
+  _pending_async_requests.pop_front();
+  process_async_request(request);
+}
@@ -11,6 +11,7 @@
 
 #pragma once
 
+#include <deque>
 #include <set>
 #include <string>
 #include "log.h"
@@ -62,6 +63,29 @@ public:
                                      HSSConnection::irs_info& irs_info,
                                      SAS::TrailId trail);
 
+  /// Makes asynchronous requests wait until complete_async_request() is
+  /// called, as they would with a pool of threads.
+  void set_async(bool async)
+  {
+    _async = async;
+  }
+
+  bool is_async() const
+  {
+    return _async;
+  }
+
+  /// Completes the oldest outstanding asynchronous request.
+  void complete_async_request();
+
+  size_t pending_async_request_count()
+  {
+    return _pending_async_requests.size();
+  }
+
+protected:
+  void send_async(AsyncRequest* request);
+
 private:
   void set_impu_result_internal(const std::string&,
                                 const std::string&,
@@ -82,6 +106,11 @@ private:
   std::map<std::string, long> _rcs;
   std::set<UrlBody> _calls;
 
+  // Whether asynchronous requests are deferred, and those that are
+  // outstanding.
+  bool _async;
+  std::deque<AsyncRequest*> _pending_async_requests;
+
   // Optional MockHSSConnection object.  May be NULL if the creator of the
   // FakeHSSConnection  does not want to explicitly check method invocation.
   MockHSSConnection* _hss_connection_observer;
@@ -146,6 +146,28 @@ TEST_F(FIFCServiceTest, ReloadChangedFIFCFile)
   delete root_reload; root_reload = NULL;
 }
 
+// Test that the fallback iFCs are parsed once when the file is loaded, rather
+// than each time they're requested.
+TEST_F(FIFCServiceTest, FIFCParsedOnLoad)
+{
+  EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
+  FIFCService fifc(_mock_alarm, string(UT_DIR).append("/test_fifc.xml"));
+
+  rapidxml::xml_document<>* root = new rapidxml::xml_document<>;
+  std::vector<Ifc> fifc_list = fifc.get_fallback_ifcs(root);
+  std::vector<Ifc> fifc_list_again = fifc.get_fallback_ifcs(root);
+  ASSERT_EQ(fifc_list.size(), 2);
+  ASSERT_EQ(fifc_list_again.size(), 2);
+
+  // Both requests get the same iFCs, in priority order.
+  EXPECT_EQ(fifc_list[0]._ifc, fifc_list_again[0]._ifc);
+  EXPECT_EQ(fifc_list[1]._ifc, fifc_list_again[1]._ifc);
+  EXPECT_EQ(get_priority(fifc_list[0]), 1);
+  EXPECT_EQ(get_priority(fifc_list[1]), 2);
+  EXPECT_TRUE(fifc_list[0].is_compiled());
+  delete root; root = NULL;
+}
+
 // In the following tests we have various invalid/unexpected fallback iFC xml
 // files.
 // These tests check that the correct logs are made in each case; this isn't
@@ -27,6 +27,7 @@
 #include "rapidjson/document.h"
 #include "handlers_test.h"
 #include "aor_test_utils.h"
+#include "msg_trace.h"
 
 using namespace std;
 using ::testing::_;
@@ -110,6 +111,7 @@ class DeregistrationTaskTest : public SipTest
                          const Bindings& bindings,
                          std::vector<std::string>& binding_ids)
   {
+    EXPECT_CALL(*_subscriber_manager, invalidate_cached_subscriber_state(aor_id));
     EXPECT_CALL(*_subscriber_manager, get_bindings(aor_id, _, _))
       .WillOnce(DoAll(SetArgReferee<1>(bindings), Return(HTTP_OK)));
 
@@ -830,6 +832,82 @@ TEST_F(DeleteImpuTaskTest, BadMethod)
 }
 
 
+class InvalidateSimservsTaskTest : public TestWithMockSM
+{
+  MockHttpStack::Request* req;
+  SimservsCache* cache;
+  InvalidateSimservsTask::Config* cfg;
+  InvalidateSimservsTask* task;
+
+  static void SetUpTestCase()
+  {
+    TestWithMockSM::SetUpTestCase();
+  }
+
+  void SetUp()
+  {
+    TestWithMockSM::SetUp();
+    cache = new SimservsCache(10, 30);
+  }
+
+  void TearDown()
+  {
+    delete req;
+    delete cfg;
+    delete cache;
+    TestWithMockSM::TearDown();
+  }
+
+  // Build the invalidation request
+  void build_task(const std::string& impu,
+                  htp_method method = htp_method_DELETE)
+  {
+    req = new MockHttpStack::Request(stack,
+                                     "/simservs/" + impu,
+                                     "",
+                                     "",
+                                     "",
+                                     method);
+
+    cfg = new InvalidateSimservsTask::Config(cache);
+    task = new InvalidateSimservsTask(*req, cfg, 0);
+  }
+
+  void put(const std::string& impu)
+  {
+    cache->put(impu, std::make_shared<const simservs>(""), cache->generation());
+  }
+};
+
+// Test that an invalidation removes only the requested IMPU from the cache.
+TEST_F(InvalidateSimservsTaskTest, Mainline)
+{
+  put("sip:6505550231@homedomain");
+  put("sip:6505550232@homedomain");
+
+  build_task("sip%3A6505550231%40homedomain");
+  EXPECT_CALL(*stack, send_reply(_, 200, _));
+
+  task->run();
+
+  EXPECT_EQ(nullptr, cache->get("sip:6505550231@homedomain"));
+  EXPECT_NE(nullptr, cache->get("sip:6505550232@homedomain"));
+}
+
+// Test that an invalidation with GET method gets rejected.
+TEST_F(InvalidateSimservsTaskTest, BadMethod)
+{
+  put("sip:6505550231@homedomain");
+
+  build_task("sip%3A6505550231%40homedomain", htp_method_GET);
+  EXPECT_CALL(*stack, send_reply(_, 405, _));
+
+  task->run();
+
+  EXPECT_NE(nullptr, cache->get("sip:6505550231@homedomain"));
+}
+
+
 class PushProfileTaskTest : public TestWithMockSM
 {
   MockHttpStack::Request* req;
@@ -898,6 +976,8 @@ TEST_F(PushProfileTaskTest, MainlineTest)
 
   build_pushprofile_request(body, default_uri);
 
+  EXPECT_CALL(*sm, invalidate_cached_subscriber_state(default_uri));
+  EXPECT_CALL(*sm, invalidate_cached_subscriber_state("sip:6505550232@homedomain"));
   EXPECT_CALL(*sm, update_associated_uris(default_uri, _, _)).WillOnce(Return(HTTP_OK));
   EXPECT_CALL(*stack, send_reply(_, 200, _));
   task->run();
@@ -1013,3 +1093,41 @@ TEST_F(PushProfileTaskTest, SubscriberManagerFails)
   task->run();
 }
 
+//
+// Test dumping sprout's message traces.
+//
+
+class GetMessageTracesTest : public TestWithMockSM
+{
+};
+
+TEST_F(GetMessageTracesTest, Mainline)
+{
+  MsgTrace::clear();
+  MsgTrace::record("Traced message", "Some bytes", 10);
+
+  MockHttpStack::Request req(stack, "/message-traces", "");
+  GetMessageTracesTask::Config config;
+  GetMessageTracesTask* task = new GetMessageTracesTask(req, &config, 0);
+
+  EXPECT_CALL(*stack, send_reply(_, 200, _));
+  task->run();
+
+  EXPECT_NE(std::string::npos, req.content().find("Traced message"));
+  MsgTrace::clear();
+}
+
+TEST_F(GetMessageTracesTest, BadMethod)
+{
+  MockHttpStack::Request req(stack,
+                             "/message-traces",
+                             "",
+                             "",
+                             "",
+                             htp_method_PUT);
+  GetMessageTracesTask::Config config;
+  GetMessageTracesTask* task = new GetMessageTracesTask(req, &config, 0);
+
+  EXPECT_CALL(*stack, send_reply(_, 405, _));
+  task->run();
+}
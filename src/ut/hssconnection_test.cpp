@@ -181,6 +181,8 @@ class HssConnectionTest : public BaseTest
     fakecurl_responses["http://10.42.42.42:80/impu/pubid44/location?auth-type=DEREG"] = "{\"result-code\": 2001, \"mandatory-capabilities\": [], \"optional-capabilities\": []}";
     fakecurl_responses["http://10.42.42.42:80/impu/pubid44/location?originating=true&auth-type=CAPAB"] = "{\"result-code\": 2001, \"mandatory-capabilities\": [1, 2, 3], \"optional-capabilities\": []}";
     fakecurl_responses["http://10.42.42.42:80/impu/pubid45/location"] = CURLE_REMOTE_FILE_NOT_FOUND;
+    fakecurl_responses["http://10.42.42.42:80/impi/privid69/av?impu=pubid44"] = "{\"digest\": {\"ha1\": \"12345678123456781234567812345678\", \"realm\": \"homedomain\", \"qop\": \"auth\"}}";
+    fakecurl_responses["http://10.42.42.42:80/impi/privid70/av?impu=pubid44"] = CURLE_REMOTE_FILE_NOT_FOUND;
 
     std::string missing_ims_subscription =
       "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
@@ -869,6 +871,143 @@ TEST_F(HssConnectionTest, LocationNotFound)
   delete actual;
 }
 
+/// Collects the results of asynchronous requests, which arrive on the
+/// connection's threads.
+class AsyncResults
+{
+public:
+  AsyncResults()
+  {
+    pthread_mutex_init(&_lock, NULL);
+    pthread_cond_init(&_cond, NULL);
+  }
+
+  ~AsyncResults()
+  {
+    pthread_cond_destroy(&_cond);
+    pthread_mutex_destroy(&_lock);
+  }
+
+  // Records the HTTP code and the realm from an AV.
+  HSSConnection::JsonCallback json_callback()
+  {
+    return [this](HTTPCode rc, rapidjson::Document* doc)
+    {
+      std::string realm = ((doc != NULL) && (doc->HasMember("digest"))) ?
+                          (*doc)["digest"]["realm"].GetString() : "";
+      delete doc;
+      add(std::to_string(rc) + " " + realm);
+    };
+  }
+
+  // Waits for the given number of results, for up to 5s.
+  std::vector<std::string> wait(size_t count)
+  {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 5;
+
+    pthread_mutex_lock(&_lock);
+    while ((_results.size() < count) &&
+           (pthread_cond_timedwait(&_cond, &_lock, &deadline) == 0))
+    {
+    }
+    std::vector<std::string> results = _results;
+    pthread_mutex_unlock(&_lock);
+    return results;
+  }
+
+private:
+  void add(const std::string& result)
+  {
+    pthread_mutex_lock(&_lock);
+    _results.push_back(result);
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_lock);
+  }
+
+  pthread_mutex_t _lock;
+  pthread_cond_t _cond;
+  std::vector<std::string> _results;
+};
+
+// Without a pool of threads, asynchronous requests complete before returning.
+TEST_F(HssConnectionTest, AsyncWithoutPool)
+{
+  AsyncResults results;
+  EXPECT_FALSE(_hss.is_async());
+
+  _hss.get_auth_vector_async("privid69", "pubid44", "", "", "", 0, results.json_callback());
+  _hss.get_auth_vector_async("privid70", "pubid44", "", "", "", 0, results.json_callback());
+
+  std::vector<std::string> expected = {"200 homedomain",
+                                       "404 "};
+  EXPECT_EQ(expected, results.wait(0));
+}
+
+// With a pool of threads, requests are made on one of those threads and the
+// result passed back through the callback.
+TEST_F(HssConnectionTest, AsyncWithPool)
+{
+  HSSConnection hss("narcissus",
+                    &_resolver,
+                    NULL,
+                    &SNMP::FAKE_IP_COUNT_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &_cm,
+                    NULL,
+                    500,
+                    NULL,
+                    2,
+                    NULL);
+  EXPECT_TRUE(hss.is_async());
+
+  // Wait for each request in turn so that the results are in a known order.
+  AsyncResults results;
+  hss.get_auth_vector_async("privid69", "pubid44", "", "", "", 0, results.json_callback());
+  results.wait(1);
+  hss.get_auth_vector_async("privid70", "pubid44", "", "", "", 0, results.json_callback());
+
+  std::vector<std::string> expected = {"200 homedomain",
+                                       "404 "};
+  EXPECT_EQ(expected, results.wait(2));
+}
+
+// Once the pool's queue is full, requests are rejected straight away.
+TEST_F(HssConnectionTest, AsyncQueueFull)
+{
+  HSSConnection hss("narcissus",
+                    &_resolver,
+                    NULL,
+                    &SNMP::FAKE_IP_COUNT_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+                    &_cm,
+                    NULL,
+                    500,
+                    NULL,
+                    1,
+                    NULL);
+
+  // Pretend that the queue is already full.
+  hss._async_pool->_queued = hss._async_pool->_max_queued;
+
+  AsyncResults results;
+  hss.get_auth_vector_async("privid69", "pubid44", "", "", "", 0, results.json_callback());
+
+  std::vector<std::string> expected = {"503 "};
+  EXPECT_EQ(expected, results.wait(0));
+
+  hss._async_pool->_queued = 0;
+}
+
 TEST_F(HssConnectionTest, SimpleAliases)
 {
   HSSConnection::irs_query irs_query;
@@ -2354,6 +2354,159 @@ TEST_F(IfcHandlerTest, SDPNoEqualsSign)
 }
 
 
+// Builds the XML for a single iFC with the given trigger point.
+static std::string ifc_xml(std::string trigger_point)
+{
+  return "<InitialFilterCriteria>\n"
+         "  <Priority>1</Priority>\n"
+         + trigger_point +
+         "  <ApplicationServer>\n"
+         "    <ServerName>sip:1.2.3.4:56789;transport=UDP</ServerName>\n"
+         "    <DefaultHandling>0</DefaultHandling>\n"
+         "  </ApplicationServer>\n"
+         "</InitialFilterCriteria>";
+}
+
+// Valid iFCs are compiled when they are matched for a second time, and
+// matching the compiled form gives the same results as walking the XML.
+TEST_F(IfcHandlerTest, CompiledMatchesXml)
+{
+  std::vector<std::string> trigger_points =
+  {
+    "",
+    "<ProfilePartIndicator>1</ProfilePartIndicator>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><Method>INVITE</Method></SPT>"
+    "</TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>0</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><Method>SUBSCRIBE</Method></SPT>"
+    "<SPT><Group>1</Group><Method>invite</Method></SPT>"
+    "<SPT><Group>2</Group><Method>FOO</Method></SPT>"
+    "<SPT><Group>3</Group><ConditionNegated>1</ConditionNegated><Method>REGISTER</Method></SPT>"
+    "</TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>0</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><Method>REGISTER</Method>"
+    "<Extension><RegistrationType>1</RegistrationType><RegistrationType>2</RegistrationType></Extension></SPT>"
+    "</TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><ConditionNegated>1</ConditionNegated><Group>0</Group><SIPHeader><Header>Accept</Header><Content>quux</Content></SIPHeader></SPT>"
+    "<SPT><Group>0</Group><Group>3</Group><SessionCase>1</SessionCase></SPT>"
+    "<SPT><Group>3</Group><RequestURI>homedomain:3443</RequestURI></SPT>"
+    "</TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>0</ConditionTypeCNF>"
+    "<SPT><Group>2</Group><SessionDescription><Line>m</Line><Content>video</Content></SessionDescription></SPT>"
+    "<SPT><Group>2</Group><SessionCase>0</SessionCase></SPT>"
+    "<SPT><Group>1</Group><SIPHeader><Header>Call-Info</Header></SIPHeader></SPT>"
+    "<SPT><Group>1</Group><ConditionNegated>1</ConditionNegated><SessionCase>4</SessionCase></SPT>"
+    "<SPT><Group>1</Group><Unknown>foo</Unknown></SPT>"
+    "</TriggerPoint>\n",
+  };
+
+  string reg_str("REGISTER sip:5755550033@homedomain SIP/2.0\n"
+                 "Via: SIP/2.0/TCP 10.64.90.97:50693;rport;branch=z9hG4bKPjPtKqxhkZnvVKI2LUEWoZVFjFaqo.cOzf;alias\n"
+                 "From: <sip:5755550033@homedomain>;tag=13919SIPpTag0011234\n"
+                 "To: <sip:5755550033@homedomain>\n"
+                 "Contact: <sip:5755550018@10.16.62.109:58309;transport=TCP;ob>;expires=0\n"
+                 "Call-ID: 1-13919@10.151.20.48\n"
+                 "CSeq: 4 REGISTER\n"
+                 "Content-Length: 0\n\n");
+  pjsip_rx_data* rdata = build_rxdata(reg_str);
+  parse_rxdata(rdata);
+  std::vector<pjsip_msg*> msgs = {TEST_MSG, rdata->msg_info.msg};
+
+  for (std::string method : {"SUBSCRIBE", "FOO"})
+  {
+    string str(method + " sip:5755550033@homedomain SIP/2.0\n"
+               "Via: SIP/2.0/TCP 10.64.90.97:50693;rport;branch=z9hG4bKPjPtKqxhkZnvVKI2LUEWoZVFjFaqo.cOzf;alias\n"
+               "From: <sip:5755550033@homedomain>;tag=13919SIPpTag0011234\n"
+               "To: <sip:5755550033@homedomain>\n"
+               "Call-ID: 1-13919@10.151.20.48\n"
+               "CSeq: 4 " + method + "\n"
+               "Content-Length: 0\n\n");
+    pjsip_rx_data* method_rdata = build_rxdata(str);
+    parse_rxdata(method_rdata);
+    msgs.push_back(method_rdata->msg_info.msg);
+  }
+
+  std::vector<const SessionCase*> session_cases = {&SessionCase::Originating,
+                                                   &SessionCase::Terminating,
+                                                   &SessionCase::OriginatingCdiv};
+
+  for (std::string trigger_point : trigger_points)
+  {
+    SCOPED_TRACE(trigger_point);
+    rapidxml::xml_document<> doc;
+    Ifc ifc(ifc_xml(trigger_point), &doc);
+    EXPECT_FALSE(ifc.is_compiled());
+    ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0);
+    EXPECT_FALSE(ifc.is_compiled());
+    ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0);
+    ASSERT_TRUE(ifc.is_compiled());
+
+    for (pjsip_msg* msg : msgs)
+    {
+      for (const SessionCase* session_case : session_cases)
+      {
+        for (int reg = 0; reg <= 1; reg++)
+        {
+          for (int initial = 0; initial <= 1; initial++)
+          {
+            EXPECT_EQ(ifc.dom_filter_matches(*session_case, reg, initial, msg, 0),
+                      ifc.filter_matches(*session_case, reg, initial, msg, 0));
+          }
+        }
+      }
+    }
+  }
+}
+
+// iFCs that would report an error or unusual iFC when matched aren't
+// compiled, so that this is still reported on each request.
+TEST_F(IfcHandlerTest, InvalidNotCompiled)
+{
+  std::vector<std::string> trigger_points =
+  {
+    "<ProfilePartIndicator>2</ProfilePartIndicator>\n",
+    "<TriggerPoint><SPT><Group>0</Group><Method>INVITE</Method></SPT></TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><Extension/></SPT></TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><SIPHeader><Header>(</Header></SIPHeader></SPT></TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><Group>0</Group><RequestURI>sip:homedomain</RequestURI></SPT></TriggerPoint>\n",
+    "<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+    "<SPT><Group>x</Group><SessionCase>0</SessionCase></SPT></TriggerPoint>\n",
+  };
+
+  for (std::string trigger_point : trigger_points)
+  {
+    SCOPED_TRACE(trigger_point);
+    rapidxml::xml_document<> doc;
+    Ifc ifc(ifc_xml(trigger_point), &doc);
+    ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0);
+    ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0);
+    EXPECT_FALSE(ifc.is_compiled());
+  }
+}
+
+// Copies of an iFC share its compiled form, so matching each of two copies
+// once compiles them both.
+TEST_F(IfcHandlerTest, CopiesShareCompilation)
+{
+  rapidxml::xml_document<> doc;
+  Ifc ifc(ifc_xml("<TriggerPoint><ConditionTypeCNF>1</ConditionTypeCNF>"
+                  "<SPT><Group>0</Group><Method>INVITE</Method></SPT>"
+                  "</TriggerPoint>\n"),
+          &doc);
+  Ifc copy(ifc);
+
+  EXPECT_TRUE(ifc.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0));
+  EXPECT_FALSE(copy.is_compiled());
+  EXPECT_TRUE(copy.filter_matches(SessionCase::Originating, true, false, TEST_MSG, 0));
+  EXPECT_TRUE(ifc.is_compiled());
+  EXPECT_TRUE(copy.is_compiled());
+}
+
 // @@@ iFC XML parse error
 // @@@ lookup_ifcs gets no served user
 // @@@ lookup_ifcs finds empty iFCs
@@ -29,13 +29,14 @@ public:
                                              HSSConnection::irs_info& irs_info,
                                              SAS::TrailId trail));
 
-  MOCK_METHOD8(reregister_subscriber, HTTPCode(const std::string& aor_id,
+  MOCK_METHOD9(reregister_subscriber, HTTPCode(const std::string& aor_id,
                                                const std::string& server_name,
                                                const AssociatedURIs& associated_uris,
                                                const Bindings& updated_bindings,
                                                const std::vector<std::string>& binding_ids_to_remove,
                                                Bindings& all_bindings,
                                                HSSConnection::irs_info& irs_info,
+                                               AoR* orig_aor,
                                                SAS::TrailId trail));
 
   MOCK_METHOD5(remove_bindings, HTTPCode(const std::string& public_id,
@@ -61,6 +62,11 @@ public:
                                       Bindings& bindings,
                                       SAS::TrailId trail));
 
+  MOCK_METHOD4(get_bindings, HTTPCode(const std::string& public_id,
+                                      Bindings& bindings,
+                                      AoR** aor,
+                                      SAS::TrailId trail));
+
   MOCK_METHOD3(get_subscriptions, HTTPCode(const std::string& public_id,
                                            Subscriptions& subscriptions,
                                            SAS::TrailId trail));
@@ -73,6 +79,8 @@ public:
                                               HSSConnection::irs_info& irs_info,
                                               SAS::TrailId trail));
 
+  MOCK_METHOD1(invalidate_cached_subscriber_state, void(const std::string& public_id));
+
   MOCK_METHOD3(update_associated_uris, HTTPCode(const std::string& aor_id,
                                                 const AssociatedURIs& associated_uris,
                                                 SAS::TrailId trail));
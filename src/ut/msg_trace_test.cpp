@@ -0,0 +1,184 @@
+/**
+ * @file msg_trace_test.cpp UT for the SIP message trace buffers.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "siptest.hpp"
+#include "testingcommon.h"
+#include "msg_trace.h"
+
+using namespace std;
+using namespace TestingCommon;
+
+class MsgTraceTest : public SipTest
+{
+public:
+  static void SetUpTestCase()
+  {
+    SipTest::SetUpTestCase();
+  }
+
+  static void TearDownTestCase()
+  {
+    SipTest::TearDownTestCase();
+  }
+
+  MsgTraceTest()
+  {
+    MsgTrace::clear();
+  }
+
+  ~MsgTraceTest()
+  {
+    MsgTrace::set_sample_rate(0);
+    MsgTrace::clear();
+  }
+};
+
+// Nothing is sampled until a sample rate is set.
+TEST_F(MsgTraceTest, DisabledByDefault)
+{
+  for (int ii = 0; ii < 10; ++ii)
+  {
+    EXPECT_FALSE(MsgTrace::sample());
+  }
+  EXPECT_EQ("", MsgTrace::dump());
+}
+
+// One message in every sample_rate is sampled.
+TEST_F(MsgTraceTest, SampleRate)
+{
+  MsgTrace::set_sample_rate(3);
+
+  int sampled = 0;
+  for (int ii = 0; ii < 30; ++ii)
+  {
+    if (MsgTrace::sample())
+    {
+      EXPECT_EQ(2, ii % 3);
+      sampled++;
+    }
+  }
+  EXPECT_EQ(10, sampled);
+}
+
+// Recorded messages appear in the dump with their descriptions.
+TEST_F(MsgTraceTest, RecordAndDump)
+{
+  Message msg;
+  pjsip_msg* req = parse_msg(msg.get_request());
+
+  MsgTrace::record("First message", "Some bytes", 10);
+  MsgTrace::record("Second message", req);
+
+  string dump = MsgTrace::dump();
+  size_t first = dump.find("First message (10 bytes):\n--start msg--\n\nSome bytes\n--end msg--");
+  size_t second = dump.find("Second message");
+  EXPECT_NE(string::npos, first);
+  EXPECT_NE(string::npos, second);
+  EXPECT_LT(first, second);
+  EXPECT_NE(string::npos, dump.find("INVITE sip:6505551234@homedomain SIP/2.0"));
+
+  // Clearing discards the traces.
+  MsgTrace::clear();
+  EXPECT_EQ("", MsgTrace::dump());
+}
+
+// Long messages are truncated.
+TEST_F(MsgTraceTest, Truncated)
+{
+  string big(MsgTrace::MAX_MSG_LEN + 100, 'x');
+  MsgTrace::record("Big message", big.data(), big.length());
+
+  string dump = MsgTrace::dump();
+  EXPECT_NE(string::npos,
+            dump.find("Big message (" + to_string(big.length()) +
+                      " bytes, truncated to " +
+                      to_string(MsgTrace::MAX_MSG_LEN) + ")"));
+  EXPECT_EQ(string::npos, dump.find(big));
+  EXPECT_NE(string::npos, dump.find(string(MsgTrace::MAX_MSG_LEN, 'x')));
+}
+
+// Once a thread's buffer is full the oldest traces are overwritten.
+TEST_F(MsgTraceTest, Wraps)
+{
+  for (int ii = 0; ii < MsgTrace::SLOTS_PER_THREAD + 2; ++ii)
+  {
+    string data = "Message " + to_string(ii);
+    MsgTrace::record(data, data.data(), data.length());
+  }
+
+  string dump = MsgTrace::dump();
+  EXPECT_EQ(string::npos, dump.find("Message 0 "));
+  EXPECT_EQ(string::npos, dump.find("Message 1 "));
+  for (int ii = 2; ii < MsgTrace::SLOTS_PER_THREAD + 2; ++ii)
+  {
+    EXPECT_NE(string::npos, dump.find("Message " + to_string(ii) + " "));
+  }
+}
+
+// Traces are dumped to a file in the given directory, but only if tracing is
+// enabled.
+TEST_F(MsgTraceTest, DumpToFile)
+{
+  char dir[] = "/tmp/msgtraceXXXXXX";
+  ASSERT_TRUE(mkdtemp(dir) != NULL);
+
+  MsgTrace::record("Dumped message", "Some bytes", 10);
+
+  // Tracing is disabled, so nothing is written.
+  MsgTrace::dump(dir);
+  DIR* d = opendir(dir);
+  ASSERT_TRUE(d != NULL);
+  std::vector<string> files;
+  for (struct dirent* entry = readdir(d); entry != NULL; entry = readdir(d))
+  {
+    if (entry->d_name[0] != '.')
+    {
+      files.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  EXPECT_TRUE(files.empty());
+
+  MsgTrace::set_sample_rate(1);
+  MsgTrace::dump(dir);
+
+  d = opendir(dir);
+  ASSERT_TRUE(d != NULL);
+  for (struct dirent* entry = readdir(d); entry != NULL; entry = readdir(d))
+  {
+    if (entry->d_name[0] != '.')
+    {
+      files.push_back(entry->d_name);
+    }
+  }
+  closedir(d);
+  ASSERT_EQ(1u, files.size());
+  EXPECT_EQ(0u, files[0].find("msgtrace."));
+
+  string path = string(dir) + "/" + files[0];
+  std::ifstream file(path.c_str());
+  std::stringstream contents;
+  contents << file.rdbuf();
+  EXPECT_NE(string::npos,
+            contents.str().find("Dumped message (10 bytes):\n--start msg--\n\nSome bytes\n--end msg--"));
+
+  unlink(path.c_str());
+  rmdir(dir);
+}
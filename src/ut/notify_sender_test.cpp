@@ -9,6 +9,7 @@
  * Metaswitch Networks in a separate written agreement.
  */
 
+#include <set>
 #include "gtest/gtest.h"
 
 #include "aor_test_utils.h"
@@ -1062,3 +1063,113 @@ TEST_F(NotifySenderTest, NotifyTwoSubscriptionsBindingChange)
   delete orig_aor; orig_aor = NULL;
   delete updated_aor; updated_aor = NULL;
 }
+
+// The NOTIFYs to different subscriptions share the same reg-info document,
+// apart from the registration ids, which are each subscription's To tag.
+TEST_F(NotifySenderTest, NotifyTwoSubscriptionsRegistrationIds)
+{
+  std::string aor_id = "sip:1234567890@homedomain";
+  int now = time(NULL);
+  AoR* orig_aor = AoRTestUtils::create_simple_aor(aor_id, false);
+  AoR* updated_aor = AoRTestUtils::create_simple_aor(aor_id);
+  updated_aor->_associated_uris.add_uri("tel:1234567890", false);
+  Subscription* s = AoRTestUtils::build_subscription("tag<&>", now);
+  updated_aor->_subscriptions.insert(std::make_pair(AoRTestUtils::SUBSCRIPTION_ID + "2", s));
+
+  _notify_sender->send_notifys(aor_id,
+                               *orig_aor,
+                               *updated_aor,
+                               SubscriberDataUtils::EventTrigger::USER,
+                               time(NULL),
+                               0);
+
+  ASSERT_EQ(2, txdata_count());
+
+  std::set<std::string> reg_ids;
+  std::vector<std::string> bodies;
+
+  for (int ii = 0; ii < 2; ++ii)
+  {
+    pjsip_msg* out = current_txdata()->msg;
+
+    char buf[16384];
+    int n = out->body->print_body(out->body, buf, sizeof(buf));
+    ASSERT_GT(n, 0);
+    std::string body(buf, n);
+
+    // Both registration elements have the subscription's To tag as their id.
+    rapidxml::xml_document<>* doc = parse_notify_body(out);
+    rapidxml::xml_node<>* reg_info = doc->first_node("reginfo");
+    ASSERT_TRUE(reg_info);
+    std::set<std::string> ids;
+    int num_reg = 0;
+
+    for (rapidxml::xml_node<>* registration = reg_info->first_node("registration");
+         registration;
+         registration = registration->next_sibling("registration"), num_reg++)
+    {
+      ids.insert(registration->first_attribute("id")->value());
+    }
+
+    EXPECT_EQ(2, num_reg);
+    ASSERT_EQ(1u, ids.size());
+    std::string reg_id = *ids.begin();
+    reg_ids.insert(reg_id);
+
+    // Apart from the ids, the bodies are the same.
+    std::string escaped_reg_id = Utils::xml_escape(reg_id);
+    size_t pos;
+    while ((pos = body.find("id=\"" + escaped_reg_id + "\"")) != std::string::npos)
+    {
+      body.replace(pos, escaped_reg_id.size() + 5, "id=\"\"");
+    }
+    bodies.push_back(body);
+
+    inject_msg(respond_to_current_txdata(200));
+    delete doc;
+  }
+
+  EXPECT_EQ(std::set<std::string>({AoRTestUtils::SUBSCRIPTION_ID, "tag<&>"}), reg_ids);
+  EXPECT_EQ(bodies[0], bodies[1]);
+
+  // Tidy up
+  delete orig_aor; orig_aor = NULL;
+  delete updated_aor; updated_aor = NULL;
+}
+
+// If the placeholder for the registration ids appears elsewhere in the
+// reg-info document, each NOTIFY builds its own document instead.
+TEST_F(NotifySenderTest, NotifyRegistrationIdPlaceholderInBody)
+{
+  std::string aor_id = "sip:1234567890@homedomain";
+  AoR* orig_aor = new AoR();
+  AoR* updated_aor = AoRTestUtils::create_simple_aor(aor_id);
+  Binding* b = updated_aor->get_binding(AoRTestUtils::BINDING_ID);
+  b->_params["<reg-id>"] = "";
+
+  _notify_sender->send_notifys(aor_id,
+                               *orig_aor,
+                               *updated_aor,
+                               SubscriberDataUtils::EventTrigger::USER,
+                               time(NULL),
+                               0);
+
+  ASSERT_EQ(1, txdata_count());
+  pjsip_msg* out = current_txdata()->msg;
+
+  rapidxml::xml_document<>* doc = parse_notify_body(out);
+  rapidxml::xml_node<>* reg_info = doc->first_node("reginfo");
+  ASSERT_TRUE(reg_info);
+  rapidxml::xml_node<>* registration = reg_info->first_node("registration");
+  ASSERT_TRUE(registration);
+  EXPECT_EQ(AoRTestUtils::SUBSCRIPTION_ID, std::string(registration->first_attribute("id")->value()));
+  std::vector<std::pair<std::string, bool>> impus;
+  impus.push_back(std::make_pair("sip:1234567890@homedomain", false));
+  check_notify_registration_nodes(doc, ACTIVE, {ACTIVE_CREATED}, impus);
+
+  // Tidy up
+  inject_msg(respond_to_current_txdata(200));
+  delete doc;
+  delete orig_aor; orig_aor = NULL;
+  delete updated_aor; updated_aor = NULL;
+}
@@ -0,0 +1,130 @@
+/**
+ * @file prefix_trie_test.cpp UT for the longest-prefix-match trie.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include "gtest/gtest.h"
+
+#include "prefix_trie.h"
+
+// Returns the prefix found by the linear scan of a sorted map that the trie
+// replaces, or "<none>".
+static std::string scan_match(const std::map<std::string, int>& prefixes,
+                              const std::string& number)
+{
+  for (std::map<std::string, int>::const_reverse_iterator it = prefixes.rbegin();
+       it != prefixes.rend();
+       it++)
+  {
+    int len = std::min(number.size(), it->first.size());
+    if (number.compare(0, len, it->first, 0, len) == 0)
+    {
+      return it->first;
+    }
+  }
+  return "<none>";
+}
+
+static std::string trie_match(const PrefixTrie<int>& trie,
+                              const std::string& number,
+                              bool match_extensions)
+{
+  const std::pair<std::string, int>* match =
+                                 trie.longest_match(number, match_extensions);
+  return (match != NULL) ? match->first : "<none>";
+}
+
+// The longest matching prefix is found, regardless of insertion order.
+TEST(PrefixTrieTest, LongestMatch)
+{
+  PrefixTrie<int> trie;
+  EXPECT_TRUE(trie.insert("+22", 2));
+  EXPECT_TRUE(trie.insert("+2222", 4));
+  EXPECT_TRUE(trie.insert("+222", 3));
+  EXPECT_FALSE(trie.insert("+222", 5));
+  EXPECT_EQ(3u, trie.size());
+
+  EXPECT_EQ(3, trie.longest_match("+22238899")->second);
+  EXPECT_EQ(2, trie.longest_match("+22338899")->second);
+  EXPECT_EQ(4, trie.longest_match("+22228899")->second);
+  EXPECT_EQ(3, trie.longest_match("+222")->second);
+  EXPECT_TRUE(trie.longest_match("+2") == NULL);
+  EXPECT_TRUE(trie.longest_match("123") == NULL);
+  EXPECT_TRUE(trie.longest_match("") == NULL);
+
+  // An empty prefix matches everything.
+  trie.insert("", 0);
+  EXPECT_EQ(0, trie.longest_match("123")->second);
+  EXPECT_EQ(0, trie.longest_match("")->second);
+}
+
+// With match_extensions, a number that is a prefix of configured prefixes
+// matches the greatest of them.
+TEST(PrefixTrieTest, MatchExtensions)
+{
+  PrefixTrie<int> trie;
+  trie.insert("12", 12);
+  trie.insert("1234", 1234);
+  trie.insert("1299", 1299);
+
+  EXPECT_EQ("1299", trie_match(trie, "12", true));
+  EXPECT_EQ("1299", trie_match(trie, "1", true));
+  EXPECT_EQ("1234", trie_match(trie, "123", true));
+  EXPECT_EQ("12", trie_match(trie, "123", false));
+  EXPECT_EQ("12", trie_match(trie, "1235", true));
+  EXPECT_EQ("<none>", trie_match(trie, "2", true));
+}
+
+// The trie gives the same answers as the linear scan it replaces.
+TEST(PrefixTrieTest, MatchesLinearScan)
+{
+  srand(1);
+  std::map<std::string, int> prefixes;
+  PrefixTrie<int> trie;
+
+  for (int ii = 0; ii < 1000; ++ii)
+  {
+    std::string prefix = (rand() % 4 == 0) ? "+" : "";
+    int len = rand() % 6;
+    for (int jj = 0; jj < len; ++jj)
+    {
+      prefix.push_back('0' + rand() % 4);
+    }
+    prefixes.insert(std::make_pair(prefix, ii));
+    trie.insert(prefix, ii);
+  }
+
+  for (int ii = 0; ii < 10000; ++ii)
+  {
+    std::string number = (rand() % 4 == 0) ? "+" : "";
+    int len = rand() % 9;
+    for (int jj = 0; jj < len; ++jj)
+    {
+      number.push_back('0' + rand() % 4);
+    }
+    SCOPED_TRACE(number);
+    EXPECT_EQ(scan_match(prefixes, number), trie_match(trie, number, true));
+  }
+}
+
+// Swapping exchanges the contents of two tries.
+TEST(PrefixTrieTest, Swap)
+{
+  PrefixTrie<int> trie1;
+  PrefixTrie<int> trie2;
+  trie1.insert("1", 1);
+
+  trie1.swap(trie2);
+  EXPECT_TRUE(trie1.empty());
+  EXPECT_TRUE(trie1.longest_match("1") == NULL);
+  EXPECT_EQ(1, trie2.longest_match("1")->second);
+}
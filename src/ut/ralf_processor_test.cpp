@@ -10,16 +10,19 @@
  */
 
 #include <string>
+#include <atomic>
 #include "gtest/gtest.h"
 
 #include "basetest.hpp"
 #include "ralf_processor.h"
 #include "mock_httpclient.h"
 #include "httpconnection.h"
+#include "fakesnmp.hpp"
 
 using ::testing::_;
 using ::testing::Return;
 using ::testing::AllOf;
+using ::testing::InvokeWithoutArgs;
 
 class RalfProcessorTest : public BaseTest
 {
@@ -67,3 +70,91 @@ TEST_F(RalfProcessorTest, RequestComplete)
   _ralf_processor->send_request_to_ralf(rr);
   sleep(1);
 }
+
+/// Fixture for tests of a Ralf processor that batches requests.
+class RalfProcessorBatchTest : public RalfProcessorTest
+{
+  SNMP::FakeCounterTable _dropped_tbl;
+
+  /// Replaces the Ralf processor with one that batches requests.
+  void create_processor(int max_batch_size, int batch_linger_ms, int spool_size)
+  {
+    delete _ralf_processor;
+    _ralf_processor = new RalfProcessor(_ralf_connection,
+                                        NULL,
+                                        1,
+                                        max_batch_size,
+                                        batch_linger_ms,
+                                        spool_size,
+                                        &_dropped_tbl);
+  }
+
+  void send_request(const std::string& path)
+  {
+    RalfProcessor::RalfRequest* rr = new RalfProcessor::RalfRequest();
+    rr->path = path;
+    rr->message = "message";
+    rr->trail = 0;
+    _ralf_processor->send_request_to_ralf(rr);
+  }
+};
+
+// A full batch is sent straight away.
+TEST_F(RalfProcessorBatchTest, FullBatch)
+{
+  create_processor(3, 60000, 0);
+
+  {
+    ::testing::InSequence seq;
+    EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path1"))));
+    EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path2"))));
+    EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path3"))));
+  }
+
+  send_request("path1");
+  send_request("path2");
+  send_request("path3");
+  sleep(1);
+}
+
+// A batch that doesn't fill up is sent after the linger time.
+TEST_F(RalfProcessorBatchTest, PartialBatch)
+{
+  create_processor(10, 10, 0);
+
+  EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path1"))));
+
+  send_request("path1");
+  sleep(1);
+}
+
+// Requests are dropped when the spool is full, rather than blocking.
+TEST_F(RalfProcessorBatchTest, SpoolFull)
+{
+  create_processor(1, 0, 1);
+
+  // Hold up the first request until the second has been dropped.
+  std::atomic<bool> release(false);
+  EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path1"))))
+    .WillOnce(InvokeWithoutArgs([&release]()
+    {
+      while (!release)
+      {
+        usleep(1000);
+      }
+      return HttpResponse(HTTP_OK, "", {});
+    }));
+
+  send_request("path1");
+  send_request("path2");
+  EXPECT_EQ(1, _dropped_tbl._count);
+
+  // Once the first request has been sent there's room in the spool again.
+  release = true;
+  sleep(1);
+
+  EXPECT_CALL(*_mock_client, send_request(AllOf(IsPost(), HasPath("path3"))));
+  send_request("path3");
+  sleep(1);
+  EXPECT_EQ(1, _dropped_tbl._count);
+}
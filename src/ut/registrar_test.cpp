@@ -322,7 +322,7 @@ public:
 
   void expectations_for_not_found_get_bindings()
   {
-    EXPECT_CALL(*_sm, get_bindings(_, _, _))
+    EXPECT_CALL(*_sm, get_bindings(_, _, _, _))
       .WillOnce(Return(HTTP_NOT_FOUND));
   }
 
@@ -335,7 +335,7 @@ public:
   {
     Bindings get_bindings;
     set_up_single_returned_binding(get_bindings, "different cid");
-    EXPECT_CALL(*_sm, get_bindings(_, _, _))
+    EXPECT_CALL(*_sm, get_bindings(_, _, _, _))
       .WillOnce(DoAll(SetArgReferee<1>(get_bindings),
                       Return(HTTP_OK)));
   }
@@ -383,7 +383,7 @@ TEST_F(RegistrarTest, RegisterSubscriber)
     .WillOnce(DoAll(SaveArg<0>(&irs_query),
                     SetArgReferee<1>(irs_info),
                     Return(HTTP_OK)));
-  EXPECT_CALL(*_sm, get_bindings("sip:6505550231@homedomain", _, _))
+  EXPECT_CALL(*_sm, get_bindings("sip:6505550231@homedomain", _, _, _))
     .WillOnce(Return(HTTP_NOT_FOUND));
   EXPECT_CALL(*_sm, register_subscriber("sip:6505550231@homedomain", "sip:scscf.sprout.homedomain:5058;transport=TCP", irs_info._associated_uris, _, _, _, _))
     .WillOnce(DoAll(SaveBindingsRegister(&bindings),
@@ -537,7 +537,7 @@ TEST_F(RegistrarTest, ReRegisterSubscriber)
 
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber("sip:6505550231@homedomain", "sip:scscf.sprout.homedomain:5058;transport=TCP", irs_info._associated_uris, _, std::vector<std::string>(), _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber("sip:6505550231@homedomain", "sip:scscf.sprout.homedomain:5058;transport=TCP", irs_info._associated_uris, _, std::vector<std::string>(), _, _, _, _))
     .WillOnce(DoAll(SaveBindingsReRegister(&bindings),
                     SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
@@ -581,7 +581,7 @@ TEST_F(RegistrarTest, FetchBindingsRegisterExistingSubscriber)
 
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), std::vector<std::string>(), _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), std::vector<std::string>(), _, _, _, _))
     .WillOnce(DoAll(SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
                     Return(HTTP_OK)));
@@ -646,7 +646,7 @@ TEST_F(RegistrarTest, DeregisterSubscriber)
   std::vector<std::string> removed_bindings;
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _, _))
     .WillOnce(DoAll(SaveArg<4>(&removed_bindings),
                     SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
@@ -686,7 +686,7 @@ TEST_F(RegistrarTest, DeregisterSubscriberWithWildcard)
   std::vector<std::string> removed_bindings;
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _, _))
     .WillOnce(DoAll(SaveArg<4>(&removed_bindings),
                     SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
@@ -717,7 +717,7 @@ TEST_F(RegistrarTest, DeregisterSubscriberContactParams)
   std::vector<std::string> removed_bindings;
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, Bindings(), _, _, _, _, _))
     .WillOnce(DoAll(SaveArg<4>(&removed_bindings),
                     SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
@@ -763,7 +763,7 @@ TEST_F(RegistrarTest, GetBindingsFail)
   Message msg;
   HSSConnection::irs_info irs_info;
   expectations_for_successful_get_subscriber_state(irs_info);
-  EXPECT_CALL(*_sm, get_bindings(_, _, _))
+  EXPECT_CALL(*_sm, get_bindings(_, _, _, _))
     .WillOnce(Return(HTTP_SERVER_ERROR));
 
   inject_msg(msg.get());
@@ -804,7 +804,7 @@ TEST_F(RegistrarTest, ReRegisterFail)
   HSSConnection::irs_info irs_info;
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _, _))
     .WillOnce(Return(HTTP_SERVER_ERROR));
   expectations_for_registration_sender();
 
@@ -826,7 +826,7 @@ TEST_F(RegistrarTest, DeregisterFail)
   HSSConnection::irs_info irs_info;
   expectations_for_successful_get_subscriber_state(irs_info);
   expectations_for_get_single_binding();
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _, _))
     .WillOnce(Return(HTTP_SERVER_ERROR));
   expectations_for_registration_sender();
 
@@ -1049,10 +1049,10 @@ TEST_F(RegistrarTest, ReduceTimeForEmergencyBinding)
   EXPECT_CALL(*_sm, get_subscriber_state(_, _, _))
     .WillOnce(DoAll(SetArgReferee<1>(irs_info),
                     Return(HTTP_OK)));
-  EXPECT_CALL(*_sm, get_bindings(_, _, _))
+  EXPECT_CALL(*_sm, get_bindings(_, _, _, _))
     .WillOnce(DoAll(SetArgReferee<1>(get_bindings),
                     Return(HTTP_OK)));
-  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _))
+  EXPECT_CALL(*_sm, reregister_subscriber(_, _, _, _, _, _, _, _, _))
     .WillOnce(DoAll(SaveBindingsReRegister(&bindings),
                     SetArgReferee<6>(irs_info),
                     SetArgReferee<5>(all_bindings),
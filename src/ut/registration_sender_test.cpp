@@ -376,6 +376,59 @@ TEST_F(RegistrationSenderTest, 3rdPartyRegisterMultipleAS)
   EXPECT_EQ(2,((SNMP::FakeSuccessFailCountTable*)SNMP::FAKE_THIRD_PARTY_REGISTRATION_STATS_TABLES.init_reg_tbl)->_successes);
 }
 
+// Set up two iFCs that want the received register and its response in the
+// body, as well as service info, and check that both 3rd party registers
+// contain all of them.
+TEST_F(RegistrationSenderTest, 3rdPartyRegisterMultipleASWithBody)
+{
+  RegisterMessage msg;
+  pjsip_msg* received_register = parse_msg(msg.get_request());
+  pjsip_msg* sent_response = parse_msg(msg.get_response());
+
+  Ifcs ifcs = build_ifcs({"sip:1.2.3.4:56789;transport=TCP", "sip:9.8.7.6:54321;transport=TCP"},
+                         "banana",
+                         true);
+  bool unused_deregister_subscriber;
+  _registration_sender->register_with_application_servers(received_register,
+                                                          sent_response,
+                                                          "sip:6505551000@homedomain",
+                                                          ifcs,
+                                                          300,
+                                                          true,
+                                                          unused_deregister_subscriber,
+                                                          0);
+
+  // Expect two 3rd party registers.
+  ASSERT_EQ(2, txdata_count());
+
+  const char* as_uris[] = {"sip:1.2.3.4:56789;transport=TCP",
+                           "sip:9.8.7.6:54321;transport=TCP"};
+  for (const char* as_uri : as_uris)
+  {
+    pjsip_msg* out = current_txdata()->msg;
+    EXPECT_EQ(as_uri, str_uri(out->line.req.uri));
+    EXPECT_EQ("P-Charging-Vector: icid-value=\"100\"", get_headers(out, "P-Charging-Vector"));
+    EXPECT_EQ("P-Charging-Function-Addresses: ccf=cdf.homedomain", get_headers(out, "P-Charging-Function-Addresses"));
+
+    // Check that the body contains the service info, the REGISTER and the
+    // 200 OK.
+    ASSERT_TRUE(out->body != NULL);
+    pjsip_multipart_part multipart = ((struct multipart_data*)out->body->data)->part_head;
+    EXPECT_EQ("<ims-3gpp><service-info>banana</service-info></ims-3gpp>",
+              PJUtils::body_to_string(multipart.next->body));
+    EXPECT_THAT(PJUtils::body_to_string(multipart.next->next->body),
+                HasSubstr("REGISTER"));
+    EXPECT_THAT(PJUtils::body_to_string(multipart.next->next->next->body),
+                HasSubstr("200 OK"));
+
+    inject_msg(respond_to_current_txdata(200));
+  }
+
+  // Check statistics.
+  EXPECT_EQ(2,((SNMP::FakeSuccessFailCountTable*)SNMP::FAKE_THIRD_PARTY_REGISTRATION_STATS_TABLES.init_reg_tbl)->_attempts);
+  EXPECT_EQ(2,((SNMP::FakeSuccessFailCountTable*)SNMP::FAKE_THIRD_PARTY_REGISTRATION_STATS_TABLES.init_reg_tbl)->_successes);
+}
+
 // Set up a two iFCs and check that two 3rd party registers are sent to the
 // application servers. Return an error from one of the application servers and
 // check that the subscriber is deregistered.
@@ -0,0 +1,268 @@
+/**
+ * @file request_coalescer_test.cpp UT for the request coalescer.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <unistd.h>
+#include "gtest/gtest.h"
+
+#include "request_coalescer.h"
+#include "fakesnmp.hpp"
+
+/// Counter table that can be incremented from several threads at once.
+class ThreadSafeCounterTable : public SNMP::CounterTable
+{
+public:
+  std::atomic<int> _count;
+  ThreadSafeCounterTable() : _count(0) {}
+  void increment() { _count++; }
+};
+
+/// Fixture for RequestCoalescerTest.
+class RequestCoalescerTest : public ::testing::Test
+{
+  ThreadSafeCounterTable _coalesced_tbl;
+  RequestCoalescer<std::string> _coalescer;
+
+  // The number of requests that have been sent.
+  std::atomic<int> _requests_sent;
+
+  // Requests block until this is set.
+  std::atomic<bool> _release;
+
+  RequestCoalescerTest() :
+    _coalescer(5000, &_coalesced_tbl),
+    _requests_sent(0),
+    _release(true)
+  {
+  }
+
+  /// Sends a request for the key through the coalescer.  The request returns
+  /// a result made from the key and the number of requests sent so far.
+  HTTPCode send(const std::string& key, std::string& result)
+  {
+    return _coalescer.send(key, result, [this, &key](std::string& r)
+    {
+      int request_num = ++_requests_sent;
+
+      while (!_release)
+      {
+        usleep(1000);
+      }
+
+      r = key + " " + std::to_string(request_num);
+      return HTTP_OK;
+    },
+    0);
+  }
+
+  /// Waits until the given number of threads are waiting for the request for
+  /// the key.
+  void wait_for_waiters(const std::string& key, int waiters)
+  {
+    for (int ii = 0; ii < 5000; ++ii)
+    {
+      pthread_mutex_lock(&_coalescer._lock);
+      auto it = _coalescer._in_flight.find(key);
+      bool done = ((it != _coalescer._in_flight.end()) &&
+                   (it->second->waiters == waiters));
+      pthread_mutex_unlock(&_coalescer._lock);
+
+      if (done)
+      {
+        return;
+      }
+
+      usleep(1000);
+    }
+
+    FAIL() << "Timed out waiting for " << waiters << " waiters";
+  }
+};
+
+// A request is sent when there's no identical request in flight.
+TEST_F(RequestCoalescerTest, SingleRequest)
+{
+  std::string result;
+  EXPECT_EQ(HTTP_OK, send("impu1", result));
+  EXPECT_EQ("impu1 1", result);
+  EXPECT_EQ(1, _requests_sent);
+  EXPECT_EQ(0, _coalesced_tbl._count);
+  EXPECT_TRUE(_coalescer._in_flight.empty());
+}
+
+// Requests that don't overlap are each sent.
+TEST_F(RequestCoalescerTest, SequentialRequests)
+{
+  std::string result;
+  send("impu1", result);
+  send("impu1", result);
+  EXPECT_EQ("impu1 2", result);
+  EXPECT_EQ(2, _requests_sent);
+  EXPECT_EQ(0, _coalesced_tbl._count);
+}
+
+// Identical concurrent requests share a single request.
+TEST_F(RequestCoalescerTest, ConcurrentIdenticalRequests)
+{
+  _release = false;
+
+  std::vector<std::string> results(4);
+  std::vector<std::thread> threads;
+  threads.emplace_back([this, &results]() { send("impu1", results[0]); });
+
+  // Wait for the first request to be sent before making the others.
+  while (_requests_sent == 0)
+  {
+    usleep(1000);
+  }
+
+  for (int ii = 1; ii < 4; ++ii)
+  {
+    threads.emplace_back([this, &results, ii]() { send("impu1", results[ii]); });
+  }
+
+  wait_for_waiters("impu1", 3);
+  _release = true;
+
+  for (std::thread& thread : threads)
+  {
+    thread.join();
+  }
+
+  EXPECT_EQ(1, _requests_sent);
+  EXPECT_EQ(3, _coalesced_tbl._count);
+  for (const std::string& result : results)
+  {
+    EXPECT_EQ("impu1 1", result);
+  }
+  EXPECT_TRUE(_coalescer._in_flight.empty());
+}
+
+// Waiting for an in-flight request is reported as IO, so that the time spent
+// waiting isn't counted against the waiting thread.
+TEST_F(RequestCoalescerTest, WaitIsIo)
+{
+  _release = false;
+
+  std::string result1;
+  std::thread thread([this, &result1]() { send("impu1", result1); });
+
+  while (_requests_sent == 0)
+  {
+    usleep(1000);
+  }
+
+  std::atomic<int> io_started(0);
+  std::atomic<int> io_completed(0);
+  std::string result2;
+  std::thread waiter([this, &result2, &io_started, &io_completed]()
+  {
+    Utils::IOHook io_hook([&io_started](const std::string&) { ++io_started; },
+                          [&io_completed](const std::string&) { ++io_completed; });
+    send("impu1", result2);
+  });
+
+  wait_for_waiters("impu1", 1);
+  EXPECT_EQ(1, io_started);
+  EXPECT_EQ(0, io_completed);
+
+  _release = true;
+  thread.join();
+  waiter.join();
+
+  EXPECT_EQ("impu1 1", result2);
+  EXPECT_EQ(1, io_started);
+  EXPECT_EQ(1, io_completed);
+}
+
+// Requests with different keys aren't coalesced.
+TEST_F(RequestCoalescerTest, DifferentKeys)
+{
+  _release = false;
+
+  std::string result1;
+  std::thread thread([this, &result1]() { send("impu1", result1); });
+
+  while (_requests_sent == 0)
+  {
+    usleep(1000);
+  }
+
+  // The request for the other key is sent as soon as the first is released,
+  // rather than waiting for the first one.
+  std::thread releaser([this]()
+  {
+    while (_requests_sent < 2)
+    {
+      usleep(1000);
+    }
+    _release = true;
+  });
+
+  std::string result2;
+  send("impu2", result2);
+  thread.join();
+  releaser.join();
+
+  EXPECT_EQ("impu1 1", result1);
+  EXPECT_EQ("impu2 2", result2);
+  EXPECT_EQ(0, _coalesced_tbl._count);
+}
+
+// A request that has been in flight for too long is treated as abandoned, and
+// an identical request is sent again.
+TEST_F(RequestCoalescerTest, AbandonedRequest)
+{
+  RequestCoalescer<std::string> coalescer(10, &_coalesced_tbl);
+  _release = false;
+
+  std::string result1;
+  std::thread thread([this, &coalescer, &result1]()
+  {
+    coalescer.send("impu1", result1, [this](std::string& r)
+    {
+      ++_requests_sent;
+      while (!_release)
+      {
+        usleep(1000);
+      }
+      r = "first";
+      return HTTP_OK;
+    },
+    0);
+  });
+
+  while (_requests_sent == 0)
+  {
+    usleep(1000);
+  }
+
+  std::string result2;
+  HTTPCode rc = coalescer.send("impu1", result2, [](std::string& r)
+  {
+    r = "second";
+    return HTTP_NOT_FOUND;
+  },
+  0);
+
+  EXPECT_EQ(HTTP_NOT_FOUND, rc);
+  EXPECT_EQ("second", result2);
+
+  // The abandoned request still completes, and doesn't affect later requests.
+  _release = true;
+  thread.join();
+  EXPECT_EQ("first", result1);
+  EXPECT_TRUE(coalescer._in_flight.empty());
+  EXPECT_EQ(0, _coalesced_tbl._count);
+}
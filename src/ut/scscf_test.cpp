@@ -1814,6 +1814,126 @@ TEST_F(SCSCFTest, TestEnumExternalSuccess)
 }
 
 
+/// EnumService that only completes lookups when told to, as an asynchronous
+/// ENUM service would, using another EnumService to do the translation.
+class DeferredEnumService : public EnumService
+{
+public:
+  DeferredEnumService(EnumService* enum_service) : _enum_service(enum_service) {}
+
+  std::string lookup_uri_from_user(const std::string& user, SAS::TrailId trail) const
+  {
+    return _enum_service->lookup_uri_from_user(user, trail);
+  }
+
+  bool is_async() const { return true; }
+
+  void lookup_uri_from_user_async(const std::string& user,
+                                  SAS::TrailId trail,
+                                  LookupCallback callback) const
+  {
+    _pending.push_back(std::make_pair(user, callback));
+  }
+
+  // Completes the oldest outstanding lookup.
+  void complete_lookup()
+  {
+    std::pair<std::string, LookupCallback> lookup = _pending.front();
+    _pending.pop_front();
+    lookup.second(_enum_service->lookup_uri_from_user(lookup.first, 0));
+  }
+
+  // Drops the oldest outstanding lookup without completing it.
+  void drop_lookup()
+  {
+    _pending.pop_front();
+  }
+
+  mutable std::deque<std::pair<std::string, LookupCallback>> _pending;
+
+private:
+  EnumService* _enum_service;
+};
+
+
+// The transaction is suspended while an asynchronous ENUM lookup is
+// outstanding, and carries on when the lookup completes.
+TEST_F(SCSCFTest, TestEnumAsync)
+{
+  SCOPED_TRACE("");
+  DeferredEnumService enum_service(_enum_service);
+  _scscf_sproutlet->_enum_service = &enum_service;
+
+  // Set up caller info.
+  HSSConnection::irs_info irs_info;
+  setup_irs_info(irs_info, "+16505551000", "homedomain");
+  expect_get_subscriber_state(irs_info, "sip:+16505551000@homedomain");
+
+  SCSCFMessage msg;
+  msg._to = "+15108580271";
+  msg._route = "Route: <sip:sprout.homedomain;orig>";
+  msg._extra = "Record-Route: <sip:homedomain>\nP-Asserted-Identity: <sip:+16505551000@homedomain>";
+  add_host_mapping("ut.cw-ngv.com", "10.9.8.7");
+
+  // Only the 100 Trying goes out while the lookup is outstanding.
+  inject_msg(msg.get_request());
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(100).matches(current_txdata()->msg);
+  free_txdata();
+  ASSERT_EQ(1u, enum_service._pending.size());
+
+  // Once the lookup completes, the INVITE is passed on to the translated URI.
+  enum_service.complete_lookup();
+  ASSERT_EQ(1, txdata_count());
+  pjsip_msg* out = current_txdata()->msg;
+  ReqMatcher req("INVITE");
+  ASSERT_NO_FATAL_FAILURE(req.matches(out));
+  EXPECT_THAT(req.uri(), testing::MatchesRegex(".*+15108580271@ut.cw-ngv.com.*"));
+
+  // Send 200 OK back, which is passed on upstream.
+  inject_msg(respond_to_current_txdata(200));
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(200).matches(current_txdata()->msg);
+  free_txdata();
+
+  _scscf_sproutlet->_enum_service = _enum_service;
+}
+
+
+// If an asynchronous ENUM lookup is dropped without completing, the
+// suspension is released and the request is rejected rather than leaked.
+TEST_F(SCSCFTest, TestEnumAsyncDropped)
+{
+  SCOPED_TRACE("");
+  DeferredEnumService enum_service(_enum_service);
+  _scscf_sproutlet->_enum_service = &enum_service;
+
+  // Set up caller info.
+  HSSConnection::irs_info irs_info;
+  setup_irs_info(irs_info, "+16505551000", "homedomain");
+  expect_get_subscriber_state(irs_info, "sip:+16505551000@homedomain");
+
+  SCSCFMessage msg;
+  msg._to = "+15108580271";
+  msg._route = "Route: <sip:sprout.homedomain;orig>";
+  msg._extra = "Record-Route: <sip:homedomain>\nP-Asserted-Identity: <sip:+16505551000@homedomain>";
+
+  inject_msg(msg.get_request());
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(100).matches(current_txdata()->msg);
+  free_txdata();
+  ASSERT_EQ(1u, enum_service._pending.size());
+
+  // Dropping the lookup fails the INVITE.
+  enum_service.drop_lookup();
+  ASSERT_EQ(1, txdata_count());
+  RespMatcher(500).matches(current_txdata()->msg);
+  free_txdata();
+
+  _scscf_sproutlet->_enum_service = _enum_service;
+}
+
+
 TEST_F(SCSCFTest, TestNoEnumWhenGRUU)
 {
   SCOPED_TRACE("");
@@ -10608,6 +10728,11 @@ TEST_F(SCSCFTestWithRalf, MainlineBilling)
   // Complete call flow with ACK and BYE.
   doSuccessfulFlow(msg, testing::MatchesRegex(".*wuntootreefower.*"), hdrs);
 
+  // The messages are encoded on the Ralf threads, so encode them here.
+  ralf_request_1->encode();
+  ralf_request_2->encode();
+  ralf_request_3->encode();
+
   // Check Node Function is S-CSCF.
   EXPECT_THAT(ralf_request_1->path,MatchesRegex("/call-id/.*%4010.114.61.213"));
   EXPECT_THAT(ralf_request_1->message,MatchesRegex(".*\"Node-Functionality\":0.*"));
@@ -10735,7 +10860,9 @@ TEST_F(SCSCFTestWithRalf, ExpiredChain)
   pj_ssize_t len = pjsip_msg_print(saved, buf, sizeof(buf));
   doAsOriginated(string(buf, len), true);
 
-  // Check first ralf request.
+  // Check first ralf request.  It's encoded on a Ralf thread, so encode it
+  // here.
+  ralf_request->encode();
   EXPECT_THAT(ralf_request->message,MatchesRegex(".*\"Accounting-Record-Type\":1.*")); // EVENT_RECORD
   EXPECT_THAT(ralf_request->message,MatchesRegex(".*\"Role-Of-Node\":0.*"));  // NODE_ROLE_ORIGINATING
   EXPECT_THAT(ralf_request->message,MatchesRegex(".*\"SIP-Method\":\"INVITE\".*"));
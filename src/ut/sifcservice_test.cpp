@@ -160,6 +160,29 @@ TEST_F(SIFCServiceTest, SIFCReloadDifferentFile)
   EXPECT_EQ(get_server_name(ifc_map.find(0)->second), "publish.example.com");
 }
 
+// Test that the shared iFCs are parsed once when the file is loaded, rather
+// than each time they're requested.
+TEST_F(SIFCServiceTest, SIFCParsedOnLoad)
+{
+  EXPECT_CALL(*_mock_alarm, clear()).Times(AtLeast(1));
+  SIFCService sifc(_mock_alarm, &SNMP::FAKE_COUNTER_TABLE, string(UT_DIR).append("/test_sifc.xml"));
+
+  std::set<int> id; id.insert(2);
+  std::multimap<int32_t, Ifc> ifc_map;
+  std::multimap<int32_t, Ifc> ifc_map_again;
+  std::shared_ptr<rapidxml::xml_document<> > root (new rapidxml::xml_document<>);
+  sifc.get_ifcs_from_id(ifc_map, id, root, 0);
+  sifc.get_ifcs_from_id(ifc_map_again, id, root, 0);
+  ASSERT_EQ(ifc_map.size(), 1);
+  ASSERT_EQ(ifc_map_again.size(), 1);
+
+  // Both requests get the same iFC, and nothing is allocated from the
+  // caller's document.
+  EXPECT_EQ(ifc_map.find(0)->second._ifc, ifc_map_again.find(0)->second._ifc);
+  EXPECT_TRUE(ifc_map.find(0)->second.is_compiled());
+  EXPECT_EQ(root->first_node(), (rapidxml::xml_node<>*)NULL);
+}
+
 // In the following tests we have various invalid/unexpected SiFC xml files.
 // These tests check that the correct logs are made in each case; this isn't
 // ideal as it means the tests are quite fragile, but it's the best we can do.
@@ -0,0 +1,241 @@
+/**
+ * @file simservs_cache_test.cpp UT for the simservs cache.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+#include "gmock/gmock.h"
+
+#include "simservs_cache.h"
+#include "mmtel.h"
+#include "mock_xdm_connection.h"
+#include "fakesnmp.hpp"
+#include "basetest.hpp"
+#include "test_interposer.hpp"
+
+using ::testing::_;
+using ::testing::Return;
+using ::testing::SetArgReferee;
+using ::testing::DoAll;
+using ::testing::StrictMock;
+
+static const std::string CDIV_SIMSERVS = R"(<?xml version="1.0" encoding="UTF-8"?>
+  <simservs xmlns="http://uri.etsi.org/ngn/params/xml/simservs/xcap" xmlns:cp="urn:ietf:params:xml:ns:common-policy">
+    <originating-identity-presentation active="true" />
+    <communication-diversion active="true">
+      <NoReplyTimer>19</NoReplyTimer>
+      <cp:ruleset>
+        <cp:rule id="rule1">
+          <cp:conditions/>
+          <cp:actions><forward-to><target>sip:6505555678@homedomain</target></forward-to></cp:actions>
+        </cp:rule>
+      </cp:ruleset>
+    </communication-diversion>
+  </simservs>)";
+
+/// Fixture for SimservsCacheTest.
+class SimservsCacheTest : public BaseTest
+{
+  SNMP::FakeCounterTable _hit_tbl;
+  SNMP::FakeCounterTable _miss_tbl;
+  SNMP::FakeCounterTable _eviction_tbl;
+  SimservsCache _cache;
+
+  SimservsCacheTest() :
+    _cache(3, 30, &_hit_tbl, &_miss_tbl, &_eviction_tbl)
+  {
+  }
+
+  virtual ~SimservsCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  void put(const std::string& public_id, const std::string& xml)
+  {
+    _cache.put(public_id,
+               std::make_shared<const simservs>(xml),
+               _cache.generation());
+  }
+};
+
+// Entries can be stored and retrieved, and hits and misses are counted.
+TEST_F(SimservsCacheTest, Mainline)
+{
+  EXPECT_EQ(nullptr, _cache.get("sip:alice@example.com"));
+  EXPECT_EQ(1, _miss_tbl._count);
+
+  put("sip:alice@example.com", CDIV_SIMSERVS);
+
+  std::shared_ptr<const simservs> user_services =
+                                          _cache.get("sip:alice@example.com");
+  ASSERT_NE(nullptr, user_services);
+  EXPECT_EQ(1, _hit_tbl._count);
+  EXPECT_TRUE(user_services->cdiv_enabled());
+  EXPECT_EQ(19u, user_services->cdiv_no_reply_timer());
+  ASSERT_EQ(1u, user_services->cdiv_rules()->size());
+  EXPECT_EQ("sip:6505555678@homedomain",
+            (*user_services->cdiv_rules())[0].forward_target());
+
+  EXPECT_EQ(nullptr, _cache.get("sip:bob@example.com"));
+  EXPECT_EQ(2, _miss_tbl._count);
+}
+
+// Entries expire after the TTL.
+TEST_F(SimservsCacheTest, Expiry)
+{
+  cwtest_completely_control_time();
+  put("sip:alice@example.com", CDIV_SIMSERVS);
+
+  cwtest_advance_time_ms(29000);
+  EXPECT_NE(nullptr, _cache.get("sip:alice@example.com"));
+
+  cwtest_advance_time_ms(1000);
+  EXPECT_EQ(nullptr, _cache.get("sip:alice@example.com"));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// The least recently used entry is evicted when the cache is full.
+TEST_F(SimservsCacheTest, Eviction)
+{
+  put("sip:alice@example.com", CDIV_SIMSERVS);
+  put("sip:bob@example.com", "");
+  put("sip:carol@example.com", "");
+
+  // Use alice so that bob is the least recently used.
+  EXPECT_NE(nullptr, _cache.get("sip:alice@example.com"));
+
+  put("sip:dave@example.com", "");
+  EXPECT_EQ(3u, _cache.size());
+  EXPECT_EQ(1, _eviction_tbl._count);
+  EXPECT_EQ(nullptr, _cache.get("sip:bob@example.com"));
+  EXPECT_NE(nullptr, _cache.get("sip:alice@example.com"));
+  EXPECT_NE(nullptr, _cache.get("sip:dave@example.com"));
+
+  // Replacing an existing entry doesn't evict anything.
+  put("sip:dave@example.com", CDIV_SIMSERVS);
+  EXPECT_EQ(3u, _cache.size());
+  EXPECT_EQ(1, _eviction_tbl._count);
+}
+
+// Entries can be invalidated.
+TEST_F(SimservsCacheTest, Invalidate)
+{
+  put("sip:alice@example.com", CDIV_SIMSERVS);
+  put("sip:bob@example.com", "");
+
+  _cache.invalidate("sip:alice@example.com");
+  EXPECT_EQ(nullptr, _cache.get("sip:alice@example.com"));
+  EXPECT_NE(nullptr, _cache.get("sip:bob@example.com"));
+
+  // Invalidating an IMPU that isn't cached is fine.
+  _cache.invalidate("sip:carol@example.com");
+  EXPECT_EQ(1u, _cache.size());
+}
+
+// A document fetched before an invalidation isn't cached, as it may be out of
+// date.
+TEST_F(SimservsCacheTest, InvalidateDuringFetch)
+{
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:alice@example.com");
+  _cache.put("sip:alice@example.com",
+             std::make_shared<const simservs>(CDIV_SIMSERVS),
+             generation);
+  EXPECT_EQ(nullptr, _cache.get("sip:alice@example.com"));
+
+  // A fresh fetch is cached.
+  put("sip:alice@example.com", CDIV_SIMSERVS);
+  EXPECT_NE(nullptr, _cache.get("sip:alice@example.com"));
+}
+
+// Invalidating another subscriber's simservs during a fetch doesn't stop the
+// document being cached.
+TEST_F(SimservsCacheTest, InvalidateOtherDuringFetch)
+{
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:bob@example.com");
+  _cache.put("sip:alice@example.com",
+             std::make_shared<const simservs>(CDIV_SIMSERVS),
+             generation);
+  EXPECT_NE(nullptr, _cache.get("sip:alice@example.com"));
+}
+
+// A cache with no space doesn't store anything.
+TEST_F(SimservsCacheTest, ZeroSize)
+{
+  SimservsCache cache(0, 30);
+  cache.put("sip:alice@example.com",
+            std::make_shared<const simservs>(CDIV_SIMSERVS),
+            cache.generation());
+  EXPECT_EQ(0u, cache.size());
+  EXPECT_EQ(nullptr, cache.get("sip:alice@example.com"));
+}
+
+/// Fixture for tests of the MMTEL AS's use of the simservs cache.
+class MmtelSimservsCacheTest : public SimservsCacheTest
+{
+  StrictMock<MockXDMConnection> _xdm_connection;
+  Mmtel _mmtel;
+
+  MmtelSimservsCacheTest() :
+    _mmtel("mmtel", &_xdm_connection, &_cache)
+  {
+  }
+};
+
+// Only the first request for a subscriber's simservs goes to the XDMS, and
+// each caller gets its own copy.
+TEST_F(MmtelSimservsCacheTest, FetchOnce)
+{
+  EXPECT_CALL(_xdm_connection, get_simservs("sip:alice@example.com", _, _, _))
+    .WillOnce(DoAll(SetArgReferee<1>(CDIV_SIMSERVS), Return(true)));
+
+  simservs* first = _mmtel.get_user_services("sip:alice@example.com", 0);
+  simservs* second = _mmtel.get_user_services("sip:alice@example.com", 0);
+
+  ASSERT_NE(first, second);
+  EXPECT_TRUE(first->cdiv_enabled());
+  EXPECT_TRUE(second->cdiv_enabled());
+  EXPECT_EQ(19u, second->cdiv_no_reply_timer());
+  EXPECT_EQ(1, _hit_tbl._count);
+  EXPECT_EQ(1, _miss_tbl._count);
+
+  delete first;
+  delete second;
+}
+
+// Failures to fetch simservs aren't cached.
+TEST_F(MmtelSimservsCacheTest, FetchFailure)
+{
+  EXPECT_CALL(_xdm_connection, get_simservs("sip:alice@example.com", _, _, _))
+    .WillOnce(Return(false))
+    .WillOnce(DoAll(SetArgReferee<1>(CDIV_SIMSERVS), Return(true)));
+
+  simservs* user_services = _mmtel.get_user_services("sip:alice@example.com", 0);
+  EXPECT_FALSE(user_services->cdiv_enabled());
+  delete user_services;
+
+  user_services = _mmtel.get_user_services("sip:alice@example.com", 0);
+  EXPECT_TRUE(user_services->cdiv_enabled());
+  delete user_services;
+}
+
+// Once a subscriber's simservs is invalidated, it is fetched again.
+TEST_F(MmtelSimservsCacheTest, RefetchAfterInvalidate)
+{
+  EXPECT_CALL(_xdm_connection, get_simservs("sip:alice@example.com", _, _, _))
+    .Times(2)
+    .WillRepeatedly(DoAll(SetArgReferee<1>(CDIV_SIMSERVS), Return(true)));
+
+  delete _mmtel.get_user_services("sip:alice@example.com", 0);
+  _cache.invalidate("sip:alice@example.com");
+  delete _mmtel.get_user_services("sip:alice@example.com", 0);
+}
@@ -3444,6 +3444,35 @@ TEST_F(SproutletProxyTest, SproutletSelection)
   ASSERT_EQ("b2bua", service_name);
 }
 
+// Tests that host matching ignores case, that remote aliases are matched, and
+// that an unknown host or service name doesn't match.
+TEST_F(SproutletProxyTest, SproutletSelectionHostLocality)
+{
+  pj_str_t host = pj_str((char*)"PROXY1.HomeDomain");
+  EXPECT_EQ(SproutletProxy::AliasMatchLocality::LOCAL,
+            _proxy->get_host_locality(&host));
+  host = pj_str((char*)"Scscf.Proxy1.Homedomain");
+  EXPECT_EQ(SproutletProxy::AliasMatchLocality::LOCAL,
+            _proxy->get_host_locality(&host));
+  host = pj_str((char*)"proxy1.REMOTEdomain");
+  EXPECT_EQ(SproutletProxy::AliasMatchLocality::REMOTE,
+            _proxy->get_host_locality(&host));
+  host = pj_str((char*)"proxy1.homedomain.other");
+  EXPECT_EQ(SproutletProxy::AliasMatchLocality::NO_MATCH,
+            _proxy->get_host_locality(&host));
+
+  pjsip_uri* uri = PJUtils::uri_from_string("sip:fwd@PROXY1.HOMEDOMAIN", stack_data.pool, PJ_FALSE);
+  EXPECT_EQ("fwd", match_sproutlet_from_uri(uri));
+  uri = PJUtils::uri_from_string("sip:scscf.proxy1.remotedomain", stack_data.pool, PJ_FALSE);
+  EXPECT_EQ("scscf", match_sproutlet_from_uri(uri));
+
+  // Service names are case-sensitive.
+  uri = PJUtils::uri_from_string("sip:FWD@proxy1.homedomain", stack_data.pool, PJ_FALSE);
+  EXPECT_EQ("", match_sproutlet_from_uri(uri));
+  uri = PJUtils::uri_from_string("sip:fwd@proxy2.homedomain", stack_data.pool, PJ_FALSE);
+  EXPECT_EQ("", match_sproutlet_from_uri(uri));
+}
+
 // Tests that it's not possible to register more than one Sproutlet for the
 // same service name or port.
 TEST_F(SproutletProxyTest, ConflictingSproutlets)
@@ -27,6 +27,7 @@ using ::testing::SaveArg;
 using ::testing::SetArgReferee;
 using ::testing::SetArgPointee;
 using ::testing::SaveArgPointee;
+using ::testing::AnyNumber;
 
 static const int DUMMY_TRAIL_ID = 0;
 static const std::string DEFAULT_ID = "sip:example.com";
@@ -375,6 +376,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriber)
                                                            removed_bindings,
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   // Finally, we carry out some more checks. Most of the checks are done by the
@@ -452,6 +454,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriberContactChanged)
                                                            {},
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   // Finally, we carry out some more checks. Most of the checks are done by the
@@ -508,6 +511,7 @@ TEST_F(SubscriberManagerTest, TestReregisterRemovedSubscriber)
                                                            {},
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   EXPECT_EQ(rc, HTTP_OK);
@@ -560,6 +564,7 @@ TEST_F(SubscriberManagerTest, TestReregisterRemovedSubscriber2)
                                                            {},
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   EXPECT_EQ(rc, HTTP_OK);
@@ -600,6 +605,7 @@ TEST_F(SubscriberManagerTest, TestReregisterRemovedSubscriberReappears)
                                                            {},
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   EXPECT_EQ(rc, HTTP_PRECONDITION_FAILED);
@@ -644,6 +650,7 @@ TEST_F(SubscriberManagerTest, TestReregisterRemovedSubscriberReappears2)
                                                            {},
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
 
   EXPECT_EQ(rc, HTTP_PRECONDITION_FAILED);
@@ -696,6 +703,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriberRemoveLastBinding)
                                                            removed_bindings,
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
   EXPECT_EQ(rc, HTTP_OK);
 
@@ -747,6 +755,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriberRemoveLastBindingHSSFail)
                                                            removed_bindings,
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
   EXPECT_EQ(rc, HTTP_SERVER_ERROR);
 
@@ -775,6 +784,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriberS4LookupFails)
                                                            std::vector<std::string>(),
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
   EXPECT_EQ(rc, HTTP_SERVER_ERROR);
 
@@ -813,6 +823,7 @@ TEST_F(SubscriberManagerTest, TestReregisterSubscriberS4WriteFails)
                                                            removed_bindings,
                                                            all_bindings,
                                                            irs_info,
+                                                           NULL,
                                                            DUMMY_TRAIL_ID);
   EXPECT_EQ(rc, HTTP_SERVER_ERROR);
 
@@ -1492,6 +1503,78 @@ TEST_F(SubscriberManagerTest, TestGetBindingsFail)
   EXPECT_EQ(rc, HTTP_NOT_FOUND);
 }
 
+// Tests that reregistering a subscriber uses the AoR that get_bindings passed
+// out, rather than reading it from S4 again.
+TEST_F(SubscriberManagerTest, TestReregisterUsesAoRFromGetBindings)
+{
+  AoR* get_aor = AoRTestUtils::create_simple_aor(DEFAULT_ID);
+  AoR* patch_aor = AoRTestUtils::create_simple_aor(DEFAULT_ID);
+
+  // There's only one read from S4.
+  EXPECT_CALL(*_s4, handle_get(DEFAULT_ID, _, _, _))
+    .WillOnce(DoAll(SetArgPointee<1>(get_aor),
+                    Return(HTTP_OK)));
+  EXPECT_CALL(*_s4, handle_patch(DEFAULT_ID, _, _, _))
+    .WillOnce(DoAll(SetArgPointee<2>(patch_aor),
+                    Return(HTTP_OK)));
+  EXPECT_CALL(*_analytics_logger, registration(_, _, _, _)).Times(AnyNumber());
+  EXPECT_CALL(*_notify_sender, send_notifys(DEFAULT_ID,
+                                            AoRsMatch(*get_aor),
+                                            AoRsMatch(*patch_aor),
+                                            SubscriberDataUtils::EventTrigger::USER,
+                                            _,
+                                            _));
+
+  Bindings current_bindings;
+  AoR* current_aor = NULL;
+  HTTPCode rc = _subscriber_manager->get_bindings(DEFAULT_ID,
+                                                  current_bindings,
+                                                  &current_aor,
+                                                  DUMMY_TRAIL_ID);
+  EXPECT_EQ(rc, HTTP_OK);
+  EXPECT_EQ(current_aor, get_aor);
+
+  AssociatedURIs associated_uris;
+  associated_uris.add_uri(DEFAULT_ID, false);
+  Binding* binding = AoRTestUtils::build_binding(DEFAULT_ID, time(NULL));
+  Bindings updated_bindings;
+  updated_bindings.insert(std::make_pair(AoRTestUtils::BINDING_ID, binding));
+  Bindings all_bindings;
+  HSSConnection::irs_info irs_info;
+
+  // The SM takes ownership of the AoR.
+  rc = _subscriber_manager->reregister_subscriber(DEFAULT_ID,
+                                                  "sip:scscf.sprout.homedomain:5058;transport=TCP",
+                                                  associated_uris,
+                                                  updated_bindings,
+                                                  {},
+                                                  all_bindings,
+                                                  irs_info,
+                                                  current_aor,
+                                                  DUMMY_TRAIL_ID);
+  EXPECT_EQ(rc, HTTP_OK);
+
+  SubscriberDataUtils::delete_bindings(current_bindings);
+  SubscriberDataUtils::delete_bindings(updated_bindings);
+  SubscriberDataUtils::delete_bindings(all_bindings);
+}
+
+// Tests that no AoR is passed out when getting bindings fails.
+TEST_F(SubscriberManagerTest, TestGetBindingsAndAoRFail)
+{
+  EXPECT_CALL(*_s4, handle_get(DEFAULT_ID, _, _, _))
+    .WillOnce(Return(HTTP_NOT_FOUND));
+
+  Bindings all_bindings;
+  AoR* aor = NULL;
+  HTTPCode rc = _subscriber_manager->get_bindings(DEFAULT_ID,
+                                                  all_bindings,
+                                                  &aor,
+                                                  DUMMY_TRAIL_ID);
+  EXPECT_EQ(rc, HTTP_NOT_FOUND);
+  EXPECT_EQ(aor, (AoR*)NULL);
+}
+
 // Tests getting subscriptions from SM.
 TEST_F(SubscriberManagerTest, TestGetSubscriptions)
 {
@@ -0,0 +1,471 @@
+/**
+ * @file subscriber_profile_cache_test.cpp UT for the subscriber profile cache.
+ *
+ * Copyright (C) Metaswitch Networks 2017
+ * If license terms are provided to you in a COPYING file in the root directory
+ * of the source code repository by which you are accessing this code, then
+ * the license outlined in that COPYING file applies to your use.
+ * Otherwise no rights are granted except for those provided to you by
+ * Metaswitch Networks in a separate written agreement.
+ */
+
+#include <string>
+#include "gtest/gtest.h"
+
+#include "subscriber_profile_cache.h"
+#include "hssconnection.h"
+#include "xml_utils.h"
+#include "fakehttpresolver.hpp"
+#include "fakecurl.hpp"
+#include "fakesnmp.hpp"
+#include "basetest.hpp"
+#include "sprout_alarmdefinition.h"
+#include "test_interposer.hpp"
+
+/// Fixture for SubscriberProfileCacheTest.
+class SubscriberProfileCacheTest : public BaseTest
+{
+  SNMP::FakeCounterTable _hit_tbl;
+  SNMP::FakeCounterTable _miss_tbl;
+  SNMP::FakeCounterTable _eviction_tbl;
+  SubscriberProfileCache _cache;
+
+  SubscriberProfileCacheTest() :
+    _cache(3, 30, 60, &_hit_tbl, &_miss_tbl, &_eviction_tbl)
+  {
+  }
+
+  virtual ~SubscriberProfileCacheTest()
+  {
+    cwtest_reset_time();
+  }
+
+  // Builds the registration data for a registered IRS.
+  static HSSConnection::irs_info irs(const std::vector<std::string>& uris)
+  {
+    HSSConnection::irs_info irs_info;
+    irs_info._regstate = RegDataXMLUtils::STATE_REGISTERED;
+    for (const std::string& uri : uris)
+    {
+      irs_info._associated_uris.add_uri(uri, false);
+    }
+    irs_info._ccfs.push_back("ccf1");
+    return irs_info;
+  }
+
+  void put(const std::string& public_id, const HSSConnection::irs_info& irs_info)
+  {
+    _cache.put(public_id, irs_info, _cache.generation());
+  }
+};
+
+// Entries can be stored and retrieved, and hits and misses are counted.
+TEST_F(SubscriberProfileCacheTest, Mainline)
+{
+  HSSConnection::irs_info irs_info;
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_EQ(1, _miss_tbl._count);
+
+  put("sip:alice@example.com", irs({"sip:alice@example.com", "tel:1234"}));
+
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_EQ(1, _hit_tbl._count);
+  EXPECT_EQ(RegDataXMLUtils::STATE_REGISTERED, irs_info._regstate);
+  EXPECT_EQ(2u, irs_info._associated_uris.get_unbarred_uris().size());
+  ASSERT_EQ(1u, irs_info._ccfs.size());
+  EXPECT_EQ("ccf1", irs_info._ccfs[0]);
+
+  // Entries are only stored under the IMPU they were looked up for.
+  EXPECT_FALSE(_cache.get("tel:1234", irs_info));
+  EXPECT_EQ(2, _miss_tbl._count);
+}
+
+// Entries expire after the TTL.
+TEST_F(SubscriberProfileCacheTest, Expiry)
+{
+  HSSConnection::irs_info irs_info;
+  put("sip:alice@example.com", irs({"sip:alice@example.com"}));
+
+  cwtest_advance_time_ms(29 * 1000);
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+
+  cwtest_advance_time_ms(1000);
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// The least recently used entry is evicted when the cache is full.
+TEST_F(SubscriberProfileCacheTest, Eviction)
+{
+  HSSConnection::irs_info irs_info;
+  put("sip:alice@example.com", irs({"sip:alice@example.com"}));
+  put("sip:bob@example.com", irs({"sip:bob@example.com"}));
+  put("sip:carol@example.com", irs({"sip:carol@example.com"}));
+
+  // Use Alice's entry, so that Bob's is now the oldest.
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+
+  put("sip:dave@example.com", irs({"sip:dave@example.com"}));
+  EXPECT_EQ(3u, _cache.size());
+  EXPECT_EQ(1, _eviction_tbl._count);
+
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_FALSE(_cache.get("sip:bob@example.com", irs_info));
+  EXPECT_TRUE(_cache.get("sip:carol@example.com", irs_info));
+  EXPECT_TRUE(_cache.get("sip:dave@example.com", irs_info));
+
+  // Replacing an existing entry doesn't evict anything.
+  put("sip:dave@example.com", irs({"sip:dave@example.com"}));
+  EXPECT_EQ(3u, _cache.size());
+  EXPECT_EQ(1, _eviction_tbl._count);
+}
+
+// Invalidating any IMPU in an IRS invalidates the entries for all of them,
+// and nothing else.
+TEST_F(SubscriberProfileCacheTest, InvalidateIrs)
+{
+  HSSConnection::irs_info irs_info;
+  put("sip:alice@example.com", irs({"sip:alice@example.com", "tel:1234"}));
+  put("tel:1234", irs({"sip:alice@example.com", "tel:1234"}));
+  put("sip:bob@example.com", irs({"sip:bob@example.com"}));
+
+  _cache.invalidate("tel:1234");
+
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_FALSE(_cache.get("tel:1234", irs_info));
+  EXPECT_TRUE(_cache.get("sip:bob@example.com", irs_info));
+  EXPECT_EQ(1u, _cache.size());
+
+  // Invalidating an IMPU that isn't cached is harmless.
+  _cache.invalidate("sip:nobody@example.com");
+  EXPECT_EQ(1u, _cache.size());
+}
+
+// Data fetched before an invalidation isn't cached.
+TEST_F(SubscriberProfileCacheTest, InvalidateDuringFetch)
+{
+  HSSConnection::irs_info irs_info;
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:alice@example.com");
+  _cache.put("sip:alice@example.com",
+             irs({"sip:alice@example.com"}),
+             generation);
+
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+}
+
+// Only invalidations of the same IRS stop data fetched before them from being
+// cached, including invalidations of IRS members that aren't cached yet.
+TEST_F(SubscriberProfileCacheTest, InvalidateOtherIrsDuringFetch)
+{
+  HSSConnection::irs_info irs_info;
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:bob@example.com");
+  _cache.put("sip:alice@example.com",
+             irs({"sip:alice@example.com", "tel:1234"}),
+             generation);
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+
+  generation = _cache.generation();
+  _cache.invalidate("tel:1234");
+  _cache.put("sip:alice@example.com",
+             irs({"sip:alice@example.com", "tel:1234"}),
+             generation);
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+}
+
+// The cache only remembers as many invalidations as it has room for entries.
+// Data fetched before the ones it has forgotten isn't cached.
+TEST_F(SubscriberProfileCacheTest, InvalidationsForgotten)
+{
+  HSSConnection::irs_info irs_info;
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:bob@example.com");
+  _cache.invalidate("sip:carol@example.com");
+  _cache.invalidate("sip:dave@example.com");
+  _cache.put("sip:alice@example.com",
+             irs({"sip:alice@example.com"}),
+             generation);
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+
+  generation = _cache.generation();
+  for (int ii = 0; ii < 4; ++ii)
+  {
+    _cache.invalidate("sip:user" + std::to_string(ii) + "@example.com");
+  }
+  _cache.put("sip:erin@example.com",
+             irs({"sip:erin@example.com"}),
+             generation);
+  EXPECT_FALSE(_cache.get("sip:erin@example.com", irs_info));
+}
+
+// Registrations stored in the cache can be used for refreshes by the same
+// private ID until the registration refresh interval has passed, even once
+// the entry is too old to be used for calls.
+TEST_F(SubscriberProfileCacheTest, RegistrationRefresh)
+{
+  HSSConnection::irs_info irs_info;
+  EXPECT_FALSE(_cache.get_registration("sip:alice@example.com",
+                                       "alice@example.com",
+                                       irs_info));
+
+  _cache.put_registration("sip:alice@example.com",
+                          "alice@example.com",
+                          irs({"sip:alice@example.com", "tel:1234"}),
+                          _cache.generation());
+
+  EXPECT_TRUE(_cache.get_registration("sip:alice@example.com",
+                                      "alice@example.com",
+                                      irs_info));
+  EXPECT_EQ(RegDataXMLUtils::STATE_REGISTERED, irs_info._regstate);
+  EXPECT_EQ(2u, irs_info._associated_uris.get_unbarred_uris().size());
+
+  // A registration by a different private ID must go to Homestead.
+  EXPECT_FALSE(_cache.get_registration("sip:alice@example.com",
+                                       "alice2@example.com",
+                                       irs_info));
+
+  // Registration lookups don't count towards the hits and misses.
+  EXPECT_EQ(0, _hit_tbl._count);
+  EXPECT_EQ(0, _miss_tbl._count);
+
+  // The entry can't be used for calls after the TTL, but stays in place for
+  // registration refreshes.
+  cwtest_advance_time_ms(30 * 1000);
+  EXPECT_FALSE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_TRUE(_cache.get_registration("sip:alice@example.com",
+                                      "alice@example.com",
+                                      irs_info));
+
+  // Refreshing the entry for calls keeps the registration.
+  put("sip:alice@example.com", irs({"sip:alice@example.com", "tel:1234"}));
+  cwtest_advance_time_ms(29 * 1000);
+  EXPECT_TRUE(_cache.get_registration("sip:alice@example.com",
+                                      "alice@example.com",
+                                      irs_info));
+
+  // After the registration refresh interval, the registration must go to
+  // Homestead again.
+  cwtest_advance_time_ms(1000);
+  EXPECT_FALSE(_cache.get_registration("sip:alice@example.com",
+                                       "alice@example.com",
+                                       irs_info));
+}
+
+// Invalidating any IMPU in the IRS stops refreshes being served from the
+// cache, as does an invalidation while the registration was being sent.
+TEST_F(SubscriberProfileCacheTest, RegistrationInvalidated)
+{
+  HSSConnection::irs_info irs_info;
+  _cache.put_registration("sip:alice@example.com",
+                          "alice@example.com",
+                          irs({"sip:alice@example.com", "tel:1234"}),
+                          _cache.generation());
+  _cache.invalidate("tel:1234");
+  EXPECT_FALSE(_cache.get_registration("sip:alice@example.com",
+                                       "alice@example.com",
+                                       irs_info));
+
+  uint64_t generation = _cache.generation();
+  _cache.invalidate("sip:alice@example.com");
+  _cache.put_registration("sip:alice@example.com",
+                          "alice@example.com",
+                          irs({"sip:alice@example.com"}),
+                          generation);
+  EXPECT_FALSE(_cache.get_registration("sip:alice@example.com",
+                                       "alice@example.com",
+                                       irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Registrations of other subscribers while a registration is being sent don't
+// stop it being cached.
+TEST_F(SubscriberProfileCacheTest, OtherRegistrationDuringRegistration)
+{
+  HSSConnection::irs_info irs_info;
+  uint64_t generation = _cache.generation();
+  _cache.put_registration("sip:bob@example.com",
+                          "bob@example.com",
+                          irs({"sip:bob@example.com"}),
+                          _cache.generation());
+  _cache.put_registration("sip:alice@example.com",
+                          "alice@example.com",
+                          irs({"sip:alice@example.com", "tel:1234"}),
+                          generation);
+  EXPECT_TRUE(_cache.get_registration("sip:alice@example.com",
+                                      "alice@example.com",
+                                      irs_info));
+  EXPECT_TRUE(_cache.get_registration("sip:bob@example.com",
+                                      "bob@example.com",
+                                      irs_info));
+}
+
+// Storing a registration replaces anything cached for the rest of the IRS.
+TEST_F(SubscriberProfileCacheTest, RegistrationReplacesIrs)
+{
+  HSSConnection::irs_info irs_info;
+  put("tel:1234", irs({"sip:alice@example.com", "tel:1234"}));
+
+  _cache.put_registration("sip:alice@example.com",
+                          "alice@example.com",
+                          irs({"sip:alice@example.com", "tel:1234"}),
+                          _cache.generation());
+
+  EXPECT_FALSE(_cache.get("tel:1234", irs_info));
+  EXPECT_TRUE(_cache.get("sip:alice@example.com", irs_info));
+  EXPECT_EQ(1u, _cache.size());
+}
+
+/// Fixture for tests of the cache in use by an HSSConnection.
+class HssConnectionProfileCacheTest : public BaseTest
+{
+  FakeHttpResolver _resolver;
+  AlarmManager _am;
+  CommunicationMonitor _cm;
+  SubscriberProfileCache _cache;
+  HSSConnection _hss;
+
+  HssConnectionProfileCacheTest() :
+    _resolver("10.42.42.42"),
+    _cm(new Alarm(&_am, "sprout", AlarmDef::SPROUT_HOMESTEAD_COMM_ERROR, AlarmDef::CRITICAL), "sprout", "homestead"),
+    _cache(100, 30),
+    _hss("narcissus",
+         &_resolver,
+         NULL,
+         &SNMP::FAKE_IP_COUNT_TABLE,
+         &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+         &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+         &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+         &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+         &SNMP::FAKE_EVENT_ACCUMULATOR_TABLE,
+         &_cm,
+         NULL,
+         500,
+         &_cache)
+  {
+    fakecurl_responses.clear();
+    fakecurl_requests.clear();
+    set_response("call", "REGISTERED");
+  }
+
+  virtual ~HssConnectionProfileCacheTest()
+  {
+    fakecurl_responses.clear();
+    fakecurl_responses_with_body.clear();
+    fakecurl_requests.clear();
+  }
+
+  // Sets Homestead's response to a request of the given type for pubid42.
+  void set_response(const std::string& reqtype, const std::string& regstate)
+  {
+    std::string body = (reqtype.empty()) ?
+                       "" :
+                       "{\"reqtype\": \"" + reqtype + "\", \"server_name\": \"server_name\"}";
+    fakecurl_responses_with_body[std::make_pair("http://10.42.42.42:80/impu/pubid42/reg-data", body)] =
+      "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+      "<ClearwaterRegData>"
+        "<RegistrationState>" + regstate + "</RegistrationState>"
+        "<IMSSubscription>"
+          "<ServiceProfile>"
+            "<PublicIdentity>"
+              "<Identity>pubid42</Identity>"
+            "</PublicIdentity>"
+            "<PublicIdentity>"
+              "<Identity>pubid42_alias</Identity>"
+            "</PublicIdentity>"
+          "</ServiceProfile>"
+        "</IMSSubscription>"
+      "</ClearwaterRegData>";
+  }
+
+  HTTPCode query(const std::string& reqtype, HSSConnection::irs_info& irs_info)
+  {
+    HSSConnection::irs_query irs_query;
+    irs_query._public_id = "pubid42";
+    irs_query._req_type = reqtype;
+    irs_query._server_name = "server_name";
+    return _hss.update_registration_state(irs_query, irs_info, 0);
+  }
+};
+
+// Calls are served from the cache once it has been filled.
+TEST_F(HssConnectionProfileCacheTest, CallServedFromCache)
+{
+  HSSConnection::irs_info irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::CALL, irs_info));
+  EXPECT_EQ(1u, _cache.size());
+
+  // Homestead is no longer reachable, but the call still succeeds.
+  fakecurl_responses_with_body.clear();
+  HSSConnection::irs_info cached_irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::CALL, cached_irs_info));
+  EXPECT_EQ("REGISTERED", cached_irs_info._regstate);
+  EXPECT_EQ(2u, cached_irs_info._associated_uris.get_unbarred_uris().size());
+
+  // Lookups of the cached registration data are also served from the cache.
+  EXPECT_EQ(HTTP_OK, _hss.get_registration_data("pubid42", cached_irs_info, 0));
+
+  // Once invalidated (through another member of the IRS), requests go to
+  // Homestead again.
+  _hss.invalidate_cached_registration_data("pubid42_alias");
+  EXPECT_NE(HTTP_OK, query(HSSConnection::CALL, cached_irs_info));
+}
+
+// Registration state changes invalidate the cache.
+TEST_F(HssConnectionProfileCacheTest, RegInvalidates)
+{
+  HSSConnection::irs_info irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::CALL, irs_info));
+  EXPECT_EQ(1u, _cache.size());
+
+  set_response("reg", "REGISTERED");
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::REG, irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Subscribers that aren't registered aren't cached, as a call request can
+// change their state.
+TEST_F(HssConnectionProfileCacheTest, NotRegisteredNotCached)
+{
+  set_response("call", "NOT_REGISTERED");
+  HSSConnection::irs_info irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::CALL, irs_info));
+  EXPECT_EQ(0u, _cache.size());
+}
+
+// Registration refreshes are served from the cache if it is configured to
+// allow it, and the previous registration state is reported as registered.
+TEST_F(HssConnectionProfileCacheTest, RegRefreshServedFromCache)
+{
+  SubscriberProfileCache reg_cache(100, 30, 60);
+  _hss._profile_cache = &reg_cache;
+
+  set_response("reg", "REGISTERED");
+  HSSConnection::irs_info irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::REG, irs_info));
+  EXPECT_FALSE(irs_info._reg_from_cache);
+  EXPECT_EQ(1u, reg_cache.size());
+
+  // Homestead is no longer reachable, but the refresh still succeeds.
+  fakecurl_responses_with_body.clear();
+  HSSConnection::irs_info cached_irs_info;
+  EXPECT_EQ(HTTP_OK, query(HSSConnection::REG, cached_irs_info));
+  EXPECT_TRUE(cached_irs_info._reg_from_cache);
+  EXPECT_EQ("REGISTERED", cached_irs_info._regstate);
+  EXPECT_EQ("REGISTERED", cached_irs_info._prev_regstate);
+  EXPECT_EQ(2u, cached_irs_info._associated_uris.get_unbarred_uris().size());
+
+  // Callers can insist on going to Homestead.
+  HSSConnection::irs_query irs_query;
+  irs_query._public_id = "pubid42";
+  irs_query._req_type = HSSConnection::REG;
+  irs_query._server_name = "server_name";
+  irs_query._cache_allowed = false;
+  EXPECT_NE(HTTP_OK, _hss.update_registration_state(irs_query, cached_irs_info, 0));
+
+  // The failure invalidated the cached registration.
+  EXPECT_EQ(0u, reg_cache.size());
+  EXPECT_NE(HTTP_OK, query(HSSConnection::REG, cached_irs_info));
+
+  _hss._profile_cache = &_cache;
+}
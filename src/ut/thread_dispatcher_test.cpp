@@ -497,6 +497,44 @@ TEST_F(ThreadDispatcherTest, PrioritiseOptionsOverOlderTest)
   process_queue_element();
 }
 
+// Tests that a pool factory with the capacity the stack uses keeps the pool of
+// a freed received message clone, and reuses it for the next clone.
+TEST_F(ThreadDispatcherTest, RxDataCloneReusesCachedPool)
+{
+  TestingCommon::Message msg;
+  msg._method = "INVITE";
+
+  pj_caching_pool cp;
+  pj_caching_pool_init(&cp,
+                       &pj_pool_factory_default_policy,
+                       PJSIP_POOL_CACHE_CAPACITY);
+
+  // Clones get their pools from the same factory as the original message.
+  pj_pool_t* rdata_pool = pj_pool_create(&cp.factory,
+                                         "rtd%p",
+                                         PJSIP_POOL_RDATA_LEN,
+                                         PJSIP_POOL_RDATA_INC,
+                                         NULL);
+  pjsip_rx_data* rdata = build_rxdata(msg.get_request(), _tp_default, rdata_pool);
+  parse_rxdata(rdata);
+  EXPECT_EQ(0u, cp.capacity);
+
+  pjsip_rx_data* clone_rdata;
+  pjsip_rx_data_clone(rdata, 0, &clone_rdata);
+  pjsip_rx_data_free_cloned(clone_rdata);
+
+  // The clone's pool is kept rather than freed.
+  EXPECT_LT(0u, cp.capacity);
+
+  // The next clone takes the kept pool.
+  pjsip_rx_data_clone(rdata, 0, &clone_rdata);
+  EXPECT_EQ(0u, cp.capacity);
+  pjsip_rx_data_free_cloned(clone_rdata);
+
+  pj_pool_release(rdata_pool);
+  pj_caching_pool_destroy(&cp);
+}
+
 class SipEventQueueTest : public ::testing::Test
 {
 public:
@@ -641,3 +679,232 @@ TEST_F(SipEventQueueTest, QueuePriorityAndTimeOrdering)
   q->pop(e);
   EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
 }
+
+// Test that SipEvents with the same priority and start time are returned in
+// the order they were queued.
+TEST_F(SipEventQueueTest, QueueFifoOrderingForEqualTimes)
+{
+  e1.stop_watch.start();
+  e2.stop_watch.start();
+
+  q->push(e1);
+  q->push(e2);
+
+  SipEvent e;
+
+  q->pop(e);
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+
+  q->pop(e);
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+}
+
+// Runs the thread dispatcher with two workers, each with its own queue shard.
+class ShardedThreadDispatcherTest : public ThreadDispatcherTest
+{
+public:
+  ShardedThreadDispatcherTest() : ThreadDispatcherTest()
+  {
+    unregister_thread_dispatcher();
+    init_thread_dispatcher(2,
+                           NULL,
+                           NULL,
+                           NULL,
+                           NULL,
+                           &load_monitor,
+                           &rph_service,
+                           NULL,
+                           REQUEST_ON_QUEUE_TIMEOUT_MS,
+                           2);
+  }
+};
+
+// Messages should be processed by either worker, regardless of which shard
+// they are hashed to.
+TEST_F(ShardedThreadDispatcherTest, ProcessOnEitherShardTest)
+{
+  TestingCommon::Message msg1;
+  msg1._method = "INVITE";
+
+  TestingCommon::Message msg2;
+  msg2._method = "INVITE";
+
+  EXPECT_CALL(load_monitor, admit_request(_, _)).Times(2).WillRepeatedly(Return(true));
+  EXPECT_CALL(*mod_mock, on_rx_request(_)).Times(2).WillRepeatedly(Return(PJ_TRUE));
+  EXPECT_CALL(load_monitor, get_target_latency_us()).WillRepeatedly(Return(100000));
+  EXPECT_CALL(load_monitor, request_complete(_, _)).Times(2);
+
+  inject_msg_thread(msg1.get_request());
+  inject_msg_thread(msg2.get_request());
+
+  // Both messages can be taken by the first worker (stealing from the second
+  // shard if necessary).
+  EXPECT_TRUE(process_queue_element(0));
+  EXPECT_TRUE(process_queue_element(0));
+}
+
+// Callbacks should also be run from the sharded queues.
+TEST_F(ShardedThreadDispatcherTest, CallbackTest)
+{
+  EXPECT_CALL(load_monitor, get_target_latency_us()).WillOnce(Return(100000));
+
+  StrictMock<MockCallback>* cb = new StrictMock<MockCallback>();
+  add_callback_to_queue(cb);
+
+  EXPECT_CALL(*cb, run());
+  EXPECT_CALL(*cb, destruct());
+
+  EXPECT_TRUE(process_queue_element(1));
+}
+
+class ShardedSipEventQueueTest : public SipEventQueueTest
+{
+public:
+  ShardedSipEventQueueTest() : SipEventQueueTest()
+  {
+    sq = new ShardedSipEventQueue(2);
+  }
+
+  virtual ~ShardedSipEventQueueTest()
+  {
+    delete sq; sq = nullptr;
+  }
+
+  ShardedSipEventQueue* sq;
+};
+
+// Test that events are returned from the home shard in priority order.
+TEST_F(ShardedSipEventQueueTest, HomeShardPriorityOrdering)
+{
+  e2.priority = SIPEventPriorityLevel::HIGH_PRIORITY_10;
+
+  sq->push(0, e1);
+  sq->push(0, e2);
+  EXPECT_EQ(2, sq->size());
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that the home shard is serviced before any other shard.
+TEST_F(ShardedSipEventQueueTest, HomeShardFirst)
+{
+  // e1 is older, but is on the other shard.
+  e1.stop_watch.start();
+  cwtest_advance_time_ms(1);
+  e2.stop_watch.start();
+
+  sq->push(1, e1);
+  sq->push(0, e2);
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+}
+
+// Test that a worker steals work from another shard if its own is empty.
+TEST_F(ShardedSipEventQueueTest, StealFromOtherShard)
+{
+  sq->push(1, e1);
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that a worker takes a higher priority event from another shard before
+// the events on its home shard.
+TEST_F(ShardedSipEventQueueTest, HigherPriorityOnOtherShardFirst)
+{
+  e2.priority = SIPEventPriorityLevel::HIGH_PRIORITY_10;
+
+  sq->push(0, e1);
+  sq->push(1, e2);
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+}
+
+static void* pop_on_shard_0(void* q)
+{
+  SipEvent e;
+  ((ShardedSipEventQueue*)q)->pop(0, e);
+  return e.event_data.rdata;
+}
+
+// Test that a worker waiting for work is woken when an event is pushed to a
+// shard with no waiting workers.
+TEST_F(ShardedSipEventQueueTest, IdleWorkerWokenForOtherShard)
+{
+  pthread_t worker;
+  pthread_create(&worker, NULL, pop_on_shard_0, sq);
+
+  // Wait for the worker to be waiting on its home shard.
+  while (sq->_idle_workers == 0)
+  {
+    usleep(1000);
+  }
+
+  sq->push(1, e1);
+
+  void* rdata;
+  pthread_join(worker, &rdata);
+  EXPECT_EQ(e1.event_data.rdata, rdata);
+  EXPECT_EQ(0, sq->size());
+}
+
+// Test that shard indices wrap around the number of shards.
+TEST_F(ShardedSipEventQueueTest, ShardIndexWraps)
+{
+  sq->push(3, e1);
+  sq->push(4, e2);
+
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(1, e));
+  EXPECT_EQ(e1.event_data.rdata, e.event_data.rdata);
+  EXPECT_TRUE(sq->pop(0, e));
+  EXPECT_EQ(e2.event_data.rdata, e.event_data.rdata);
+}
+
+// Test that a shard which isn't serviced is spotted as deadlocked.
+TEST_F(ShardedSipEventQueueTest, DeadlockDetection)
+{
+  sq->set_deadlock_threshold(4000);
+  EXPECT_FALSE(sq->is_deadlocked());
+
+  sq->push(1, e1);
+  cwtest_advance_time_ms(3000);
+  EXPECT_FALSE(sq->is_deadlocked());
+
+  cwtest_advance_time_ms(2000);
+  EXPECT_TRUE(sq->is_deadlocked());
+
+  // Servicing the shard clears the deadlock.
+  SipEvent e;
+  EXPECT_TRUE(sq->pop(1, e));
+  EXPECT_FALSE(sq->is_deadlocked());
+}
+
+// Test that terminating the queue returns the remaining events, and that
+// subsequent pops fail.
+TEST_F(ShardedSipEventQueueTest, Terminate)
+{
+  sq->push(0, e1);
+  sq->push(1, e2);
+
+  std::vector<SipEvent> remaining;
+  sq->terminate(remaining);
+  EXPECT_EQ(2u, remaining.size());
+  EXPECT_EQ(0, sq->size());
+
+  SipEvent e;
+  EXPECT_FALSE(sq->pop(0, e));
+}